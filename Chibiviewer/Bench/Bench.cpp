@@ -0,0 +1,1415 @@
+// Microbenchmarks for the portable engine code, run over the bundled GIFs.
+//
+//   chibi_bench [--gifs DIR] [--filter TEXT] [--json FILE] [--quick]
+//               [--replay SESSION] [--save-session SESSION]
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstdio>
+#include <cstring>
+#include <cwctype>
+#include <deque>
+#include <filesystem>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "BenchHarness.h"
+#include "Core/AllocTracker.h"
+#include "Core/Behavior.h"
+#include "Core/CharacterEngine.h"
+#include "Core/CharacterManifest.h"
+#include "Core/CharacterState.h"
+#include "Core/Compositor.h"
+#include "Core/FrameOps.h"
+#include "Core/GifDecoder.h"
+#include "Core/Histogram.h"
+#include "Core/MpscQueue.h"
+#include "Core/Playback.h"
+#include "Core/PixelScale.h"
+#include "Core/PlaybackStats.h"
+#include "Core/PowerMode.h"
+#include "Core/Profiler.h"
+#include "Core/QualityGovernor.h"
+#include "Core/Resampler.h"
+#include "Core/RenderSurfacePool.h"
+#include "Core/ScaledFrameCache.h"
+#include "Core/Scheduler.h"
+#include "Core/Session.h"
+#include "Core/Simulation.h"
+#include "Core/SpscQueue.h"
+#include "Core/SurfaceIndex.h"
+#include "Core/TaskPool.h"
+
+#ifndef CHIBI_ASSET_DIR
+#define CHIBI_ASSET_DIR "."
+#endif
+
+namespace {
+
+struct GifFile {
+    std::string name;
+    std::vector<uint8_t> bytes;
+    DecodedGif gif;
+};
+
+// Stand-in for the viewer's GifInfo; FindGifOfType only needs `type`
+struct GifEntry {
+    GifType type;
+};
+
+std::vector<GifFile> LoadGifs(const std::string& directory) {
+    std::vector<GifFile> files;
+    std::error_code error;
+    for (const auto& entry : std::filesystem::directory_iterator(directory, error)) {
+        std::string extension = entry.path().extension().string();
+        std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+        if (extension != ".gif") continue;
+
+        GifFile file;
+        file.name = entry.path().stem().string();
+        std::string decodeError;
+        if (!ReadFileBytes(entry.path().string().c_str(), &file.bytes) ||
+            !DecodeGif(file.bytes.data(), file.bytes.size(), &file.gif, &decodeError)) {
+            std::fprintf(stderr, "skipping %s: %s\n", entry.path().string().c_str(), decodeError.c_str());
+            continue;
+        }
+        files.push_back(std::move(file));
+    }
+    std::sort(files.begin(), files.end(),
+              [](const GifFile& a, const GifFile& b) { return a.name < b.name; });
+    return files;
+}
+
+// A 4x4 GIF whose 2x1 frames of opaque white sit at the given offsets,
+// each disposed to the background. Offsets past the canvas are legal in
+// the format and show up in broken or hand-edited files.
+std::vector<uint8_t> MakeOffsetGif(const std::vector<std::pair<int, int>>& offsets) {
+    std::vector<uint8_t> bytes = { 'G', 'I', 'F', '8', '9', 'a', 4, 0, 4, 0, 0x80, 0, 0,
+                                   0, 0, 0, 0xFF, 0xFF, 0xFF };
+    for (const std::pair<int, int>& offset : offsets) {
+        const uint8_t control[] = { 0x21, 0xF9, 4, 2 << 2, 10, 0, 0, 0 };
+        bytes.insert(bytes.end(), control, control + sizeof(control));
+        const uint8_t image[] = { 0x2C, static_cast<uint8_t>(offset.first), static_cast<uint8_t>(offset.first >> 8),
+                                  static_cast<uint8_t>(offset.second), static_cast<uint8_t>(offset.second >> 8),
+                                  2, 0, 1, 0, 0,
+                                  2, 2, 0x4C, 0x0A, 0 };  // LZW: clear, 1, 1, end
+        bytes.insert(bytes.end(), image, image + sizeof(image));
+    }
+    bytes.push_back(0x3B);
+    return bytes;
+}
+
+// Decode every bundled GIF, and check that frames hanging off the canvas
+// are clipped rather than written past it
+bool BenchDecode(BenchRunner& runner, const std::vector<GifFile>& files) {
+    const std::vector<std::pair<int, int>> offsets = { { 10, 0 }, { 3, 1 }, { 0, 9 }, { 65535, 65535 }, { 1, 3 } };
+    std::vector<uint8_t> offsetGif = MakeOffsetGif(offsets);
+    DecodedGif clipped;
+    std::string error;
+    if (!DecodeGif(offsetGif.data(), offsetGif.size(), &clipped, &error) ||
+        clipped.FrameCount() != offsets.size()) {
+        std::fprintf(stderr, "GIF with off-canvas frames did not decode: %s\n", error.c_str());
+        return false;
+    }
+    size_t drawn[5] = {};
+    for (size_t frame = 0; frame < clipped.FrameCount(); frame++) {
+        for (size_t i = 0; i < clipped.FramePixels(); i++) {
+            drawn[frame] += clipped.Frame(frame)[i] != 0;
+        }
+    }
+    const uint32_t* partial = clipped.Frame(1);
+    const uint32_t* bottom = clipped.Frame(4);
+    if (drawn[0] != 0 || drawn[1] != 1 || partial[1 * 4 + 3] != 0xFFFFFFFFu || drawn[2] != 0 || drawn[3] != 0 ||
+        drawn[4] != 2 || bottom[3 * 4 + 1] != 0xFFFFFFFFu || bottom[3 * 4 + 2] != 0xFFFFFFFFu) {
+        std::fprintf(stderr, "off-canvas GIF frames were not clipped to the canvas\n");
+        return false;
+    }
+
+    for (const GifFile& file : files) {
+        runner.Run("decode/" + file.name, static_cast<double>(file.bytes.size()), "B",
+                   [&](uint64_t iterations) {
+            DecodedGif gif;
+            for (uint64_t i = 0; i < iterations; i++) {
+                DecodeGif(file.bytes.data(), file.bytes.size(), &gif);
+                DoNotOptimize(gif.pixels.data());
+            }
+        });
+    }
+    return true;
+}
+
+void BenchPrepare(BenchRunner& runner, const GifFile& file) {
+    const DecodedGif& gif = file.gif;
+    const size_t framePixels = gif.FramePixels();
+    const double pixelsPerOp = static_cast<double>(framePixels * gif.FrameCount());
+    std::vector<uint32_t> scratch(framePixels);
+
+    runner.Run("prepare/mirror", pixelsPerOp, "px", [&](uint64_t iterations) {
+        for (uint64_t i = 0; i < iterations; i++) {
+            for (size_t frame = 0; frame < gif.FrameCount(); frame++) {
+                MirrorFrame(gif.Frame(frame), scratch.data(), gif.width, gif.height);
+                DoNotOptimize(scratch[0]);
+            }
+        }
+    });
+
+    runner.Run("prepare/crop", pixelsPerOp, "px", [&](uint64_t iterations) {
+        for (uint64_t i = 0; i < iterations; i++) {
+            for (size_t frame = 0; frame < gif.FrameCount(); frame++) {
+                FrameRect bounds = FindOpaqueBounds(gif.Frame(frame), gif.width, gif.height);
+                CropFrame(gif.Frame(frame), gif.width, bounds, scratch.data());
+                DoNotOptimize(scratch[0]);
+            }
+        }
+    });
+
+    // What the viewer does at load to find each frame's changed area
+    runner.Run("prepare/frame_diff", pixelsPerOp, "px", [&](uint64_t iterations) {
+        for (uint64_t i = 0; i < iterations; i++) {
+            for (size_t frame = 0; frame < gif.FrameCount(); frame++) {
+                size_t previous = (frame + gif.FrameCount() - 1) % gif.FrameCount();
+                DoNotOptimize(DiffBounds(gif.Frame(previous), gif.Frame(frame), gif.width, gif.height));
+            }
+        }
+    });
+
+    // GIF alpha is all-or-nothing, so blend a copy with real partial alpha
+    // to exercise the arithmetic path as well
+    std::vector<uint32_t> soft(gif.Frame(0), gif.Frame(0) + framePixels);
+    for (size_t i = 0; i < soft.size(); i++) {
+        soft[i] = (soft[i] & 0x00FFFFFFu) | (static_cast<uint32_t>(i * 7 % 256) << 24);
+    }
+    runner.Run("prepare/premultiply", static_cast<double>(framePixels), "px", [&](uint64_t iterations) {
+        for (uint64_t i = 0; i < iterations; i++) {
+            std::copy(soft.begin(), soft.end(), scratch.begin());
+            PremultiplyAlpha(scratch.data(), scratch.size());
+            DoNotOptimize(scratch[0]);
+        }
+    });
+}
+
+// Upscaling one frame with each filter, and what caching a whole GIF at
+// each factor costs in memory
+void BenchScale(BenchRunner& runner, const GifFile& file) {
+    const DecodedGif& gif = file.gif;
+    std::vector<uint32_t> scaled(gif.FramePixels() * MAX_SCALE_FACTOR * MAX_SCALE_FACTOR);
+    const ScaleFilter filters[] = { SCALE_NEAREST, SCALE_EDGES };
+    const char* filterNames[] = { "nearest", "edges" };
+
+    for (int factor = 2; factor <= MAX_SCALE_FACTOR; factor++) {
+        for (int f = 0; f < 2; f++) {
+            std::string name = std::string("scale/") + filterNames[f] + "_x" + std::to_string(factor);
+            runner.Run(name, static_cast<double>(gif.FramePixels() * factor * factor), "px",
+                       [&](uint64_t iterations) {
+                for (uint64_t i = 0; i < iterations; i++) {
+                    ScaleFrame(gif.Frame(i % gif.FrameCount()), gif.width, gif.height, factor,
+                               filters[f], scaled.data());
+                    DoNotOptimize(scaled[0]);
+                }
+            });
+        }
+
+        // A 150% display on top: the fractional part goes through ResampleFrame
+        std::vector<uint32_t> resampled(gif.FramePixels() * factor * factor * 9 / 4);
+        runner.Run("scale/edges_x" + std::to_string(factor) + "_150pct",
+                   static_cast<double>(resampled.size()), "px", [&](uint64_t iterations) {
+            for (uint64_t i = 0; i < iterations; i++) {
+                ScaleFrame(gif.Frame(i % gif.FrameCount()), gif.width, gif.height, factor, SCALE_EDGES,
+                           scaled.data());
+                ResampleFrame(scaled.data(), gif.width * factor, gif.height * factor, resampled.data(),
+                              gif.width * factor * 3 / 2, gif.height * factor * 3 / 2, RESAMPLE_BILINEAR);
+                DoNotOptimize(resampled[0]);
+            }
+        });
+
+        std::string prefix = "scale/cache_x" + std::to_string(factor);
+        if (!runner.Selected(prefix)) continue;
+        ScaledFrameCache cache(SIZE_MAX);
+        for (size_t frame = 0; frame < gif.FrameCount(); frame++) {
+            cache.Add(0, static_cast<uint32_t>(frame), factor, SCALE_EDGES, 100, gif.Frame(frame),
+                      gif.width, gif.height);
+        }
+        const ScaleStats& stats = cache.Stats(factor);
+        runner.Record(prefix + "_mb_per_gif", stats.bytes / (1024.0 * 1024.0), "MB");
+        runner.Record(prefix + "_ms_per_gif", stats.generateNs / 1e6, "ms");
+    }
+}
+
+// Fractional resizing: each filter up and down, a whole GIF on one thread
+// against all of them, and the fast path checked against the reference.
+// Returns false if they disagree.
+bool BenchResample(BenchRunner& runner, const GifFile& file) {
+    const DecodedGif& gif = file.gif;
+    const ResampleFilter filters[] = { RESAMPLE_BILINEAR, RESAMPLE_LANCZOS3 };
+    const char* filterNames[] = { "bilinear", "lanczos3" };
+    const int percents[] = { 150, 75 };
+
+    for (int f = 0; f < 2; f++) {
+        for (int percent : percents) {
+            int dstWidth = gif.width * percent / 100;
+            int dstHeight = gif.height * percent / 100;
+            std::vector<uint32_t> resampled(static_cast<size_t>(dstWidth) * dstHeight);
+            runner.Run(std::string("resample/") + filterNames[f] + "_" + std::to_string(percent) + "pct",
+                       static_cast<double>(resampled.size()), "px", [&](uint64_t iterations) {
+                for (uint64_t i = 0; i < iterations; i++) {
+                    ResampleFrame(gif.Frame(i % gif.FrameCount()), gif.width, gif.height, resampled.data(),
+                                  dstWidth, dstHeight, filters[f]);
+                    DoNotOptimize(resampled[0]);
+                }
+            });
+        }
+    }
+
+    // What the cache does when the display scale changes: every frame of
+    // the GIF at 150%, on 1 to N cores of the shared task pool
+    int gifWidth = gif.width * 3 / 2;
+    int gifHeight = gif.height * 3 / 2;
+    std::vector<uint32_t> allFrames(static_cast<size_t>(gifWidth) * gifHeight * gif.FrameCount());
+    unsigned cores = std::min(std::max(std::thread::hardware_concurrency(), 1u), TaskPool::Shared().WorkerCount() + 1);
+    for (unsigned threads = 1; threads <= cores; threads++) {
+        runner.Run("resample/gif_lanczos3_150pct_" + std::to_string(threads) + "_threads",
+                   static_cast<double>(allFrames.size()), "px", [&](uint64_t iterations) {
+            for (uint64_t i = 0; i < iterations; i++) {
+                ResampleFrames(gif.Frame(0), gif.FrameCount(), gif.width, gif.height, allFrames.data(),
+                               gifWidth, gifHeight, RESAMPLE_LANCZOS3, threads);
+                DoNotOptimize(allFrames[0]);
+            }
+        });
+    }
+
+    if (!runner.Selected("resample/max_error")) {
+        return true;
+    }
+
+    // The reference is slow, so check a patch from the middle of a frame,
+    // once as decoded and once with partial alpha. The fast path sums in
+    // floats and encodes through a table, which can put alpha on the other
+    // side of a rounding step and the colors with it, so allow two levels.
+    const int PATCH = 96;
+    std::vector<uint32_t> patch(PATCH * PATCH);
+    FrameRect rect = { (gif.width - PATCH) / 2, (gif.height - PATCH) / 2, 0, 0 };
+    rect.right = rect.left + PATCH;
+    rect.bottom = rect.top + PATCH;
+    CropFrame(gif.Frame(gif.FrameCount() / 2), gif.width, rect, patch.data());
+    std::vector<uint32_t> soft(patch);
+    for (size_t i = 0; i < soft.size(); i++) {
+        uint32_t alpha = static_cast<uint32_t>(i * 7 % 256);
+        uint32_t pixel = alpha << 24;
+        for (int shift = 0; shift < 24; shift += 8) {
+            pixel |= (((soft[i] >> shift) & 0xFF) * alpha / 255) << shift;
+        }
+        soft[i] = pixel;
+    }
+
+    const int MAX_ERROR = 2;
+    int worst = 0;
+    for (const std::vector<uint32_t>* source : { &patch, &soft }) {
+        for (int f = 0; f < 2; f++) {
+            for (int percent : percents) {
+                int size = PATCH * percent / 100;
+                std::vector<uint32_t> fast(static_cast<size_t>(size) * size);
+                std::vector<uint32_t> reference(fast.size());
+                ResampleFrame(source->data(), PATCH, PATCH, fast.data(), size, size, filters[f]);
+                ResampleFrameReference(source->data(), PATCH, PATCH, reference.data(), size, size, filters[f]);
+                for (size_t i = 0; i < fast.size(); i++) {
+                    for (int shift = 0; shift < 32; shift += 8) {
+                        int a = static_cast<int>((fast[i] >> shift) & 0xFF);
+                        int b = static_cast<int>((reference[i] >> shift) & 0xFF);
+                        worst = std::max(worst, std::abs(a - b));
+                    }
+                }
+            }
+        }
+    }
+
+    runner.Record("resample/max_error", worst, "levels");
+    if (worst > MAX_ERROR) {
+        std::fprintf(stderr, "resampler differs from the reference by %d levels (at most %d allowed)\n",
+                     worst, MAX_ERROR);
+        return false;
+    }
+    return true;
+}
+
+// Returns false if drawing a frame mirrored differs from drawing a
+// mirrored copy of it
+bool BenchComposite(BenchRunner& runner, const GifFile& file) {
+    const DecodedGif& gif = file.gif;
+
+    // A scene the size of the character walking past a couch
+    std::vector<uint32_t> scene(700 * 400);
+    PixelBuffer target = { scene.data(), 700, 400, 700 };
+
+    std::vector<uint32_t> couch(226 * 160);
+    for (size_t i = 0; i < couch.size(); i++) {
+        couch[i] = (i % 226) < 8 ? 0 : 0xFF804020u;
+    }
+
+    runner.Run("composite/character", static_cast<double>(gif.FramePixels()), "px",
+               [&](uint64_t iterations) {
+        for (uint64_t i = 0; i < iterations; i++) {
+            BlendSprite(target, gif.Frame(i % gif.FrameCount()), gif.width, gif.height,
+                        static_cast<int>(i % 300), 30);
+            DoNotOptimize(scene[0]);
+        }
+    });
+
+    runner.Run("composite/character_mirrored", static_cast<double>(gif.FramePixels()), "px",
+               [&](uint64_t iterations) {
+        for (uint64_t i = 0; i < iterations; i++) {
+            BlendSpriteMirrored(target, gif.Frame(i % gif.FrameCount()), gif.width, gif.height,
+                                static_cast<int>(i % 300), 30);
+            DoNotOptimize(scene[0]);
+        }
+    });
+
+    runner.Run("composite/scene", static_cast<double>(scene.size()), "px", [&](uint64_t iterations) {
+        for (uint64_t i = 0; i < iterations; i++) {
+            ClearPixels(target, 0);
+            BlendSprite(target, couch.data(), 226, 160, 400, 240);
+            BlendSprite(target, gif.Frame(i % gif.FrameCount()), gif.width, gif.height, 300, 60);
+            DoNotOptimize(scene[0]);
+        }
+    });
+
+    // Over the couch and clipped at both scene edges
+    std::vector<uint32_t> mirrored(gif.FramePixels());
+    std::vector<uint32_t> expected(scene.size());
+    PixelBuffer expectedTarget = { expected.data(), 700, 400, 700 };
+    const int offsets[] = { -gif.width / 2, 300, 700 - gif.width / 2 };
+    for (int x : offsets) {
+        for (size_t frame = 0; frame < gif.FrameCount(); frame += std::max<size_t>(gif.FrameCount() / 4, 1)) {
+            ClearPixels(target, 0);
+            ClearPixels(expectedTarget, 0);
+            BlendSprite(target, couch.data(), 226, 160, 400, 240);
+            BlendSprite(expectedTarget, couch.data(), 226, 160, 400, 240);
+            BlendSpriteMirrored(target, gif.Frame(frame), gif.width, gif.height, x, 60);
+            MirrorFrame(gif.Frame(frame), mirrored.data(), gif.width, gif.height);
+            BlendSprite(expectedTarget, mirrored.data(), gif.width, gif.height, x, 60);
+            if (scene != expected) {
+                std::fprintf(stderr, "mirrored blend of frame %zu at x=%d differs from blending a mirrored copy\n",
+                             frame, x);
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+void BenchPlayback(BenchRunner& runner, const GifFile& file) {
+    const DecodedGif& gif = file.gif;
+
+    runner.Run("playback/advance_16ms", 0, nullptr, [&](uint64_t iterations) {
+        PlaybackCursor cursor;
+        cursor.Reset(gif.delaysMs.data(), gif.FrameCount(), 16);
+        for (uint64_t i = 0; i < iterations; i++) {
+            DoNotOptimize(cursor.Advance(16));
+        }
+        DoNotOptimize(cursor.Frame());
+    });
+
+    // Long stalls (a suspended machine, a dragged window) should not cost
+    // more than a normal tick
+    std::mt19937 rng(1);
+    std::vector<uint32_t> stalls(1024);
+    for (uint32_t& stall : stalls) stall = std::uniform_int_distribution<uint32_t>(0, 600000)(rng);
+    runner.Run("playback/advance_stall", 0, nullptr, [&](uint64_t iterations) {
+        PlaybackCursor cursor;
+        cursor.Reset(gif.delaysMs.data(), gif.FrameCount(), 16);
+        for (uint64_t i = 0; i < iterations; i++) {
+            DoNotOptimize(cursor.Advance(stalls[i & 1023]));
+        }
+        DoNotOptimize(cursor.Frame());
+    });
+}
+
+// The filename rules as they were before the keyword matcher, to check it
+// against
+GifType ReferenceGifType(const std::wstring& filename) {
+    std::wstring lower = filename;
+    std::transform(lower.begin(), lower.end(), lower.begin(),
+                   [](wchar_t c) { return static_cast<wchar_t>(std::towlower(c)); });
+    if (lower.find(L"move") != std::wstring::npos) return MOVE;
+    if (lower.find(L"wait") != std::wstring::npos) return WAIT;
+    if (lower.find(L"sit") != std::wstring::npos) return SIT;
+    if (lower.find(L"pick") != std::wstring::npos) return PICK;
+    return MISC;
+}
+
+const char BENCH_MANIFEST[] =
+    "# Kalina, with the extra states her viewer has\n"
+    "state laying as=sit\n"
+    "animation walk.gif move\n"
+    "animation idle.gif wait weight=3\n"
+    "animation idle2.gif wait weight=1 speed=1.5\n"
+    "animation sit.gif sit anchor=64,120\n"
+    "animation pick.gif pick\n"
+    "animation work1.gif work1 loop=once\n"
+    "animation work2.gif work2 loop=once\n"
+    "animation \"lay down.gif\" laying\n"
+    "transition wait move=4 sit=1 work1=1 work2=1 laying=1\n"
+    "transition work1 work2=1 wait=1\n"
+    "transition * wait=1\n";
+
+// Returns false if the keyword matcher classifies a name differently from
+// the old rules or the sample manifest doesn't compile as written
+bool BenchState(BenchRunner& runner, const std::vector<GifFile>& files) {
+    std::vector<GifEntry> entries;
+    std::vector<std::wstring> names;
+    for (const GifFile& file : files) {
+        names.push_back(std::wstring(file.name.begin(), file.name.end()) + L".gif");
+        GifEntry entry = { GetGifTypeFromFilename(names.back()) };
+        entries.push_back(entry);
+    }
+
+    runner.Run("state/manual_cycle", 0, nullptr, [&](uint64_t iterations) {
+        AppState state = STATE_WAIT;
+        size_t found = 0;
+        for (uint64_t i = 0; i < iterations; i++) {
+            state = NextManualState(state);
+            found += FindGifOfType(entries, GifTypeForState(state));
+        }
+        DoNotOptimize(found);
+    });
+
+    runner.Run("state/classify_filename", static_cast<double>(names.size()), "name",
+               [&](uint64_t iterations) {
+        int sum = 0;
+        for (uint64_t i = 0; i < iterations; i++) {
+            for (const std::wstring& name : names) {
+                sum += GetGifTypeFromFilename(name);
+            }
+        }
+        DoNotOptimize(sum);
+    });
+
+    CharacterTable table;
+    std::string error;
+    runner.Run("state/manifest_compile", 0, nullptr, [&](uint64_t iterations) {
+        for (uint64_t i = 0; i < iterations; i++) {
+            ParseCharacterManifest(BENCH_MANIFEST, sizeof(BENCH_MANIFEST) - 1, &table, &error);
+        }
+    });
+
+    std::mt19937 random(11);
+    runner.Run("state/pick_next", 0, nullptr, [&](uint64_t iterations) {
+        int state = STATE_WAIT;
+        int sum = 0;
+        for (uint64_t i = 0; i < iterations; i++) {
+            state = table.PickNextState(state, random);
+            sum += table.PickAnimation(state, random);
+        }
+        DoNotOptimize(sum);
+    });
+
+    if (!runner.Selected("state/classify_mismatches")) {
+        return true;
+    }
+
+    // Bundled names plus the awkward cases: several keywords, odd case,
+    // keywords overlapping each other, none at all
+    std::vector<std::wstring> checks = names;
+    const wchar_t* extra[] = { L"Kalina_SIT_wait.gif", L"pickmove.gif", L"deposit.gif", L"WAITWAIT.GIF",
+                               L"mov.gif", L"sitpick", L"laying.gif", L"work1.gif", L"", L"s" };
+    for (const wchar_t* name : extra) {
+        checks.push_back(name);
+    }
+    uint64_t mismatches = 0;
+    for (const std::wstring& name : checks) {
+        if (GetGifTypeFromFilename(name) != ReferenceGifType(name)) {
+            mismatches++;
+        }
+    }
+
+    bool compiled = ParseCharacterManifest(BENCH_MANIFEST, sizeof(BENCH_MANIFEST) - 1, &table, &error) &&
+                    table.StateCount() == 8 && table.Animations().size() == 8 && table.HasTransitions() &&
+                    table.BaseState(table.FindState("laying")) == STATE_SIT &&
+                    table.Animations()[7].file == L"lay down.gif" &&
+                    table.PickNextState(table.FindState("pick"), random) == STATE_WAIT;
+    if (!compiled) {
+        std::fprintf(stderr, "sample manifest compiled wrong: %s\n", error.c_str());
+        mismatches++;
+    }
+
+    runner.Record("state/classify_mismatches", static_cast<double>(mismatches), "names");
+    if (mismatches != 0) {
+        std::fprintf(stderr, "filename classification differs from the old rules for %llu names\n",
+                     static_cast<unsigned long long>(mismatches));
+        return false;
+    }
+    return true;
+}
+
+void BenchSurfaces(BenchRunner& runner) {
+    // A busy desktop: a few hundred title bars spread over three monitors
+    SurfaceIndex index;
+    std::mt19937 rng(7);
+    for (SurfaceKey key = 1; key <= 300; key++) {
+        int left = std::uniform_int_distribution<int>(-1920, 3200)(rng);
+        int width = std::uniform_int_distribution<int>(200, 1600)(rng);
+        int y = std::uniform_int_distribution<int>(0, 1400)(rng);
+        index.Set(key, left, left + width, y);
+    }
+
+    // What walking asks every step: is there still something under the feet
+    runner.Run("surface/find_support", 0, nullptr, [&](uint64_t iterations) {
+        Surface surface;
+        int hits = 0;
+        for (uint64_t i = 0; i < iterations; i++) {
+            int x = static_cast<int>((i * 2654435761u) % 6000) - 1920;
+            hits += index.FindSupport(x, static_cast<int>(i % 1400), 4, &surface);
+        }
+        DoNotOptimize(hits);
+    });
+
+    runner.Run("surface/find_below", 0, nullptr, [&](uint64_t iterations) {
+        Surface surface;
+        int hits = 0;
+        for (uint64_t i = 0; i < iterations; i++) {
+            int x = static_cast<int>((i * 2654435761u) % 6000) - 1920;
+            hits += index.FindBelow(x, static_cast<int>(i % 1400), &surface);
+        }
+        DoNotOptimize(hits);
+    });
+}
+
+// Headless wakeup count: one simulated minute of walking and of idling,
+// with and without power saver
+void BenchPower(BenchRunner& runner, const GifFile& walk, const GifFile& idle) {
+    const uint64_t MINUTE_MS = 60000;
+    struct Case { const char* name; const GifFile* gif; bool moving; };
+    const Case cases[] = { { "walk", &walk, true }, { "idle", &idle, false } };
+
+    for (const Case& c : cases) {
+        const DecodedGif& gif = c.gif->gif;
+        WakeupStats normal = SimulateWakeups(gif.delaysMs.data(), gif.FrameCount(), c.moving, false, MINUTE_MS);
+        WakeupStats saver = SimulateWakeups(gif.delaysMs.data(), gif.FrameCount(), c.moving, true, MINUTE_MS);
+
+        std::string prefix = std::string("power/") + c.name;
+        runner.Record(prefix + "_wakeups_per_min", static_cast<double>(normal.wakeups), "wakeups");
+        runner.Record(prefix + "_saver_wakeups_per_min", static_cast<double>(saver.wakeups), "wakeups");
+        runner.Record(prefix + "_saver_frames_per_min", static_cast<double>(saver.frames), "frames");
+        if (saver.wakeups >= normal.wakeups) {
+            std::fprintf(stderr, "power saver did not reduce wakeups for %s\n", c.name);
+        }
+    }
+}
+
+// Everything the viewer does per frame once an animation is playing:
+// advance, record timing, schedule the next tick, check out a layer,
+// composite. None of it may touch the heap. Returns false if a steady-state
+// frame allocated.
+bool BenchSteadyFrame(BenchRunner& runner, const GifFile& file) {
+    const DecodedGif& gif = file.gif;
+
+    RenderSurfacePool<std::vector<uint32_t>> surfaces(
+        [](std::vector<uint32_t>* pixels, int width, int height, RenderSurfaceFormat format) {
+            pixels->resize(RenderSurfaceBytes(width, height, format) / sizeof(uint32_t));
+            return true;
+        },
+        [](std::vector<uint32_t>* pixels) { std::vector<uint32_t>().swap(*pixels); });
+    std::vector<uint32_t> couch(226 * 160, 0xFF804020u);
+
+    PlaybackCursor cursor;
+    cursor.Reset(gif.delaysMs.data(), gif.FrameCount(), 16);
+    PlaybackStats stats;
+    QualityGovernor governor;
+    Scheduler scheduler;
+    uint64_t nowMs = 0;
+    uint64_t ticks = 0;
+
+    auto frame = [&]() {
+        TRACE_ZONE("frame");
+        nowMs += 16;
+        cursor.Advance(16);
+        stats.RecordFrame(cursor.RemainingMs(), 16.0);
+        governor.RecordFrame(cursor.RemainingMs(), 16.0);
+        if (governor.WindowComplete()) {
+            governor.Evaluate(0.01);
+        }
+        scheduler.ScheduleAt(nowMs + 16, [&ticks]() { ticks++; });
+        scheduler.RunDue(nowMs + 16);
+
+        std::vector<uint32_t>* scene = surfaces.Acquire(700, 400, RENDER_ARGB32);
+        PixelBuffer target = { scene->data(), 700, 400, 700 };
+        ClearPixels(target, 0);
+        BlendSprite(target, couch.data(), 226, 160, 400, 240);
+        BlendSprite(target, gif.Frame(cursor.Frame()), gif.width, gif.height, 300, 60);
+        DoNotOptimize((*scene)[0]);
+        surfaces.Release(scene);
+    };
+
+    runner.Run("render/steady_frame", 0, nullptr, [&](uint64_t iterations) {
+        for (uint64_t i = 0; i < iterations; i++) {
+            frame();
+        }
+    });
+
+    if (!runner.Selected("render/steady_frame_allocations")) {
+        return true;
+    }
+    if (!AllocationTrackingEnabled()) {
+        std::fprintf(stderr, "allocation tracking is off in this build; skipping the steady frame check\n");
+        return true;
+    }
+
+    // Warm up first: containers grow to their working size once
+    for (int i = 0; i < 1000; i++) {
+        frame();
+    }
+    const int FRAMES = 1000;
+    AllocationScope scope;
+    for (int i = 0; i < FRAMES; i++) {
+        frame();
+    }
+    uint64_t allocations = scope.Allocations();
+
+    runner.Record("render/steady_frame_allocations", static_cast<double>(allocations) / FRAMES, "allocs");
+    if (allocations != 0) {
+        std::fprintf(stderr, "steady-state frames allocated %llu times (%llu bytes) over %d frames\n",
+                     static_cast<unsigned long long>(allocations),
+                     static_cast<unsigned long long>(scope.Bytes()), FRAMES);
+        return false;
+    }
+    return true;
+}
+
+void BenchTracing(BenchRunner& runner) {
+    bool wasEnabled = IsTracingEnabled();
+
+    SetTracingEnabled(false);
+    runner.Run("trace/zone_disabled", 0, nullptr, [&](uint64_t iterations) {
+        for (uint64_t i = 0; i < iterations; i++) {
+            TRACE_ZONE("bench");
+        }
+    });
+
+    SetTracingEnabled(true);
+    runner.Run("trace/zone_enabled", 0, nullptr, [&](uint64_t iterations) {
+        for (uint64_t i = 0; i < iterations; i++) {
+            TRACE_ZONE("bench");
+        }
+    });
+
+    SetTracingEnabled(wasEnabled);
+    ClearTrace();
+}
+
+// Task pool overhead: empty tasks submitted from outside the pool (how the
+// loader uses it), and tasks that each spawn more from inside it, which is
+// where stealing has to spread the work.
+// Check: a thread outside the pool that waits on its own group (the
+// render thread resampling) must not pick up another group's queued work
+// (an import still decoding), however busy the workers are
+bool BenchTasks(BenchRunner& runner) {
+    TaskPool& pool = TaskPool::Shared();
+    std::atomic<uint64_t> ran(0);
+
+    TaskGroup import;
+    std::atomic<int> importsHere(0);
+    const std::thread::id waiter = std::this_thread::get_id();
+    for (unsigned i = 0; i < pool.WorkerCount() + 2; i++) {
+        pool.Submit(&import, TASK_NORMAL, [&importsHere, waiter]() {
+            importsHere += std::this_thread::get_id() == waiter;
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        });
+    }
+    TaskGroup resample;
+    for (int i = 0; i < 8; i++) {
+        pool.Submit(&resample, TASK_NORMAL, [&ran]() { ran.fetch_add(1, std::memory_order_relaxed); });
+    }
+    pool.Wait(&resample);
+    bool isolated = importsHere.load() == 0;
+    pool.Wait(&import);
+    if (!isolated) {
+        std::fprintf(stderr, "waiting on one task group ran another group's tasks\n");
+    }
+
+    runner.Run("tasks/submit_wait", 1, "task", [&](uint64_t iterations) {
+        TaskGroup group;
+        for (uint64_t i = 0; i < iterations; i++) {
+            pool.Submit(&group, i % 8 == 0 ? TASK_HIGH : TASK_NORMAL, [&ran]() {
+                ran.fetch_add(1, std::memory_order_relaxed);
+            });
+        }
+        pool.Wait(&group);
+    });
+
+    const uint64_t FAN_OUT = 16;
+    runner.Run("tasks/nested_fan_out", static_cast<double>(FAN_OUT + 1), "task", [&](uint64_t iterations) {
+        TaskGroup group;
+        for (uint64_t i = 0; i < iterations; i++) {
+            pool.Submit(&group, TASK_NORMAL, [&pool, &group, &ran, FAN_OUT]() {
+                for (uint64_t j = 0; j < FAN_OUT; j++) {
+                    pool.Submit(&group, TASK_NORMAL, [&ran]() {
+                        ran.fetch_add(1, std::memory_order_relaxed);
+                    });
+                }
+            });
+        }
+        pool.Wait(&group);
+    });
+    DoNotOptimize(ran);
+    return isolated;
+}
+
+// One headless character: walking and animation loops take a fixed time
+// per pixel or per loop on the shared virtual clock
+class BenchCharacter : public BehaviorHost {
+public:
+    BenchCharacter(Scheduler& scheduler, uint64_t& nowMs, int x)
+        : scheduler(scheduler), nowMs(nowMs), x(x), pending(INVALID_TASK) {}
+
+    Scheduler& BehaviorScheduler() override { return scheduler; }
+    uint64_t BehaviorNowMs() override { return nowMs; }
+
+    void PlayUntilLoopEnd(AppState, std::coroutine_handle<> resume) override {
+        ResumeAfter(LOOP_MS, resume);
+    }
+
+    void MoveTo(int targetX, std::coroutine_handle<> resume) override {
+        uint64_t distance = static_cast<uint64_t>(targetX > x ? targetX - x : x - targetX);
+        x = targetX;
+        ResumeAfter(distance * MS_PER_PIXEL + 1, resume);
+    }
+
+    void CancelResume(std::coroutine_handle<>) override {
+        scheduler.Cancel(pending);
+        pending = INVALID_TASK;
+    }
+
+private:
+    static const uint64_t LOOP_MS = 800;
+    static const uint64_t MS_PER_PIXEL = 10;
+
+    void ResumeAfter(uint64_t ms, std::coroutine_handle<> resume) {
+        pending = scheduler.ScheduleAt(nowMs + ms, [this, resume]() {
+            pending = INVALID_TASK;
+            resume.resume();
+        });
+    }
+
+    Scheduler& scheduler;
+    uint64_t& nowMs;
+    int x;
+    TaskId pending;
+};
+
+// The viewer's stroll, forever: walk out, sit through a loop, rest, walk back
+Behavior Patrol([[maybe_unused]] BehaviorHost& host, int edgeX, int homeX, uint64_t* steps) {
+    for (;;) {
+        co_await MoveTo(edgeX);
+        (*steps)++;
+        co_await PlayUntilLoopEnd(STATE_SIT);
+        (*steps)++;
+        co_await WaitFor(200);
+        (*steps)++;
+        co_await MoveTo(homeX);
+        (*steps)++;
+    }
+}
+
+// Cost of resuming a behavior from the scheduler with thousands of them in
+// flight, and of starting and cancelling one. Returns false if a step or a
+// start/cancel allocated once the frame pool and the scheduler had grown.
+bool BenchBehaviors(BenchRunner& runner) {
+    const int CHARACTERS = 4096;
+    Scheduler scheduler;
+    uint64_t nowMs = 0;
+    uint64_t steps = 0;
+    std::mt19937 random(7);
+    std::uniform_int_distribution<int> place(0, 1920);
+
+    std::vector<std::unique_ptr<BenchCharacter>> characters;
+    std::vector<Behavior> behaviors;
+    for (int i = 0; i < CHARACTERS; i++) {
+        int homeX = place(random);
+        characters.emplace_back(new BenchCharacter(scheduler, nowMs, homeX));
+        behaviors.push_back(Patrol(*characters.back(), place(random), homeX, &steps));
+        behaviors.back().Start();
+    }
+
+    auto advance = [&](uint64_t count) {
+        uint64_t target = steps + count;
+        while (steps < target) {
+            nowMs++;
+            scheduler.RunDue(nowMs);
+        }
+    };
+
+    runner.Run("behavior/resume", 0, nullptr, [&](uint64_t iterations) {
+        advance(iterations);
+    });
+
+    Scheduler spareScheduler;
+    uint64_t spareNowMs = 0;
+    uint64_t spareSteps = 0;
+    BenchCharacter spare(spareScheduler, spareNowMs, 0);
+    auto startCancel = [&]() {
+        Behavior behavior = Patrol(spare, 100, 0, &spareSteps);
+        behavior.Start();
+    };
+    runner.Run("behavior/start_cancel", 0, nullptr, [&](uint64_t iterations) {
+        for (uint64_t i = 0; i < iterations; i++) {
+            startCancel();
+        }
+    });
+
+    BehaviorFrameStats frames = BehaviorFramePoolStats();
+    runner.Record("behavior/frame_bytes", frames.liveFrames ? static_cast<double>(frames.liveBytes) / frames.liveFrames : 0.0,
+                  "bytes");
+
+    if (!runner.Selected("behavior/step_allocations")) {
+        return true;
+    }
+    if (!AllocationTrackingEnabled()) {
+        std::fprintf(stderr, "allocation tracking is off in this build; skipping the behavior check\n");
+        return true;
+    }
+
+    advance(CHARACTERS * 4);
+    startCancel();
+    const uint64_t STEPS = CHARACTERS * 4;
+    AllocationScope scope;
+    advance(STEPS);
+    for (int i = 0; i < 1000; i++) {
+        startCancel();
+    }
+    uint64_t allocations = scope.Allocations();
+
+    runner.Record("behavior/step_allocations", static_cast<double>(allocations) / STEPS, "allocs");
+    if (allocations != 0 || frames.oversize != 0) {
+        std::fprintf(stderr, "behaviors allocated %llu times (%llu bytes) over %llu steps, %llu oversize frames\n",
+                     static_cast<unsigned long long>(allocations),
+                     static_cast<unsigned long long>(scope.Bytes()),
+                     static_cast<unsigned long long>(STEPS),
+                     static_cast<unsigned long long>(frames.oversize));
+        return false;
+    }
+    return true;
+}
+
+// Push count messages from `producers` threads while this thread pops them
+// all. Messages are (producer << 32 | sequence); returns how many arrived
+// missing, twice or out of order for their producer.
+template <typename Queue>
+uint64_t PumpMessages(Queue& queue, unsigned producers, uint64_t count) {
+    std::vector<std::thread> threads;
+    uint64_t perProducer = count / producers;
+    for (unsigned p = 0; p < producers; p++) {
+        threads.emplace_back([&queue, p, perProducer]() {
+            for (uint64_t i = 0; i < perProducer; i++) {
+                while (!queue.TryPush((static_cast<uint64_t>(p) << 32) | i)) {
+                    std::this_thread::yield();
+                }
+            }
+        });
+    }
+
+    std::vector<uint64_t> next(producers, 0);
+    uint64_t errors = 0;
+    uint64_t message;
+    for (uint64_t received = 0; received < perProducer * producers;) {
+        if (!queue.TryPop(&message)) {
+            std::this_thread::yield();
+            continue;
+        }
+        uint64_t producer = message >> 32;
+        uint64_t sequence = message & 0xFFFFFFFFu;
+        if (producer >= producers || sequence != next[producer]) {
+            errors++;
+        }
+        if (producer < producers) {
+            next[producer] = sequence + 1;
+        }
+        received++;
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    return errors;
+}
+
+// Messages per second through the command queues, and a stress run on a
+// tiny ring so the indices wrap thousands of times. Build with
+// -DCHIBI_SANITIZE_THREAD=ON to have ThreadSanitizer watch the stress run.
+// Returns false if a message got lost, duplicated or reordered.
+bool BenchQueues(BenchRunner& runner) {
+    const size_t CAPACITY = 1024;
+    SpscQueue<uint64_t> spsc(CAPACITY);
+    runner.Run("queue/spsc_1_producer", 1, "msg", [&](uint64_t iterations) {
+        DoNotOptimize(PumpMessages(spsc, 1, iterations));
+    });
+
+    const unsigned producerCounts[] = { 1, 4 };
+    for (unsigned producers : producerCounts) {
+        MpscQueue<uint64_t> mpsc(CAPACITY);
+        runner.Run("queue/mpsc_" + std::to_string(producers) + "_producers", 1, "msg",
+                   [&](uint64_t iterations) {
+            // Whole messages per producer, so the count stays exact
+            DoNotOptimize(PumpMessages(mpsc, producers, std::max<uint64_t>(iterations / producers, 1) * producers));
+        });
+    }
+
+    if (!runner.Selected("queue/stress_errors")) {
+        return true;
+    }
+
+    const size_t TINY = 8;
+    const uint64_t MESSAGES = 200000;
+    SpscQueue<uint64_t> tinySpsc(TINY);
+    MpscQueue<uint64_t> tinyMpsc(TINY);
+    uint64_t errors = PumpMessages(tinySpsc, 1, MESSAGES) + PumpMessages(tinyMpsc, 4, MESSAGES);
+    runner.Record("queue/stress_errors", static_cast<double>(errors), "msgs");
+    if (errors != 0) {
+        std::fprintf(stderr, "queues lost, duplicated or reordered %llu messages\n",
+                     static_cast<unsigned long long>(errors));
+        return false;
+    }
+    return true;
+}
+
+// A made-up session: the character left alone, picked up and thrown every
+// few seconds, and a spell of manual mode with some state cycling
+Session SyntheticSession(uint64_t seed, uint64_t durationMs, int screenWidth, int screenHeight) {
+    Session session;
+    session.seed = seed;
+    session.durationMs = durationMs;
+    session.screenWidth = screenWidth;
+    session.screenHeight = screenHeight;
+    session.startX = screenWidth / 4;
+    session.startY = screenHeight;
+    session.areaRight = screenWidth;
+    session.areaBottom = screenHeight;
+
+    std::mt19937 random(static_cast<uint32_t>(seed));
+    for (uint64_t t = 3000; t + 1000 < durationMs; t += 4000 + random() % 8000) {
+        // Grab somewhere along the bottom where the character usually is
+        // and fling it up and sideways; a miss is still realistic input
+        int x = static_cast<int>(random() % screenWidth);
+        int y = screenHeight - 40 - static_cast<int>(random() % 200);
+        int dx = static_cast<int>(random() % 41) - 20;
+        SessionEvent down = { t, SESSION_MOUSE_DOWN, x, y, 0 };
+        session.events.push_back(down);
+        for (int i = 1; i <= 30; i++) {
+            SessionEvent move = { t + 8 * i, SESSION_MOUSE_MOVE, x + dx * i, y - 12 * i, 0 };
+            session.events.push_back(move);
+        }
+        SessionEvent up = { t + 8 * 31, SESSION_MOUSE_UP, x + dx * 31, y - 12 * 31, 0 };
+        session.events.push_back(up);
+
+        if (t / 60000 != (t + 4000) / 60000) {
+            // Manual mode for a while, cycling through the states
+            const uint32_t keys[] = { 'A', ' ', ' ', ' ', 'A' };
+            for (int k = 0; k < 5; k++) {
+                SessionEvent key = { t + 500 + 700 * k, SESSION_KEY, 0, 0, keys[k] };
+                session.events.push_back(key);
+            }
+            t += 4000;
+        }
+    }
+    return session;
+}
+
+bool ReadSessionFile(const char* path, Session* session) {
+    std::vector<uint8_t> bytes;
+    std::string error;
+    if (!ReadFileBytes(path, &bytes) || !ReadSession(bytes.data(), bytes.size(), session, &error)) {
+        std::fprintf(stderr, "can't replay %s: %s\n", path, error.empty() ? "unreadable" : error.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool WriteSessionFile(const char* path, const Session& session) {
+    std::vector<uint8_t> bytes;
+    WriteSession(session, &bytes);
+    FILE* file = std::fopen(path, "wb");
+    if (!file) return false;
+    bool written = std::fwrite(bytes.data(), 1, bytes.size(), file) == bytes.size();
+    return std::fclose(file) == 0 && written;
+}
+
+// Stands in for the viewer while it records: walking on the floor of the
+// work area only, no furniture or strolls
+class RecordingHost : public CharacterHost {
+public:
+    explicit RecordingHost(const Session& setup) {
+        area.left = setup.areaLeft;
+        area.top = setup.areaTop;
+        area.right = setup.areaRight;
+        area.bottom = setup.areaBottom;
+        screen.left = setup.screenLeft;
+        screen.top = setup.screenTop;
+        screen.right = setup.screenLeft + setup.screenWidth;
+        screen.bottom = setup.screenTop + setup.screenHeight;
+    }
+
+    void AnimationStarted(int, bool) override {}
+    void AnimationTurned(bool) override {}
+    void SceneMoved() override {}
+    ScreenArea WalkArea(int, int) override { return area; }
+    ScreenArea ScreenBounds() override { return screen; }
+    bool FurnitureSize(size_t, int*, int*) override { return false; }
+    StateOptions Extras() override { return StateOptions(); }
+
+private:
+    ScreenArea area;
+    ScreenArea screen;
+};
+
+// Input a recording driver sends. Mouse offsets are from where the
+// character was grabbed; SESSION_SCALE takes dx and dy as they are.
+struct PlannedInput {
+    uint64_t timeMs;
+    SessionEventType type;
+    int dx;
+    int dy;
+    uint32_t key;
+};
+
+// The next gesture from startMs: a throw, a spell hidden, manual mode, a
+// size change or a predicted drag
+void PlanGesture(int gesture, uint64_t startMs, std::mt19937& random, std::deque<PlannedInput>* planned) {
+    uint64_t t = startMs;
+    int vx = static_cast<int>(random() % 31) - 15;
+    switch (gesture % 5) {
+        case 0:
+        case 4: {
+            if (gesture % 5 == 4) planned->push_back({ t, SESSION_KEY, 0, 0, 'P' });
+            planned->push_back({ t, SESSION_MOUSE_DOWN, 0, 0, 0 });
+            for (int i = 1; i <= 12; i++) {
+                t += 5 + random() % 6;
+                planned->push_back({ t, SESSION_MOUSE_MOVE, vx * i, -14 * i, 0 });
+            }
+            planned->push_back({ t + 3, SESSION_MOUSE_UP, vx * 13, -14 * 13, 0 });
+            if (gesture % 5 == 4) planned->push_back({ t + 3, SESSION_KEY, 0, 0, 'P' });
+            break;
+        }
+        case 1:
+            planned->push_back({ t, SESSION_HIDDEN, 0, 0, 0 });
+            planned->push_back({ t + 2000 + random() % 20000, SESSION_SHOWN, 0, 0, 0 });
+            break;
+        case 2: {
+            const uint32_t keys[] = { 'A', ' ', ' ', 0, 'A' };
+            for (int k = 0; k < 5; k++) {
+                SessionEventType type = keys[k] != 0 ? SESSION_KEY : SESSION_NEXT_STATE;
+                planned->push_back({ t + 700 * k, type, 0, 0, keys[k] });
+            }
+            break;
+        }
+        case 3:
+            planned->push_back({ t, SESSION_SCALE, 2, 125, 0 });
+            planned->push_back({ t + 5000 + random() % 5000, SESSION_SCALE, 1, 100, 0 });
+            break;
+    }
+}
+
+// Record a session the way the viewer does: the engine on real timers that
+// wake up a few ms late (on the grid too, if gridMs isn't 0), input at
+// whatever time it arrives, each event saved with the time the engine
+// applied it at. True if replaying it reproduces the recorder's state and
+// position trace.
+bool ReplaysRecording(const CharacterTable& table, const std::vector<CharacterAnimation>& animations,
+                      uint64_t seed, uint64_t gridMs) {
+    // A second monitor left of the primary one, whose taskbar the character
+    // walks above
+    Session setup;
+    setup.seed = seed;
+    setup.screenLeft = -1280;
+    setup.screenWidth = 1280 + 1920;
+    setup.screenHeight = 1080;
+    setup.areaRight = 1920;
+    setup.areaBottom = 1040;
+    setup.startX = 480;
+    setup.startY = 1040;
+
+    RecordingHost host(setup);
+    SurfaceIndex floor;
+    floor.Set(1, setup.areaLeft, setup.areaRight, setup.areaBottom);
+    CharacterEngine engine(table, animations, floor, host);
+    SessionRecorder recorder;
+    std::mt19937 random(static_cast<uint32_t>(seed * 7919 + gridMs));
+    const uint64_t startMs = 1000000 + random() % 1000;
+    const uint64_t endMs = startMs + 2 * 60 * 1000;
+    engine.Seed(seed);
+    engine.Start(startMs, setup.startX, setup.startY, AUTOMATIC);
+    recorder.Start(setup, startMs);
+
+    std::deque<PlannedInput> planned;
+    int gesture = 0;
+    int grabX = 0;
+    int grabY = 0;
+    uint64_t now = startMs;
+    for (;;) {
+        if (planned.empty()) {
+            uint64_t next = now + 1500 + random() % 6000;
+            if (next >= endMs) break;
+            PlanGesture(gesture++, next, random, &planned);
+        }
+
+        // The timer wakes up late, and in power saver on the next grid step
+        uint64_t wake = engine.HasPending() ? engine.NextDeadline() + random() % 16 : endMs;
+        if (gridMs != 0) {
+            wake = (wake + gridMs - 1) / gridMs * gridMs;
+        }
+        const PlannedInput& input = planned.front();
+        if (input.timeMs >= endMs && wake >= endMs) {
+            break;
+        }
+        if (input.timeMs <= wake) {
+            now = std::max(now, input.timeMs);
+            if (input.type == SESSION_MOUSE_DOWN) {
+                grabX = engine.X() + engine.Width() / 2;
+                grabY = engine.Y() + engine.Height() / 2;
+            }
+            bool mouse = input.type == SESSION_MOUSE_DOWN || input.type == SESSION_MOUSE_MOVE ||
+                         input.type == SESSION_MOUSE_UP;
+            SessionEvent event = { now, input.type, mouse ? grabX + input.dx : input.dx,
+                                   mouse ? grabY + input.dy : input.dy, input.key };
+            uint64_t applied = engine.Input(event);
+            recorder.Record(event.type, applied, mouse ? event.x - setup.screenLeft : event.x,
+                            mouse ? event.y - setup.screenTop : event.y, event.key);
+            planned.pop_front();
+        } else {
+            now = std::max(now, wake);
+            engine.RunDue(now);
+        }
+    }
+    engine.RunDue(endMs);
+    recorder.Stop(endMs);
+
+    Session recorded = recorder.Recorded();
+    recorded.choiceTrace = engine.ChoiceTrace();
+    recorded.stateTrace = engine.StateTrace();
+    std::vector<uint8_t> bytes;
+    WriteSession(recorded, &bytes);
+    Session reread;
+    std::string error;
+    if (!ReadSession(bytes.data(), bytes.size(), &reread, &error)) {
+        std::fprintf(stderr, "recording didn't read back: %s\n", error.c_str());
+        return false;
+    }
+
+    CharacterSimulation simulation(table, animations);
+    std::function<void(const SimFrame&)> none;
+    simulation.Run(reread, none);
+    if (simulation.StateTrace() != recorded.stateTrace || simulation.ChoiceTrace() != recorded.choiceTrace) {
+        std::fprintf(stderr, "recording %llu (grid %llu ms) replayed states %016llx choices %016llx, "
+                     "recorded %016llx %016llx\n", static_cast<unsigned long long>(seed),
+                     static_cast<unsigned long long>(gridMs),
+                     static_cast<unsigned long long>(simulation.StateTrace()),
+                     static_cast<unsigned long long>(simulation.ChoiceTrace()),
+                     static_cast<unsigned long long>(recorded.stateTrace),
+                     static_cast<unsigned long long>(recorded.choiceTrace));
+        return false;
+    }
+    return true;
+}
+
+// Replays a session headless: the sample manifest's character with the
+// bundled GIFs standing in for its animations, each presented frame
+// composited like the viewer would. Returns false if two runs of the same
+// session (one through the file format) come out different, or differ
+// from the trace hash the session was saved with.
+bool BenchReplay(BenchRunner& runner, const std::vector<GifFile>& files, const char* replayPath,
+                 const char* savePath) {
+    CharacterTable table;
+    std::string error;
+    if (!ParseCharacterManifest(BENCH_MANIFEST, sizeof(BENCH_MANIFEST) - 1, &table, &error)) {
+        std::fprintf(stderr, "sample manifest: %s\n", error.c_str());
+        return false;
+    }
+    std::vector<const DecodedGif*> gifs;
+    std::vector<CharacterAnimation> animations;
+    for (size_t i = 0; i < table.Animations().size(); i++) {
+        const DecodedGif& gif = files[i % files.size()].gif;
+        CharacterAnimation animation = { gif.delaysMs, gif.width, gif.height };
+        animations.push_back(animation);
+        gifs.push_back(&gif);
+    }
+
+    Session session = SyntheticSession(46, 3 * 60 * 1000, 1920, 1080);
+    if (replayPath && !ReadSessionFile(replayPath, &session)) {
+        return false;
+    }
+
+    CharacterSimulation simulation(table, animations);
+    uint64_t mismatches = 0;
+    if (runner.Selected("replay/frame")) {
+        // The character's own window: clear it, draw the frame
+        std::vector<uint32_t> window;
+        Histogram frameNs;
+        auto last = std::chrono::steady_clock::now();
+        auto present = [&](const SimFrame& frame) {
+            const DecodedGif& gif = *gifs[frame.animation];
+            window.resize(gif.FramePixels());
+            PixelBuffer target = { window.data(), gif.width, gif.height, gif.width };
+            ClearPixels(target, 0);
+            BlendSprite(target, gif.Frame(frame.frame), gif.width, gif.height, 0, 0);
+            DoNotOptimize(window[0]);
+
+            // Everything since the last frame: the simulation's share plus this
+            auto now = std::chrono::steady_clock::now();
+            frameNs.Record(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(now - last).count()));
+            last = now;
+        };
+        auto start = std::chrono::steady_clock::now();
+        uint64_t frames = simulation.Run(session, present);
+        double wallMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+        std::printf("replayed %llu ms of session in %.1f ms: %llu frames\n",
+                    static_cast<unsigned long long>(session.durationMs), wallMs,
+                    static_cast<unsigned long long>(frames));
+        runner.Record("replay/frame_p50", static_cast<double>(frameNs.Percentile(50.0)), "ns");
+        runner.Record("replay/frame_p99", static_cast<double>(frameNs.Percentile(99.0)), "ns");
+        runner.Record("replay/speedup", wallMs > 0.0 ? session.durationMs / wallMs : 0.0, "x");
+    }
+
+    std::function<void(const SimFrame&)> none;
+    uint64_t frames = simulation.Run(session, none);
+    uint64_t hash = simulation.TraceHash();
+    uint64_t choices = simulation.ChoiceTrace();
+    uint64_t states = simulation.StateTrace();
+
+    if (savePath) {
+        Session saved = session;
+        saved.traceHash = hash;
+        saved.choiceTrace = choices;
+        saved.stateTrace = states;
+        if (!WriteSessionFile(savePath, saved)) {
+            std::fprintf(stderr, "failed to write %s\n", savePath);
+            return false;
+        }
+        std::printf("wrote %s (trace %016llx)\n", savePath, static_cast<unsigned long long>(hash));
+    }
+
+    if (!runner.Selected("replay/mismatches")) {
+        return true;
+    }
+
+    // Same session again, after a round trip through the file format
+    std::vector<uint8_t> bytes;
+    WriteSession(session, &bytes);
+    Session reread;
+    if (!ReadSession(bytes.data(), bytes.size(), &reread, &error)) {
+        std::fprintf(stderr, "session didn't read back: %s\n", error.c_str());
+        mismatches++;
+    } else if (simulation.Run(reread, none) != frames || simulation.TraceHash() != hash ||
+               simulation.ChoiceTrace() != choices || simulation.StateTrace() != states) {
+        std::fprintf(stderr, "replaying the same session twice gave different frames\n");
+        mismatches++;
+    }
+    if (session.traceHash != 0 && session.traceHash != hash) {
+        std::fprintf(stderr, "replay trace %016llx, the session was saved with %016llx\n",
+                     static_cast<unsigned long long>(hash), static_cast<unsigned long long>(session.traceHash));
+        mismatches++;
+    }
+
+    // A viewer recording only knows its choices and states. They differ if
+    // it was recorded with another character than the sample manifest.
+    if (session.choiceTrace != 0 && session.choiceTrace != choices) {
+        std::fprintf(stderr, "replay made different choices (%016llx) from the recording (%016llx)\n",
+                     static_cast<unsigned long long>(choices), static_cast<unsigned long long>(session.choiceTrace));
+        mismatches++;
+    }
+    if (session.stateTrace != 0 && session.stateTrace != states) {
+        std::fprintf(stderr, "replay went through different states (%016llx) from the recording (%016llx)\n",
+                     static_cast<unsigned long long>(states), static_cast<unsigned long long>(session.stateTrace));
+        mismatches++;
+    }
+
+    // Sessions recorded on late real timers, with and without the power
+    // saver grid, replay the recorder's states and positions exactly
+    for (uint64_t seed = 1; seed <= 3; seed++) {
+        if (!ReplaysRecording(table, animations, seed, 0) ||
+            !ReplaysRecording(table, animations, seed, POWER_SAVER_GRID_MS)) {
+            mismatches++;
+        }
+    }
+
+    runner.Record("replay/mismatches", static_cast<double>(mismatches), "runs");
+    return mismatches == 0;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    std::string gifDirectory = CHIBI_ASSET_DIR;
+    const char* jsonPath = nullptr;
+    const char* replayPath = nullptr;
+    const char* savePath = nullptr;
+    BenchRunner runner;
+
+    for (int i = 1; i < argc; i++) {
+        if (std::strcmp(argv[i], "--gifs") == 0 && i + 1 < argc) {
+            gifDirectory = argv[++i];
+        } else if (std::strcmp(argv[i], "--filter") == 0 && i + 1 < argc) {
+            runner.SetFilter(argv[++i]);
+        } else if (std::strcmp(argv[i], "--json") == 0 && i + 1 < argc) {
+            jsonPath = argv[++i];
+        } else if (std::strcmp(argv[i], "--quick") == 0) {
+            runner.SetMinSampleMs(5.0);
+            runner.SetSamples(3);
+        } else if (std::strcmp(argv[i], "--replay") == 0 && i + 1 < argc) {
+            replayPath = argv[++i];
+        } else if (std::strcmp(argv[i], "--save-session") == 0 && i + 1 < argc) {
+            savePath = argv[++i];
+        } else {
+            std::fprintf(stderr, "usage: %s [--gifs DIR] [--filter TEXT] [--json FILE] [--quick] "
+                         "[--replay SESSION] [--save-session SESSION]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    std::vector<GifFile> files = LoadGifs(gifDirectory);
+    if (files.empty()) {
+        std::fprintf(stderr, "no GIFs found in %s\n", gifDirectory.c_str());
+        return 1;
+    }
+    for (const GifFile& file : files) {
+        std::printf("%s: %dx%d, %zu frames, %zu bytes\n", file.name.c_str(), file.gif.width,
+                    file.gif.height, file.gif.FrameCount(), file.bytes.size());
+    }
+
+    // The walk cycle is what plays most of the time
+    const GifFile* hot = &files[0];
+    const GifFile* idle = &files[0];
+    for (const GifFile& file : files) {
+        GifType type = GetGifTypeFromFilename(std::wstring(file.name.begin(), file.name.end()));
+        if (type == MOVE && hot == &files[0]) hot = &file;
+        if (type == WAIT && idle == &files[0]) idle = &file;
+    }
+
+    bool decoded = BenchDecode(runner, files);
+    BenchPrepare(runner, *hot);
+    BenchScale(runner, *hot);
+    bool resampled = BenchResample(runner, *hot);
+    bool composited = BenchComposite(runner, *hot);
+    BenchPlayback(runner, *hot);
+    bool classified = BenchState(runner, files);
+    BenchSurfaces(runner);
+    BenchTracing(runner);
+    bool queued = BenchQueues(runner);
+    bool pooled = BenchTasks(runner);
+    bool behaved = BenchBehaviors(runner);
+    BenchPower(runner, *hot, *idle);
+    bool steady = BenchSteadyFrame(runner, *hot);
+    bool replayed = BenchReplay(runner, files, replayPath, savePath);
+
+    if (jsonPath) {
+        if (!runner.WriteJson(jsonPath)) {
+            std::fprintf(stderr, "failed to write %s\n", jsonPath);
+            return 1;
+        }
+        std::printf("wrote %s\n", jsonPath);
+    }
+    return decoded && composited && pooled && steady && resampled && queued && behaved && classified && replayed ? 0 : 1;
+}
@@ -0,0 +1,175 @@
+#include "BenchHarness.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+
+#if defined(_WIN32)
+#include <windows.h>
+#include <psapi.h>
+#endif
+
+namespace {
+
+double ElapsedNs(const std::function<void(uint64_t)>& body, uint64_t iterations) {
+    auto start = std::chrono::steady_clock::now();
+    body(iterations);
+    auto end = std::chrono::steady_clock::now();
+    return static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+}
+
+void WriteJsonString(FILE* file, const std::string& text) {
+    std::fputc('"', file);
+    for (char c : text) {
+        if (c == '"' || c == '\\') std::fputc('\\', file);
+        std::fputc(c, file);
+    }
+    std::fputc('"', file);
+}
+
+}  // namespace
+
+BenchRunner::BenchRunner() : minSampleMs(50.0), samples(7) {
+}
+
+void BenchRunner::Run(const std::string& name, double itemsPerOp, const char* itemUnit,
+                      const std::function<void(uint64_t)>& body) {
+    if (!Selected(name)) return;
+
+    // Warm up, then grow the iteration count until one sample is long
+    // enough for the clock to be meaningful
+    body(1);
+    uint64_t iterations = 1;
+    const double minSampleNs = minSampleMs * 1e6;
+    for (;;) {
+        double ns = ElapsedNs(body, iterations);
+        if (ns >= minSampleNs || iterations >= (1ull << 40)) break;
+        double scale = ns > 0 ? minSampleNs * 1.2 / ns : 100.0;
+        scale = std::min(100.0, std::max(2.0, scale));
+        iterations = static_cast<uint64_t>(iterations * scale);
+    }
+
+    std::vector<double> perOp;
+    for (int i = 0; i < samples; i++) {
+        perOp.push_back(ElapsedNs(body, iterations) / iterations);
+    }
+    std::sort(perOp.begin(), perOp.end());
+
+    BenchResult result;
+    result.name = name;
+    result.nsPerOp = perOp[perOp.size() / 2];
+    result.minNsPerOp = perOp.front();
+    result.maxNsPerOp = perOp.back();
+    result.iterations = iterations;
+    result.samples = samples;
+    result.itemsPerOp = itemsPerOp;
+    result.itemUnit = itemUnit ? itemUnit : "";
+    result.isValue = false;
+    result.value = 0.0;
+    results.push_back(result);
+
+    std::printf("%-40s %14.1f ns/op", name.c_str(), result.nsPerOp);
+    if (itemsPerOp > 0) {
+        std::printf("  %12.1f M%s/s", itemsPerOp * 1e3 / result.nsPerOp, result.itemUnit.c_str());
+    }
+    std::printf("\n");
+    std::fflush(stdout);
+}
+
+void BenchRunner::Record(const std::string& name, double value, const char* unit) {
+    if (!Selected(name)) return;
+
+    BenchResult result;
+    result.name = name;
+    result.nsPerOp = 0.0;
+    result.minNsPerOp = 0.0;
+    result.maxNsPerOp = 0.0;
+    result.iterations = 0;
+    result.samples = 0;
+    result.itemsPerOp = 0.0;
+    result.itemUnit = unit ? unit : "";
+    result.isValue = true;
+    result.value = value;
+    results.push_back(result);
+
+    std::printf("%-40s %14.1f %s\n", name.c_str(), value, result.itemUnit.c_str());
+    std::fflush(stdout);
+}
+
+void BenchRunner::PrintTable() const {
+    std::printf("%-40s %14s %14s %14s\n", "case", "median ns", "min ns", "max ns");
+    for (const BenchResult& result : results) {
+        if (result.isValue) continue;
+        std::printf("%-40s %14.1f %14.1f %14.1f\n", result.name.c_str(),
+                    result.nsPerOp, result.minNsPerOp, result.maxNsPerOp);
+    }
+}
+
+bool BenchRunner::WriteJson(const char* path) const {
+    FILE* file = std::fopen(path, "w");
+    if (!file) return false;
+
+    char timestamp[32];
+    std::time_t now = std::time(nullptr);
+    std::strftime(timestamp, sizeof(timestamp), "%Y-%m-%dT%H:%M:%SZ", std::gmtime(&now));
+
+    std::fprintf(file, "{\n  \"schema\": 1,\n  \"timestamp\": \"%s\",\n", timestamp);
+#if defined(__clang__)
+    std::fprintf(file, "  \"compiler\": \"clang %d.%d\",\n", __clang_major__, __clang_minor__);
+#elif defined(__GNUC__)
+    std::fprintf(file, "  \"compiler\": \"gcc %d.%d\",\n", __GNUC__, __GNUC_MINOR__);
+#elif defined(_MSC_VER)
+    std::fprintf(file, "  \"compiler\": \"msvc %d\",\n", _MSC_VER);
+#endif
+    std::fprintf(file, "  \"results\": [\n");
+    for (size_t i = 0; i < results.size(); i++) {
+        const BenchResult& result = results[i];
+        std::fprintf(file, "    {\"name\": ");
+        WriteJsonString(file, result.name);
+        if (result.isValue) {
+            std::fprintf(file, ", \"value\": %.3f, \"unit\": ", result.value);
+            WriteJsonString(file, result.itemUnit);
+            std::fprintf(file, "}%s\n", i + 1 < results.size() ? "," : "");
+            continue;
+        }
+        std::fprintf(file, ", \"ns_per_op\": %.3f, \"min_ns_per_op\": %.3f, \"max_ns_per_op\": %.3f, "
+                           "\"iterations\": %llu, \"samples\": %d",
+                     result.nsPerOp, result.minNsPerOp, result.maxNsPerOp,
+                     static_cast<unsigned long long>(result.iterations), result.samples);
+        if (result.itemsPerOp > 0) {
+            std::fprintf(file, ", \"items_per_op\": %.1f, \"item_unit\": ", result.itemsPerOp);
+            WriteJsonString(file, result.itemUnit);
+            std::fprintf(file, ", \"items_per_second\": %.1f", result.itemsPerOp * 1e9 / result.nsPerOp);
+        }
+        std::fprintf(file, "}%s\n", i + 1 < results.size() ? "," : "");
+    }
+    std::fprintf(file, "  ]\n}\n");
+    return std::fclose(file) == 0;
+}
+
+uint64_t ResidentKb() {
+#if defined(_WIN32)
+    PROCESS_MEMORY_COUNTERS counters;
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) return 0;
+    return counters.WorkingSetSize / 1024;
+#elif defined(__linux__)
+    // /proc files report a size of 0, so read line by line
+    FILE* file = std::fopen("/proc/self/status", "r");
+    if (!file) return 0;
+    char line[256];
+    uint64_t kb = 0;
+    while (std::fgets(line, sizeof(line), file)) {
+        if (std::strncmp(line, "VmRSS:", 6) == 0) {
+            kb = std::strtoull(line + 6, nullptr, 10);
+            break;
+        }
+    }
+    std::fclose(file);
+    return kb;
+#else
+    return 0;
+#endif
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+// Resident set size of this process in KB, 0 where we can't tell
+uint64_t ResidentKb();
+
+// Keep a value alive so the optimizer can't drop the work that made it
+template <typename T>
+inline void DoNotOptimize(const T& value) {
+#if defined(__GNUC__)
+    asm volatile("" : : "r,m"(value) : "memory");
+#else
+    const volatile char* sink = reinterpret_cast<const volatile char*>(&value);
+    (void)*sink;
+#endif
+}
+
+struct BenchResult {
+    std::string name;
+    double nsPerOp;       // Median over all samples
+    double minNsPerOp;
+    double maxNsPerOp;
+    uint64_t iterations;  // Per sample
+    int samples;
+    double itemsPerOp;    // Work units per op (bytes, pixels, frames...)
+    std::string itemUnit;
+    bool isValue;         // A plain measurement (Record) instead of a timing
+    double value;
+};
+
+// Runs each case for a calibrated number of iterations, several times, and
+// keeps the median. The body gets the iteration count and does the loop
+// itself so per-iteration call overhead stays out of the numbers.
+class BenchRunner {
+public:
+    BenchRunner();
+
+    void SetFilter(const std::string& filter) { this->filter = filter; }
+    void SetMinSampleMs(double ms) { minSampleMs = ms; }
+    void SetSamples(int count) { samples = count; }
+
+    // Whether the filter lets a case with this name run
+    bool Selected(const std::string& name) const {
+        return filter.empty() || name.find(filter) != std::string::npos;
+    }
+
+    // Runs the case unless the filter excludes it
+    void Run(const std::string& name, double itemsPerOp, const char* itemUnit,
+             const std::function<void(uint64_t)>& body);
+
+    // Store a measured quantity that isn't a time, like a simulated count
+    void Record(const std::string& name, double value, const char* unit);
+
+    const std::vector<BenchResult>& Results() const { return results; }
+
+    void PrintTable() const;
+    bool WriteJson(const char* path) const;
+
+private:
+    std::string filter;
+    double minSampleMs;
+    int samples;
+    std::vector<BenchResult> results;
+};
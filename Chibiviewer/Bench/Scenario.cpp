@@ -0,0 +1,633 @@
+// End-to-end scenarios: a script of what someone does with the viewer, run
+// headless and measured as a whole session instead of one function at a
+// time. The character is CharacterSimulation, which runs the viewer's own
+// state machine and movement (CharacterEngine) on a virtual clock, with
+// the same GIF decoder, compositor and task pool, so state changes, walking,
+// throws and decode/composite costs are the viewer's, while window
+// handling, the Win32 timers and painting through GDI are not measured here.
+//
+//   chibi_scenario [--assets DIR] [--quick] [--baseline FILE] [--compare FILE] SCENARIO...
+//
+// A scenario file has one step per line; '#' starts a comment:
+//
+//   seed 47            where the random streams start
+//   screen 1920 1080   virtual screen size
+//   load DIR           import a folder (relative to --assets); another load switches folders
+//   idle 10m           leave the character alone (ms, or with an s or m suffix)
+//   drag 5s            pick the character up, wave it around and throw it
+//   states 200         manual mode, Space that many times, back to automatic
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <functional>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <sys/resource.h>
+#endif
+
+#include "BenchHarness.h"
+#include "Core/AllocTracker.h"
+#include "Core/CharacterManifest.h"
+#include "Core/Compositor.h"
+#include "Core/FrameOps.h"
+#include "Core/GifDecoder.h"
+#include "Core/Histogram.h"
+#include "Core/MemoryLedger.h"
+#include "Core/RenderSurfacePool.h"
+#include "Core/Simulation.h"
+#include "Core/TaskPool.h"
+
+#ifndef CHIBI_ASSET_DIR
+#define CHIBI_ASSET_DIR "."
+#endif
+
+namespace {
+
+const uint64_t DRAG_MOVE_MS = 8;         // About how often Windows reports a moving mouse
+const uint64_t FLICK_MOVES = 5;          // Fast moves at the end of a drag that throw the character
+const uint64_t STATE_KEY_MS = 100;       // Between Space presses
+const uint64_t RSS_SAMPLE_MS = 1000;     // Virtual time between memory samples
+const int QUICK_DIVISOR = 10;            // --quick shortens every step by this much
+
+enum StepType {
+    STEP_LOAD,
+    STEP_IDLE,
+    STEP_DRAG,
+    STEP_STATES
+};
+
+struct Step {
+    StepType type;
+    std::string folder;  // STEP_LOAD
+    uint64_t amount;     // Milliseconds, or state changes for STEP_STATES
+};
+
+struct Scenario {
+    std::string name;
+    uint64_t seed;
+    int screenWidth;
+    int screenHeight;
+    std::vector<Step> steps;
+
+    Scenario() : seed(1), screenWidth(1920), screenHeight(1080) {}
+};
+
+// An imported folder, decoded and prepared the way the viewer keeps it
+struct LoadedCharacter {
+    CharacterTable table;
+    std::vector<DecodedGif> gifs;                   // Parallel to table.Animations()
+    std::vector<CharacterAnimation> animations;
+    MemoryLedger* memory;
+    std::vector<MemoryAsset> assets;                // One per loaded animation
+
+    explicit LoadedCharacter(MemoryLedger* memory) : memory(memory) {}
+    ~LoadedCharacter() {
+        for (MemoryAsset asset : assets) memory->RemoveAsset(asset);
+    }
+};
+
+struct Metric {
+    std::string name;
+    std::string value;
+    std::string unit;
+};
+
+bool Fail(std::string* error, int line, const std::string& reason) {
+    if (error) *error = "line " + std::to_string(line) + ": " + reason;
+    return false;
+}
+
+// "600000", "90s" or "10m" in milliseconds
+bool ParseDuration(const std::string& text, uint64_t* ms) {
+    char* end = nullptr;
+    unsigned long long value = std::strtoull(text.c_str(), &end, 10);
+    if (end == text.c_str()) return false;
+    std::string unit = end;
+    if (unit.empty() || unit == "ms") {
+        *ms = value;
+    } else if (unit == "s") {
+        *ms = value * 1000;
+    } else if (unit == "m") {
+        *ms = value * 60 * 1000;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+bool ParseScenario(const std::string& text, Scenario* scenario, std::string* error) {
+    std::istringstream lines(text);
+    std::string line;
+    int number = 0;
+    while (std::getline(lines, line)) {
+        number++;
+        size_t comment = line.find('#');
+        if (comment != std::string::npos) line.erase(comment);
+        std::istringstream words(line);
+        std::string command;
+        if (!(words >> command)) continue;
+
+        std::string argument;
+        words >> argument;
+        Step step = { STEP_IDLE, std::string(), 0 };
+        if (command == "seed") {
+            if (!ParseDuration(argument, &scenario->seed)) return Fail(error, number, "seed needs a number");
+            continue;
+        } else if (command == "screen") {
+            int height = 0;
+            scenario->screenWidth = std::atoi(argument.c_str());
+            if (!(words >> height) || scenario->screenWidth <= 0 || height <= 0) {
+                return Fail(error, number, "screen needs a width and a height");
+            }
+            scenario->screenHeight = height;
+            continue;
+        } else if (command == "load") {
+            if (argument.empty()) return Fail(error, number, "load needs a folder");
+            step.type = STEP_LOAD;
+            step.folder = argument;
+        } else if (command == "idle" || command == "drag") {
+            step.type = command == "idle" ? STEP_IDLE : STEP_DRAG;
+            if (!ParseDuration(argument, &step.amount)) return Fail(error, number, command + " needs a duration");
+        } else if (command == "states") {
+            step.type = STEP_STATES;
+            if (!ParseDuration(argument, &step.amount) || argument.back() < '0' || argument.back() > '9') {
+                return Fail(error, number, "states needs a count");
+            }
+        } else {
+            return Fail(error, number, "unknown step '" + command + "'");
+        }
+        if (step.type != STEP_LOAD && (scenario->steps.empty() || scenario->steps[0].type != STEP_LOAD)) {
+            return Fail(error, number, "load a folder first");
+        }
+        scenario->steps.push_back(step);
+    }
+    return true;
+}
+
+bool ReadText(const std::filesystem::path& path, std::string* text) {
+    std::vector<uint8_t> bytes;
+    if (!ReadFileBytes(path.string().c_str(), &bytes)) return false;
+    text->assign(bytes.begin(), bytes.end());
+    return true;
+}
+
+// Like the viewer's LoadGifFiles: the manifest if the folder has one,
+// otherwise every GIF by its name, decoded in parallel on the task pool
+bool LoadCharacter(const std::filesystem::path& folder, LoadedCharacter* character, std::string* error) {
+    std::string manifest;
+    if (ReadText(folder / "character.manifest", &manifest)) {
+        if (!ParseCharacterManifest(manifest.data(), manifest.size(), &character->table, error)) {
+            return false;
+        }
+    } else {
+        std::vector<std::wstring> names;
+        std::error_code listError;
+        for (const auto& entry : std::filesystem::directory_iterator(folder, listError)) {
+            std::string extension = entry.path().extension().string();
+            std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+            if (extension == ".gif") names.push_back(entry.path().filename().wstring());
+        }
+        std::sort(names.begin(), names.end());
+        character->table.AddAnimationsFromFilenames(names);
+    }
+
+    const std::vector<ManifestAnimation>& specs = character->table.Animations();
+    if (specs.empty()) {
+        *error = "no GIFs in " + folder.string();
+        return false;
+    }
+    character->gifs.assign(specs.size(), DecodedGif());
+    std::vector<std::string> errors(specs.size());
+
+    TaskGroup tasks;
+    for (size_t i = 0; i < specs.size(); i++) {
+        TaskPool::Shared().Submit(&tasks, TASK_NORMAL, [&, i]() {
+            std::vector<uint8_t> bytes;
+            std::string path = (folder / specs[i].file).string();
+            if (!ReadFileBytes(path.c_str(), &bytes)) {
+                errors[i] = "can't read " + path;
+                return;
+            }
+            if (!DecodeGif(bytes.data(), bytes.size(), &character->gifs[i], &errors[i])) {
+                errors[i] = path + ": " + errors[i];
+            }
+        });
+    }
+    TaskPool::Shared().Wait(&tasks);
+
+    for (size_t i = 0; i < specs.size(); i++) {
+        if (!errors[i].empty()) {
+            *error = errors[i];
+            return false;
+        }
+        const DecodedGif& gif = character->gifs[i];
+        CharacterAnimation animation = { gif.delaysMs, gif.width, gif.height };
+        character->animations.push_back(animation);
+
+        // The file bytes are gone by now; what stays is charged. Flipped
+        // frames are drawn mirrored straight from these, as the viewer does.
+        MemoryAsset asset = character->memory->AddAsset(std::filesystem::path(specs[i].file).string());
+        character->memory->Set(asset, MEMORY_DECODED, gif.pixels.capacity() * sizeof(uint32_t));
+        character->memory->Set(asset, MEMORY_PLAYBACK, gif.delaysMs.capacity() * sizeof(uint32_t));
+        character->assets.push_back(asset);
+    }
+    return true;
+}
+
+double ProcessCpuMs() {
+#if defined(_WIN32)
+    FILETIME creation, exitTime, kernel, user;
+    if (!GetProcessTimes(GetCurrentProcess(), &creation, &exitTime, &kernel, &user)) return 0.0;
+    ULARGE_INTEGER kernelTime = { { kernel.dwLowDateTime, kernel.dwHighDateTime } };
+    ULARGE_INTEGER userTime = { { user.dwLowDateTime, user.dwHighDateTime } };
+    return (kernelTime.QuadPart + userTime.QuadPart) / 10000.0;
+#else
+    rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) return 0.0;
+    return (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000.0 +
+           (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1000.0;
+#endif
+}
+
+std::string Number(double value) {
+    char text[64];
+    std::snprintf(text, sizeof(text), "%.1f", value);
+    return text;
+}
+
+// The headless stand-in for the viewer's layers: plain pixel arrays
+bool CreatePixelSurface(std::vector<uint32_t>* pixels, int width, int height, RenderSurfaceFormat format) {
+    pixels->resize(RenderSurfaceBytes(width, height, format) / sizeof(uint32_t));
+    return true;
+}
+
+void DestroyPixelSurface(std::vector<uint32_t>* pixels) {
+    std::vector<uint32_t>().swap(*pixels);
+}
+
+class ScenarioRunner {
+public:
+    ScenarioRunner(const std::filesystem::path& assets, bool quick)
+        : assets(assets), quick(quick), sceneMemory(memory.AddAsset("scene")),
+          surfaces(CreatePixelSurface, DestroyPixelSurface) {}
+
+    bool Run(const Scenario& scenario, std::vector<Metric>* metrics, std::string* error);
+
+private:
+    bool Load(const Scenario& scenario, const std::string& folder, std::string* error);
+    void Advance(uint64_t untilMs);
+    void Drag(uint64_t durationMs);
+    void CycleStates(uint64_t count);
+    void Present(const SimFrame& frame);
+    void SampleMemory();
+
+    std::filesystem::path assets;
+    bool quick;
+    MemoryLedger memory;
+    MemoryAsset sceneMemory;  // The window layers
+    RenderSurfacePool<std::vector<uint32_t>> surfaces;
+
+    std::unique_ptr<LoadedCharacter> character;
+    std::unique_ptr<CharacterSimulation> simulation;
+    std::function<void(const SimFrame&)> onFrame;
+    Histogram frameNs;
+    Histogram stepNs;
+    std::chrono::steady_clock::time_point lastPresent;
+    uint64_t traceHash;
+    uint64_t simulatedMs;
+    uint64_t frames;
+    uint64_t peakKb;
+    uint64_t unloadUs;  // Freeing the folder the last load replaced
+};
+
+bool ScenarioRunner::Run(const Scenario& scenario, std::vector<Metric>* metrics, std::string* error) {
+    onFrame = [this](const SimFrame& frame) { Present(frame); };
+    frameNs.Reset();
+    traceHash = 0;
+    simulatedMs = 0;
+    frames = 0;
+    peakKb = ResidentKb();
+    unloadUs = 0;
+    uint64_t steadyKb = 0;
+
+    double cpuStart = ProcessCpuMs();
+    uint64_t allocationsStart = AllocationCount();
+    uint64_t bytesStart = AllocatedBytes();
+    auto wallStart = std::chrono::steady_clock::now();
+
+    for (size_t i = 0; i < scenario.steps.size(); i++) {
+        const Step& step = scenario.steps[i];
+        uint64_t amount = quick ? std::max<uint64_t>(step.amount / QUICK_DIVISOR, 1) : step.amount;
+        uint64_t framesBefore = simulation ? simulation->Frames() : 0;
+        stepNs.Reset();
+        auto stepStart = std::chrono::steady_clock::now();
+        lastPresent = stepStart;
+
+        const char* kind = "load";
+        switch (step.type) {
+            case STEP_LOAD:
+                if (!Load(scenario, step.folder, error)) return false;
+                framesBefore = 0;
+                break;
+            case STEP_IDLE:
+                kind = "idle";
+                Advance(simulation->Now() + amount);
+                steadyKb = ResidentKb();
+                break;
+            case STEP_DRAG:
+                kind = "drag";
+                Drag(amount);
+                break;
+            case STEP_STATES:
+                kind = "states";
+                CycleStates(amount);
+                break;
+        }
+        SampleMemory();
+
+        double stepMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - stepStart).count();
+        std::string prefix = scenario.name + ".step" + std::to_string(i + 1) + "_" + kind;
+        metrics->push_back({ prefix + ".wall", Number(stepMs), "ms" });
+        if (step.type == STEP_LOAD) {
+            metrics->push_back({ prefix + ".unload", std::to_string(unloadUs), "us" });
+        }
+        if (step.type != STEP_LOAD) {
+            metrics->push_back({ prefix + ".frames", std::to_string(simulation->Frames() - framesBefore), "frames" });
+            metrics->push_back({ prefix + ".frame_p99", std::to_string(stepNs.Percentile(99.0)), "ns" });
+        }
+    }
+    if (simulation) {
+        frames += simulation->Frames();
+        traceHash = traceHash * 0x100000001B3ull ^ simulation->TraceHash();
+    }
+
+    double wallMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - wallStart).count();
+    double cpuMs = ProcessCpuMs() - cpuStart;
+    uint64_t allocations = AllocationCount() - allocationsStart;
+    uint64_t allocatedKb = (AllocatedBytes() - bytesStart) / 1024;
+    if (steadyKb == 0) steadyKb = ResidentKb();
+
+    // What the last folder holds, by category, for per-character budgets
+    uint64_t categoryBytes[MEMORY_CATEGORY_COUNT] = {};
+    uint64_t ledgerBytes = 0;
+    for (const MemoryAssetUsage& usage : memory.Snapshot()) {
+        for (int c = 0; c < MEMORY_CATEGORY_COUNT; c++) {
+            categoryBytes[c] += usage.bytes[c];
+        }
+        ledgerBytes += usage.Total();
+    }
+
+    // Drop the last folder so the next scenario starts from nothing
+    simulation.reset();
+    character.reset();
+
+    char trace[32];
+    std::snprintf(trace, sizeof(trace), "%016llx", static_cast<unsigned long long>(traceHash));
+    const std::string& name = scenario.name;
+    metrics->push_back({ name + ".simulated", std::to_string(simulatedMs), "ms" });
+    metrics->push_back({ name + ".wall", Number(wallMs), "ms" });
+    metrics->push_back({ name + ".cpu", Number(cpuMs), "ms" });
+    metrics->push_back({ name + ".peak_rss", std::to_string(peakKb), "KB" });
+    metrics->push_back({ name + ".steady_rss", std::to_string(steadyKb), "KB" });
+    metrics->push_back({ name + ".memory", std::to_string(ledgerBytes / 1024), "KB" });
+    for (int c = 0; c < MEMORY_CATEGORY_COUNT; c++) {
+        std::string category = MemoryCategoryName(static_cast<MemoryCategory>(c));
+        metrics->push_back({ name + ".memory_" + category, std::to_string(categoryBytes[c] / 1024), "KB" });
+    }
+    metrics->push_back({ name + ".allocations", std::to_string(allocations), "allocs" });
+    metrics->push_back({ name + ".allocated", std::to_string(allocatedKb), "KB" });
+    metrics->push_back({ name + ".frames", std::to_string(frames), "frames" });
+    metrics->push_back({ name + ".frame_p50", std::to_string(frameNs.Percentile(50.0)), "ns" });
+    metrics->push_back({ name + ".frame_p99", std::to_string(frameNs.Percentile(99.0)), "ns" });
+    metrics->push_back({ name + ".trace", trace, "hash" });
+    return true;
+}
+
+// Switching folders: the old character goes away only once the new one is
+// ready, like in the viewer, and the simulation starts over with it
+bool ScenarioRunner::Load(const Scenario& scenario, const std::string& folder, std::string* error) {
+    std::unique_ptr<LoadedCharacter> loaded(new LoadedCharacter(&memory));
+    if (!LoadCharacter(assets / folder, loaded.get(), error)) {
+        return false;
+    }
+    if (simulation) {
+        frames += simulation->Frames();
+        traceHash = traceHash * 0x100000001B3ull ^ simulation->TraceHash();
+    }
+    simulation.reset();
+    auto unloadStart = std::chrono::steady_clock::now();
+    character = std::move(loaded);
+    unloadUs = static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - unloadStart).count());
+    simulation.reset(new CharacterSimulation(character->table, character->animations));
+    lastPresent = std::chrono::steady_clock::now();
+    simulation->Start(scenario.seed, scenario.screenWidth, scenario.screenHeight, onFrame);
+    return true;
+}
+
+// Run in slices so memory gets sampled as time passes
+void ScenarioRunner::Advance(uint64_t untilMs) {
+    while (simulation->Now() < untilMs) {
+        uint64_t from = simulation->Now();
+        simulation->RunUntil(std::min(from + RSS_SAMPLE_MS, untilMs));
+        simulatedMs += simulation->Now() - from;
+        SampleMemory();
+    }
+}
+
+void ScenarioRunner::Drag(uint64_t durationMs) {
+    int left, top, width, height;
+    simulation->CharacterRect(&left, &top, &width, &height);
+    int x = left + width / 2;
+    int y = top + height / 2;
+    uint64_t start = simulation->Now() + 1;
+    SessionEvent down = { start, SESSION_MOUSE_DOWN, x, y, 0 };
+    simulation->Input(down);
+
+    // Zigzag side to side while lifting, then flick up into a throw
+    uint64_t moves = std::max<uint64_t>(durationMs / DRAG_MOVE_MS, 1);
+    SessionEvent move = { start, SESSION_MOUSE_MOVE, x, y, 0 };
+    for (uint64_t i = 1; i <= moves; i++) {
+        int swing = static_cast<int>(i * 6 % 400);
+        move.timeMs = start + i * DRAG_MOVE_MS;
+        move.x = x + (swing < 200 ? swing - 100 : 300 - swing);
+        move.y = y - static_cast<int>(std::min<uint64_t>(i, 50)) * 4;
+        if (i + FLICK_MOVES > moves) {
+            move.y -= static_cast<int>(i + FLICK_MOVES - moves) * 40;
+        }
+        simulation->Input(move);
+    }
+    SessionEvent up = move;
+    up.type = SESSION_MOUSE_UP;
+    up.timeMs += DRAG_MOVE_MS;
+    simulation->Input(up);
+    Advance(up.timeMs);
+}
+
+void ScenarioRunner::CycleStates(uint64_t count) {
+    uint64_t at = simulation->Now() + 1;
+    SessionEvent manual = { at, SESSION_KEY, 0, 0, 'A' };
+    simulation->Input(manual);
+    for (uint64_t i = 1; i <= count; i++) {
+        SessionEvent space = { at + i * STATE_KEY_MS, SESSION_KEY, 0, 0, ' ' };
+        simulation->Input(space);
+    }
+    SessionEvent automatic = { at + (count + 1) * STATE_KEY_MS, SESSION_KEY, 0, 0, 'A' };
+    simulation->Input(automatic);
+    Advance(automatic.timeMs);
+}
+
+// What the viewer does for every frame it presents: clear the window and
+// draw the character into it, mirrored when walking left
+void ScenarioRunner::Present(const SimFrame& frame) {
+    const DecodedGif& gif = character->gifs[frame.animation];
+    std::vector<uint32_t>* window = surfaces.Acquire(gif.width, gif.height, RENDER_ARGB32);
+    PixelBuffer target = { window->data(), gif.width, gif.height, gif.width };
+    ClearPixels(target, 0);
+    if (frame.flipped) {
+        BlendSpriteMirrored(target, gif.Frame(frame.frame), gif.width, gif.height, 0, 0);
+    } else {
+        BlendSprite(target, gif.Frame(frame.frame), gif.width, gif.height, 0, 0);
+    }
+    DoNotOptimize((*window)[0]);
+    surfaces.Release(window);
+
+    // Everything since the last frame: the simulation's share plus this
+    auto now = std::chrono::steady_clock::now();
+    uint64_t ns = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(now - lastPresent).count());
+    frameNs.Record(ns);
+    stepNs.Record(ns);
+    lastPresent = now;
+}
+
+// Reading the RSS isn't free, so it doesn't count towards the next frame
+void ScenarioRunner::SampleMemory() {
+    peakKb = std::max(peakKb, ResidentKb());
+    memory.Set(sceneMemory, MEMORY_BUFFERS, surfaces.Bytes());
+    lastPresent = std::chrono::steady_clock::now();
+}
+
+// name value unit, one per line, in a stable order so builds diff cleanly
+bool WriteBaseline(const char* path, const std::vector<Metric>& metrics) {
+    FILE* file = std::fopen(path, "w");
+    if (!file) return false;
+    std::fprintf(file, "# chibi_scenario baseline: metric value unit\n");
+    for (const Metric& metric : metrics) {
+        std::fprintf(file, "%s %s %s\n", metric.name.c_str(), metric.value.c_str(), metric.unit.c_str());
+    }
+    return std::fclose(file) == 0;
+}
+
+bool Compare(const char* path, const std::vector<Metric>& metrics) {
+    std::string text;
+    if (!ReadText(path, &text)) return false;
+    std::map<std::string, std::string> old;
+    std::istringstream lines(text);
+    std::string line;
+    while (std::getline(lines, line)) {
+        std::istringstream words(line);
+        std::string name, value;
+        if (line.empty() || line[0] == '#' || !(words >> name >> value)) continue;
+        old[name] = value;
+    }
+
+    std::printf("\n%-44s %14s %14s %9s\n", "compared to baseline", "before", "after", "change");
+    for (const Metric& metric : metrics) {
+        std::map<std::string, std::string>::const_iterator found = old.find(metric.name);
+        if (found == old.end()) {
+            std::printf("%-44s %14s %14s %9s\n", metric.name.c_str(), "-", metric.value.c_str(), "new");
+        } else if (metric.unit == "hash") {
+            std::printf("%-44s %14s %14s %9s\n", metric.name.c_str(), found->second.c_str(), metric.value.c_str(),
+                        found->second == metric.value ? "same" : "DIFFERS");
+        } else {
+            double before = std::atof(found->second.c_str());
+            double after = std::atof(metric.value.c_str());
+            char change[32];
+            std::snprintf(change, sizeof(change), "%+.1f%%", before != 0.0 ? (after - before) * 100.0 / before : 0.0);
+            std::printf("%-44s %14s %14s %9s\n", metric.name.c_str(), found->second.c_str(), metric.value.c_str(), change);
+        }
+    }
+    return true;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    std::string assets = CHIBI_ASSET_DIR;
+    const char* baselinePath = nullptr;
+    const char* comparePath = nullptr;
+    bool quick = false;
+    std::vector<std::string> paths;
+
+    for (int i = 1; i < argc; i++) {
+        if (std::strcmp(argv[i], "--assets") == 0 && i + 1 < argc) {
+            assets = argv[++i];
+        } else if (std::strcmp(argv[i], "--baseline") == 0 && i + 1 < argc) {
+            baselinePath = argv[++i];
+        } else if (std::strcmp(argv[i], "--compare") == 0 && i + 1 < argc) {
+            comparePath = argv[++i];
+        } else if (std::strcmp(argv[i], "--quick") == 0) {
+            quick = true;
+        } else if (argv[i][0] == '-') {
+            paths.clear();
+            break;
+        } else {
+            paths.push_back(argv[i]);
+        }
+    }
+    if (paths.empty()) {
+        std::fprintf(stderr, "usage: %s [--assets DIR] [--quick] [--baseline FILE] [--compare FILE] SCENARIO...\n",
+                     argv[0]);
+        return 2;
+    }
+    if (!AllocationTrackingEnabled()) {
+        std::fprintf(stderr, "allocation tracking is off in this build; allocation counts will read 0\n");
+    }
+
+    ScenarioRunner runner(assets, quick);
+    std::vector<Metric> metrics;
+    for (const std::string& path : paths) {
+        Scenario scenario;
+        scenario.name = std::filesystem::path(path).stem().string();
+        std::string text;
+        std::string error;
+        if (!ReadText(path, &text) || !ParseScenario(text, &scenario, &error)) {
+            std::fprintf(stderr, "%s: %s\n", path.c_str(), error.empty() ? "can't read" : error.c_str());
+            return 1;
+        }
+
+        size_t first = metrics.size();
+        if (!runner.Run(scenario, &metrics, &error)) {
+            std::fprintf(stderr, "%s: %s\n", path.c_str(), error.c_str());
+            return 1;
+        }
+        for (size_t i = first; i < metrics.size(); i++) {
+            std::printf("%-44s %14s %s\n", metrics[i].name.c_str(), metrics[i].value.c_str(), metrics[i].unit.c_str());
+        }
+    }
+
+    if (comparePath && !Compare(comparePath, metrics)) {
+        std::fprintf(stderr, "can't read %s\n", comparePath);
+        return 1;
+    }
+    if (baselinePath) {
+        if (!WriteBaseline(baselinePath, metrics)) {
+            std::fprintf(stderr, "failed to write %s\n", baselinePath);
+            return 1;
+        }
+        std::printf("wrote %s\n", baselinePath);
+    }
+    return 0;
+}
@@ -4,129 +4,104 @@
 #include <gdiplus.h>
 #include <shlwapi.h>
 #include <shlobj.h>
+#include <dwmapi.h>
+#include <wtsapi32.h>
 #include <vector>
 #include <memory>
 #include <string>
 #include <algorithm>
 #include <random>
 #include <ctime>
+#include <cstdlib>
+#include <cmath>
+#include <cstring>
+#include <cwchar>
+#include <atomic>
+
+#include "Core/AllocTracker.h"
+#include "Core/CharacterEngine.h"
+#include "Core/CharacterManifest.h"
+#include "Core/CharacterState.h"
+#include "Core/Compositor.h"
+#include "Core/Scheduler.h"
+#include "Core/Furniture.h"
+#include "Core/FrameOps.h"
+#include "Core/SurfaceIndex.h"
+#include "Core/Visibility.h"
+#include "Core/PowerMode.h"
+#include "Core/PlaybackStats.h"
+#include "Core/Histogram.h"
+#include "Core/MemoryLedger.h"
+#include "Core/Profiler.h"
+#include "Core/QualityGovernor.h"
+#include "Core/RandomStreams.h"
+#include "Core/RenderSurfacePool.h"
+#include "Core/Session.h"
+#include "Core/StateRules.h"
+#include "Core/ScaledFrameCache.h"
+#include "Core/SpscQueue.h"
+#include "Core/TaskPool.h"
 
 #pragma comment(lib, "user32.lib")
 #pragma comment(lib, "gdi32.lib")
 #pragma comment(lib, "gdiplus.lib")
 #pragma comment(lib, "shlwapi.lib")
+#pragma comment(lib, "dwmapi.lib")
+#pragma comment(lib, "wtsapi32.lib")
 
 // Add using namespace for GDI+ at the top
 using namespace Gdiplus;
 
-// Application constants
-const int TIMER_ID = 1;
-const int MIN_STATE_DURATION = 5000;  // 5 seconds in milliseconds
-const int MAX_STATE_DURATION = 20000; // 20 seconds in milliseconds
+// Windows 8.1+ message; older SDKs don't define it
+#ifndef WM_DPICHANGED
+#define WM_DPICHANGED 0x02E0
+#endif
+
+// Windows 10 1803+ waitable timer flag, same story
+#ifndef CREATE_WAITABLE_TIMER_HIGH_RESOLUTION
+#define CREATE_WAITABLE_TIMER_HIGH_RESOLUTION 0x00000002
+#endif
+
+// Application constants (the character's own are in Core/CharacterEngine.h)
 const int ANIMATION_TIMER_ID = 2;
 const int ANIMATION_INTERVAL = 16;  // 16ms for 60 FPS
 const int FRAME_BUFFER_SIZE = 5;  // Number of frames to buffer ahead
-const UINT MIN_FRAME_DELAY = 16;   // Minimum frame delay (60 FPS)
-const int MOVE_INTERVAL = 16;  // Changed to 16ms for smoother movement
-const int MOVE_DISTANCE = 2;   // Reduced movement distance per step
-
-// GIF categories
-enum GifType {
-    MOVE,
-    WAIT,
-    SIT,
-    PICK,
-    MISC
-};
+const int DRAG_TIMER_ID = 5;               // Presents coalesced drag moves, once per display frame
+const int TIMER_SLOTS = DRAG_TIMER_ID + 1; // Timer ids index g_timerTasks
 
-// Application modes
-enum AppMode {
-    AUTOMATIC,
-    MANUAL
-};
+// Every byte the viewer holds, by GIF and by what it's for (Memory Usage in
+// the menu). Loader threads charge it too.
+MemoryLedger g_memory;
+MemoryAsset g_sceneMemory = g_memory.AddAsset("scene");  // Layers and the frame queue
 
-// Application states
-enum AppState {
-    STATE_MOVE,
-    STATE_WAIT,
-    STATE_SIT,
-    STATE_PICK,
-    STATE_MISC
+// GDI+ images come from GdiplusBase's allocator, whose operator delete a
+// plain delete picks up; spelled out so every owner frees them the same way
+struct ImageDeleter {
+    void operator()(Gdiplus::Image* image) const { delete image; }
 };
+typedef std::unique_ptr<Gdiplus::Image, ImageDeleter> ImagePtr;
 
 // Structure to store GIF information
 struct GifAnimation {
-    Gdiplus::Image* image;
+    ImagePtr image;
     UINT frameCount;
     UINT currentFrame;
     std::vector<UINT> frameDelays;
+    std::vector<RECT> frameChanges;  // Area that changes going into each frame (image coordinates)
     bool isPlaying;
-    std::unique_ptr<Gdiplus::Bitmap> backBuffer;
-
-    // Default constructor
-    GifAnimation() : image(nullptr), frameCount(0), currentFrame(0), isPlaying(false) {}
-
-    // Move constructor
-    GifAnimation(GifAnimation&& other) noexcept
-        : image(other.image),
-          frameCount(other.frameCount),
-          currentFrame(other.currentFrame),
-          frameDelays(std::move(other.frameDelays)),
-          isPlaying(other.isPlaying),
-          backBuffer(std::move(other.backBuffer)) {
-        other.image = nullptr;
-    }
-
-    // Move assignment operator
-    GifAnimation& operator=(GifAnimation&& other) noexcept {
-        if (this != &other) {
-            if (image) delete image;
-            image = other.image;
-            frameCount = other.frameCount;
-            currentFrame = other.currentFrame;
-            frameDelays = std::move(other.frameDelays);
-            isPlaying = other.isPlaying;
-            backBuffer = std::move(other.backBuffer);
-            other.image = nullptr;
-        }
-        return *this;
-    }
 
-    // Destructor
-    ~GifAnimation() {
-        if (image) {
-            delete image;
-            image = nullptr;
-        }
-    }
+    GifAnimation() : frameCount(0), currentFrame(0), isPlaying(false) {}
 };
 
 struct GifInfo {
     std::wstring filePath;
     GifType type;
+    int manifestIndex;     // Entry in g_character.Animations()
     GifAnimation animation;
-    bool flipped;
+    PlaybackStats timing;  // How the frame delays held up on screen
+    OwnedMemoryAsset memoryAsset;  // Its line in g_memory, added once it has loaded
 
-    // Default constructor
-    GifInfo() : type(MISC), flipped(false) {}
-
-    // Move constructor
-    GifInfo(GifInfo&& other) noexcept
-        : filePath(std::move(other.filePath)),
-          type(other.type),
-          animation(std::move(other.animation)),
-          flipped(other.flipped) {}
-
-    // Move assignment operator
-    GifInfo& operator=(GifInfo&& other) noexcept {
-        if (this != &other) {
-            filePath = std::move(other.filePath);
-            type = other.type;
-            animation = std::move(other.animation);
-            flipped = other.flipped;
-        }
-        return *this;
-    }
+    GifInfo() : type(MISC), manifestIndex(-1) {}
 };
 
 // Add new structures for frame queueing
@@ -135,33 +110,32 @@ struct FrameInfo {
     UINT frameIndex;
     UINT delay;
     bool flipped;
+    size_t gifIndex;  // Owner in g_gifs, for playback timing
 };
 
 // Global variables
 HWND g_hwnd = NULL;
 std::vector<GifInfo> g_gifs;
-size_t g_currentGifIndex = 0;
-AppMode g_appMode = AUTOMATIC;
-AppState g_appState = STATE_WAIT;
-AppState g_prevState = STATE_WAIT;
-bool g_isPickMode = false;
-bool g_moveDirectionRight = true;
+CharacterTable g_character;                 // States, animations and transitions of the loaded folder
+const size_t NO_GIF = static_cast<size_t>(-1);
 bool g_menuVisible = false;
 HWND g_importButton = NULL;
 HWND g_quitButton = NULL;
-int g_miscGifIndex = 0;
-std::mt19937 g_randomEngine(static_cast<unsigned int>(time(nullptr)));
+HWND g_timingButton = NULL;
+HWND g_memoryButton = NULL;
+SessionRecorder g_sessionRecorder;          // R starts and stops recording input
 HWND g_startupText = NULL;
 bool g_hasGifs = false;
 const int MENU_WIDTH = 300;  // Reduced size since we only have buttons
-const int MENU_HEIGHT = 150; // Reduced height
+const int MENU_HEIGHT = 260; // Room for four buttons
 const int BUTTON_WIDTH = 250;
 const int BUTTON_HEIGHT = 40;
 const int BUTTON_MARGIN = 20;
 const int TEXT_MARGIN = 30;
 
 // Add global variables for frame queueing
-std::vector<FrameInfo> g_frameQueue;
+std::vector<FrameInfo, TrackedAllocator<FrameInfo>> g_frameQueue(
+    TrackedAllocator<FrameInfo>(&g_memory, g_sceneMemory, MEMORY_PLAYBACK));
 size_t g_currentFrameIndex = 0;
 bool g_isQueueingFrames = false;
 
@@ -175,29 +149,318 @@ LARGE_INTEGER g_lastFrameTime;
 double g_frameTime = 0.0;
 
 // Add new global variables for frame management
-bool g_isRendering = false;
 Gdiplus::Image* g_currentRenderedFrame = nullptr;
 
 // Add at the top of the file with other global variables
 bool needsClear = true;
 
-// Add at the top with other global variables
-Gdiplus::Bitmap* g_topLayer = nullptr;
-Gdiplus::Bitmap* g_bottomLayer = nullptr;
+// An offscreen layer: a DIB section kept selected into its own memory DC
+// with a GDI+ Graphics on it, so painting a frame creates nothing
+struct RenderLayer {
+    HDC dc;
+    HBITMAP bitmap;
+    HGDIOBJ oldBitmap;
+    uint32_t* bits;  // Top-down 0xAARRGGBB, width pixels per row
+    Gdiplus::Graphics* graphics;
+    int width;
+    int height;
+};
+
+
+// What the last paint left on screen, so the next one only has to cover
+// what changed since
+bool g_hasShownFrame = false;
+size_t g_shownGif = 0;
+UINT g_shownFrame = 0;
+POINT g_shownPosition = {0, 0};
+
+#ifdef CHIBI_TRACK_ALLOCATIONS
+uint64_t g_allocatingFrames = 0;  // Steady-state paints that allocated or created GDI objects
+#endif
+
+// Shared scheduler, and the render thread's frame clock: every timer, frame
+// and delayed check is a task on it, and g_frameTimer is kept armed for the
+// earliest one
+Scheduler g_scheduler;
+TaskId g_timerTasks[TIMER_SLOTS] = {};  // Repeating timers by id, see StartTimer
+HANDLE g_frameTimer = NULL;
+
+// The render thread owns the simulation, the frame clock and presenting.
+// The UI thread owns the windows and only forwards what they receive, so a
+// modal dialog or a slow menu command never holds up the character.
+enum RenderCommandType {
+    CMD_KEY,               // value: virtual key
+    CMD_MOUSE_DOWN,        // point, time
+    CMD_MOUSE_MOVE,
+    CMD_MOUSE_UP,
+    CMD_REPAINT,           // The window lost what was on it
+    CMD_RESIZED,
+    CMD_DPI_CHANGED,       // value: new DPI
+    CMD_DISPLAY_CHANGED,
+    CMD_WORK_AREA_CHANGED,
+    CMD_SESSION_LOCK,      // value: 1 locked, 0 unlocked
+    CMD_DISPLAY_OFF,       // value: 1 off, 0 on
+    CMD_POWER_SOURCE,
+    CMD_MENU_SHOWN,
+    CMD_IMPORT,            // text: folder to load
+    CMD_TIMING_REPORT,     // Answered with WM_APP_TIMING_REPORT
+    CMD_MEMORY_REPORT,     // Answered with WM_APP_MEMORY_REPORT
+    CMD_QUIT
+};
+
+struct RenderCommand {
+    RenderCommandType type;
+    WPARAM value;
+    POINT point;        // Screen coordinates
+    DWORD time;         // GetMessageTime() of the input
+    double receivedMs;  // When the UI thread got it, for drag latency
+    wchar_t* text;      // malloc'ed by the UI thread, freed by the render thread
+};
+
+const size_t RENDER_COMMAND_CAPACITY = 256;
+SpscQueue<RenderCommand> g_renderCommands(RENDER_COMMAND_CAPACITY);
+HANDLE g_renderWake = NULL;    // Set after every command or loaded folder
+HANDLE g_renderThread = NULL;
+RECT g_dirtyRect = {0, 0, 0, 0};  // Scene area to present at the end of this pass (window coordinates)
+
+// Render thread to UI thread, posted to the main window and the menu
+const UINT WM_APP_SHOW_MENU = WM_APP + 1;      // Nothing to show at startup
+const UINT WM_APP_TIMING_REPORT = WM_APP + 2;  // lParam: TimingReport*, the receiver deletes it
+const UINT WM_APP_MEMORY_REPORT = WM_APP + 3;  // lParam: MemoryReport*, the receiver deletes it
+
+// Playback Timing window contents, gathered on the render thread for the
+// UI thread to show and save
+struct TimingReport {
+    std::wstring text;
+    std::vector<std::wstring> names;
+    std::vector<PlaybackStats> timing;
+};
+
+// Memory Usage window contents, the same way
+struct MemoryReport {
+    std::wstring text;
+    std::vector<MemoryAssetUsage> usage;
+};
+
+// A folder's GIFs, decoded by the task pool for the loader thread and handed
+// to the render thread through g_loadedFolders. Only the newest import gets
+// installed; starting another cancels the decoding that hasn't started yet.
+struct LoadedFolder {
+    std::wstring path;
+    uint64_t generation;
+    CharacterTable character;
+    std::vector<GifInfo> gifs;
+    TaskGroup tasks;
+};
+
+// One loader thread for the render thread's whole life. A thread per
+// import would register a new trace buffer with the profiler every time,
+// and those are never freed. Folders to load go over in g_loadRequests,
+// loaded ones come back in g_loadedFolders; the render thread is the only
+// other end of both.
+const size_t LOADED_FOLDER_CAPACITY = 16;
+SpscQueue<LoadedFolder*> g_loadRequests(LOADED_FOLDER_CAPACITY);
+SpscQueue<LoadedFolder*> g_loadedFolders(LOADED_FOLDER_CAPACITY);
+HANDLE g_loaderWake = NULL;              // Set after every request, and to stop
+HANDLE g_loaderThread = NULL;            // Null if it couldn't start; imports load in place then
+std::atomic<bool> g_loaderStop(false);
+uint64_t g_loadGeneration = 0;           // Bumped by every StartFolderLoad
+LoadedFolder* g_pendingLoad = nullptr;   // Newest load still in flight; only the render thread deletes it
+
+// Last rect we put the main window at, so moves never have to ask for it
+RECT g_windowRect = {100, 100, 300, 300};
+
+// Cached display metrics, refreshed on WM_DISPLAYCHANGE
+RECT g_virtualScreen = {0, 0, 0, 0};
+UINT g_frameInterval = 16;
+
+// Character position and size in screen coordinates, as the window was last
+// laid out for them (UpdateSceneBounds copies them from g_engine). The
+// window covers the whole scene (character plus furniture), so it can be
+// larger than this.
+POINT g_charPos = {100, 100};
+int g_charWidth = 200;
+int g_charHeight = 200;
+POINT g_sceneOrigin = {100, 100};
+size_t g_sceneFurniture = 0;  // Furniture pieces the window was laid out for
+
+// Furniture entities, composited into the main window below the character
+std::vector<Gdiplus::Image*> g_furnitureImages;  // Indexed like FURNITURE_TYPES, null if missing
+
+// Draw order inside the compositor, lowest first
+const int Z_FURNITURE = 0;
+const int Z_CHARACTER = 1;
+
+// Walkable surfaces (window tops and monitor floors), kept current by
+// window event hooks instead of polling EnumWindows
+SurfaceIndex g_surfaces;
+HWINEVENTHOOK g_objectEventHook = NULL;
+HWINEVENTHOOK g_locationEventHook = NULL;
+HWINEVENTHOOK g_minimizeEventHook = NULL;
+const int MIN_SURFACE_WIDTH = 64;     // Ignore slivers nobody could stand on
+const SurfaceKey MONITOR_SURFACE_KEY = 1ull << 63;  // Or'ed with the monitor number
+
+// The character itself: states, walking, dragging and throwing, furniture
+// and strolls. CharacterSimulation runs the same engine, so a recording
+// replays through the same code; the viewer only shows what it does.
+class ViewerCharacterHost : public CharacterHost {
+public:
+    void AnimationStarted(int animation, bool flipped) override;
+    void AnimationTurned(bool flipped) override;
+    void SceneMoved() override;
+    ScreenArea WalkArea(int x, int y) override;
+    ScreenArea ScreenBounds() override;
+    bool FurnitureSize(size_t type, int* width, int* height) override;
+    StateOptions Extras() override;
+};
+std::vector<CharacterAnimation> g_animations;  // Lines up with g_character.Animations()
+std::vector<size_t> g_animationGifs;           // Its GIF in g_gifs, NO_GIF if it didn't load
+ViewerCharacterHost g_engineHost;
+SurfaceIndex g_recordingSurfaces;              // The floor a recording walks on
+CharacterEngine g_engine(g_character, g_animations, g_surfaces, g_engineHost);
+TaskId g_engineTask = INVALID_TASK;            // Runs the engine's next deadline
+uint64_t g_engineDue = 0;
+bool g_engineOnGrid = false;
+
+// Coalesced drag. WM_MOUSEMOVE only feeds the engine; DRAG_TIMER_ID moves
+// the window at most once per display frame, together with the repaint.
+bool g_dragPending = false;
+DWORD g_lastDragPointTime = 0;
+POINT g_lastDragPoint = {0, 0};
+double g_dragInputTime = 0.0;  // Arrival of the oldest input not yet presented
+Histogram g_dragLatency;       // Input-to-move latency in microseconds
+
+// Rendering quality, stepped down when animation frames miss their
+// deadlines or we use too much CPU, and back up once things are quiet
+QualityGovernor g_governor;
+QualitySettings g_quality = QualityGovernor::SettingsFor(QUALITY_FULL);
+double g_governorWindowStart = 0.0;
+uint64_t g_governorCpuStart = 0;
+double g_frameDebt = 0.0;  // Lateness not yet made up by skipping frames (ms)
+UINT g_scheduledFrameDelay = MIN_FRAME_DELAY;  // What the pending tick was asked for, floors included (ms)
+
+// Animation and movement stop while nobody can see the character
+// (fullscreen app, locked session, display off, fully covered)
+VisibilityMonitor g_visibility;
+HWINEVENTHOOK g_foregroundEventHook = NULL;
+HPOWERNOTIFY g_displayNotify = NULL;
+TaskId g_visibilityTask = INVALID_TASK;
+bool g_animationSuspended = false;  // Restart ANIMATION_TIMER_ID when shown again
+const UINT VISIBILITY_CHECK_DELAY = 100;  // Coalesces bursts of window events (ms)
+
+// Integer upscaling. Scaled frames are made on first use and cached; the
+// cache drops the least recently used ones when it's full or memory runs low.
+int g_scaleFactor = 1;
+ScaleFilter g_scaleFilter = SCALE_EDGES;
+ScaledFrameCache g_scaledFrames;
+HANDLE g_lowMemoryNotify = NULL;
+bool g_scaledFrameMade = false;  // This paint had to scale a frame
+
+// The process is per-monitor DPI aware, so we scale for the monitor the
+// character is on ourselves instead of letting Windows stretch the window.
+// Percent is rounded to steps of 25, each with its own cached frames.
+UINT g_dpi = 96;
+int g_dpiPercent = 100;
+
+// Power saver: frame deadlines and the engine's go on a coarse scheduler
+// grid, so there is one wakeup per grid step at most
+PowerSetting g_powerSetting = POWER_AUTO;
+bool g_powerSaver = false;
+TaskId g_frameTask = INVALID_TASK;  // Next animation tick while in power saver
+
+// GUID_CONSOLE_DISPLAY_STATE, spelled out so no extra import library is needed
+const GUID CONSOLE_DISPLAY_STATE = { 0x6fe69556, 0x704a, 0x47a0, { 0x8f, 0x24, 0xc2, 0x8d, 0x93, 0x6f, 0xda, 0x47 } };
+
+struct SceneSprite {
+    Gdiplus::Image* image;
+    int x;
+    int y;
+    int width;
+    int height;
+    int z;
+    bool flipped;
+    const ScaledFrame* scaled;  // Blended straight into the layer instead of drawn with GDI+
+};
 
 // Function prototypes
 LRESULT CALLBACK WindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam);
-void RenderGif(HWND hwnd);
-bool LoadGifsFromFolder(const std::wstring& folderPath);
-void SwitchToNextGif();
-void UpdateAppState();
-void StartStateTimer();
-void MoveWindow();
+bool LoadGifFiles(const std::wstring& folderPath, CharacterTable* character, std::vector<GifInfo>* gifs,
+                  TaskGroup* tasks);
+bool ReadCharacterManifest(const std::wstring& folderPath, CharacterTable* character);
+float GifSpeed(size_t gifIndex);
+bool LoadGif(const std::wstring& filePath, GifInfo* gifInfo);
+void StartFolderLoad(const std::wstring& folderPath);
+DWORD WINAPI LoaderThreadMain(LPVOID);
+void StopLoaderThread();
+void RunLoadedFolders();
+bool InstallGifs(LoadedFolder* folder);
+RECT WorkAreaAt(int x, int y);
+void AnimationTick();
+void ScheduleNextFrame(UINT delay);
+void CancelNextFrame();
+void UpdatePowerMode();
 void ToggleMenu();
 void CreateButtons(HWND hwnd);
-GifType GetGifTypeFromFilename(const std::wstring& filename);
 void CleanupGifs();
-void QueueFramesFromGif(size_t gifIndex);
+void QueueFramesFromGif(size_t gifIndex, bool flipped);
+uint64_t NowMs();
+void ArmEngine();
+void ArmScheduler();
+void FeedEngine(SessionEventType type, uint64_t timeMs, int x, int y, uint32_t key);
+void UpdateSceneBounds(HWND hwnd);
+void SetScaleFactor(int factor);
+void SetDisplayDpi(UINT dpi);
+UINT WindowDpi(HWND hwnd);
+void LoadFurnitureFromFolder(const std::wstring& folderPath);
+void RebuildSurfaceIndex();
+double PreciseNowMs();
+void UpdateScreenMetrics();
+void RecordDragInput(POINT pt, DWORD time, double receivedMs);
+void PresentDragFrame();
+void ReportDragLatency();
+void ToggleTracing();
+uint64_t NewSessionSeed();
+uint64_t SessionSeedFromCommandLine(const char* commandLine);
+void ToggleSessionRecording();
+TimingReport* BuildTimingReport();
+void ShowPlaybackTiming(HWND owner, const TimingReport& report);
+MemoryReport* BuildMemoryReport();
+void ShowMemoryReport(HWND owner, const MemoryReport& report);
+std::string Utf8FromWide(const std::wstring& text);
+uint64_t ProcessCpuTime();
+void EvaluateQuality();
+void RequestVisibilityCheck();
+void UpdateVisibility();
+void SetHiddenReason(HiddenReason reason, bool active);
+void SuspendAnimation();
+void ResumeAnimation();
+bool CreateRenderLayer(RenderLayer* layer, int width, int height);
+void InvalidateChangedArea();
+void DestroyRenderLayer(RenderLayer* layer);
+void InstallSurfaceHooks();
+void RemoveSurfaceHooks();
+DWORD WINAPI RenderThreadMain(LPVOID);
+void SendRenderCommand(RenderCommand command);
+void SendRenderCommand(RenderCommandType type, WPARAM value = 0);
+bool RunRenderCommands();
+void HandleKey(WPARAM key);
+void HandleMouseDown(const RenderCommand& command);
+void HandleMouseUp(const RenderCommand& command);
+void PlaceMenu();
+void StartTimer(int id, UINT intervalMs);
+void StopTimer(int id);
+void OnTimer(int id);
+void InvalidateScene(const RECT* rect);
+void PresentScene();
+void PaintScene(HDC hdc, RECT dirty);
+
+// Layers PaintScene draws into, checked out for each frame and handed back
+// once it is on screen
+RenderSurfacePool<RenderLayer> g_renderSurfaces(
+    [](RenderLayer* layer, int width, int height, RenderSurfaceFormat) {
+        return CreateRenderLayer(layer, width, height);
+    },
+    DestroyRenderLayer);
 
 // Add new helper functions
 std::vector<UINT> LoadGifFrameInfo(Gdiplus::Image* image) {
@@ -229,40 +492,238 @@ std::vector<UINT> LoadGifFrameInfo(Gdiplus::Image* image) {
     return frameDelays;
 }
 
-void GenerateFrame(Gdiplus::Bitmap* bmp, Gdiplus::Image* gif) {
-    Gdiplus::Graphics dest(bmp);
+// (Re)create a layer at the given size. Everything it owns lives until the
+// next resize or DestroyRenderLayer, so frames can draw into it for free.
+bool CreateRenderLayer(RenderLayer* layer, int width, int height) {
+    DestroyRenderLayer(layer);
+    if (width <= 0 || height <= 0) return false;
+    
+    BITMAPINFO info = {};
+    info.bmiHeader.biSize = sizeof(BITMAPINFOHEADER);
+    info.bmiHeader.biWidth = width;
+    info.bmiHeader.biHeight = -height;  // Top-down
+    info.bmiHeader.biPlanes = 1;
+    info.bmiHeader.biBitCount = 32;
+    info.bmiHeader.biCompression = BI_RGB;
+    
+    void* bits = NULL;
+    layer->bitmap = CreateDIBSection(NULL, &info, DIB_RGB_COLORS, &bits, NULL, 0);
+    layer->dc = CreateCompatibleDC(NULL);
+    if (!layer->bitmap || !layer->dc) {
+        DestroyRenderLayer(layer);
+        return false;
+    }
+    
+    layer->oldBitmap = SelectObject(layer->dc, layer->bitmap);
+    layer->bits = (uint32_t*)bits;
+    layer->graphics = new Gdiplus::Graphics(layer->dc);
+    layer->width = width;
+    layer->height = height;
+    g_memory.Charge(g_sceneMemory, MEMORY_BUFFERS, (int64_t)width * height * sizeof(uint32_t));
+    return true;
+}
+
+void DestroyRenderLayer(RenderLayer* layer) {
+    if (layer->graphics) {
+        delete layer->graphics;
+    }
+    if (layer->dc) {
+        if (layer->oldBitmap) SelectObject(layer->dc, layer->oldBitmap);
+        DeleteDC(layer->dc);
+    }
+    if (layer->bitmap) {
+        DeleteObject(layer->bitmap);
+    }
+    g_memory.Charge(g_sceneMemory, MEMORY_BUFFERS, -(int64_t)(layer->width * layer->height * sizeof(uint32_t)));
+    *layer = RenderLayer();
+}
+
+// Per-monitor v2 where available (Windows 10 1703+), otherwise system DPI
+// aware. Looked up at runtime so older systems still start.
+void EnablePerMonitorDpi() {
+    typedef BOOL (WINAPI *SetContextFn)(HANDLE);
+    HMODULE user32 = GetModuleHandleW(L"user32.dll");
+    SetContextFn setContext = (SetContextFn)GetProcAddress(user32, "SetProcessDpiAwarenessContext");
+    const HANDLE PER_MONITOR_AWARE_V2 = (HANDLE)-4;
+    if (!setContext || !setContext(PER_MONITOR_AWARE_V2)) {
+        SetProcessDPIAware();
+    }
+}
+
+UINT WindowDpi(HWND hwnd) {
+    typedef UINT (WINAPI *GetDpiFn)(HWND);
+    static GetDpiFn getDpi = (GetDpiFn)GetProcAddress(GetModuleHandleW(L"user32.dll"), "GetDpiForWindow");
+    if (getDpi && hwnd) {
+        UINT dpi = getDpi(hwnd);
+        if (dpi != 0) return dpi;
+    }
+    
+    HDC screen = GetDC(NULL);
+    UINT dpi = (UINT)GetDeviceCaps(screen, LOGPIXELSX);
+    ReleaseDC(NULL, screen);
+    return dpi ? dpi : 96;
+}
+
+// 96 dpi is 100%; rounded to the nearest 25%
+int DpiPercent(UINT dpi) {
+    int percent = ((int)dpi * 100 + 48) / 96;
+    return std::max(25, (percent + 12) / 25 * 25);
+}
+
+// On-screen size of something imageSize pixels big in the GIF
+int CharacterSize(int imageSize) {
+    return imageSize * g_scaleFactor * g_dpiPercent / 100;
+}
+
+// Copy one GIF frame out as 0xAARRGGBB pixels, transparent = 0. canvas must
+// be a 32bpp ARGB bitmap the size of the image.
+bool ReadFramePixels(Gdiplus::Image* image, UINT frame, Gdiplus::Bitmap* canvas, uint32_t* pixels) {
+    int width = (int)canvas->GetWidth();
+    int height = (int)canvas->GetHeight();
+    
+    GUID timeDimension = Gdiplus::FrameDimensionTime;
+    image->SelectActiveFrame(&timeDimension, frame);
+    {
+        Gdiplus::Graphics graphics(canvas);
+        graphics.Clear(Gdiplus::Color(0, 0, 0, 0));
+        graphics.DrawImage(image, 0, 0, width, height);
+    }
+    
+    Gdiplus::Rect rect(0, 0, width, height);
+    Gdiplus::BitmapData data;
+    if (canvas->LockBits(&rect, Gdiplus::ImageLockModeRead, PixelFormat32bppARGB, &data) != Gdiplus::Ok) {
+        return false;
+    }
+    for (int y = 0; y < height; y++) {
+        memcpy(pixels + (size_t)y * width, (BYTE*)data.Scan0 + (size_t)y * data.Stride, width * sizeof(uint32_t));
+    }
+    canvas->UnlockBits(&data);
+    return true;
+}
+
+// The current frame at g_scaleFactor and g_dpiPercent, scaling and caching it on first use
+const ScaledFrame* GetScaledFrame(const FrameInfo& frame) {
+    // Keyed by the GIF's ledger asset, which the cache charges them to
+    MemoryAsset asset = g_gifs[frame.gifIndex].memoryAsset.Get();
+    const ScaledFrame* scaled = g_scaledFrames.Find(asset, frame.frameIndex,
+                                                    g_scaleFactor, g_scaleFilter, g_dpiPercent);
+    if (scaled) {
+        return scaled;
+    }
+    
+    // Give memory back before taking more if the system is running low
+    BOOL lowMemory = FALSE;
+    if (g_lowMemoryNotify && QueryMemoryResourceNotification(g_lowMemoryNotify, &lowMemory) && lowMemory) {
+        g_scaledFrames.Trim(g_scaledFrames.Bytes() / 4);
+    }
+    
+    int width = (int)frame.image->GetWidth();
+    int height = (int)frame.image->GetHeight();
+    size_t framePixels = (size_t)width * height;
+    Gdiplus::Bitmap canvas(width, height, PixelFormat32bppARGB);
+    GUID timeDimension = Gdiplus::FrameDimensionTime;
+    g_scaledFrameMade = true;
     
-    // Clear with black (transparent color)
-    Gdiplus::SolidBrush black(Gdiplus::Color::Black);
-    dest.FillRectangle(&black, 0, 0, bmp->GetWidth(), bmp->GetHeight());
+    // A display scale means resampling, which is too slow to do a frame at a
+    // time while playing, so do the whole GIF at once across all cores
+    if (g_dpiPercent != 100) {
+        UINT frameCount = frame.image->GetFrameCount(&timeDimension);
+        std::vector<uint32_t> frames(framePixels * frameCount);
+        for (UINT i = 0; i < frameCount; i++) {
+            if (!ReadFramePixels(frame.image, i, &canvas, frames.data() + i * framePixels)) {
+                return nullptr;
+            }
+        }
+        frame.image->SelectActiveFrame(&timeDimension, frame.frameIndex);
+        
+        g_scaledFrames.AddAll(asset, frameCount, g_scaleFactor, g_scaleFilter, g_dpiPercent,
+                              frames.data(), width, height);
+        return g_scaledFrames.Find(asset, frame.frameIndex, g_scaleFactor, g_scaleFilter, g_dpiPercent);
+    }
     
-    if (gif) {
-        // Draw the GIF
-        dest.DrawImage(gif, 0, 0);
+    std::vector<uint32_t> pixels(framePixels);
+    if (!ReadFramePixels(frame.image, frame.frameIndex, &canvas, pixels.data())) {
+        return nullptr;
     }
+    
+    // Reading back moved the GIF's active frame; put it back for GDI+ draws
+    frame.image->SelectActiveFrame(&timeDimension, frame.frameIndex);
+    
+    return g_scaledFrames.Add(asset, frame.frameIndex, g_scaleFactor, g_scaleFilter,
+                              g_dpiPercent, pixels.data(), width, height);
 }
 
-std::unique_ptr<Gdiplus::Bitmap> CreateBackBuffer(HWND hwnd) {
-    RECT r;
-    GetClientRect(hwnd, &r);
-    return std::make_unique<Gdiplus::Bitmap>(r.right - r.left, r.bottom - r.top);
+// Changed area of every step of the loop: entry i covers going from frame
+// i-1 to frame i, entry 0 wraps around from the last frame. Empty when the
+// frames can't be read back, which makes every frame a full repaint.
+std::vector<RECT> ComputeFrameChanges(Gdiplus::Image* image, UINT frameCount) {
+    std::vector<RECT> changes;
+    int width = (int)image->GetWidth();
+    int height = (int)image->GetHeight();
+    if (frameCount == 0 || width <= 0 || height <= 0) {
+        return changes;
+    }
+    
+    Gdiplus::Bitmap canvas(width, height, PixelFormat32bppARGB);
+    std::vector<uint32_t> previous((size_t)width * height);
+    std::vector<uint32_t> current((size_t)width * height);
+    
+    if (!ReadFramePixels(image, frameCount - 1, &canvas, previous.data())) {
+        return changes;
+    }
+    for (UINT i = 0; i < frameCount; i++) {
+        if (!ReadFramePixels(image, i, &canvas, current.data())) {
+            changes.clear();
+            break;
+        }
+        FrameRect diff = DiffBounds(previous.data(), current.data(), width, height);
+        RECT rect = { diff.left, diff.top, diff.right, diff.bottom };
+        changes.push_back(rect);
+        previous.swap(current);
+    }
+    
+    GUID timeDimension = Gdiplus::FrameDimensionTime;
+    image->SelectActiveFrame(&timeDimension, 0);
+    return changes;
 }
 
 // Modify MenuWindowProc to create opaque grey buttons
+// Place the menu buttons and make their font for a monitor DPI. *font is
+// replaced; the old one is deleted once the buttons have let go of it.
+void LayoutMenu(UINT dpi, HFONT* font) {
+    int width = MulDiv(BUTTON_WIDTH, dpi, 96);
+    int height = MulDiv(BUTTON_HEIGHT, dpi, 96);
+    int margin = MulDiv(BUTTON_MARGIN, dpi, 96);
+    int left = (MulDiv(MENU_WIDTH, dpi, 96) - width) / 2;
+    
+    HFONT oldFont = *font;
+    *font = CreateFontW(
+        MulDiv(18, dpi, 96), 0, 0, 0, FW_NORMAL, FALSE, FALSE, FALSE,
+        DEFAULT_CHARSET, OUT_DEFAULT_PRECIS, CLIP_DEFAULT_PRECIS,
+        DEFAULT_QUALITY, DEFAULT_PITCH | FF_DONTCARE, L"Segoe UI"
+    );
+    
+    HWND buttons[] = { g_importButton, g_timingButton, g_memoryButton, g_quitButton };
+    for (int i = 0; i < 4; i++) {
+        SetWindowPos(buttons[i], NULL, left, margin * (i + 1) + height * i, width, height,
+                    SWP_NOZORDER | SWP_NOACTIVATE);
+        SendMessage(buttons[i], WM_SETFONT, (WPARAM)*font, TRUE);
+    }
+    
+    if (oldFont) {
+        DeleteObject(oldFont);
+    }
+}
+
 LRESULT CALLBACK MenuWindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam) {
     static HFONT hFont = NULL;  // Make font static to avoid case label jump
+    static HBRUSH buttonBrush = NULL;
+    static HBRUSH pressedBrush = NULL;
+    static HBRUSH backgroundBrush = NULL;
+    static HPEN borderPen = NULL;
     
     switch (uMsg) {
         case WM_CREATE:
-            // Create font if not already created
-            if (hFont == NULL) {
-                hFont = CreateFontW(
-                    18, 0, 0, 0, FW_NORMAL, FALSE, FALSE, FALSE,
-                    DEFAULT_CHARSET, OUT_DEFAULT_PRECIS, CLIP_DEFAULT_PRECIS,
-                    DEFAULT_QUALITY, DEFAULT_PITCH | FF_DONTCARE, L"Segoe UI"
-                );
-            }
-            
             // Create buttons in the menu window with solid colors
             g_importButton = CreateWindowW(
                 L"BUTTON", L"Select GIF Folder",
@@ -273,21 +734,46 @@ LRESULT CALLBACK MenuWindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lPar
                 hwnd, NULL, GetModuleHandle(NULL), NULL
             );
             
+            g_timingButton = CreateWindowW(
+                L"BUTTON", L"Playback Timing",
+                WS_CHILD | BS_PUSHBUTTON | BS_CENTER | BS_VCENTER | BS_OWNERDRAW,
+                (MENU_WIDTH - BUTTON_WIDTH) / 2, 
+                BUTTON_MARGIN * 2 + BUTTON_HEIGHT,
+                BUTTON_WIDTH, BUTTON_HEIGHT,
+                hwnd, NULL, GetModuleHandle(NULL), NULL
+            );
+            
+            g_memoryButton = CreateWindowW(
+                L"BUTTON", L"Memory Usage",
+                WS_CHILD | BS_PUSHBUTTON | BS_CENTER | BS_VCENTER | BS_OWNERDRAW,
+                (MENU_WIDTH - BUTTON_WIDTH) / 2, 
+                BUTTON_MARGIN * 3 + BUTTON_HEIGHT * 2,
+                BUTTON_WIDTH, BUTTON_HEIGHT,
+                hwnd, NULL, GetModuleHandle(NULL), NULL
+            );
+            
             g_quitButton = CreateWindowW(
                 L"BUTTON", L"Exit Program",
                 WS_CHILD | BS_PUSHBUTTON | BS_CENTER | BS_VCENTER | BS_OWNERDRAW,
                 (MENU_WIDTH - BUTTON_WIDTH) / 2, 
-                BUTTON_MARGIN * 2 + BUTTON_HEIGHT,
+                BUTTON_MARGIN * 4 + BUTTON_HEIGHT * 3,
                 BUTTON_WIDTH, BUTTON_HEIGHT,
                 hwnd, NULL, GetModuleHandle(NULL), NULL
             );
             
-            // Set font for all controls
-            SendMessage(g_importButton, WM_SETFONT, (WPARAM)hFont, TRUE);
-            SendMessage(g_quitButton, WM_SETFONT, (WPARAM)hFont, TRUE);
+            // Everything the buttons and background are drawn with, made once
+            buttonBrush = CreateSolidBrush(RGB(220, 220, 220));   // Light grey normal state
+            pressedBrush = CreateSolidBrush(RGB(180, 180, 180));  // Darker grey when pressed
+            backgroundBrush = CreateSolidBrush(RGB(240, 240, 240));
+            borderPen = CreatePen(PS_SOLID, 1, RGB(200, 200, 200));
+            
+            // Size the buttons and font for this monitor
+            LayoutMenu(WindowDpi(hwnd), &hFont);
             
             // Show buttons
             ShowWindow(g_importButton, SW_SHOW);
+            ShowWindow(g_timingButton, SW_SHOW);
+            ShowWindow(g_memoryButton, SW_SHOW);
             ShowWindow(g_quitButton, SW_SHOW);
             return 0;
             
@@ -295,26 +781,16 @@ LRESULT CALLBACK MenuWindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lPar
             if (wParam == 0 || wParam == 1) {  // Button IDs
                 LPDRAWITEMSTRUCT lpDrawItem = (LPDRAWITEMSTRUCT)lParam;
                 
-                // Set button colors
-                HBRUSH hBrush;
-                if (lpDrawItem->itemState & ODS_SELECTED) {
-                    hBrush = CreateSolidBrush(RGB(180, 180, 180));  // Darker grey when pressed
-                } else {
-                    hBrush = CreateSolidBrush(RGB(220, 220, 220));  // Light grey normal state
-                }
-                
                 // Fill button background
+                HBRUSH hBrush = (lpDrawItem->itemState & ODS_SELECTED) ? pressedBrush : buttonBrush;
                 FillRect(lpDrawItem->hDC, &lpDrawItem->rcItem, hBrush);
-                DeleteObject(hBrush);
                 
                 // Draw button border
-                HPEN hPen = CreatePen(PS_SOLID, 1, RGB(200, 200, 200));
-                HPEN hOldPen = (HPEN)SelectObject(lpDrawItem->hDC, hPen);
+                HPEN hOldPen = (HPEN)SelectObject(lpDrawItem->hDC, borderPen);
                 Rectangle(lpDrawItem->hDC, 
                          lpDrawItem->rcItem.left, lpDrawItem->rcItem.top,
                          lpDrawItem->rcItem.right, lpDrawItem->rcItem.bottom);
                 SelectObject(lpDrawItem->hDC, hOldPen);
-                DeleteObject(hPen);
                 
                 // Draw button text
                 SetBkMode(lpDrawItem->hDC, TRANSPARENT);
@@ -337,42 +813,54 @@ LRESULT CALLBACK MenuWindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lPar
             }
             return DefWindowProc(hwnd, uMsg, wParam, lParam);
             
+        case WM_DPICHANGED: {
+            RECT* suggested = (RECT*)lParam;
+            SetWindowPos(hwnd, NULL, suggested->left, suggested->top,
+                        suggested->right - suggested->left, suggested->bottom - suggested->top,
+                        SWP_NOZORDER | SWP_NOACTIVATE);
+            LayoutMenu(LOWORD(wParam), &hFont);
+            return 0;
+        }
+            
         case WM_DESTROY:
-            // Clean up font
+            // Clean up font, brushes and pen
             if (hFont != NULL) {
                 DeleteObject(hFont);
                 hFont = NULL;
             }
+            DeleteObject(buttonBrush);
+            DeleteObject(pressedBrush);
+            DeleteObject(backgroundBrush);
+            DeleteObject(borderPen);
+            buttonBrush = pressedBrush = backgroundBrush = NULL;
+            borderPen = NULL;
             return 0;
             
         case WM_COMMAND:
             if (HIWORD(wParam) == BN_CLICKED) {
                 if ((HWND)lParam == g_quitButton) {
                     DestroyWindow(g_hwnd);  // Close main window
+                } else if ((HWND)lParam == g_timingButton) {
+                    // Shown when the render thread sends back WM_APP_TIMING_REPORT
+                    SendRenderCommand(CMD_TIMING_REPORT);
+                } else if ((HWND)lParam == g_memoryButton) {
+                    // Shown when the render thread sends back WM_APP_MEMORY_REPORT
+                    SendRenderCommand(CMD_MEMORY_REPORT);
                 } else if ((HWND)lParam == g_importButton) {
                     BROWSEINFOW bi = {0};
                     bi.hwndOwner = hwnd;
                     bi.lpszTitle = L"Select Folder with GIF Files";
                     bi.ulFlags = BIF_RETURNONLYFSDIRS | BIF_NEWDIALOGSTYLE;
                     
+                    // Modal, but only for this thread; the character keeps going
                     LPITEMIDLIST pidl = SHBrowseForFolderW(&bi);
                     if (pidl != NULL) {
                         wchar_t folderPath[MAX_PATH] = {0};
                         if (SHGetPathFromIDListW(pidl, folderPath)) {
-                            // Clean up existing GIFs
-                            CleanupGifs();
-                            
-                            // Load new GIFs
-                            if (LoadGifsFromFolder(folderPath)) {
-                                // Reset to initial state
-                                g_currentGifIndex = 0;
-                                g_appState = STATE_WAIT;
-                                InvalidateRect(g_hwnd, NULL, TRUE);
-                                
-                                if (g_appMode == AUTOMATIC) {
-                                    StartStateTimer();
-                                }
-                            }
+                            RenderCommand command = {};
+                            command.type = CMD_IMPORT;
+                            command.text = _wcsdup(folderPath);
+                            SendRenderCommand(command);
                         }
                         CoTaskMemFree(pidl);
                     }
@@ -381,6 +869,20 @@ LRESULT CALLBACK MenuWindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lPar
             }
             return 0;
             
+        case WM_APP_TIMING_REPORT: {
+            TimingReport* report = (TimingReport*)lParam;
+            ShowPlaybackTiming(hwnd, *report);
+            delete report;
+            return 0;
+        }
+            
+        case WM_APP_MEMORY_REPORT: {
+            MemoryReport* report = (MemoryReport*)lParam;
+            ShowMemoryReport(hwnd, *report);
+            delete report;
+            return 0;
+        }
+            
         case WM_PAINT: {
             PAINTSTRUCT ps;
             HDC hdc = BeginPaint(hwnd, &ps);
@@ -388,9 +890,7 @@ LRESULT CALLBACK MenuWindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lPar
             // Draw menu background (transparent)
             RECT clientRect;
             GetClientRect(hwnd, &clientRect);
-            HBRUSH menuBrush = CreateSolidBrush(RGB(240, 240, 240));
-            FillRect(hdc, &clientRect, menuBrush);
-            DeleteObject(menuBrush);
+            FillRect(hdc, &clientRect, backgroundBrush);
             
             EndPaint(hwnd, &ps);
             return 0;
@@ -408,11 +908,124 @@ std::wstring GetProgramDirectory() {
     return std::wstring(path);
 }
 
+// Milliseconds on the performance counter clock, used by g_scheduler
+uint64_t NowMs() {
+    LARGE_INTEGER now;
+    QueryPerformanceCounter(&now);
+    return static_cast<uint64_t>(now.QuadPart * 1000 / g_performanceFrequency.QuadPart);
+}
+
+// Sub-millisecond time for pointer samples and physics
+double PreciseNowMs() {
+    LARGE_INTEGER now;
+    QueryPerformanceCounter(&now);
+    return now.QuadPart * 1000.0 / g_performanceFrequency.QuadPart;
+}
+
+// Keep one task on g_scheduler for the engine's next deadline. The engine
+// runs each of its tasks at its own deadline however late this wakes up,
+// so the power saver grid changes when things are shown, not what happens.
+// Held or flying, the character stays off the grid.
+void ArmEngine() {
+    bool pending = g_engine.HasPending();
+    uint64_t due = pending ? g_engine.NextDeadline() : 0;
+    bool onGrid = !g_engine.Held() && !g_engine.Thrown();
+    if (pending && g_engineTask != INVALID_TASK && due == g_engineDue && onGrid == g_engineOnGrid) {
+        return;
+    }
+    
+    g_scheduler.Cancel(g_engineTask);
+    g_engineTask = INVALID_TASK;
+    if (!pending) return;
+    g_engineDue = due;
+    g_engineOnGrid = onGrid;
+    g_engineTask = g_scheduler.ScheduleAt(due, []() {
+        g_engineTask = INVALID_TASK;
+        g_engine.RunDue(NowMs());
+    }, onGrid);
+}
+
+// Keep g_frameTimer armed for the earliest pending task, the engine's
+// included. The render loop calls this before every wait.
+void ArmScheduler() {
+    ArmEngine();
+    if (!g_scheduler.HasPending()) {
+        CancelWaitableTimer(g_frameTimer);
+        return;
+    }
+    
+    // Relative due times are negative, in 100 ns units
+    uint64_t now = NowMs();
+    uint64_t due = g_scheduler.NextDeadline();
+    LARGE_INTEGER dueTime;
+    dueTime.QuadPart = due > now ? -(LONGLONG)(due - now) * 10000 : -1;
+    
+#if _WIN32_WINNT >= 0x0601
+    // In power saver, also let Windows line us up with other programs' timers
+    // (not while the character is held or flying)
+    ULONG tolerance = (g_powerSaver && !g_engine.Held() && !g_engine.Thrown()) ? POWER_SAVER_GRID_MS / 5 : 0;
+    SetWaitableTimerEx(g_frameTimer, &dueTime, 0, NULL, NULL, NULL, tolerance);
+#else
+    SetWaitableTimer(g_frameTimer, &dueTime, 0, NULL, NULL, FALSE);
+#endif
+}
+
+// Repeating timers, like SetTimer gave us when everything ran on the UI
+// thread. The task re-arms itself before running the handler, so the
+// handler can stop or restart it. Dragging stays off the power saver grid.
+void StartTimer(int id, UINT intervalMs) {
+    StopTimer(id);
+    bool onGrid = id != DRAG_TIMER_ID;
+    g_timerTasks[id] = g_scheduler.ScheduleAt(NowMs() + intervalMs, [id, intervalMs]() {
+        g_timerTasks[id] = INVALID_TASK;
+        StartTimer(id, intervalMs);
+        OnTimer(id);
+    }, onGrid);
+}
+
+void StopTimer(int id) {
+    if (g_timerTasks[id] != INVALID_TASK) {
+        g_scheduler.Cancel(g_timerTasks[id]);
+        g_timerTasks[id] = INVALID_TASK;
+    }
+}
+
+void OnTimer(int id) {
+    if (id == DRAG_TIMER_ID) {
+        PresentDragFrame();
+    } else if (id == ANIMATION_TIMER_ID) {
+        AnimationTick();
+    }
+}
+
 // Main entry point
 int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine, int nCmdShow) {
+    // Before any window exists, so Windows never bitmap-stretches ours
+    EnablePerMonitorDpi();
+    
     // Initialize performance counter
     QueryPerformanceFrequency(&g_performanceFrequency);
     QueryPerformanceCounter(&g_lastFrameTime);
+    SetTraceThreadName("UI");
+    
+    // The render thread's wakeups: commands from this thread, and its
+    // frame clock (high resolution where Windows has it, so 1-2 ms frame
+    // deadlines aren't rounded up to the 15.6 ms tick)
+    g_renderWake = CreateEventW(NULL, FALSE, FALSE, NULL);
+    g_loaderWake = CreateEventW(NULL, FALSE, FALSE, NULL);
+    g_frameTimer = CreateWaitableTimerExW(NULL, NULL, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS);
+    if (!g_frameTimer) {
+        g_frameTimer = CreateWaitableTimerW(NULL, FALSE, NULL);
+    }
+    g_governorWindowStart = PreciseNowMs();
+    g_governorCpuStart = ProcessCpuTime();
+    
+    // --seed N repeats the random choices of an earlier run
+    g_engine.Seed(SessionSeedFromCommandLine(lpCmdLine));
+    char seedText[64];
+    snprintf(seedText, sizeof(seedText), "Session seed %llu\n", (unsigned long long)g_engine.SessionSeed());
+    OutputDebugStringA(seedText);
+    g_visibility.Start(PreciseNowMs());
     
     // Initialize GDI+
     Gdiplus::GdiplusStartupInput gdiplusStartupInput;
@@ -452,6 +1065,8 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine
     if (g_hwnd == NULL) {
         return 0;
     }
+    g_dpi = WindowDpi(g_hwnd);
+    g_dpiPercent = DpiPercent(g_dpi);
 
     // Create the menu window
     g_menuHwnd = CreateWindowExW(
@@ -475,16 +1090,20 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine
     // Show the windows
     ShowWindow(g_hwnd, nCmdShow);
     ShowWindow(g_menuHwnd, SW_HIDE);  // Menu starts hidden
+    
+    // Hear about locking and the display going off
+    WTSRegisterSessionNotification(g_hwnd, NOTIFY_FOR_THIS_SESSION);
+    g_displayNotify = RegisterPowerSettingNotification(g_hwnd, &CONSOLE_DISPLAY_STATE,
+                                                       DEVICE_NOTIFY_WINDOW_HANDLE);
+    
+    // Lets the scaled frame cache shrink when the system runs low on memory
+    g_lowMemoryNotify = CreateMemoryResourceNotification(LowMemoryResourceNotification);
+    g_scaledFrames.SetLedger(&g_memory);
 
-    // Try to load GIFs from program directory first
-    std::wstring programDir = GetProgramDirectory();
-    if (!LoadGifsFromFolder(programDir)) {
-        // If no GIFs found in program directory, show menu
-        ToggleMenu();
-    } else {
-        // If GIFs were loaded, start with automatic mode
-        g_appMode = AUTOMATIC;
-        StartStateTimer();
+    // Everything else happens on the render thread, which loads the GIFs
+    g_renderThread = CreateThread(NULL, 0, RenderThreadMain, NULL, 0, NULL);
+    if (g_renderThread == NULL) {
+        DestroyWindow(g_hwnd);
     }
 
     // Main message loop
@@ -494,8 +1113,19 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine
         DispatchMessage(&msg);
     }
 
-    // Cleanup
-    CleanupGifs();
+    // Cleanup (the render thread has already let go of the GIFs)
+    if (g_displayNotify) {
+        UnregisterPowerSettingNotification(g_displayNotify);
+    }
+    if (g_lowMemoryNotify) {
+        CloseHandle(g_lowMemoryNotify);
+    }
+    if (g_renderThread) {
+        CloseHandle(g_renderThread);
+    }
+    CloseHandle(g_frameTimer);
+    CloseHandle(g_renderWake);
+    CloseHandle(g_loaderWake);
     
     // Shutdown GDI+
     Gdiplus::GdiplusShutdown(gdiplusToken);
@@ -503,329 +1133,786 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine
     return 0;
 }
 
-// Window procedure
+// Window procedure. Runs on the UI thread and only passes things on to the
+// render thread, which owns everything the character does.
 LRESULT CALLBACK WindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam) {
     switch (uMsg) {
         case WM_DESTROY:
-            PostQuitMessage(0);
-            return 0;
-
-        case WM_TIMER:
-            if (wParam == TIMER_ID) {
-                if (g_appState == STATE_MOVE) {
-                    MoveWindow();
-                } else {
-                    UpdateAppState();
-                }
-            } else if (wParam == ANIMATION_TIMER_ID && !g_frameQueue.empty()) {
-                // Calculate frame time
-                LARGE_INTEGER currentTime;
-                QueryPerformanceCounter(&currentTime);
-                double deltaTime = (currentTime.QuadPart - g_lastFrameTime.QuadPart) * 1000.0 / g_performanceFrequency.QuadPart;
-                g_lastFrameTime = currentTime;
-                
-                // Move to next frame in queue
-                g_currentFrameIndex = (g_currentFrameIndex + 1) % g_frameQueue.size();
-                
-                // Set timer for next frame
-                UINT nextDelay = std::max(g_frameQueue[g_currentFrameIndex].delay, MIN_FRAME_DELAY);
-                SetTimer(hwnd, ANIMATION_TIMER_ID, nextDelay, NULL);
-                
-                // Force redraw
-                InvalidateRect(hwnd, NULL, TRUE);
+            // The render thread cleans up after itself before it exits
+            SendRenderCommand(CMD_QUIT);
+            if (g_renderThread) {
+                WaitForSingleObject(g_renderThread, INFINITE);
             }
+            WTSUnRegisterSessionNotification(hwnd);
+            PostQuitMessage(0);
             return 0;
-
+        
         case WM_PAINT: {
-            if (g_isRendering) return 0;  // Prevent re-entrant rendering
-            g_isRendering = true;
-            
+            // Validate here; the render thread draws the whole scene again
             PAINTSTRUCT ps;
-            HDC hdc = BeginPaint(hwnd, &ps);
-            
-            // Only clear if necessary (when switching GIFs or states)
-            if (needsClear) {
-                RECT clientRect;
-                GetClientRect(hwnd, &clientRect);
-                HBRUSH hBrush = CreateSolidBrush(RGB(0, 0, 0));
-                FillRect(hdc, &clientRect, hBrush);
-                DeleteObject(hBrush);
-                needsClear = false;
-                
-                // Initialize layers if needed
-                if (!g_topLayer || !g_bottomLayer) {
-                    if (g_topLayer) delete g_topLayer;
-                    if (g_bottomLayer) delete g_bottomLayer;
-                    
-                    RECT rect;
-                    GetClientRect(hwnd, &rect);
-                    g_topLayer = new Gdiplus::Bitmap(rect.right, rect.bottom);
-                    g_bottomLayer = new Gdiplus::Bitmap(rect.right, rect.bottom);
-                }
-            }
-            
-            // Draw the current frame from the queue
-            if (!g_frameQueue.empty() && g_currentFrameIndex < g_frameQueue.size()) {
-                FrameInfo& frame = g_frameQueue[g_currentFrameIndex];
-                
-                // Select the correct frame
-                GUID timeDimension = Gdiplus::FrameDimensionTime;
-                frame.image->SelectActiveFrame(&timeDimension, frame.frameIndex);
-                
-                // Draw new frame to top layer
-                Gdiplus::Graphics topGraphics(g_topLayer);
-                topGraphics.Clear(Gdiplus::Color::Black);
-                topGraphics.SetInterpolationMode(Gdiplus::InterpolationModeHighQuality);
-                topGraphics.SetSmoothingMode(Gdiplus::SmoothingModeHighQuality);
-                
-                // Get image dimensions
-                int width = frame.image->GetWidth();
-                int height = frame.image->GetHeight();
-                
-                // Apply horizontal flip if needed
-                if (frame.flipped) {
-                    // Create a temporary bitmap for the flipped image
-                    Gdiplus::Bitmap flippedBitmap(width, height);
-                    Gdiplus::Graphics flippedGraphics(&flippedBitmap);
-                    
-                    // Draw the original image to the temporary bitmap
-                    flippedGraphics.DrawImage(frame.image, 0, 0, width, height);
-                    
-                    // Draw the flipped image to the top layer
-                    topGraphics.DrawImage(&flippedBitmap, 0, 0, width, height);
-                } else {
-                    // Draw the original image
-                    topGraphics.DrawImage(frame.image, 0, 0, width, height);
-                }
-                
-                // Draw to screen
-                Gdiplus::Graphics screenGraphics(hdc);
-                screenGraphics.DrawImage(g_bottomLayer, 0, 0);
-                screenGraphics.DrawImage(g_topLayer, 0, 0);
-                
-                // Move top layer to bottom layer for next frame
-                Gdiplus::Graphics bottomGraphics(g_bottomLayer);
-                bottomGraphics.Clear(Gdiplus::Color::Black);
-                bottomGraphics.DrawImage(g_topLayer, 0, 0);
-            }
-            
+            BeginPaint(hwnd, &ps);
             EndPaint(hwnd, &ps);
-            g_isRendering = false;
+            SendRenderCommand(CMD_REPAINT);
             return 0;
         }
-
-        case WM_SIZE: {
-            // Recreate back buffers for all GIFs
-            for (auto& gif : g_gifs) {
-                gif.animation.backBuffer = CreateBackBuffer(hwnd);
-                GenerateFrame(gif.animation.backBuffer.get(), gif.animation.image);
+        
+        case WM_DPICHANGED:
+            // The suggested rect assumes the window is just the character;
+            // it spans the whole scene, so size it ourselves
+            SendRenderCommand(CMD_DPI_CHANGED, LOWORD(wParam));
+            return 0;
+        
+        case WM_DISPLAYCHANGE:
+            SendRenderCommand(CMD_DISPLAY_CHANGED);
+            return 0;
+        
+        case WM_WTSSESSION_CHANGE:
+            if (wParam == WTS_SESSION_LOCK) {
+                SendRenderCommand(CMD_SESSION_LOCK, 1);
+            } else if (wParam == WTS_SESSION_UNLOCK) {
+                SendRenderCommand(CMD_SESSION_LOCK, 0);
             }
-            InvalidateRect(hwnd, NULL, TRUE);
             return 0;
-        }
-
+        
+        case WM_POWERBROADCAST:
+            if (wParam == PBT_POWERSETTINGCHANGE) {
+                POWERBROADCAST_SETTING* setting = (POWERBROADCAST_SETTING*)lParam;
+                if (setting->PowerSetting == CONSOLE_DISPLAY_STATE && setting->DataLength >= 1) {
+                    // 0 = off, 1 = on, 2 = dimmed (still visible)
+                    SendRenderCommand(CMD_DISPLAY_OFF, setting->Data[0] == 0);
+                }
+                return TRUE;
+            }
+            if (wParam == PBT_APMPOWERSTATUSCHANGE) {
+                // Plugged in or unplugged
+                SendRenderCommand(CMD_POWER_SOURCE);
+                return TRUE;
+            }
+            break;
+        
+        case WM_SETTINGCHANGE:
+            if (wParam == SPI_SETWORKAREA) {
+                SendRenderCommand(CMD_WORK_AREA_CHANGED);
+            }
+            return 0;
+        
+        case WM_SIZE:
+            SendRenderCommand(CMD_RESIZED);
+            return 0;
+        
         case WM_KEYDOWN:
-            switch (wParam) {
-                case 'M':
-                    ToggleMenu();
-                    break;
-                    
-                case 'A':
-                    g_appMode = (g_appMode == AUTOMATIC) ? MANUAL : AUTOMATIC;
-                    if (g_appMode == AUTOMATIC) {
-                        StartStateTimer();
-                    } else {
-                        KillTimer(hwnd, TIMER_ID);
-                    }
-                    break;
-                    
-                case VK_SPACE:
-                    if (g_appMode == MANUAL && !g_gifs.empty()) {
-                        SwitchToNextGif();
-                        InvalidateRect(hwnd, NULL, TRUE);
-                    }
-                    break;
+            // The menu is a window, so it stays on this thread
+            if (wParam == 'M') {
+                ToggleMenu();
+            } else {
+                SendRenderCommand(CMD_KEY, wParam);
             }
             return 0;
-            
-        case WM_MOUSEMOVE:
-            if (g_isPickMode) {
-                // Move the window with the mouse
-                POINT pt;
-                pt.x = GET_X_LPARAM(lParam);
-                pt.y = GET_Y_LPARAM(lParam);
-                ClientToScreen(hwnd, &pt);
-                
-                RECT windowRect;
-                GetWindowRect(hwnd, &windowRect);
-                int width = windowRect.right - windowRect.left;
-                int height = windowRect.bottom - windowRect.top;
-                
-                // Ensure the window stays within screen bounds
-                int screenWidth = GetSystemMetrics(SM_CXSCREEN);
-                int screenHeight = GetSystemMetrics(SM_CYSCREEN);
-                
-                // Calculate new position
-                int newX = pt.x - width / 2;
-                int newY = pt.y - height / 2;
-                
-                // Clamp to screen bounds
-                newX = std::max(0, std::min(newX, screenWidth - width));
-                newY = std::max(0, std::min(newY, screenHeight - height));
-                
-                SetWindowPos(hwnd, NULL, newX, newY, 0, 0, SWP_NOSIZE | SWP_NOZORDER);
+        
+        case WM_APP_SHOW_MENU:
+            if (!g_menuVisible) {
+                ToggleMenu();
             }
             return 0;
-            
+        
+        case WM_MOUSEMOVE:
         case WM_LBUTTONDOWN:
-            if (!g_gifs.empty()) {
-                g_prevState = g_appState;
-                g_isPickMode = true;
-                g_appState = STATE_PICK;
-                
-                // Queue frames from the PICK GIF
-                for (size_t i = 0; i < g_gifs.size(); i++) {
-                    if (g_gifs[i].type == PICK) {
-                        // Clear existing queue
-                        g_frameQueue.clear();
-                        g_currentFrameIndex = 0;
-                        
-                        // Queue frames from the PICK GIF
-                        QueueFramesFromGif(i);
-                        
-                        // Start animation timer
-                        if (!g_frameQueue.empty()) {
-                            SetTimer(hwnd, ANIMATION_TIMER_ID, g_frameQueue[0].delay, NULL);
-                        }
-                        break;
-                    }
-                }
-                
-                InvalidateRect(hwnd, NULL, TRUE);
+        case WM_LBUTTONUP: {
+            // Capture on every press; the render thread decides whether
+            // anything was picked up and ignores the rest
+            if (uMsg == WM_LBUTTONDOWN) {
                 SetCapture(hwnd);
+            } else if (GetCapture() != hwnd) {
+                return 0;
             }
-            return 0;
             
-        case WM_LBUTTONUP:
-            if (g_isPickMode) {
-                g_isPickMode = false;
-                g_appState = g_prevState;
-                
-                // Queue frames from the previous state GIF
-                size_t newGifIndex = g_currentGifIndex;
-                bool foundGif = false;
-                
-                GifType targetType;
-                switch (g_prevState) {
-                    case STATE_MOVE: targetType = MOVE; break;
-                    case STATE_WAIT: targetType = WAIT; break;
-                    case STATE_SIT: targetType = SIT; break;
-                    default: targetType = MISC; break;
-                }
-                
-                for (size_t i = 0; i < g_gifs.size(); i++) {
-                    if (g_gifs[i].type == targetType) {
-                        newGifIndex = i;
-                        foundGif = true;
-                        break;
-                    }
-                }
-                
-                if (foundGif && newGifIndex < g_gifs.size()) {
-                    // Clear existing queue
-                    g_frameQueue.clear();
-                    g_currentFrameIndex = 0;
-                    
-                    // Queue frames from the new GIF
-                    QueueFramesFromGif(newGifIndex);
-                    
-                    // Start animation timer
-                    if (!g_frameQueue.empty()) {
-                        SetTimer(hwnd, ANIMATION_TIMER_ID, g_frameQueue[0].delay, NULL);
-                    }
-                }
-                
-                InvalidateRect(hwnd, NULL, TRUE);
+            RenderCommand command = {};
+            command.type = uMsg == WM_LBUTTONDOWN ? CMD_MOUSE_DOWN :
+                           uMsg == WM_LBUTTONUP ? CMD_MOUSE_UP : CMD_MOUSE_MOVE;
+            command.point.x = GET_X_LPARAM(lParam);
+            command.point.y = GET_Y_LPARAM(lParam);
+            ClientToScreen(hwnd, &command.point);
+            command.time = GetMessageTime();
+            SendRenderCommand(command);
+            
+            if (uMsg == WM_LBUTTONUP) {
                 ReleaseCapture();
-                
-                if (g_appMode == AUTOMATIC) {
-                    StartStateTimer();
-                }
             }
             return 0;
+        }
     }
     
     return DefWindowProc(hwnd, uMsg, wParam, lParam);
 }
 
-// Render the current GIF
-void RenderGif(HWND hwnd) {
-    if (g_gifs.empty()) {
-        return;
+// Hand a command to the render thread. UI thread only: the queue has a
+// single producer. Moves are dropped when the render thread is that far
+// behind (the next one carries the position, and RecordDragInput reads the
+// system's mouse history anyway); anything else waits for room.
+void SendRenderCommand(RenderCommand command) {
+    command.receivedMs = PreciseNowMs();
+    while (!g_renderCommands.TryPush(command)) {
+        if (command.type == CMD_MOUSE_MOVE) {
+            return;
+        }
+        SetEvent(g_renderWake);
+        Sleep(1);
+    }
+    SetEvent(g_renderWake);
+}
+
+void SendRenderCommand(RenderCommandType type, WPARAM value) {
+    RenderCommand command = {};
+    command.type = type;
+    command.value = value;
+    SendRenderCommand(command);
+}
+
+// The render thread: runs the scheduler (every timer is a task on it),
+// handles forwarded input and presents the scene, without ever waiting on
+// the UI thread. It still pumps its own messages for the WinEvent hooks.
+DWORD WINAPI RenderThreadMain(LPVOID) {
+    SetTraceThreadName("Render");
+    
+    // Index the desktop once; window events keep it current from here on.
+    // Hooks call back on the thread that installed them.
+    UpdateScreenMetrics();
+    RebuildSurfaceIndex();
+    InstallSurfaceHooks();
+    UpdatePowerMode();
+    
+    // Try to load GIFs from program directory first; the menu opens if
+    // there are none
+    g_loaderThread = CreateThread(NULL, 0, LoaderThreadMain, NULL, 0, NULL);
+    StartFolderLoad(GetProgramDirectory());
+    
+    HANDLE waits[2] = { g_renderWake, g_frameTimer };
+    bool running = true;
+    while (running) {
+        ArmScheduler();
+        PresentScene();
+        
+        DWORD woke = MsgWaitForMultipleObjectsEx(2, waits, INFINITE, QS_ALLINPUT, MWMO_INPUTAVAILABLE);
+        if (woke == WAIT_OBJECT_0) {
+            g_visibility.RecordWakeup(WAKE_COMMAND);
+        } else if (woke == WAIT_OBJECT_0 + 1) {
+            g_visibility.RecordWakeup(WAKE_TIMER);
+        } else if (woke == WAIT_OBJECT_0 + 2) {
+            g_visibility.RecordWakeup(WAKE_MESSAGE);
+        }
+        
+        MSG msg;
+        while (PeekMessage(&msg, NULL, 0, 0, PM_REMOVE)) {
+            DispatchMessage(&msg);
+        }
+        
+        running = RunRenderCommands();
+        RunLoadedFolders();
+        g_scheduler.RunDue(NowMs());
     }
     
-    size_t gifIndex = g_currentGifIndex;
+    StopLoaderThread();
     
-    // If in pick mode, find and use the PICK gif
-    if (g_appState == STATE_PICK) {
-        for (size_t i = 0; i < g_gifs.size(); i++) {
-            if (g_gifs[i].type == PICK) {
-                gifIndex = i;
+    // CleanupGifs also ends the behavior, whose frame lives in this
+    // thread's pool and has to go before the thread does
+    RemoveSurfaceHooks();
+    CleanupGifs();
+    return 0;
+}
+
+// Drain the command queue. False once the UI thread asked us to quit.
+bool RunRenderCommands() {
+    RenderCommand command;
+    while (g_renderCommands.TryPop(&command)) {
+        switch (command.type) {
+            case CMD_KEY:
+                HandleKey(command.value);
+                break;
+            
+            case CMD_MOUSE_DOWN:
+                HandleMouseDown(command);
+                break;
+            
+            case CMD_MOUSE_MOVE:
+                if (g_engine.Held()) {
+                    // Only feed the engine here; the window follows on the next display frame
+                    RecordDragInput(command.point, command.time, command.receivedMs);
+                }
+                break;
+            
+            case CMD_MOUSE_UP:
+                HandleMouseUp(command);
+                break;
+            
+            case CMD_REPAINT:
+                InvalidateScene(NULL);
+                break;
+            
+            case CMD_RESIZED:
+                // The next paint checks out layers of the new size
+                InvalidateScene(NULL);
+                break;
+            
+            case CMD_DPI_CHANGED:
+                SetDisplayDpi((UINT)command.value);
+                break;
+            
+            case CMD_DISPLAY_CHANGED:
+                UpdateScreenMetrics();
+                RebuildSurfaceIndex();
+                RequestVisibilityCheck();
+                break;
+            
+            case CMD_WORK_AREA_CHANGED:
+                RebuildSurfaceIndex();
+                break;
+            
+            case CMD_SESSION_LOCK:
+                SetHiddenReason(HIDDEN_LOCKED, command.value != 0);
+                break;
+            
+            case CMD_DISPLAY_OFF:
+                SetHiddenReason(HIDDEN_DISPLAY_OFF, command.value != 0);
+                break;
+            
+            case CMD_POWER_SOURCE:
+                UpdatePowerMode();
+                break;
+            
+            case CMD_MENU_SHOWN:
+                PlaceMenu();
+                break;
+            
+            case CMD_IMPORT:
+                StartFolderLoad(command.text);
+                free(command.text);
+                break;
+            
+            case CMD_TIMING_REPORT: {
+                TimingReport* report = BuildTimingReport();
+                if (!PostMessage(g_menuHwnd, WM_APP_TIMING_REPORT, 0, (LPARAM)report)) {
+                    delete report;
+                }
+                break;
+            }
+            
+            case CMD_MEMORY_REPORT: {
+                MemoryReport* report = BuildMemoryReport();
+                if (!PostMessage(g_menuHwnd, WM_APP_MEMORY_REPORT, 0, (LPARAM)report)) {
+                    delete report;
+                }
                 break;
             }
+            
+            case CMD_QUIT:
+                return false;
         }
-    } else {
-        // Otherwise, find a gif of the appropriate type for the current state
-        GifType targetType;
-        switch (g_appState) {
-            case STATE_MOVE: targetType = MOVE; break;
-            case STATE_WAIT: targetType = WAIT; break;
-            case STATE_SIT: targetType = SIT; break;
-            default: targetType = MISC; break;
+    }
+    return true;
+}
+
+void HandleKey(WPARAM key) {
+    switch (key) {
+        case 'A':
+        case VK_SPACE:
+        case 'P':
+        case 'F':
+            // The character's own: automatic mode, next state in manual
+            // mode, drag prediction, and furniture (not while recording,
+            // replays have none)
+            FeedEngine(SESSION_KEY, NowMs(), 0, 0, (uint32_t)key);
+            break;
+        
+        case 'T':
+            // Start recording trace zones, or stop and write them out
+            ToggleTracing();
+            break;
+        
+        case 'R':
+            // Start recording a replayable session, or stop and save it
+            ToggleSessionRecording();
+            break;
+        
+        case 'S':
+            // Cycle power saver: on battery only, always, never
+            g_powerSetting = NextPowerSetting(g_powerSetting);
+            OutputDebugStringW(PowerSettingName(g_powerSetting));
+            OutputDebugStringW(L"\n");
+            UpdatePowerMode();
+            break;
+        
+        case 'Z':
+            // Cycle the character size: 1x, 2x, 3x, 4x
+            SetScaleFactor(g_scaleFactor % MAX_SCALE_FACTOR + 1);
+            break;
+        
+        case 'E':
+            // Switch between blocky and edge-smoothing upscaling
+            g_scaleFilter = (g_scaleFilter == SCALE_NEAREST) ? SCALE_EDGES : SCALE_NEAREST;
+            OutputDebugStringW(ScaleFilterName(g_scaleFilter));
+            OutputDebugStringW(L"\n");
+            needsClear = true;
+            InvalidateScene(NULL);
+            break;
+    }
+}
+
+void HandleMouseDown(const RenderCommand& command) {
+    // The engine picks the character up if the click landed on it or its
+    // furniture
+    FeedEngine(SESSION_MOUSE_DOWN, (uint64_t)command.receivedMs, command.point.x, command.point.y, 0);
+    if (g_engine.Held()) {
+        g_lastDragPointTime = command.time;
+        g_lastDragPoint = command.point;
+        g_dragPending = false;
+        StartTimer(DRAG_TIMER_ID, g_frameInterval);
+    }
+}
+
+void HandleMouseUp(const RenderCommand& command) {
+    if (g_engine.Held()) {
+        // Flush the last coalesced move before physics takes over
+        RecordDragInput(command.point, command.time, command.receivedMs);
+        PresentDragFrame();
+        StopTimer(DRAG_TIMER_ID);
+        ReportDragLatency();
+        
+        // Let go: the character keeps the drag velocity and falls until
+        // it lands, then goes back to what it was doing
+        FeedEngine(SESSION_MOUSE_UP, (uint64_t)command.receivedMs, command.point.x, command.point.y, 0);
+    }
+}
+
+// Decode a folder's GIFs on the loader thread. The character on screen keeps
+// going until they are ready; starting another load makes this one stale.
+void StartFolderLoad(const std::wstring& folderPath) {
+    // Whatever the last import hasn't decoded yet is no longer wanted
+    if (g_pendingLoad) {
+        g_pendingLoad->tasks.Cancel();
+    }
+    
+    LoadedFolder* folder = new LoadedFolder();
+    folder->path = folderPath;
+    folder->generation = ++g_loadGeneration;
+    
+    if (!g_loaderThread || !g_loadRequests.TryPush(folder)) {
+        // No loader, or a backlog of imports it hasn't caught up with;
+        // load it right here instead
+        g_pendingLoad = nullptr;
+        LoadGifFiles(folder->path, &folder->character, &folder->gifs, &folder->tasks);
+        InstallGifs(folder);
+        delete folder;
+        return;
+    }
+    g_pendingLoad = folder;
+    SetEvent(g_loaderWake);
+}
+
+// Loads one requested folder after another until StopLoaderThread
+DWORD WINAPI LoaderThreadMain(LPVOID) {
+    SetTraceThreadName("Loader");
+    while (!g_loaderStop.load(std::memory_order_acquire)) {
+        LoadedFolder* folder;
+        if (!g_loadRequests.TryPop(&folder)) {
+            WaitForSingleObject(g_loaderWake, INFINITE);
+            continue;
+        }
+        
+        // Superseded before it started: hand it straight back
+        if (!folder->tasks.IsCancelled()) {
+            LoadGifFiles(folder->path, &folder->character, &folder->gifs, &folder->tasks);
         }
         
-        for (size_t i = 0; i < g_gifs.size(); i++) {
-            if (g_gifs[i].type == targetType) {
-                gifIndex = i;
+        // The render thread drains the queue every pass, and while it
+        // waits for this thread to stop, so it is only ever full for a moment
+        while (!g_loadedFolders.TryPush(folder)) {
+            Sleep(1);
+        }
+        SetEvent(g_renderWake);
+    }
+    return 0;
+}
+
+// Cancel the load in flight, wait for the loader to finish with it and
+// throw away everything still queued either way. The loader may be
+// waiting for room in g_loadedFolders, so that is emptied while we wait.
+void StopLoaderThread() {
+    if (g_pendingLoad) {
+        g_pendingLoad->tasks.Cancel();
+        g_pendingLoad = nullptr;
+    }
+    
+    LoadedFolder* folder;
+    if (g_loaderThread) {
+        g_loaderStop.store(true, std::memory_order_release);
+        SetEvent(g_loaderWake);
+        do {
+            while (g_loadedFolders.TryPop(&folder)) {
+                delete folder;
+            }
+        } while (WaitForSingleObject(g_loaderThread, 1) == WAIT_TIMEOUT);
+        CloseHandle(g_loaderThread);
+        g_loaderThread = NULL;
+    }
+    
+    // Requests it never got to; it is gone, so popping them here is safe
+    while (g_loadRequests.TryPop(&folder)) {
+        delete folder;
+    }
+    while (g_loadedFolders.TryPop(&folder)) {
+        delete folder;
+    }
+}
+
+// Install the newest finished load; anything older was superseded
+void RunLoadedFolders() {
+    LoadedFolder* folder;
+    while (g_loadedFolders.TryPop(&folder)) {
+        if (folder == g_pendingLoad) {
+            g_pendingLoad = nullptr;
+        }
+        if (folder->generation == g_loadGeneration) {
+            InstallGifs(folder);
+        }
+        delete folder;
+    }
+}
+
+// The menu just opened: put it next to the character, which only this
+// thread knows the position of
+void PlaceMenu() {
+    UINT dpi = g_dpi;
+    SetWindowPos(g_menuHwnd, NULL,
+                g_charPos.x + g_charWidth, g_charPos.y,
+                MulDiv(MENU_WIDTH, dpi, 96), MulDiv(MENU_HEIGHT, dpi, 96),
+                SWP_NOZORDER | SWP_NOACTIVATE | SWP_ASYNCWINDOWPOS);
+    
+    // Switch states immediately when menu becomes visible
+    if (!g_gifs.empty()) {
+        FeedEngine(SESSION_NEXT_STATE, NowMs(), 0, 0, 0);
+    }
+}
+
+// Add to the area PresentScene draws at the end of this pass (window
+// coordinates, NULL for everything)
+void InvalidateScene(const RECT* rect) {
+    RECT window = { 0, 0, g_windowRect.right - g_windowRect.left, g_windowRect.bottom - g_windowRect.top };
+    RECT area = window;
+    if (rect) {
+        IntersectRect(&area, rect, &window);
+    }
+    UnionRect(&g_dirtyRect, &g_dirtyRect, &area);
+}
+
+// Draw whatever changed straight to the window. The layered window takes
+// GDI from any thread, so this never waits for a WM_PAINT.
+void PresentScene() {
+    // Whatever asked for this pass, bring everything up to date
+    InvalidateChangedArea();
+    if (IsRectEmpty(&g_dirtyRect)) {
+        return;
+    }
+    
+    HDC hdc = GetDC(g_hwnd);
+    if (hdc) {
+        PaintScene(hdc, g_dirtyRect);
+        ReleaseDC(g_hwnd, hdc);
+    }
+    SetRectEmpty(&g_dirtyRect);
+}
+
+// Draw the scene inside dirty (window coordinates) onto hdc
+void PaintScene(HDC hdc, RECT dirty) {
+    TRACE_ZONE("PaintScene");
+    
+    // The window is exactly the scene; asking it would mean waiting on the UI thread
+    RECT layerRect = { 0, 0, g_windowRect.right - g_windowRect.left, g_windowRect.bottom - g_windowRect.top };
+    IntersectRect(&dirty, &dirty, &layerRect);
+    if (IsRectEmpty(&dirty)) {
+        return;
+    }
+    
+    // A frame that isn't switching animations or resizing must not
+    // allocate or create GDI objects; debug builds check that
+#ifdef CHIBI_TRACK_ALLOCATIONS
+    AllocationScope frameAllocations;
+    DWORD gdiObjectsBefore = GetGuiResources(GetCurrentProcess(), GR_GDIOBJECTS);
+    bool steadyFrame = !needsClear;
+    g_scaledFrameMade = false;
+#endif
+    
+    // Only clear if necessary (when switching GIFs or states)
+    if (needsClear) {
+        FillRect(hdc, &layerRect, (HBRUSH)GetStockObject(BLACK_BRUSH));
+        needsClear = false;
+    }
+    
+    // Check out a layer the size of the scene (it grows and shrinks with
+    // furniture); only a size the pool hasn't got makes a new one
+    RenderLayer* layer = nullptr;
+    if (!g_frameQueue.empty() && g_currentFrameIndex < g_frameQueue.size()) {
+        uint64_t surfacesCreated = g_renderSurfaces.Created();
+        layer = g_renderSurfaces.Acquire(layerRect.right, layerRect.bottom, RENDER_ARGB32);
+#ifdef CHIBI_TRACK_ALLOCATIONS
+        if (g_renderSurfaces.Created() != surfacesCreated) {
+            steadyFrame = false;
+        }
+#endif
+    }
+    
+    // Draw the current frame from the queue
+    if (layer) {
+        FrameInfo& frame = g_frameQueue[g_currentFrameIndex];
+        
+        // Select the correct frame
+        GUID timeDimension = Gdiplus::FrameDimensionTime;
+        frame.image->SelectActiveFrame(&timeDimension, frame.frameIndex);
+        
+        // Draw new frame to top layer, only inside the area being repainted
+        Gdiplus::Graphics& topGraphics = *layer->graphics;
+        topGraphics.SetClip(Gdiplus::Rect(dirty.left, dirty.top,
+                                          dirty.right - dirty.left, dirty.bottom - dirty.top));
+        topGraphics.Clear(Gdiplus::Color::Black);
+        topGraphics.SetInterpolationMode(g_quality.smoothInterpolation ?
+            Gdiplus::InterpolationModeHighQuality : Gdiplus::InterpolationModeNearestNeighbor);
+        topGraphics.SetSmoothingMode(Gdiplus::SmoothingModeHighQuality);
+        
+        // Collect everything in the scene. Positions are relative to the
+        // window, which spans the union of all entities.
+        static std::vector<SceneSprite> sprites;
+        sprites.clear();
+        
+        const std::vector<Furniture>& placed = g_engine.PlacedFurniture();
+        for (size_t i = 0; i < placed.size(); i++) {
+            const Furniture& furniture = placed[i];
+            Gdiplus::Image* image = g_furnitureImages[furniture.typeIndex];
+            if (!furniture.visible || !image) continue;
+            
+            SceneSprite sprite = { image,
+                furniture.x - g_sceneOrigin.x, furniture.y - g_sceneOrigin.y,
+                furniture.width, furniture.height, Z_FURNITURE, false, nullptr };
+            sprites.push_back(sprite);
+        }
+        
+        SceneSprite character = { frame.image,
+            g_charPos.x - g_sceneOrigin.x, g_charPos.y - g_sceneOrigin.y,
+            CharacterSize((int)frame.image->GetWidth()), CharacterSize((int)frame.image->GetHeight()),
+            Z_CHARACTER, frame.flipped,
+            (g_scaleFactor > 1 || g_dpiPercent != 100) ? GetScaledFrame(frame) : nullptr };
+        sprites.push_back(character);
+        
+        // Z-order comes from here, not from window stacking. Insertion
+        // sort: stable like std::stable_sort, without its scratch buffer.
+        for (size_t i = 1; i < sprites.size(); i++) {
+            SceneSprite sprite = sprites[i];
+            size_t j = i;
+            for (; j > 0 && sprites[j - 1].z > sprite.z; j--) {
+                sprites[j] = sprites[j - 1];
+            }
+            sprites[j] = sprite;
+        }
+        
+        for (size_t i = 0; i < sprites.size(); i++) {
+            const SceneSprite& sprite = sprites[i];
+            if (sprite.scaled) {
+                // Let GDI+ finish what's below, then copy the scaled
+                // pixels in, clipped to the area being repainted
+                topGraphics.Flush(Gdiplus::FlushIntentionSync);
+                GdiFlush();
+                PixelBuffer target = { layer->bits + dirty.top * layer->width + dirty.left,
+                                       dirty.right - dirty.left, dirty.bottom - dirty.top, layer->width };
+                const ScaledFrame& scaled = *sprite.scaled;
+                if (sprite.flipped) {
+                    BlendSpriteMirrored(target, scaled.pixels.data(), scaled.width, scaled.height,
+                                        sprite.x + sprite.width - scaled.x - scaled.width - dirty.left,
+                                        sprite.y + scaled.y - dirty.top);
+                } else {
+                    BlendSprite(target, scaled.pixels.data(), scaled.width, scaled.height,
+                                sprite.x + scaled.x - dirty.left, sprite.y + scaled.y - dirty.top);
+                }
+            } else if (sprite.flipped) {
+                // Upper-left, upper-right and lower-left corners swapped
+                // left to right mirror the image as it is drawn
+                Gdiplus::Point corners[3] = {
+                    Gdiplus::Point(sprite.x + sprite.width, sprite.y),
+                    Gdiplus::Point(sprite.x, sprite.y),
+                    Gdiplus::Point(sprite.x + sprite.width, sprite.y + sprite.height)
+                };
+                topGraphics.DrawImage(sprite.image, corners, 3);
+            } else {
+                topGraphics.DrawImage(sprite.image, sprite.x, sprite.y, sprite.width, sprite.height);
+            }
+        }
+        
+        // Draw to screen
+        TRACE_ZONE("Present");
+        topGraphics.Flush(Gdiplus::FlushIntentionSync);
+        BitBlt(hdc, dirty.left, dirty.top, dirty.right - dirty.left, dirty.bottom - dirty.top,
+               layer->dc, dirty.left, dirty.top, SRCCOPY);
+        g_renderSurfaces.Release(layer);
+        
+        g_hasShownFrame = true;
+        g_shownGif = frame.gifIndex;
+        g_shownFrame = frame.frameIndex;
+        g_shownPosition.x = g_charPos.x - g_sceneOrigin.x;
+        g_shownPosition.y = g_charPos.y - g_sceneOrigin.y;
+    }
+
+#ifdef CHIBI_TRACK_ALLOCATIONS
+    if (steadyFrame && !g_scaledFrameMade) {
+        uint64_t allocations = frameAllocations.Allocations();
+        DWORD gdiObjectsAfter = GetGuiResources(GetCurrentProcess(), GR_GDIOBJECTS);
+        if (allocations != 0 || gdiObjectsAfter > gdiObjectsBefore) {
+            g_allocatingFrames++;
+            wchar_t message[128];
+            swprintf(message, 128, L"Steady-state frame allocated %llu times, created %lu GDI objects\n",
+                     (unsigned long long)allocations, (unsigned long)(gdiObjectsAfter - gdiObjectsBefore));
+            OutputDebugStringW(message);
+        }
+    }
+#endif
+}
+
+// Virtual screen and display refresh interval
+void UpdateScreenMetrics() {
+    g_virtualScreen.left = GetSystemMetrics(SM_XVIRTUALSCREEN);
+    g_virtualScreen.top = GetSystemMetrics(SM_YVIRTUALSCREEN);
+    g_virtualScreen.right = g_virtualScreen.left + GetSystemMetrics(SM_CXVIRTUALSCREEN);
+    g_virtualScreen.bottom = g_virtualScreen.top + GetSystemMetrics(SM_CYVIRTUALSCREEN);
+    
+    g_frameInterval = 16;
+    DWM_TIMING_INFO timing = {};
+    timing.cbSize = sizeof(timing);
+    if (SUCCEEDED(DwmGetCompositionTimingInfo(NULL, &timing)) && timing.rateRefresh.uiNumerator != 0) {
+        UINT interval = 1000 * timing.rateRefresh.uiDenominator / timing.rateRefresh.uiNumerator;
+        g_frameInterval = std::max(interval, (UINT)USER_TIMER_MINIMUM);
+    }
+}
+
+// Pull every pointer position since the last one we saw out of the system's
+// mouse history and feed them to the engine, so fast mice are not reduced to
+// one sample per message. time is the input's message time, receivedMs when
+// the UI thread got it.
+void RecordDragInput(POINT pt, DWORD time, double receivedMs) {
+    double now = PreciseNowMs();
+    DWORD tickNow = GetTickCount();
+    
+    MOUSEMOVEPOINT current = {};
+    current.x = pt.x;
+    current.y = pt.y;
+    current.time = time;
+    
+    MOUSEMOVEPOINT history[64];
+    int count = GetMouseMovePointsEx(sizeof(MOUSEMOVEPOINT), &current, history, 64,
+                                     GMMP_USE_DISPLAY_POINTS);
+    if (count <= 0) {
+        FeedEngine(SESSION_MOUSE_MOVE, (uint64_t)receivedMs, pt.x, pt.y, 0);
+    } else {
+        // History is newest first; stop at the last point we already have
+        int fresh = 0;
+        while (fresh < count) {
+            const MOUSEMOVEPOINT& point = history[fresh];
+            LONG age = (LONG)(point.time - g_lastDragPointTime);
+            if (age < 0 || (age == 0 && point.x == g_lastDragPoint.x && point.y == g_lastDragPoint.y)) {
                 break;
             }
+            fresh++;
         }
+        
+        for (int i = fresh - 1; i >= 0; i--) {
+            // Display points left of/above the primary monitor come back unsigned
+            int x = history[i].x > 32767 ? history[i].x - 65536 : history[i].x;
+            int y = history[i].y > 32767 ? history[i].y - 65536 : history[i].y;
+            double sampleTime = now - (double)(DWORD)(tickNow - history[i].time);
+            FeedEngine(SESSION_MOUSE_MOVE, (uint64_t)sampleTime, x, y, 0);
+        }
+        
+        g_lastDragPointTime = history[0].time;
+        g_lastDragPoint.x = history[0].x > 32767 ? history[0].x - 65536 : history[0].x;
+        g_lastDragPoint.y = history[0].y > 32767 ? history[0].y - 65536 : history[0].y;
     }
     
-    if (gifIndex < g_gifs.size() && g_gifs[gifIndex].animation.image != nullptr) {
-        // Update the back buffer
-        GenerateFrame(g_gifs[gifIndex].animation.backBuffer.get(), g_gifs[gifIndex].animation.image);
+    // Latency counts from when the UI thread saw the input, so it includes
+    // the hop over to this thread
+    if (!g_dragPending) {
+        g_dragPending = true;
+        g_dragInputTime = receivedMs;
     }
 }
 
-// Modify ResizeWindowToGif to reduce unnecessary updates
-void ResizeWindowToGif(HWND hwnd, Gdiplus::Image* gif) {
-    if (!gif) return;
+// One window move per display frame: lay the window out for wherever the
+// engine has put the character by now and paint any pending frame in the
+// same pass
+void PresentDragFrame() {
+    TRACE_ZONE("PresentDragFrame");
     
-    // Get current window position
-    RECT windowRect;
-    GetWindowRect(hwnd, &windowRect);
+    if (!g_dragPending) {
+        return;
+    }
+    g_dragPending = false;
     
-    // Get GIF dimensions
-    int gifWidth = gif->GetWidth();
-    int gifHeight = gif->GetHeight();
+    UpdateSceneBounds(g_hwnd);
+    PresentScene();
     
-    // Only resize if dimensions have changed
-    if (windowRect.right - windowRect.left != gifWidth || 
-        windowRect.bottom - windowRect.top != gifHeight) {
-        // Resize window to fit GIF without forcing redraw
-        SetWindowPos(hwnd, NULL, windowRect.left, windowRect.top, 
-                    gifWidth, gifHeight, 
-                    SWP_NOZORDER | SWP_NOREDRAW);
+    g_dragLatency.Record((uint64_t)((PreciseNowMs() - g_dragInputTime) * 1000.0));
+}
+
+void ReportDragLatency() {
+    if (g_dragLatency.Count() == 0) {
+        return;
     }
+    
+    wchar_t report[160];
+    swprintf(report, 160, L"Drag input-to-move latency: %u moves, p50 %.2f ms, p99 %.2f ms, max %.2f ms\n",
+             (unsigned)g_dragLatency.Count(),
+             g_dragLatency.Percentile(50.0) / 1000.0,
+             g_dragLatency.Percentile(99.0) / 1000.0,
+             g_dragLatency.Max() / 1000.0);
+    OutputDebugStringW(report);
+}
+
+// Change the character size; the engine keeps its feet where they are
+void SetScaleFactor(int factor) {
+    if (factor < 1 || factor > MAX_SCALE_FACTOR || factor == g_scaleFactor) return;
+    
+    g_scaleFactor = factor;
+    FeedEngine(SESSION_SCALE, NowMs(), g_scaleFactor, g_dpiPercent, 0);
+    
+    needsClear = true;
+    InvalidateScene(NULL);
+}
+
+// The character moved onto a monitor with a different DPI. Frames for the
+// new scale come from the cache (or are made once from the loaded GIFs);
+// nothing is decoded again. The engine keeps furniture on its spot on the
+// floor and the character's feet where they are.
+void SetDisplayDpi(UINT dpi) {
+    int percent = DpiPercent(dpi);
+    g_dpi = dpi;
+    if (percent == g_dpiPercent) return;
+    
+    g_dpiPercent = percent;
+    FeedEngine(SESSION_SCALE, NowMs(), g_scaleFactor, g_dpiPercent, 0);
+    
+    needsClear = true;
+    InvalidateScene(NULL);
+}
+
+// Playback speed the manifest asks for, 1 without one
+float GifSpeed(size_t gifIndex) {
+    int index = g_gifs[gifIndex].manifestIndex;
+    return index >= 0 ? g_character.Animations()[index].speed : 1.0f;
 }
 
 // Modify QueueFramesFromGif to properly handle flipped state
-void QueueFramesFromGif(size_t gifIndex) {
+void QueueFramesFromGif(size_t gifIndex, bool flipped) {
+    TRACE_ZONE("QueueFramesFromGif");
+    
     if (gifIndex >= g_gifs.size()) return;
     
     GifInfo& gif = g_gifs[gifIndex];
     GUID timeDimension = Gdiplus::FrameDimensionTime;
+    float speed = GifSpeed(gifIndex);
     
     // Clear existing queue
     g_frameQueue.clear();
@@ -835,10 +1922,11 @@ void QueueFramesFromGif(size_t gifIndex) {
     for (int bufferPass = 0; bufferPass < FRAME_BUFFER_SIZE; bufferPass++) {
         for (UINT i = 0; i < gif.animation.frameCount; i++) {
             FrameInfo frame;
-            frame.image = gif.animation.image;
+            frame.image = gif.animation.image.get();
             frame.frameIndex = i;
-            frame.delay = std::max(gif.animation.frameDelays[i], MIN_FRAME_DELAY);
-            frame.flipped = gif.flipped;  // Set the flipped state from the GIF
+            frame.delay = std::max((UINT)(gif.animation.frameDelays[i] / speed), MIN_FRAME_DELAY);
+            frame.flipped = flipped;
+            frame.gifIndex = gifIndex;
             g_frameQueue.push_back(frame);
         }
     }
@@ -847,366 +1935,1178 @@ void QueueFramesFromGif(size_t gifIndex) {
     QueryPerformanceCounter(&g_lastFrameTime);
 }
 
-// Modify SwitchToNextGif to set needsClear
-void SwitchToNextGif() {
-    if (g_gifs.empty()) return;
+// Decode every GIF in a folder into gifs, one pool task per file. The GIF
+// the character starts in goes first so the folder is ready to show as
+// soon as possible, even while the pool is busy with other work. Runs on a
+// loader thread, so it must not touch any of the globals the render
+// thread uses. Gives up early if tasks gets cancelled.
+bool LoadGifFiles(const std::wstring& folderPath, CharacterTable* character, std::vector<GifInfo>* gifs,
+                  TaskGroup* tasks) {
+    TRACE_ZONE("LoadGifFiles");
+    
+    // The manifest lists the files itself; otherwise every GIF in the
+    // folder counts and its name says what it is
+    if (!ReadCharacterManifest(folderPath, character)) {
+        WIN32_FIND_DATAW findData;
+        HANDLE hFind;
+        std::wstring searchPath = folderPath + L"\\*.gif";
+        
+        hFind = FindFirstFileW(searchPath.c_str(), &findData);
+        if (hFind == INVALID_HANDLE_VALUE) {
+            return false;
+        }
+        
+        std::vector<std::wstring> filenames;
+        do {
+            if (!(findData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)) {
+                filenames.push_back(findData.cFileName);
+            }
+        } while (FindNextFileW(hFind, &findData) != 0);
+        FindClose(hFind);
+        
+        *character = CharacterTable();
+        character->AddAnimationsFromFilenames(filenames);
+    }
+    
+    // One slot per animation keeps manifest (or directory) order, which
+    // decides the GIF a state falls back to
+    const std::vector<ManifestAnimation>& animations = character->Animations();
+    std::vector<GifInfo> loaded(animations.size());
+    std::vector<char> loadedOk(animations.size(), 0);
+    TaskPool& pool = TaskPool::Shared();
+    for (size_t i = 0; i < animations.size(); i++) {
+        TaskPriority priority = animations[i].state == STATE_WAIT ? TASK_HIGH : TASK_NORMAL;
+        std::wstring filePath = folderPath + L"\\" + animations[i].file;
+        GifType type = GifTypeForState(character->BaseState(animations[i].state));
+        pool.Submit(tasks, priority, [&loaded, &loadedOk, i, filePath, type]() {
+            loadedOk[i] = LoadGif(filePath, &loaded[i]);
+            loaded[i].type = type;
+            loaded[i].manifestIndex = static_cast<int>(i);
+        });
+    }
+    pool.Wait(tasks);
+    if (tasks->IsCancelled()) {
+        return false;
+    }
+    
+    for (size_t i = 0; i < loaded.size(); i++) {
+        if (loadedOk[i]) {
+            // Add to our collection using move semantics
+            gifs->push_back(std::move(loaded[i]));
+        }
+    }
+    return !gifs->empty();
+}
+
+// Decode one GIF and work out what it needs for playback. False if it
+// isn't an animation we can play.
+bool LoadGif(const std::wstring& filePath, GifInfo* gifInfo) {
+    TRACE_ZONE("LoadGif");
     
-    // Store previous state
-    AppState prevState = g_appState;
+    gifInfo->filePath = filePath;
+    gifInfo->animation.image.reset(Gdiplus::Image::FromFile(filePath.c_str()));
+    gifInfo->animation.isPlaying = false;
+    gifInfo->flipped = false;
+    if (gifInfo->animation.image == nullptr) {
+        return false;
+    }
     
-    // Cycle through states
-    switch (g_appState) {
-        case STATE_MOVE: g_appState = STATE_WAIT; break;
-        case STATE_WAIT: g_appState = STATE_SIT; break;
-        case STATE_SIT: g_appState = STATE_MISC; break;
-        case STATE_MISC: g_appState = STATE_MOVE; break;
-        default: g_appState = STATE_WAIT; break;
+    // Load frame info
+    gifInfo->animation.frameDelays = LoadGifFrameInfo(gifInfo->animation.image.get());
+    if (gifInfo->animation.frameDelays.empty()) {
+        return false;  // GifAnimation deletes the image
     }
     
-    // Find appropriate GIF for new state
-    size_t newGifIndex = g_currentGifIndex;
-    bool foundGif = false;
+    // Get frame count
+    UINT count = gifInfo->animation.image->GetFrameDimensionsCount();
+    GUID* dimensionIDs = new GUID[count];
+    gifInfo->animation.image->GetFrameDimensionsList(dimensionIDs, count);
+    gifInfo->animation.frameCount = gifInfo->animation.image->GetFrameCount(&dimensionIDs[0]);
+    delete[] dimensionIDs;
+    
+    // Lets a frame repaint only the part that differs from the last one
+    gifInfo->animation.frameChanges = ComputeFrameChanges(gifInfo->animation.image.get(),
+                                                          gifInfo->animation.frameCount);
     
-    GifType targetType;
-    switch (g_appState) {
-        case STATE_MOVE: targetType = MOVE; break;
-        case STATE_WAIT: targetType = WAIT; break;
-        case STATE_SIT: targetType = SIT; break;
-        default: targetType = MISC; break;
+    // GDI+ keeps the file and one decoded frame; what it does inside is
+    // out of sight, so those two are estimates
+    MemoryAsset asset = g_memory.AddAsset(Utf8FromWide(PathFindFileNameW(filePath.c_str())));
+    WIN32_FILE_ATTRIBUTE_DATA attributes;
+    if (GetFileAttributesExW(filePath.c_str(), GetFileExInfoStandard, &attributes)) {
+        g_memory.Set(asset, MEMORY_COMPRESSED,
+                     ((uint64_t)attributes.nFileSizeHigh << 32) | attributes.nFileSizeLow);
+    }
+    g_memory.Set(asset, MEMORY_DECODED, (uint64_t)gifInfo->animation.image->GetWidth() *
+                 gifInfo->animation.image->GetHeight() * sizeof(uint32_t));
+    g_memory.Set(asset, MEMORY_MASKS, gifInfo->animation.frameChanges.capacity() * sizeof(RECT));
+    g_memory.Set(asset, MEMORY_PLAYBACK, gifInfo->animation.frameDelays.capacity() * sizeof(UINT));
+    // No MEMORY_MIRRORED: PaintScene reads flipped frames backwards as it
+    // draws them, so no mirrored copy is ever made. Charge one here if that
+    // changes.
+    gifInfo->memoryAsset = OwnedMemoryAsset(&g_memory, asset);
+    return true;
+}
+
+const LONGLONG MAX_MANIFEST_BYTES = 1024 * 1024;  // Anything bigger isn't a manifest
+
+// Compile the folder's character.manifest into character. False if there is
+// none or it doesn't parse (the reason goes to the debug output), in which
+// case the folder is read by file names instead.
+bool ReadCharacterManifest(const std::wstring& folderPath, CharacterTable* character) {
+    std::wstring manifestPath = folderPath + L"\\character.manifest";
+    HANDLE file = CreateFileW(manifestPath.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                              FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) {
+        return false;
     }
     
-    for (size_t i = 0; i < g_gifs.size(); i++) {
-        if (g_gifs[i].type == targetType) {
-            newGifIndex = i;
-            foundGif = true;
-            break;
+    std::string text;
+    LARGE_INTEGER size;
+    if (GetFileSizeEx(file, &size) && size.QuadPart > 0 && size.QuadPart < MAX_MANIFEST_BYTES) {
+        text.resize((size_t)size.QuadPart);
+        DWORD read = 0;
+        if (!ReadFile(file, &text[0], (DWORD)text.size(), &read, NULL)) {
+            read = 0;
         }
+        text.resize(read);
     }
+    CloseHandle(file);
     
-    if (foundGif && newGifIndex < g_gifs.size()) {
-        // Clear existing queue
-        g_frameQueue.clear();
-        g_currentFrameIndex = 0;
-        
-        // Queue frames from the new GIF
-        QueueFramesFromGif(newGifIndex);
-        
-        // Resize window to fit new GIF
-        ResizeWindowToGif(g_hwnd, g_gifs[newGifIndex].animation.image);
+    std::string error;
+    if (!ParseCharacterManifest(text.data(), text.size(), character, &error)) {
+        std::string message = "character.manifest: " + error + "\n";
+        OutputDebugStringA(message.c_str());
+        return false;
+    }
+    return true;
+}
+
+// Swap the loaded GIFs in for the current ones and start the character
+// over, waiting where it stands. Render thread only.
+bool InstallGifs(LoadedFolder* folder) {
+    TRACE_ZONE("InstallGifs");
+    const std::wstring& folderPath = folder->path;
+    
+    CleanupGifs();
+    g_gifs = std::move(folder->gifs);
+    g_character = std::move(folder->character);
+    g_hasGifs = !g_gifs.empty();
+    if (!g_hasGifs) {
+        // Nothing to show; let the user pick a folder
+        PostMessage(g_hwnd, WM_APP_SHOW_MENU, 0, 0);
+        return false;
+    }
+    
+    // Furniture images live next to the character GIFs
+    LoadFurnitureFromFolder(folderPath);
+    
+    // What the engine needs of each animation: delays and size. One that
+    // failed to load has no delays, so it is never picked.
+    size_t animationCount = g_character.Animations().size();
+    g_animations.assign(animationCount, CharacterAnimation());
+    g_animationGifs.assign(animationCount, NO_GIF);
+    for (size_t i = 0; i < g_gifs.size(); i++) {
+        const GifAnimation& animation = g_gifs[i].animation;
+        int index = g_gifs[i].manifestIndex;
+        if (index < 0 || (size_t)index >= animationCount || !animation.image) continue;
         
-        // Set needsClear flag
+        size_t frames = std::min((size_t)animation.frameCount, animation.frameDelays.size());
+        g_animations[index].delaysMs.assign(animation.frameDelays.begin(), animation.frameDelays.begin() + frames);
+        g_animations[index].width = (int)animation.image->GetWidth();
+        g_animations[index].height = (int)animation.image->GetHeight();
+        g_animationGifs[index] = i;
+    }
+    
+    // The engine plays the first animation and arms the state timer in
+    // automatic mode
+    g_engine.SetScale(g_scaleFactor, g_dpiPercent);
+    g_engine.Start(NowMs(), g_charPos.x + g_charWidth / 2, g_charPos.y + g_charHeight, g_engine.Mode());
+    if (g_visibility.IsHidden()) {
+        FeedEngine(SESSION_HIDDEN, NowMs(), 0, 0, 0);
+    }
+    InvalidateScene(NULL);
+    return true;
+}
+
+// Work area of the monitor at a point, usually the character's feet.
+// Surfaces and physics are in virtual-screen coordinates, so this is the
+// fallback bound when no surface carries the character, not the primary
+// monitor.
+RECT WorkAreaAt(int x, int y) {
+    POINT point = { x, y };
+    MONITORINFO info = { sizeof(info) };
+    if (GetMonitorInfoW(MonitorFromPoint(point, MONITOR_DEFAULTTONEAREST), &info)) {
+        return info.rcWork;
+    }
+    return g_virtualScreen;
+}
+
+// Lay the window out for the character and furniture where the engine has
+// them: resize and move it to the union of every scene entity. Entities
+// keep their own screen positions; only the origin moves.
+void UpdateSceneBounds(HWND hwnd) {
+    if (g_engine.Animation() >= 0) {
+        g_charPos.x = g_engine.X();
+        g_charPos.y = g_engine.Y();
+        g_charWidth = g_engine.Width();
+        g_charHeight = g_engine.Height();
+    }
+    
+    // Furniture coming or going repaints everything
+    const std::vector<Furniture>& placed = g_engine.PlacedFurniture();
+    if (placed.size() != g_sceneFurniture) {
+        g_sceneFurniture = placed.size();
         needsClear = true;
+    }
+    
+    RECT bounds = { g_charPos.x, g_charPos.y,
+                    g_charPos.x + g_charWidth, g_charPos.y + g_charHeight };
+    for (size_t i = 0; i < placed.size(); i++) {
+        const Furniture& furniture = placed[i];
+        if (!furniture.visible) continue;
         
-        // Start animation timer
-        if (!g_frameQueue.empty()) {
-            SetTimer(g_hwnd, ANIMATION_TIMER_ID, g_frameQueue[0].delay, NULL);
-        }
+        RECT furnitureRect = { furniture.x, furniture.y,
+                               furniture.x + furniture.width, furniture.y + furniture.height };
+        UnionRect(&bounds, &bounds, &furnitureRect);
+    }
+    
+    g_sceneOrigin.x = bounds.left;
+    g_sceneOrigin.y = bounds.top;
+    
+    RECT windowRect = g_windowRect;
+    if (EqualRect(&bounds, &windowRect)) {
+        return;
+    }
+    g_windowRect = bounds;
+    
+    int width = bounds.right - bounds.left;
+    int height = bounds.bottom - bounds.top;
+    if (windowRect.right - windowRect.left == width && windowRect.bottom - windowRect.top == height) {
+        SetWindowPos(hwnd, NULL, bounds.left, bounds.top, 0, 0,
+                    SWP_NOSIZE | SWP_NOZORDER | SWP_NOACTIVATE | SWP_ASYNCWINDOWPOS);
     } else {
-        // If no valid GIF found, revert to previous state
-        g_appState = prevState;
+        // Size changed, the caller is responsible for the redraw
+        // (and WM_SIZE asks for another once the window has its new size)
+        SetWindowPos(hwnd, NULL, bounds.left, bounds.top, width, height,
+                    SWP_NOZORDER | SWP_NOREDRAW | SWP_ASYNCWINDOWPOS);
+        needsClear = true;
     }
 }
 
-// Modify UpdateAppState to properly handle move state
-void UpdateAppState() {
-    if (g_gifs.empty()) {
+// Invalidate only what differs from the last paint: the character's old and
+// new spots if it moved inside the window, otherwise whatever changed between
+// the frame on screen and the current one. Identical frames invalidate nothing,
+// so they are never presented at all.
+void InvalidateChangedArea() {
+    if (g_frameQueue.empty() || g_currentFrameIndex >= g_frameQueue.size()) {
         return;
     }
     
-    // Store current state
-    AppState prevState = g_appState;
+    const FrameInfo& frame = g_frameQueue[g_currentFrameIndex];
+    if (needsClear || !g_hasShownFrame || frame.gifIndex != g_shownGif || frame.gifIndex >= g_gifs.size()) {
+        InvalidateScene(NULL);
+        return;
+    }
     
-    // Force move state for testing
-    int nextState = 0;  // Always use move state
+    POINT position = { g_charPos.x - g_sceneOrigin.x, g_charPos.y - g_sceneOrigin.y };
+    int width = CharacterSize((int)frame.image->GetWidth());
+    int height = CharacterSize((int)frame.image->GetHeight());
+    if (position.x != g_shownPosition.x || position.y != g_shownPosition.y) {
+        RECT before = { g_shownPosition.x, g_shownPosition.y,
+                        g_shownPosition.x + width, g_shownPosition.y + height };
+        RECT after = { position.x, position.y, position.x + width, position.y + height };
+        RECT both;
+        UnionRect(&both, &before, &after);
+        InvalidateScene(&both);
+        return;
+    }
     
-    // Move the dirDist declaration outside the switch
-    std::uniform_int_distribution<int> dirDist(0, 1);
+    // Everything that changed on the way from the frame on screen to this one
+    const std::vector<RECT>& changes = g_gifs[frame.gifIndex].animation.frameChanges;
+    UINT count = (UINT)changes.size();
+    if (count == 0 || frame.frameIndex >= count || g_shownFrame >= count) {
+        InvalidateScene(NULL);
+        return;
+    }
     
-    // Kill existing timers before state transition
-    KillTimer(g_hwnd, TIMER_ID);
-    KillTimer(g_hwnd, ANIMATION_TIMER_ID);
+    FrameRect dirty = { 0, 0, 0, 0 };
+    int imageWidth = (int)frame.image->GetWidth();
+    for (UINT i = g_shownFrame; i != frame.frameIndex; ) {
+        i = (i + 1) % count;
+        FrameRect change = { changes[i].left, changes[i].top, changes[i].right, changes[i].bottom };
+        if (frame.flipped) {
+            change.left = imageWidth - changes[i].right;
+            change.right = imageWidth - changes[i].left;
+        }
+        dirty = UnionRects(dirty, change);
+    }
+    if (dirty.IsEmpty()) {
+        return;
+    }
     
-    switch (nextState) {
-        case 0:
-            g_appState = STATE_MOVE;
-            
-            // Randomly decide movement direction
-            g_moveDirectionRight = dirDist(g_randomEngine) == 1;
-            
-            // Set the flipped state of MOVE gifs based on direction
-            for (size_t i = 0; i < g_gifs.size(); i++) {
-                if (g_gifs[i].type == MOVE) {
-                    g_gifs[i].flipped = !g_moveDirectionRight;
-                }
-            }
-            
-            // Start moving the window with consistent timing
-            SetTimer(g_hwnd, TIMER_ID, MOVE_INTERVAL, NULL);
-            break;
+    // One source pixel of margin, plus one screen pixel: filtering, the
+    // edge-aware scalers and DPI resampling all reach a little past the
+    // changed pixels
+    RECT rect = { position.x + CharacterSize(dirty.left - 1) - 1, position.y + CharacterSize(dirty.top - 1) - 1,
+                  position.x + CharacterSize(dirty.right + 1) + 1, position.y + CharacterSize(dirty.bottom + 1) + 1 };
+    InvalidateScene(&rect);
+}
+
+// Load every known furniture image that exists in the folder
+void LoadFurnitureFromFolder(const std::wstring& folderPath) {
+    g_furnitureImages.assign(FURNITURE_TYPE_COUNT, nullptr);
+    
+    for (size_t i = 0; i < FURNITURE_TYPE_COUNT; i++) {
+        std::wstring filePath = folderPath + L"\\" + FURNITURE_TYPES[i].fileName;
+        if (GetFileAttributesW(filePath.c_str()) == INVALID_FILE_ATTRIBUTES) {
+            continue;
+        }
+        
+        Gdiplus::Image* image = Gdiplus::Image::FromFile(filePath.c_str());
+        if (image && image->GetLastStatus() == Gdiplus::Ok) {
+            g_furnitureImages[i] = image;
+        } else {
+            delete image;
+        }
+    }
+}
+
+// Hand input to the engine, and to the recording at the time the engine
+// applied it, with mouse positions relative to the screen's top-left as
+// CharacterSimulation takes them
+void FeedEngine(SessionEventType type, uint64_t timeMs, int x, int y, uint32_t key) {
+    SessionEvent event = { timeMs, type, x, y, key };
+    uint64_t applied = g_engine.Input(event);
+    if (!g_sessionRecorder.Recording()) return;
+    
+    if (type == SESSION_MOUSE_DOWN || type == SESSION_MOUSE_MOVE || type == SESSION_MOUSE_UP) {
+        x -= g_sessionRecorder.Recorded().screenLeft;
+        y -= g_sessionRecorder.Recorded().screenTop;
+    }
+    g_sessionRecorder.Record(type, applied, x, y, key);
+}
+
+// A new animation from its first frame. The character may have changed
+// size or moved with it, so the window is laid out again.
+void ViewerCharacterHost::AnimationStarted(int animation, bool flipped) {
+    QueueFramesFromGif(g_animationGifs[animation], flipped);
+    UpdateSceneBounds(g_hwnd);
+    needsClear = true;
+    if (!g_frameQueue.empty()) {
+        ScheduleNextFrame(g_frameQueue[0].delay);
+    }
+}
+
+// Mirror the queued frames and carry on from the one on screen
+void ViewerCharacterHost::AnimationTurned(bool flipped) {
+    if (g_frameQueue.empty()) return;
+    
+    size_t frameIndex = g_currentFrameIndex;
+    QueueFramesFromGif(g_frameQueue[frameIndex].gifIndex, flipped);
+    g_currentFrameIndex = std::min(frameIndex, g_frameQueue.size() - 1);
+    needsClear = true;
+}
+
+// While the character is held the window follows once per display frame
+// instead (PresentDragFrame)
+void ViewerCharacterHost::SceneMoved() {
+    if (!g_engine.Held()) {
+        UpdateSceneBounds(g_hwnd);
+    }
+}
+
+// A recording walks on the floor of the work area it started in, which is
+// all a replay knows of the desktop
+ScreenArea ViewerCharacterHost::WalkArea(int x, int y) {
+    ScreenArea area;
+    if (g_sessionRecorder.Recording()) {
+        const Session& setup = g_sessionRecorder.Recorded();
+        area.left = setup.areaLeft;
+        area.top = setup.areaTop;
+        area.right = setup.areaRight;
+        area.bottom = setup.areaBottom;
+        return area;
     }
     
-    // Find the appropriate GIF for the new state 
-    size_t newGifIndex = g_currentGifIndex;
-    bool foundGif = false;
+    RECT rect = WorkAreaAt(x, y);
+    area.left = rect.left;
+    area.top = rect.top;
+    area.right = rect.right;
+    area.bottom = rect.bottom;
+    return area;
+}
+
+ScreenArea ViewerCharacterHost::ScreenBounds() {
+    ScreenArea bounds;
+    bounds.left = g_virtualScreen.left;
+    bounds.top = g_virtualScreen.top;
+    bounds.right = g_virtualScreen.right;
+    bounds.bottom = g_virtualScreen.bottom;
+    return bounds;
+}
+
+bool ViewerCharacterHost::FurnitureSize(size_t type, int* width, int* height) {
+    if (type >= g_furnitureImages.size() || !g_furnitureImages[type]) return false;
+    *width = (int)g_furnitureImages[type]->GetWidth();
+    *height = (int)g_furnitureImages[type]->GetHeight();
+    return true;
+}
+
+// Replays have neither furniture nor strolls, so a recording goes without them
+StateOptions ViewerCharacterHost::Extras() {
+    StateOptions options;
+    options.furniture = !g_sessionRecorder.Recording();
+    options.strolls = !g_sessionRecorder.Recording();
+    return options;
+}
+
+// Top-level windows whose top edge the character can walk on. Fills in the
+// visible frame rect when it returns true.
+bool IsWalkableWindow(HWND hwnd, RECT* rect) {
+    if (!IsWindowVisible(hwnd) || IsIconic(hwnd)) {
+        return false;
+    }
     
-    GifType targetType;
-    switch (g_appState) {
-        case STATE_MOVE: targetType = MOVE; break;
+    // Never stand on ourselves (the menu, furniture, ...)
+    DWORD processId = 0;
+    GetWindowThreadProcessId(hwnd, &processId);
+    if (processId == GetCurrentProcessId()) {
+        return false;
     }
     
-    for (size_t i = 0; i < g_gifs.size(); i++) {
-        if (g_gifs[i].type == targetType) {
-            newGifIndex = i;
-            foundGif = true;
-            break;
-        }
+    // Cloaked windows are "visible" but on another virtual desktop or suspended
+    BOOL cloaked = FALSE;
+    DwmGetWindowAttribute(hwnd, DWMWA_CLOAKED, &cloaked, sizeof(cloaked));
+    if (cloaked) {
+        return false;
     }
     
-    // Queue frames from the new GIF
-    if (foundGif && newGifIndex < g_gifs.size()) {
-        // Clear existing queue
-        g_frameQueue.clear();
-        g_currentFrameIndex = 0;
-        
-        // Queue frames from the new GIF
-        QueueFramesFromGif(newGifIndex);
-        
-        // Resize window to fit new GIF without forcing redraw
-        ResizeWindowToGif(g_hwnd, g_gifs[newGifIndex].animation.image);
-        
-        // Set needsClear flag
-        needsClear = true;
-        
-        // Start animation timer with consistent timing
-        if (!g_frameQueue.empty()) {
-            SetTimer(g_hwnd, ANIMATION_TIMER_ID, MIN_FRAME_DELAY, NULL);
-        }
+    // The extended frame bounds leave out the invisible resize borders
+    if (FAILED(DwmGetWindowAttribute(hwnd, DWMWA_EXTENDED_FRAME_BOUNDS, rect, sizeof(RECT)))) {
+        GetWindowRect(hwnd, rect);
+    }
+    if (rect->right - rect->left < MIN_SURFACE_WIDTH) {
+        return false;
+    }
+    
+    // Maximized and fullscreen windows start at the top of the monitor,
+    // there is no room above them to stand in
+    HMONITOR monitor = MonitorFromWindow(hwnd, MONITOR_DEFAULTTONULL);
+    if (!monitor) {
+        return false;
+    }
+    MONITORINFO monitorInfo = { sizeof(monitorInfo) };
+    GetMonitorInfoW(monitor, &monitorInfo);
+    return rect->top > monitorInfo.rcWork.top;
+}
+
+void UpdateWindowSurface(HWND hwnd) {
+    RECT rect;
+    SurfaceKey key = static_cast<SurfaceKey>(reinterpret_cast<uintptr_t>(hwnd));
+    if (IsWalkableWindow(hwnd, &rect)) {
+        g_surfaces.Set(key, rect.left, rect.right, rect.top);
     } else {
-        // If no valid GIF found, revert to previous state
-        g_appState = prevState;
+        g_surfaces.Remove(key);
+    }
+}
+
+BOOL CALLBACK AddWindowSurface(HWND hwnd, LPARAM lParam) {
+    UpdateWindowSurface(hwnd);
+    return TRUE;
+}
+
+// Every monitor gets a floor along the bottom of its work area
+BOOL CALLBACK AddMonitorSurface(HMONITOR monitor, HDC hdc, LPRECT monitorRect, LPARAM lParam) {
+    SurfaceKey* nextKey = reinterpret_cast<SurfaceKey*>(lParam);
+    MONITORINFO monitorInfo = { sizeof(monitorInfo) };
+    if (GetMonitorInfoW(monitor, &monitorInfo)) {
+        g_surfaces.Set((*nextKey)++, monitorInfo.rcWork.left, monitorInfo.rcWork.right,
+                       monitorInfo.rcWork.bottom);
     }
+    return TRUE;
+}
+
+// Full rebuild, only needed at startup and when the monitor layout changes
+void RebuildSurfaceIndex() {
+    g_surfaces.Clear();
     
-    // Start a new timer for the next state change
-    StartStateTimer();
+    SurfaceKey monitorKey = MONITOR_SURFACE_KEY;
+    EnumDisplayMonitors(NULL, NULL, AddMonitorSurface, reinterpret_cast<LPARAM>(&monitorKey));
+    EnumWindows(AddWindowSurface, 0);
 }
 
-// Modify LoadGifsFromFolder to queue frames after loading
-bool LoadGifsFromFolder(const std::wstring& folderPath) {
-    WIN32_FIND_DATAW findData;
-    HANDLE hFind;
-    std::wstring searchPath = folderPath + L"\\*.gif";
+void CALLBACK SurfaceWinEventProc(HWINEVENTHOOK hook, DWORD event, HWND hwnd,
+                                  LONG idObject, LONG idChild, DWORD eventThread, DWORD eventTime) {
+    g_visibility.RecordWindowEvent();
+    if (!hwnd || idObject != OBJID_WINDOW || idChild != CHILDID_SELF) {
+        return;
+    }
+    
+    // A destroyed window can no longer be queried, just forget it
+    if (event == EVENT_OBJECT_DESTROY) {
+        g_surfaces.Remove(static_cast<SurfaceKey>(reinterpret_cast<uintptr_t>(hwnd)));
+        return;
+    }
+    
+    if (GetAncestor(hwnd, GA_ROOT) == hwnd) {
+        UpdateWindowSurface(hwnd);
+    }
     
-    hFind = FindFirstFileW(searchPath.c_str(), &findData);
-    if (hFind == INVALID_HANDLE_VALUE) {
+    // Anything moving around on the desktop may cover or uncover us
+    RequestVisibilityCheck();
+}
+
+void InstallSurfaceHooks() {
+    // Create/destroy/show/hide/reorder and location change for every
+    // top-level window. Focus, selection and state changes in between are
+    // left out: nothing here needs them and they fire on every click.
+    g_objectEventHook = SetWinEventHook(EVENT_OBJECT_CREATE, EVENT_OBJECT_REORDER,
+                                        NULL, SurfaceWinEventProc, 0, 0,
+                                        WINEVENT_OUTOFCONTEXT | WINEVENT_SKIPOWNPROCESS);
+    g_locationEventHook = SetWinEventHook(EVENT_OBJECT_LOCATIONCHANGE, EVENT_OBJECT_LOCATIONCHANGE,
+                                          NULL, SurfaceWinEventProc, 0, 0,
+                                          WINEVENT_OUTOFCONTEXT | WINEVENT_SKIPOWNPROCESS);
+    g_minimizeEventHook = SetWinEventHook(EVENT_SYSTEM_MINIMIZESTART, EVENT_SYSTEM_MINIMIZEEND,
+                                          NULL, SurfaceWinEventProc, 0, 0,
+                                          WINEVENT_OUTOFCONTEXT | WINEVENT_SKIPOWNPROCESS);
+    g_foregroundEventHook = SetWinEventHook(EVENT_SYSTEM_FOREGROUND, EVENT_SYSTEM_FOREGROUND,
+                                            NULL, SurfaceWinEventProc, 0, 0,
+                                            WINEVENT_OUTOFCONTEXT | WINEVENT_SKIPOWNPROCESS);
+}
+
+void RemoveSurfaceHooks() {
+    if (g_objectEventHook) {
+        UnhookWinEvent(g_objectEventHook);
+        g_objectEventHook = NULL;
+    }
+    if (g_locationEventHook) {
+        UnhookWinEvent(g_locationEventHook);
+        g_locationEventHook = NULL;
+    }
+    if (g_minimizeEventHook) {
+        UnhookWinEvent(g_minimizeEventHook);
+        g_minimizeEventHook = NULL;
+    }
+    if (g_foregroundEventHook) {
+        UnhookWinEvent(g_foregroundEventHook);
+        g_foregroundEventHook = NULL;
+    }
+}
+
+// Window events come in bursts (a dragged window sends dozens per second),
+// so checks are coalesced into one scheduler task
+void RequestVisibilityCheck() {
+    if (g_visibilityTask != INVALID_TASK) {
+        return;
+    }
+    g_visibilityTask = g_scheduler.ScheduleAt(NowMs() + VISIBILITY_CHECK_DELAY, []() {
+        g_visibilityTask = INVALID_TASK;
+        UpdateVisibility();
+    });
+}
+
+// A window counts as fullscreen when it covers the whole monitor the
+// character is on. Covers exclusive D3D apps, borderless games and video.
+bool IsFullscreenAppInFront() {
+    HWND foreground = GetForegroundWindow();
+    if (!foreground || foreground == g_hwnd || foreground == g_menuHwnd ||
+        foreground == GetShellWindow() || foreground == GetDesktopWindow()) {
         return false;
     }
     
-    do {
-        if (!(findData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)) {
-            std::wstring filename = findData.cFileName;
-            std::wstring filePath = folderPath + L"\\" + filename;
-            
-            // Create a GIF info structure
-            GifInfo gifInfo;
-            gifInfo.filePath = filePath;
-            gifInfo.type = GetGifTypeFromFilename(filename);
-            gifInfo.animation.image = Gdiplus::Image::FromFile(filePath.c_str());
-            gifInfo.animation.isPlaying = false;
-            gifInfo.flipped = false;
-            
-            // Load frame info
-            gifInfo.animation.frameDelays = LoadGifFrameInfo(gifInfo.animation.image);
-            if (gifInfo.animation.frameDelays.empty()) {
-                delete gifInfo.animation.image;
-                continue;
-            }
-            
-            // Get frame count
-            UINT count = gifInfo.animation.image->GetFrameDimensionsCount();
-            GUID* dimensionIDs = new GUID[count];
-            gifInfo.animation.image->GetFrameDimensionsList(dimensionIDs, count);
-            gifInfo.animation.frameCount = gifInfo.animation.image->GetFrameCount(&dimensionIDs[0]);
-            delete[] dimensionIDs;
-            
-            // Add to our collection using move semantics
-            g_gifs.push_back(std::move(gifInfo));
-        }
-    } while (FindNextFileW(hFind, &findData) != 0);
+    // The desktop itself (WorkerW/Progman) spans the monitor too
+    wchar_t className[32];
+    if (GetClassNameW(foreground, className, 32) &&
+        (wcscmp(className, L"WorkerW") == 0 || wcscmp(className, L"Progman") == 0)) {
+        return false;
+    }
     
-    FindClose(hFind);
+    RECT charRect = { g_charPos.x, g_charPos.y, g_charPos.x + g_charWidth, g_charPos.y + g_charHeight };
+    HMONITOR ourMonitor = MonitorFromRect(&charRect, MONITOR_DEFAULTTONEAREST);
+    if (MonitorFromWindow(foreground, MONITOR_DEFAULTTONULL) != ourMonitor) {
+        return false;
+    }
     
-    g_hasGifs = !g_gifs.empty();
+    MONITORINFO info = { sizeof(info) };
+    RECT windowRect;
+    if (!GetMonitorInfoW(ourMonitor, &info) || !GetWindowRect(foreground, &windowRect)) {
+        return false;
+    }
+    return windowRect.left <= info.rcMonitor.left && windowRect.top <= info.rcMonitor.top &&
+           windowRect.right >= info.rcMonitor.right && windowRect.bottom >= info.rcMonitor.bottom;
+}
+
+// True when opaque windows above ours cover every pixel of the scene.
+// We are topmost, so only other topmost windows can do this.
+bool IsSceneOccluded() {
+    HRGN visible = CreateRectRgnIndirect(&g_windowRect);
+    bool occluded = false;
     
-    // After loading GIFs, resize window to fit the first GIF and queue its frames
-    if (!g_gifs.empty() && g_gifs[0].animation.image != nullptr) {
-        // Clear any existing queue
-        g_frameQueue.clear();
-        g_currentFrameIndex = 0;
+    for (HWND above = GetWindow(g_hwnd, GW_HWNDPREV); above; above = GetWindow(above, GW_HWNDPREV)) {
+        if (!IsWindowVisible(above) || IsIconic(above) || above == g_menuHwnd) continue;
         
-        // Queue frames from the first GIF
-        QueueFramesFromGif(0);
+        // Layered or click-through windows may well be see-through
+        LONG exStyle = GetWindowLongW(above, GWL_EXSTYLE);
+        if (exStyle & (WS_EX_LAYERED | WS_EX_TRANSPARENT)) continue;
         
-        // Resize window to fit the GIF
-        ResizeWindowToGif(g_hwnd, g_gifs[0].animation.image);
+        BOOL cloaked = FALSE;
+        DwmGetWindowAttribute(above, DWMWA_CLOAKED, &cloaked, sizeof(cloaked));
+        if (cloaked) continue;
         
-        // Start animation timer
-        if (!g_frameQueue.empty()) {
-            SetTimer(g_hwnd, ANIMATION_TIMER_ID, g_frameQueue[0].delay, NULL);
+        RECT rect;
+        if (FAILED(DwmGetWindowAttribute(above, DWMWA_EXTENDED_FRAME_BOUNDS, &rect, sizeof(rect))) &&
+            !GetWindowRect(above, &rect)) {
+            continue;
         }
         
-        // Force redraw
-        InvalidateRect(g_hwnd, NULL, TRUE);
+        HRGN cover = CreateRectRgnIndirect(&rect);
+        int result = CombineRgn(visible, visible, cover, RGN_DIFF);
+        DeleteObject(cover);
+        if (result == NULLREGION) {
+            occluded = true;
+            break;
+        }
     }
     
-    return g_hasGifs;
+    DeleteObject(visible);
+    return occluded;
 }
 
-// Modify StartStateTimer to use consistent timing
-void StartStateTimer() {
-    // Kill any existing timers
-    KillTimer(g_hwnd, TIMER_ID);
-    KillTimer(g_hwnd, ANIMATION_TIMER_ID);
+// Re-derive the reasons we can detect by looking at the desktop
+void UpdateVisibility() {
+    bool fullscreen = IsFullscreenAppInFront();
+    SetHiddenReason(HIDDEN_FULLSCREEN, fullscreen);
     
-    if (g_appState == STATE_MOVE) {
-        // For movement state, use consistent timing
-        SetTimer(g_hwnd, TIMER_ID, MOVE_INTERVAL, NULL);
-    } else {
-        // For other states, use the random duration
-        std::uniform_int_distribution<int> durationDist(MIN_STATE_DURATION, MAX_STATE_DURATION);
-        int duration = durationDist(g_randomEngine);
-        SetTimer(g_hwnd, TIMER_ID, duration, NULL);
+    // While we are hidden for a fullscreen app, nothing is covering us
+    if (!fullscreen) {
+        SetHiddenReason(HIDDEN_OCCLUDED, IsSceneOccluded());
     }
+}
+
+void SetHiddenReason(HiddenReason reason, bool active) {
+    bool wasFullscreen = g_visibility.Has(HIDDEN_FULLSCREEN);
+    VisibilityChange change = g_visibility.SetReason(reason, active, PreciseNowMs());
     
-    // Start animation for current GIF with minimum frame delay
-    if (g_hasGifs && g_currentGifIndex < g_gifs.size()) {
-        UINT initialDelay = std::max(g_gifs[g_currentGifIndex].animation.frameDelays[0], MIN_FRAME_DELAY);
-        SetTimer(g_hwnd, ANIMATION_TIMER_ID, initialDelay, NULL);
+    // Get out of the way of fullscreen apps instead of floating over them
+    if (reason == HIDDEN_FULLSCREEN && wasFullscreen != active) {
+        ShowWindowAsync(g_hwnd, active ? SW_HIDE : SW_SHOWNOACTIVATE);
+    }
+    
+    if (change == VISIBILITY_HIDDEN) {
+        SuspendAnimation();
+    } else if (change == VISIBILITY_SHOWN) {
+        ResumeAnimation();
     }
 }
 
-// Modify MoveWindow to properly update flipped state
-void MoveWindow() {
-    if (g_appState != STATE_MOVE) {
+// Stop the per-frame timers, and tell the engine so the character stops
+// walking
+void SuspendAnimation() {
+    if (!g_frameQueue.empty()) {
+        CancelNextFrame();
+        g_animationSuspended = true;
+    }
+    FeedEngine(SESSION_HIDDEN, NowMs(), 0, 0, 0);
+    
+    wchar_t report[96];
+    swprintf(report, 96, L"Suspended animation (hidden: 0x%x)\n", g_visibility.Reasons());
+    OutputDebugStringW(report);
+}
+
+// Restart what SuspendAnimation stopped. The animation picks up where it
+// would be had it kept playing, so it stays in step with wall time; the
+// engine restarts whatever state timer it held back.
+void ResumeAnimation() {
+    if (g_animationSuspended && !g_frameQueue.empty()) {
+        g_animationSuspended = false;
+        
+        LARGE_INTEGER now;
+        QueryPerformanceCounter(&now);
+        double elapsed = (now.QuadPart - g_lastFrameTime.QuadPart) * 1000.0 / g_performanceFrequency.QuadPart;
+        
+        // Skip whole loops, then walk the rest
+        double loopLength = 0.0;
+        for (size_t i = 0; i < g_frameQueue.size(); i++) {
+            loopLength += g_frameQueue[i].delay;
+        }
+        if (loopLength > 0.0) {
+            elapsed = std::fmod(elapsed, loopLength);
+        }
+        while (elapsed >= g_frameQueue[g_currentFrameIndex].delay) {
+            elapsed -= g_frameQueue[g_currentFrameIndex].delay;
+            g_currentFrameIndex = (g_currentFrameIndex + 1) % g_frameQueue.size();
+        }
+        
+        // Pretend the current frame went up on time, so the hidden stretch
+        // doesn't show up as late or dropped frames
+        g_lastFrameTime.QuadPart = now.QuadPart - (LONGLONG)(elapsed * g_performanceFrequency.QuadPart / 1000.0);
+        UINT remaining = (UINT)(g_frameQueue[g_currentFrameIndex].delay - elapsed);
+        ScheduleNextFrame(std::max(remaining, (UINT)USER_TIMER_MINIMUM));
+    }
+    FeedEngine(SESSION_SHOWN, NowMs(), 0, 0, 0);
+    
+    needsClear = true;
+    InvalidateScene(NULL);
+    OutputDebugStringW(L"Resumed animation\n");
+}
+
+// First press starts recording; second press stops and writes
+// chibiviewer_trace.json next to the executable for chrome://tracing or Perfetto
+void ToggleTracing() {
+    if (!IsTracingEnabled()) {
+        ClearTrace();
+        SetTracingEnabled(true);
         return;
     }
     
-    RECT windowRect;
-    GetWindowRect(g_hwnd, &windowRect);
+    SetTracingEnabled(false);
     
-    int screenWidth = GetSystemMetrics(SM_CXSCREEN);
-    int windowWidth = windowRect.right - windowRect.left;
+    std::wstring path = GetProgramDirectory() + L"\\chibiviewer_trace.json";
+    FILE* file = _wfopen(path.c_str(), L"w");
+    if (!file) {
+        return;
+    }
+    long written = WriteChromeTrace(file);
+    fclose(file);
     
-    // Calculate the new position
-    int newX = windowRect.left;
-    if (g_moveDirectionRight) {
-        newX += MOVE_DISTANCE;
-        
-        // If we've reached the right edge, change direction
-        if (newX + windowWidth > screenWidth) {
-            g_moveDirectionRight = false;
-            
-            // Flip the GIF and update frame queue
-            for (size_t i = 0; i < g_gifs.size(); i++) {
-                if (g_gifs[i].type == MOVE) {
-                    g_gifs[i].flipped = true;
-                    // Re-queue frames with new flipped state
-                    QueueFramesFromGif(i);
-                }
-            }
+    wchar_t report[MAX_PATH + 64];
+    swprintf(report, MAX_PATH + 64, L"Wrote %ld trace events to %ls\n", written, path.c_str());
+    OutputDebugStringW(report);
+}
+
+// A seed nobody is likely to have used before
+uint64_t NewSessionSeed() {
+    LARGE_INTEGER now;
+    QueryPerformanceCounter(&now);
+    return MixSeed(static_cast<uint64_t>(now.QuadPart), static_cast<uint64_t>(time(nullptr)));
+}
+
+uint64_t SessionSeedFromCommandLine(const char* commandLine) {
+    const char* option = commandLine ? strstr(commandLine, "--seed ") : nullptr;
+    if (option) {
+        return strtoull(option + strlen("--seed "), nullptr, 10);
+    }
+    return NewSessionSeed();
+}
+
+// Recording reseeds the random streams and starts the character over
+// waiting, in automatic mode, where it stands, the way CharacterSimulation
+// starts a replay, so the session begins from a seed and a state it can
+// name. What comes before that point isn't part of the recording. Until it
+// stops the character walks on the floor of the work area it started in,
+// since that is all a replay knows of the desktop. The session is saved
+// with the engine's choice and state traces, for the replay to check
+// against.
+void ToggleSessionRecording() {
+    if (!g_sessionRecorder.Recording()) {
+        if (g_gifs.empty() || g_engine.Held()) {
+            return;
         }
-    } else {
-        newX -= MOVE_DISTANCE;
+        uint64_t now = NowMs();
+        g_engine.RunDue(now);
+        int footX = g_engine.X() + g_engine.Width() / 2;
+        int footY = g_engine.Y() + g_engine.Height();
+        RECT area = WorkAreaAt(footX, footY - 1);
         
-        // If we've reached the left edge, change direction
-        if (newX < 0) {
-            g_moveDirectionRight = true;
-            
-            // Flip the GIF and update frame queue
-            for (size_t i = 0; i < g_gifs.size(); i++) {
-                if (g_gifs[i].type == MOVE) {
-                    g_gifs[i].flipped = false;
-                    // Re-queue frames with new flipped state
-                    QueueFramesFromGif(i);
-                }
-            }
+        Session setup;
+        setup.seed = NewSessionSeed();
+        setup.screenLeft = g_virtualScreen.left;
+        setup.screenTop = g_virtualScreen.top;
+        setup.screenWidth = g_virtualScreen.right - g_virtualScreen.left;
+        setup.screenHeight = g_virtualScreen.bottom - g_virtualScreen.top;
+        setup.startX = footX;
+        setup.startY = footY;
+        setup.areaLeft = area.left;
+        setup.areaTop = area.top;
+        setup.areaRight = area.right;
+        setup.areaBottom = area.bottom;
+        setup.scaleFactor = g_scaleFactor;
+        setup.dpiPercent = g_dpiPercent;
+        g_sessionRecorder.Start(setup, now);
+        
+        g_recordingSurfaces.Clear();
+        g_recordingSurfaces.Set(MONITOR_SURFACE_KEY, area.left, area.right, area.bottom);
+        g_engine.SetSurfaces(g_recordingSurfaces);
+        g_engine.Seed(setup.seed);
+        g_engine.Start(now, footX, footY, AUTOMATIC);
+        if (g_visibility.IsHidden()) {
+            FeedEngine(SESSION_HIDDEN, now, 0, 0, 0);
         }
+        InvalidateScene(NULL);
+        return;
     }
     
-    // Update the window position
-    SetWindowPos(g_hwnd, NULL, newX, windowRect.top, 0, 0, 
-                SWP_NOSIZE | SWP_NOZORDER);
+    uint64_t now = NowMs();
+    g_engine.RunDue(now);
+    g_sessionRecorder.Stop(now);
+    g_engine.SetSurfaces(g_surfaces);
+    Session recorded = g_sessionRecorder.Recorded();
+    recorded.choiceTrace = g_engine.ChoiceTrace();
+    recorded.stateTrace = g_engine.StateTrace();
+    std::vector<uint8_t> bytes;
+    WriteSession(recorded, &bytes);
     
-    // Force redraw to ensure smooth animation
-    InvalidateRect(g_hwnd, NULL, TRUE);
+    std::wstring path = GetProgramDirectory() + L"\\chibiviewer_session.chsn";
+    FILE* file = _wfopen(path.c_str(), L"wb");
+    if (!file) {
+        return;
+    }
+    fwrite(bytes.data(), 1, bytes.size(), file);
+    fclose(file);
+    
+    wchar_t report[MAX_PATH + 96];
+    swprintf(report, MAX_PATH + 96, L"Wrote %zu input events (seed %llu) to %ls\n",
+             g_sessionRecorder.Recorded().events.size(), g_sessionRecorder.Recorded().seed, path.c_str());
+    OutputDebugStringW(report);
 }
 
-// Modify ToggleMenu to switch states when menu becomes visible
-void ToggleMenu() {
-    g_menuVisible = !g_menuVisible;
-    ShowWindow(g_menuHwnd, g_menuVisible ? SW_SHOW : SW_HIDE);
+// CPU time used by the whole process so far, in 100 ns units
+uint64_t ProcessCpuTime() {
+    FILETIME creation, exitTime, kernel, user;
+    if (!GetProcessTimes(GetCurrentProcess(), &creation, &exitTime, &kernel, &user)) {
+        return 0;
+    }
+    ULARGE_INTEGER kernelTime = { { kernel.dwLowDateTime, kernel.dwHighDateTime } };
+    ULARGE_INTEGER userTime = { { user.dwLowDateTime, user.dwHighDateTime } };
+    return kernelTime.QuadPart + userTime.QuadPart;
+}
+
+// Close a governor window and apply the new tier if it changed
+void EvaluateQuality() {
+    double now = PreciseNowMs();
+    uint64_t cpu = ProcessCpuTime();
+    double wallMs = now - g_governorWindowStart;
+    double cpuFraction = wallMs > 0.0 ? (cpu - g_governorCpuStart) / 10000.0 / wallMs : 0.0;
+    g_governorWindowStart = now;
+    g_governorCpuStart = cpu;
     
-    // Position menu window next to main window
-    if (g_menuVisible) {
-        RECT mainRect;
-        GetWindowRect(g_hwnd, &mainRect);
-        SetWindowPos(g_menuHwnd, NULL, 
-                    mainRect.right, mainRect.top,
-                    MENU_WIDTH, MENU_HEIGHT,
-                    SWP_NOZORDER);
-        
-        // Switch states immediately when menu becomes visible
-        if (!g_gifs.empty()) {
-            SwitchToNextGif();
+    QualityTier previous = g_governor.Tier();
+    if (!g_governor.Evaluate(cpuFraction)) {
+        return;
+    }
+    g_quality = g_governor.Settings();
+    
+    wchar_t report[200];
+    swprintf(report, 200, L"Quality %ls -> %ls (%.0f%% of frames missed, %.1f%% CPU; %llu down, %llu up)\n",
+             QualityGovernor::TierName(previous), QualityGovernor::TierName(g_governor.Tier()),
+             g_governor.LastMissRatio() * 100.0, g_governor.LastCpuFraction() * 100.0,
+             (unsigned long long)g_governor.Downgrades(), (unsigned long long)g_governor.Upgrades());
+    OutputDebugStringW(report);
+}
+
+// Summarize how each animation's frame delays held up. Runs on the render
+// thread; the copy it returns is shown by ShowPlaybackTiming.
+TimingReport* BuildTimingReport() {
+    wchar_t quality[160];
+    swprintf(quality, 160, L"Quality: %ls (%llu steps down, %llu up)\n\n",
+             QualityGovernor::TierName(g_governor.Tier()),
+             (unsigned long long)g_governor.Downgrades(),
+             (unsigned long long)g_governor.Upgrades());
+    std::wstring text = quality;
+    
+    double now = PreciseNowMs();
+    wchar_t wakeups[320];
+    swprintf(wakeups, 320,
+             L"Wakeups: %.0f/min visible, %.0f/min hidden (%llu suspensions)\n"
+             L"  timer %.0f/%.0f, commands %.0f/%.0f, window events %.0f/%.0f\n"
+             L"  window event callbacks %.0f/min visible, %.0f/min hidden\n\n",
+             g_visibility.WakeupsPerMinute(false, now), g_visibility.WakeupsPerMinute(true, now),
+             (unsigned long long)g_visibility.Suspensions(),
+             g_visibility.WakeupsPerMinute(false, WAKE_TIMER, now),
+             g_visibility.WakeupsPerMinute(true, WAKE_TIMER, now),
+             g_visibility.WakeupsPerMinute(false, WAKE_COMMAND, now),
+             g_visibility.WakeupsPerMinute(true, WAKE_COMMAND, now),
+             g_visibility.WakeupsPerMinute(false, WAKE_MESSAGE, now),
+             g_visibility.WakeupsPerMinute(true, WAKE_MESSAGE, now),
+             g_visibility.WindowEventsPerMinute(false, now),
+             g_visibility.WindowEventsPerMinute(true, now));
+    text += wakeups;
+    
+    wchar_t power[96];
+    swprintf(power, 96, L"Power: %ls (%ls)\n\n", PowerSettingName(g_powerSetting),
+             g_powerSaver ? L"saving" : L"full rate");
+    text += power;
+    
+    // What each character size has cost to make and keep
+    for (int factor = 2; factor <= MAX_SCALE_FACTOR; factor++) {
+        const ScaleStats& stats = g_scaledFrames.Stats(factor);
+        if (stats.framesGenerated == 0) continue;
+        wchar_t scale[160];
+        swprintf(scale, 160, L"Scale %dx: %llu frames made in %.1f ms, %zu cached (%.1f MB), %llu evicted\n\n",
+                 factor, (unsigned long long)stats.framesGenerated, stats.generateNs / 1e6,
+                 stats.frames, stats.bytes / (1024.0 * 1024.0), (unsigned long long)stats.evictions);
+        text += scale;
+    }
+    
+#ifdef CHIBI_TRACK_ALLOCATIONS
+    wchar_t allocating[96];
+    swprintf(allocating, 96, L"Steady-state frames that allocated: %llu\n\n",
+             (unsigned long long)g_allocatingFrames);
+    text += allocating;
+#endif
+    TimingReport* report = new TimingReport();
+    for (size_t i = 0; i < g_gifs.size(); i++) {
+        const wchar_t* name = PathFindFileNameW(g_gifs[i].filePath.c_str());
+        wchar_t line[320];
+        g_gifs[i].timing.FormatSummary(line, 320, name);
+        text += line;
+        text += L"\n\n";
+        report->names.push_back(name);
+        report->timing.push_back(g_gifs[i].timing);
+    }
+    if (g_gifs.empty()) {
+        text += L"No animations loaded.\n\n";
+    }
+    text += L"Save the histograms as CSV?";
+    report->text = text;
+    return report;
+}
+
+// Show a report from BuildTimingReport, and offer the histograms as CSV in
+// the program directory (UI thread)
+void ShowPlaybackTiming(HWND owner, const TimingReport& report) {
+    if (MessageBoxW(owner, report.text.c_str(), L"Playback Timing", MB_YESNO | MB_ICONINFORMATION) != IDYES) {
+        return;
+    }
+    
+    std::wstring path = GetProgramDirectory() + L"\\chibiviewer_playback.csv";
+    FILE* file = _wfopen(path.c_str(), L"w");
+    if (!file) {
+        MessageBoxW(owner, path.c_str(), L"Could not write", MB_OK | MB_ICONWARNING);
+        return;
+    }
+    
+    PlaybackStats::WriteCsvHeader(file);
+    for (size_t i = 0; i < report.names.size(); i++) {
+        // Quoted UTF-8 file name, so commas in names don't split the row
+        char name[MAX_PATH * 3];
+        int length = WideCharToMultiByte(CP_UTF8, 0, report.names[i].c_str(), -1,
+                                         name, sizeof(name), NULL, NULL);
+        std::string quoted = "\"";
+        for (int c = 0; c < length - 1; c++) {
+            if (name[c] == '"') quoted += '"';
+            quoted += name[c];
+        }
+        quoted += '"';
+        report.timing[i].WriteCsv(file, quoted.c_str());
+    }
+    fclose(file);
+}
+
+std::string Utf8FromWide(const std::wstring& text) {
+    int length = WideCharToMultiByte(CP_UTF8, 0, text.c_str(), (int)text.size(), NULL, 0, NULL, NULL);
+    std::string utf8(length, '\0');
+    WideCharToMultiByte(CP_UTF8, 0, text.c_str(), (int)text.size(), &utf8[0], length, NULL, NULL);
+    return utf8;
+}
+
+// What g_memory holds right now, biggest asset first (render thread)
+MemoryReport* BuildMemoryReport() {
+    MemoryReport* report = new MemoryReport();
+    report->usage = g_memory.Snapshot();
+    std::stable_sort(report->usage.begin(), report->usage.end(),
+                     [](const MemoryAssetUsage& a, const MemoryAssetUsage& b) { return a.Total() > b.Total(); });
+    
+    uint64_t totals[MEMORY_CATEGORY_COUNT] = {};
+    uint64_t total = 0;
+    for (const MemoryAssetUsage& asset : report->usage) {
+        for (int c = 0; c < MEMORY_CATEGORY_COUNT; c++) {
+            totals[c] += asset.bytes[c];
         }
+        total += asset.Total();
+    }
+    
+    wchar_t line[320];
+    swprintf(line, 320, L"Total: %.1f MB\n", total / (1024.0 * 1024.0));
+    std::wstring text = line;
+    for (int c = 0; c < MEMORY_CATEGORY_COUNT; c++) {
+        swprintf(line, 320, L"  %hs: %.1f MB\n", MemoryCategoryName((MemoryCategory)c), totals[c] / (1024.0 * 1024.0));
+        text += line;
+    }
+    text += L"\n";
+    
+    // The dialog only has room for the biggest; the JSON has all of them
+    const size_t MAX_LISTED = 12;
+    for (size_t i = 0; i < report->usage.size() && i < MAX_LISTED; i++) {
+        const MemoryAssetUsage& asset = report->usage[i];
+        int length = MultiByteToWideChar(CP_UTF8, 0, asset.name.c_str(), (int)asset.name.size(), NULL, 0);
+        std::wstring name(length, L'\0');
+        MultiByteToWideChar(CP_UTF8, 0, asset.name.c_str(), (int)asset.name.size(), &name[0], length);
+        swprintf(line, 320, L"%ls: %.1f MB (%.1f decoded, %.1f scaled)\n", name.c_str(),
+                 asset.Total() / (1024.0 * 1024.0), asset.bytes[MEMORY_DECODED] / (1024.0 * 1024.0),
+                 asset.bytes[MEMORY_SCALED] / (1024.0 * 1024.0));
+        text += line;
+    }
+    if (report->usage.size() > MAX_LISTED) {
+        swprintf(line, 320, L"...and %zu more\n", report->usage.size() - MAX_LISTED);
+        text += line;
+    }
+    text += L"\nSave the full breakdown as JSON?";
+    report->text = text;
+    return report;
+}
+
+// Show a report from BuildMemoryReport, and offer it as JSON in the program
+// directory (UI thread)
+void ShowMemoryReport(HWND owner, const MemoryReport& report) {
+    if (MessageBoxW(owner, report.text.c_str(), L"Memory Usage", MB_YESNO | MB_ICONINFORMATION) != IDYES) {
+        return;
+    }
+    
+    std::wstring path = GetProgramDirectory() + L"\\chibiviewer_memory.json";
+    FILE* file = _wfopen(path.c_str(), L"w");
+    if (!file) {
+        MessageBoxW(owner, path.c_str(), L"Could not write", MB_OK | MB_ICONWARNING);
+        return;
     }
+    WriteMemoryJson(file, report.usage);
+    fclose(file);
 }
 
-// Determine GIF type from filename
-GifType GetGifTypeFromFilename(const std::wstring& filename) {
-    std::wstring lowerFilename = filename;
-    std::transform(lowerFilename.begin(), lowerFilename.end(), lowerFilename.begin(), ::tolower);
+// Advance the animation by one tick. Driven by ANIMATION_TIMER_ID, or by
+// g_scheduler in power saver mode.
+void AnimationTick() {
+    TRACE_ZONE("AnimationTick");
+    
+    if (g_frameQueue.empty()) {
+        return;
+    }
+    
+    // Started again while hidden; ResumeAnimation brings it back
+    if (g_visibility.IsHidden()) {
+        CancelNextFrame();
+        g_animationSuspended = true;
+        return;
+    }
     
-    if (lowerFilename.find(L"move") != std::wstring::npos) {
-        return MOVE;
-    } else if (lowerFilename.find(L"wait") != std::wstring::npos) {
-        return WAIT;
-    } else if (lowerFilename.find(L"sit") != std::wstring::npos) {
-        return SIT;
-    } else if (lowerFilename.find(L"pick") != std::wstring::npos) {
-        return PICK;
+    // Calculate frame time
+    LARGE_INTEGER currentTime;
+    QueryPerformanceCounter(&currentTime);
+    double deltaTime = (currentTime.QuadPart - g_lastFrameTime.QuadPart) * 1000.0 / g_performanceFrequency.QuadPart;
+    g_lastFrameTime = currentTime;
+    
+    // The frame that was showing has had its turn; compare with what the GIF asked for
+    const FrameInfo& shown = g_frameQueue[g_currentFrameIndex];
+    UINT shownDelay = shown.delay;
+    if (shown.gifIndex < g_gifs.size()) {
+        g_gifs[shown.gifIndex].timing.RecordFrame(shownDelay, deltaTime);
+    }
+    
+    // Judge the frame against the deadline we actually set, which the
+    // 60 FPS floor and a capped tier can make later than the GIF's delay.
+    // Power saver wakes late on purpose; only hold against us what the
+    // grid doesn't explain.
+    UINT deadline = g_scheduledFrameDelay;
+    g_governor.RecordFrame(g_powerSaver ? deadline + POWER_SAVER_GRID_MS : deadline, deltaTime);
+    if (g_governor.WindowComplete()) {
+        EvaluateQuality();
+    }
+    
+    // Move to next frame in queue
+    g_currentFrameIndex = (g_currentFrameIndex + 1) % g_frameQueue.size();
+    
+    // At the lowest tier and in power saver, jump over frames whose time
+    // has already passed so the animation keeps its speed
+    if (g_quality.skipFrames || g_powerSaver) {
+        g_frameDebt = std::max(0.0, g_frameDebt + deltaTime - shownDelay);
+        for (size_t skipped = 0; skipped < g_frameQueue.size() &&
+             g_frameDebt >= g_frameQueue[g_currentFrameIndex].delay; skipped++) {
+            g_frameDebt -= g_frameQueue[g_currentFrameIndex].delay;
+            g_currentFrameIndex = (g_currentFrameIndex + 1) % g_frameQueue.size();
+        }
     } else {
-        return MISC;
+        g_frameDebt = 0.0;
+    }
+    
+    // Set timer for next frame
+    UINT minDelay = std::max(MIN_FRAME_DELAY, (UINT)g_quality.minFrameDelayMs);
+    UINT nextDelay = std::max(g_frameQueue[g_currentFrameIndex].delay, minDelay);
+    ScheduleNextFrame(nextDelay);
+    
+    // Repaint what the new frame changed, if anything
+    InvalidateChangedArea();
+}
+
+// Ask for the next animation tick after delay ms. Power saver puts it on
+// the scheduler grid so it shares a wakeup with everything else due then.
+void ScheduleNextFrame(UINT delay) {
+    CancelNextFrame();
+    g_scheduledFrameDelay = delay;
+    if (g_powerSaver) {
+        g_frameTask = g_scheduler.ScheduleAt(NowMs() + delay, []() {
+            g_frameTask = INVALID_TASK;
+            AnimationTick();
+        });
+    } else {
+        StartTimer(ANIMATION_TIMER_ID, delay);
+    }
+}
+
+void CancelNextFrame() {
+    StopTimer(ANIMATION_TIMER_ID);
+    if (g_frameTask != INVALID_TASK) {
+        g_scheduler.Cancel(g_frameTask);
+        g_frameTask = INVALID_TASK;
+    }
+}
+
+// Pick power saver on or off from the setting and the power source
+void UpdatePowerMode() {
+    SYSTEM_POWER_STATUS status;
+    bool onBattery = GetSystemPowerStatus(&status) && status.ACLineStatus == 0;
+    bool active = IsPowerSaverActive(g_powerSetting, onBattery);
+    if (active == g_powerSaver) {
+        return;
+    }
+    
+    g_powerSaver = active;
+    g_scheduler.SetGrid(active ? POWER_SAVER_GRID_MS : 0);
+    
+    // Move the frame timer over to the new way of driving it; the engine's
+    // task goes on the grid when ArmEngine next schedules it
+    if (!g_frameQueue.empty() && !g_animationSuspended && !g_visibility.IsHidden()) {
+        ScheduleNextFrame(g_frameQueue[g_currentFrameIndex].delay);
+    }
+    
+    OutputDebugStringW(active ? L"Power saver on\n" : L"Power saver off\n");
+}
+
+// Show or hide the menu (UI thread). The render thread moves it next to
+// the character and switches states once it is visible.
+void ToggleMenu() {
+    g_menuVisible = !g_menuVisible;
+    ShowWindow(g_menuHwnd, g_menuVisible ? SW_SHOW : SW_HIDE);
+    
+    if (g_menuVisible) {
+        SendRenderCommand(CMD_MENU_SHOWN);
     }
 }
 
 // Modify CleanupGifs to ensure proper cleanup
 void CleanupGifs() {
-    // Kill any existing timers
-    KillTimer(g_hwnd, TIMER_ID);
-    KillTimer(g_hwnd, ANIMATION_TIMER_ID);
+    // Take the character away, furniture, throws and strolls included,
+    // and kill any existing timers
+    g_engine.Stop();
+    CancelNextFrame();
     
     // Clear frame queue
     g_frameQueue.clear();
     g_currentFrameIndex = 0;
     
-    // Clean up layers
-    if (g_topLayer) {
-        delete g_topLayer;
-        g_topLayer = nullptr;
-    }
-    if (g_bottomLayer) {
-        delete g_bottomLayer;
-        g_bottomLayer = nullptr;
+    // Clean up furniture images
+    for (size_t i = 0; i < g_furnitureImages.size(); i++) {
+        delete g_furnitureImages[i];
     }
+    g_furnitureImages.clear();
     
-    // Clean up GIFs
-    for (size_t i = 0; i < g_gifs.size(); i++) {
-        if (g_gifs[i].animation.image != nullptr) {
-            delete g_gifs[i].animation.image;
-            g_gifs[i].animation.image = nullptr;
-        }
-    }
+    // Scaled frames belong to the GIFs going away
+    g_scaledFrames.Clear();
+    
+    // Clean up layers
+    g_renderSurfaces.Clear();
+    g_hasShownFrame = false;
     
+    // Clean up GIFs; each takes its image and ledger line with it
     g_gifs.clear();
     g_hasGifs = false;
 } 
\ No newline at end of file
@@ -0,0 +1,63 @@
+#include "AllocTracker.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+namespace {
+
+std::atomic<uint64_t> s_allocations(0);
+std::atomic<uint64_t> s_bytes(0);
+thread_local uint64_t t_allocations = 0;
+thread_local uint64_t t_bytes = 0;
+
+}  // namespace
+
+#ifdef CHIBI_TRACK_ALLOCATIONS
+
+namespace {
+
+void* CountedAlloc(std::size_t size) {
+    s_allocations.fetch_add(1, std::memory_order_relaxed);
+    s_bytes.fetch_add(size, std::memory_order_relaxed);
+    t_allocations++;
+    t_bytes += size;
+    return std::malloc(size ? size : 1);
+}
+
+}  // namespace
+
+void* operator new(std::size_t size) {
+    void* p = CountedAlloc(size);
+    if (!p) throw std::bad_alloc();
+    return p;
+}
+
+void* operator new[](std::size_t size) {
+    void* p = CountedAlloc(size);
+    if (!p) throw std::bad_alloc();
+    return p;
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept { return CountedAlloc(size); }
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept { return CountedAlloc(size); }
+
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::size_t) noexcept { std::free(p); }
+void operator delete(void* p, const std::nothrow_t&) noexcept { std::free(p); }
+void operator delete[](void* p, const std::nothrow_t&) noexcept { std::free(p); }
+
+bool AllocationTrackingEnabled() { return true; }
+
+#else
+
+bool AllocationTrackingEnabled() { return false; }
+
+#endif
+
+uint64_t AllocationCount() { return s_allocations.load(std::memory_order_relaxed); }
+uint64_t AllocatedBytes() { return s_bytes.load(std::memory_order_relaxed); }
+uint64_t ThreadAllocationCount() { return t_allocations; }
+uint64_t ThreadAllocatedBytes() { return t_bytes; }
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstdint>
+
+// Heap allocation counting for checking that hot paths stay allocation
+// free. Debug builds and the bench replace the global operator new to
+// count every call; elsewhere the counters stay at zero.
+#if defined(_DEBUG) && !defined(CHIBI_TRACK_ALLOCATIONS)
+#define CHIBI_TRACK_ALLOCATIONS
+#endif
+
+// True when this build actually counts
+bool AllocationTrackingEnabled();
+
+// Totals since startup, across all threads
+uint64_t AllocationCount();
+uint64_t AllocatedBytes();
+
+// Totals made by the calling thread
+uint64_t ThreadAllocationCount();
+uint64_t ThreadAllocatedBytes();
+
+// Allocations the calling thread made between construction and
+// Allocations(); other threads working at the same time don't count
+class AllocationScope {
+public:
+    AllocationScope() : startCount(ThreadAllocationCount()), startBytes(ThreadAllocatedBytes()) {}
+
+    uint64_t Allocations() const { return ThreadAllocationCount() - startCount; }
+    uint64_t Bytes() const { return ThreadAllocatedBytes() - startBytes; }
+
+private:
+    uint64_t startCount;
+    uint64_t startBytes;
+};
@@ -0,0 +1,175 @@
+#include "Behavior.h"
+
+#include <cstdlib>
+#include <new>
+#include <vector>
+
+namespace {
+
+const size_t FRAME_CLASS_BYTES = 64;   // Size classes are multiples of this
+const size_t FRAME_CLASSES = 16;       // So frames up to 1 KB are pooled
+const size_t FRAME_CHUNK_BYTES = 64 * 1024;
+
+// Per-thread pool of coroutine frames. A freed frame goes on the free list
+// of its size class and is handed to the next frame of that class, so after
+// warm-up starting and finishing behaviors never touches the heap.
+class FramePool {
+public:
+    FramePool() : chunkUsed(FRAME_CHUNK_BYTES), liveFrames(0), liveBytes(0), oversize(0) {
+        for (size_t i = 0; i < FRAME_CLASSES; i++) {
+            freeLists[i] = nullptr;
+        }
+    }
+
+    ~FramePool() {
+        for (size_t i = 0; i < chunks.size(); i++) {
+            std::free(chunks[i]);
+        }
+    }
+
+    void* Allocate(size_t size) {
+        size_t sizeClass = ClassOf(size);
+        if (sizeClass >= FRAME_CLASSES) {
+            oversize++;
+            return ::operator new(size);
+        }
+        liveFrames++;
+        liveBytes += (sizeClass + 1) * FRAME_CLASS_BYTES;
+
+        if (FreeBlock* block = freeLists[sizeClass]) {
+            freeLists[sizeClass] = block->next;
+            return block;
+        }
+
+        size_t bytes = (sizeClass + 1) * FRAME_CLASS_BYTES;
+        if (chunkUsed + bytes > FRAME_CHUNK_BYTES) {
+            // The tail of the old chunk is wasted; at most one block
+            void* chunk = std::malloc(FRAME_CHUNK_BYTES);
+            if (!chunk) throw std::bad_alloc();
+            chunks.push_back(static_cast<char*>(chunk));
+            chunkUsed = 0;
+        }
+        void* block = chunks.back() + chunkUsed;
+        chunkUsed += bytes;
+        return block;
+    }
+
+    void Free(void* frame, size_t size) {
+        size_t sizeClass = ClassOf(size);
+        if (sizeClass >= FRAME_CLASSES) {
+            ::operator delete(frame);
+            return;
+        }
+        liveFrames--;
+        liveBytes -= (sizeClass + 1) * FRAME_CLASS_BYTES;
+
+        FreeBlock* block = static_cast<FreeBlock*>(frame);
+        block->next = freeLists[sizeClass];
+        freeLists[sizeClass] = block;
+    }
+
+    BehaviorFrameStats Stats() const {
+        BehaviorFrameStats stats;
+        stats.chunks = chunks.size();
+        stats.liveFrames = liveFrames;
+        stats.liveBytes = liveBytes;
+        stats.oversize = oversize;
+        return stats;
+    }
+
+private:
+    struct FreeBlock {
+        FreeBlock* next;
+    };
+
+    static size_t ClassOf(size_t size) {
+        return (size + FRAME_CLASS_BYTES - 1) / FRAME_CLASS_BYTES - 1;
+    }
+
+    FreeBlock* freeLists[FRAME_CLASSES];
+    std::vector<char*> chunks;
+    size_t chunkUsed;  // Bytes handed out from chunks.back()
+    size_t liveFrames;
+    size_t liveBytes;
+    uint64_t oversize;
+};
+
+thread_local FramePool t_framePool;
+
+}  // namespace
+
+void* Behavior::promise_type::operator new(size_t size) {
+    return t_framePool.Allocate(size);
+}
+
+void Behavior::promise_type::operator delete(void* frame, size_t size) {
+    t_framePool.Free(frame, size);
+}
+
+BehaviorFrameStats BehaviorFramePoolStats() {
+    return t_framePool.Stats();
+}
+
+Behavior& Behavior::operator=(Behavior&& other) noexcept {
+    if (this != &other) {
+        Cancel();
+        handle = other.handle;
+        other.handle = nullptr;
+    }
+    return *this;
+}
+
+void Behavior::Start() {
+    if (handle && !handle.done()) {
+        handle.resume();
+    }
+}
+
+void Behavior::Cancel() {
+    if (!handle) {
+        return;
+    }
+
+    // Whoever would have resumed it must not touch the frame again
+    promise_type& promise = handle.promise();
+    if (promise.pendingTask != INVALID_TASK) {
+        promise.host->BehaviorScheduler().Cancel(promise.pendingTask);
+    }
+    if (promise.hostResume) {
+        promise.host->CancelResume(promise.hostResume);
+    }
+    handle.destroy();
+    handle = nullptr;
+}
+
+void WaitFor::await_suspend(std::coroutine_handle<Behavior::promise_type> handle) {
+    Behavior::promise_type& promise = handle.promise();
+    BehaviorHost* host = promise.host;
+
+    // Only the handle is captured, which fits in std::function's own
+    // storage, so waiting doesn't allocate
+    promise.pendingTask = host->BehaviorScheduler().ScheduleAt(host->BehaviorNowMs() + ms, [handle]() {
+        handle.promise().pendingTask = INVALID_TASK;
+        handle.resume();
+    });
+}
+
+void PlayUntilLoopEnd::await_suspend(std::coroutine_handle<Behavior::promise_type> handle) {
+    promise = &handle.promise();
+    promise->hostResume = handle;
+    promise->host->PlayUntilLoopEnd(state, handle);
+}
+
+void PlayUntilLoopEnd::await_resume() {
+    promise->hostResume = nullptr;
+}
+
+void MoveTo::await_suspend(std::coroutine_handle<Behavior::promise_type> handle) {
+    promise = &handle.promise();
+    promise->hostResume = handle;
+    promise->host->MoveTo(x, handle);
+}
+
+void MoveTo::await_resume() {
+    promise->hostResume = nullptr;
+}
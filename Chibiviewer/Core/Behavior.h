@@ -0,0 +1,157 @@
+#pragma once
+
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+
+#include "CharacterState.h"
+#include "Scheduler.h"
+
+// Multi-step character routines ("walk to the edge, sit for 10 s, wave,
+// walk back") written as C++20 coroutines instead of a web of timer
+// callbacks:
+//
+//   Behavior Stroll([[maybe_unused]] BehaviorHost& host, int edgeX, int homeX) {
+//       co_await MoveTo(edgeX);
+//       co_await PlayUntilLoopEnd(STATE_SIT);
+//       co_await WaitFor(10000);
+//       co_await MoveTo(homeX);
+//   }
+//
+// The first parameter of a behavior must be its BehaviorHost; the awaitables
+// find it through the promise, so the body itself usually never names it
+// (hence [[maybe_unused]]). Frames come from a per-thread pool, so
+// running thousands of behaviors costs no heap traffic per step once the
+// pool has grown to fit them. Everything runs on the thread that owns the
+// host's scheduler.
+
+// What a behavior can ask of the character it drives. The viewer implements
+// it on top of its animation and movement code; the bench with a fake clock.
+class BehaviorHost {
+public:
+    virtual ~BehaviorHost() {}
+
+    // Clock and scheduler that WaitFor uses
+    virtual Scheduler& BehaviorScheduler() = 0;
+    virtual uint64_t BehaviorNowMs() = 0;
+
+    // Switch to the state's animation and resume once it has played
+    // through once
+    virtual void PlayUntilLoopEnd(AppState state, std::coroutine_handle<> resume) = 0;
+
+    // Walk until the character's center is at x, then resume
+    virtual void MoveTo(int x, std::coroutine_handle<> resume) = 0;
+
+    // The behavior waiting on resume is being destroyed; forget it
+    virtual void CancelResume(std::coroutine_handle<> resume) = 0;
+
+    // A behavior ran to its end. Called from inside it, so don't destroy
+    // it from here.
+    virtual void BehaviorFinished() {}
+};
+
+// Owning handle to a running behavior. Destroying it (or Cancel) stops the
+// routine wherever it is waiting.
+class Behavior {
+public:
+    struct promise_type {
+        BehaviorHost* host;
+        TaskId pendingTask;                  // WaitFor's scheduler task
+        std::coroutine_handle<> hostResume;  // Handed to the host, if waiting on it
+
+        // Sees the behavior's arguments; only the first one is kept
+        template <typename... Args>
+        explicit promise_type(BehaviorHost& host, Args&&...)
+            : host(&host), pendingTask(INVALID_TASK) {}
+
+        Behavior get_return_object() {
+            return Behavior(std::coroutine_handle<promise_type>::from_promise(*this));
+        }
+
+        // Nothing runs until Start()
+        std::suspend_always initial_suspend() noexcept { return {}; }
+
+        struct FinalAwaiter {
+            bool await_ready() noexcept { return false; }
+            void await_suspend(std::coroutine_handle<promise_type> handle) noexcept {
+                handle.promise().host->BehaviorFinished();
+            }
+            void await_resume() noexcept {}
+        };
+        FinalAwaiter final_suspend() noexcept { return {}; }
+
+        void return_void() {}
+        void unhandled_exception() { throw; }
+
+        // Frames come from the calling thread's BehaviorFramePool
+        static void* operator new(size_t size);
+        static void operator delete(void* frame, size_t size);
+    };
+
+    Behavior() {}
+    explicit Behavior(std::coroutine_handle<promise_type> handle) : handle(handle) {}
+    Behavior(Behavior&& other) noexcept : handle(other.handle) { other.handle = nullptr; }
+    Behavior& operator=(Behavior&& other) noexcept;
+    ~Behavior() { Cancel(); }
+
+    // Run up to the first wait
+    void Start();
+
+    // Stop wherever it is waiting and free the frame
+    void Cancel();
+
+    bool Running() const { return handle && !handle.done(); }
+    bool Empty() const { return !handle; }
+
+private:
+    Behavior(const Behavior&);
+    Behavior& operator=(const Behavior&);
+
+    std::coroutine_handle<promise_type> handle;
+};
+
+// co_await WaitFor(ms): resume ms later on the host's scheduler (on the
+// power saver grid like any other state timer)
+struct WaitFor {
+    uint64_t ms;
+    explicit WaitFor(uint64_t ms) : ms(ms) {}
+
+    bool await_ready() const { return false; }
+    void await_suspend(std::coroutine_handle<Behavior::promise_type> handle);
+    void await_resume() {}
+};
+
+// co_await PlayUntilLoopEnd(state): play the state's animation through once
+struct PlayUntilLoopEnd {
+    AppState state;
+    explicit PlayUntilLoopEnd(AppState state) : state(state) {}
+
+    bool await_ready() const { return false; }
+    void await_suspend(std::coroutine_handle<Behavior::promise_type> handle);
+    void await_resume();
+
+    Behavior::promise_type* promise = nullptr;
+};
+
+// co_await MoveTo(x): walk until the character's center is at x
+struct MoveTo {
+    int x;
+    explicit MoveTo(int x) : x(x) {}
+
+    bool await_ready() const { return false; }
+    void await_suspend(std::coroutine_handle<Behavior::promise_type> handle);
+    void await_resume();
+
+    Behavior::promise_type* promise = nullptr;
+};
+
+// Fixed-size blocks for coroutine frames, carved out of 64 KB chunks and
+// recycled through a free list per size class. Chunks are only returned when
+// the thread exits.
+struct BehaviorFrameStats {
+    size_t chunks;      // 64 KB chunks taken from the heap
+    size_t liveFrames;
+    size_t liveBytes;   // Rounded up to the size class
+    uint64_t oversize;  // Frames too big for a class, which went to the heap
+};
+BehaviorFrameStats BehaviorFramePoolStats();
@@ -0,0 +1,8 @@
+#pragma once
+
+#include <cstddef>
+
+// Size to keep data written by different threads apart, so one thread's
+// writes don't keep invalidating the line another thread reads (false
+// sharing). 64 bytes on every x86 and most ARM cores we run on.
+const size_t CACHE_LINE_SIZE = 64;
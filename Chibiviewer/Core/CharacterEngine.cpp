@@ -0,0 +1,886 @@
+#include "CharacterEngine.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+
+namespace {
+
+const uint32_t KEY_SPACE = 0x20;  // VK_SPACE
+const uint32_t KEY_A = 'A';
+const uint32_t KEY_F = 'F';
+const uint32_t KEY_P = 'P';
+
+const uint64_t FNV_OFFSET = 0xCBF29CE484222325ull;
+const uint64_t FNV_PRIME = 0x100000001B3ull;
+
+uint64_t HashValue(uint64_t hash, uint64_t value) {
+    for (int i = 0; i < 8; i++) {
+        hash ^= (value >> (8 * i)) & 0xFF;
+        hash *= FNV_PRIME;
+    }
+    return hash;
+}
+
+// Walk to the far end of the surface, sit through the sitting animation and
+// rest there, wave, then walk back to where the stroll started
+Behavior Stroll([[maybe_unused]] BehaviorHost& host, int edgeX, int homeX) {
+    co_await MoveTo(edgeX);
+    co_await PlayUntilLoopEnd(STATE_SIT);
+    co_await WaitFor(STROLL_REST_MS);
+    co_await PlayUntilLoopEnd(STATE_MISC);
+    co_await MoveTo(homeX);
+}
+
+}  // namespace
+
+CharacterEngine::CharacterEngine(const CharacterTable& character, const std::vector<CharacterAnimation>& animations,
+                                 const SurfaceIndex& surfaces, CharacterHost& host)
+    : character(character), animations(animations), surfaces(&surfaces), host(host), rules(random),
+      nowMs(0), startMs(0), trace(FNV_OFFSET), mode(AUTOMATIC), appState(STATE_WAIT), prevState(STATE_WAIT),
+      characterState(STATE_WAIT), animation(-1), shownFlipped(false), x(0), y(0), width(0), height(0),
+      scaleFactor(1), dpiPercent(100), moveRight(true), hasMoveTarget(false), moveTargetX(0), walkEndsMs(0),
+      stateTask(INVALID_TASK), hidden(false), stateTimerSuspended(false), loopEndSuspended(false), held(false),
+      thrown(false), prediction(true), stepper(PHYSICS_STEP, PHYSICS_MAX_STEPS), throwBody(0),
+      physicsTask(INVALID_TASK), usingFurniture(false), furnitureTask(INVALID_TASK),
+      behaviorTask(INVALID_TASK), loopTask(INVALID_TASK) {}
+
+CharacterEngine::~CharacterEngine() {
+    // The behavior calls back into us while it is destroyed
+    StopBehavior();
+}
+
+void CharacterEngine::Seed(uint64_t seed) {
+    random.Seed(seed, 0);
+    rules.ResetTrace();
+}
+
+void CharacterEngine::Start(uint64_t nowMs, int footX, int footY, AppMode mode) {
+    Stop();
+    this->nowMs = startMs = nowMs;
+    trace = FNV_OFFSET;
+    this->mode = mode;
+    appState = prevState = STATE_WAIT;
+    characterState = STATE_WAIT;
+    moveRight = true;
+    hidden = false;
+    flipped.assign(animations.size(), 0);
+    if (animations.size() != character.Animations().size()) {
+        return;
+    }
+
+    // Waiting if it can, otherwise in whatever loaded first
+    int first = PickAnimation(STATE_WAIT);
+    for (size_t i = 0; first < 0 && i < animations.size(); i++) {
+        if (!animations[i].delaysMs.empty()) first = static_cast<int>(i);
+    }
+    if (first < 0) {
+        return;
+    }
+    x = footX - Drawn(animations[first].width) / 2;
+    y = footY - Drawn(animations[first].height);
+    PlayAnimation(first);
+    if (mode == AUTOMATIC) {
+        StartStateTimer();
+    }
+}
+
+void CharacterEngine::Stop() {
+    StopBehavior();
+    scheduler.Clear();
+    stateTask = physicsTask = furnitureTask = INVALID_TASK;
+    furniture.clear();
+    usingFurniture = false;
+    hasMoveTarget = false;
+    walkEndsMs = 0;
+    held = thrown = false;
+    stateTimerSuspended = loopEndSuspended = false;
+    bodies.Clear();
+    pointer.Clear();
+    stepper.Reset();
+    animation = -1;
+    shownFlipped = false;
+}
+
+void CharacterEngine::RunDue(uint64_t nowMs) {
+    // One deadline at a time, so a task sees its own time on the clock
+    // and anything it schedules for then still runs in this call
+    while (scheduler.HasPending() && scheduler.NextDeadline() <= nowMs) {
+        this->nowMs = std::max(this->nowMs, scheduler.NextDeadline());
+        scheduler.RunDue(this->nowMs);
+    }
+}
+
+uint64_t CharacterEngine::Input(const SessionEvent& event) {
+    RunDue(event.timeMs);
+    nowMs = std::max(nowMs, event.timeMs);
+    if (animation < 0) {
+        return nowMs;
+    }
+
+    switch (event.type) {
+        case SESSION_MOUSE_DOWN:
+            MouseDown(event.x, event.y);
+            break;
+        case SESSION_MOUSE_MOVE:
+            if (held) Drag(event.x, event.y);
+            break;
+        case SESSION_MOUSE_UP:
+            MouseUp(event.x, event.y);
+            break;
+        case SESSION_KEY:
+            Key(event.key);
+            break;
+        case SESSION_HIDDEN:
+            Suspend();
+            break;
+        case SESSION_SHOWN:
+            Resume();
+            break;
+        case SESSION_NEXT_STATE:
+            NextState();
+            break;
+        case SESSION_SCALE:
+            Rescale(event.x, event.y);
+            break;
+        default:
+            break;
+    }
+    return nowMs;
+}
+
+void CharacterEngine::SetScale(int scaleFactor, int dpiPercent) {
+    Rescale(scaleFactor, dpiPercent);
+}
+
+// Choose what comes after the current state through the shared rules and
+// start it, with a timer for the one after that
+void CharacterEngine::UpdateAppState() {
+    // Leaving the furniture takes it away
+    if (usingFurniture) {
+        RemoveFurniture();
+    }
+    AppState previous = appState;
+
+    // Other code sets appState directly, so only trust characterState while
+    // they agree. A recording goes without furniture and strolls, which the
+    // host turns off.
+    int fromState = character.BaseState(characterState) == appState ? characterState : static_cast<int>(appState);
+    StateOptions allowed = host.Extras();
+    StateOptions options;
+    options.furniture = allowed.furniture && furniture.empty() && HasFurniture();
+    options.strolls = allowed.strolls;
+    StateChoice choice = rules.NextState(character, fromState, options);
+    AppState manifestBase = character.BaseState(choice.state);
+
+    int strollEdgeX = 0;
+    if (choice.kind == CHOICE_STROLL && !FindStrollEdge(&strollEdgeX)) {
+        choice.kind = CHOICE_WALK;
+    }
+    characterState = choice.state;
+    StopStateTicks();
+
+    switch (choice.kind) {
+        case CHOICE_WALK:
+            appState = STATE_MOVE;
+            moveRight = rules.WalkRight();
+            for (size_t i = 0; i < flipped.size(); i++) {
+                if (character.BaseState(character.Animations()[i].state) == STATE_MOVE) {
+                    flipped[i] = !moveRight;
+                }
+            }
+            StartStateTicks(MOVE_INTERVAL);
+            break;
+
+        case CHOICE_FURNITURE:
+            if (!CreateFurniture()) {
+                break;
+            }
+            appState = STATE_MOVE;
+
+            // The walk picks the direction towards the furniture
+            SetMoveTarget(GetFurnitureCenterX(furniture[0]));
+            StartStateTicks(MOVE_INTERVAL);
+            break;
+
+        case CHOICE_STROLL:
+            // The stroll picks its own animations and timers from here on
+            StartBehavior(Stroll(*this, strollEdgeX, x + width / 2));
+            return;
+
+        case CHOICE_STATE:
+            // Stand in place and play one of the state's animations; there
+            // is nothing special for a manifest state based on pick
+            appState = manifestBase == STATE_PICK ? STATE_MISC : manifestBase;
+            break;
+    }
+
+    bool manifestChose = choice.kind == CHOICE_STATE || (choice.kind == CHOICE_WALK && choice.state != STATE_MOVE);
+    int picked = PickAnimation(manifestChose ? choice.state : static_cast<int>(appState));
+    if (picked >= 0) {
+        PlayAnimation(picked);
+    } else {
+        appState = previous;
+    }
+    StartStateTimer();
+}
+
+// The next state in manual order (Space, or the menu opening)
+void CharacterEngine::NextState() {
+    AppState previous = appState;
+    appState = NextManualState(appState);
+    int picked = PickAnimation(appState);
+    if (picked >= 0) {
+        PlayAnimation(picked);
+    } else {
+        appState = previous;
+    }
+}
+
+void CharacterEngine::StartStateTimer() {
+    StopStateTicks();
+
+    if (appState == STATE_MOVE) {
+        StartStateTicks(MOVE_INTERVAL);
+
+        // With manifest transitions a walk ends like any other state;
+        // otherwise it goes on until something else happens
+        uint32_t duration = hasMoveTarget ? 0 : rules.DurationMs(character, STATE_MOVE);
+        walkEndsMs = duration != 0 ? nowMs + duration : 0;
+    } else {
+        // A random stay, unless the animation is meant to play just once
+        uint64_t duration = rules.DurationMs(character, appState);
+        if (animation >= 0 && character.Animations()[animation].loop == LOOP_ONCE) {
+            duration = LoopMs(animation);
+        }
+        StartStateTicks(duration);
+    }
+}
+
+// A repeating timer: walking steps in STATE_MOVE, the end of the state
+// otherwise. It re-arms before running, so the handler can stop or
+// restart it.
+void CharacterEngine::StartStateTicks(uint64_t intervalMs) {
+    StopStateTicks();
+    stateTask = scheduler.ScheduleAt(nowMs + intervalMs, [this, intervalMs]() {
+        stateTask = INVALID_TASK;
+        StartStateTicks(intervalMs);
+        OnStateTimer();
+    });
+}
+
+void CharacterEngine::StopStateTicks() {
+    scheduler.Cancel(stateTask);
+    stateTask = INVALID_TASK;
+}
+
+void CharacterEngine::OnStateTimer() {
+    // Started again while hidden; Resume() brings it back
+    if (hidden) {
+        StopStateTicks();
+        stateTimerSuspended = true;
+        return;
+    }
+
+    if (held || thrown) {
+        // FinishPick restarts the state timer
+        StopStateTicks();
+    } else if (appState == STATE_MOVE) {
+        MoveStep(MOVE_DISTANCE);
+    } else {
+        UpdateAppState();
+    }
+}
+
+// An animation of a state, chosen by the animation weights, or -1 if it
+// has none. Built-in states pass their AppState.
+int CharacterEngine::PickAnimation(int state) {
+    int picked = character.PickAnimation(state, random[RANDOM_ANIMATION]);
+    if (picked >= 0 && !animations[picked].delaysMs.empty()) {
+        return picked;
+    }
+
+    // Picked one that failed to load: any animation of the right kind will do
+    GifType type = GifTypeForState(character.BaseState(state));
+    for (size_t i = 0; i < animations.size(); i++) {
+        if (!animations[i].delaysMs.empty() &&
+            GifTypeForState(character.BaseState(character.Animations()[i].state)) == type) {
+            return static_cast<int>(i);
+        }
+    }
+    return -1;
+}
+
+bool CharacterEngine::PlayState(AppState state) {
+    int picked = PickAnimation(state);
+    if (picked < 0) {
+        return false;
+    }
+    PlayAnimation(picked);
+    return true;
+}
+
+// Switch animations. If both have an anchor, that point stays where it was
+// on screen; otherwise the top-left does.
+void CharacterEngine::PlayAnimation(int next) {
+    int fromX = 0, fromY = 0, toX = 0, toY = 0;
+    bool anchored = animation >= 0 && Anchor(animation, shownFlipped, &fromX, &fromY);
+
+    animation = next;
+    shownFlipped = flipped[next] != 0;
+    width = Drawn(animations[next].width);
+    height = Drawn(animations[next].height);
+    if (anchored && Anchor(next, shownFlipped, &toX, &toY)) {
+        x += fromX - toX;
+        y += fromY - toY;
+    }
+    NoteState();
+    host.AnimationStarted(next, shownFlipped);
+}
+
+// How long one pass through an animation takes on screen
+uint64_t CharacterEngine::LoopMs(int animation) const {
+    float speed = character.Animations()[animation].speed;
+    uint64_t total = 0;
+    for (uint32_t delay : animations[animation].delaysMs) {
+        total += std::max(static_cast<uint32_t>(delay / speed), MIN_FRAME_DELAY);
+    }
+    return total;
+}
+
+// Where an animation's manifest anchor is inside the character as drawn
+// (scaled, and mirrored if flipped). False if it has none.
+bool CharacterEngine::Anchor(int animation, bool flipped, int* anchorX, int* anchorY) const {
+    const ManifestAnimation& spec = character.Animations()[animation];
+    if (!spec.hasAnchor) return false;
+
+    *anchorX = Drawn(flipped ? animations[animation].width - 1 - spec.anchorX : spec.anchorX);
+    *anchorY = Drawn(spec.anchorY);
+    return true;
+}
+
+// One walking step along the surface under the character's feet, turning
+// at its ends, or towards the move target
+void CharacterEngine::MoveStep(int distance) {
+    if (appState != STATE_MOVE) {
+        return;
+    }
+    if (walkEndsMs != 0 && !hasMoveTarget && nowMs >= walkEndsMs) {
+        walkEndsMs = 0;
+        UpdateAppState();
+        return;
+    }
+
+    int newY = y;
+    int minX;
+    int maxX;
+
+    // If the surface moved a little we follow it; if it is gone we drop
+    // onto the next one below
+    int footY = y + height;
+    int footX = x + width / 2;
+    Surface surface;
+    if (surfaces->FindSupport(footX, footY, SURFACE_SNAP_DISTANCE, &surface) ||
+        surfaces->FindBelow(footX, footY, &surface)) {
+        newY = surface.y - height;
+        minX = surface.left;
+        maxX = surface.right - width;
+
+        // Narrow surfaces: keep just the feet on it
+        if (maxX <= minX) {
+            minX = surface.left - width / 2;
+            maxX = surface.right - 1 - width / 2;
+        }
+    } else {
+        // Nothing to stand on: stay on the monitor the character is on
+        ScreenArea area = host.WalkArea(footX, footY - 1);
+        minX = area.left;
+        maxX = area.right - width;
+    }
+
+    int newX = x;
+    if (hasMoveTarget) {
+        // Walking to a target keeps its initial direction until it arrives
+        if (std::abs(footX - moveTargetX) < distance * 2) {
+            hasMoveTarget = false;
+            if (behaviorResume) {
+                // Stand still until the behavior says what's next
+                StopStateTicks();
+                appState = STATE_WAIT;
+                ResumeBehaviorSoon();
+            } else {
+                UseFurniture();
+            }
+            return;
+        }
+        newX += moveRight ? distance : -distance;
+    } else if (moveRight) {
+        newX += distance;
+        if (newX > maxX) {
+            newX += TurnAround(false);
+        }
+    } else {
+        newX -= distance;
+        if (newX < minX) {
+            newX += TurnAround(true);
+        }
+    }
+    Place(newX, newY);
+}
+
+// Walk the other way: mirror the animation that is playing, and only that
+// one, so the weighted pick that chose it stands. The anchor is kept where
+// it was on screen like a switch keeps it, and the animation carries on
+// from the frame it was at. Returns how far the character has to move
+// sideways for that; the caller moves it.
+int CharacterEngine::TurnAround(bool right) {
+    moveRight = right;
+    if (animation < 0 || (flipped[animation] != 0) == !right) {
+        return 0;
+    }
+
+    int fromX = 0, toX = 0, anchorY = 0;
+    bool anchored = Anchor(animation, !right, &toX, &anchorY) && Anchor(animation, right, &fromX, &anchorY);
+    flipped[animation] = !right;
+    shownFlipped = !right;
+    NoteState();
+    host.AnimationTurned(shownFlipped);
+    return anchored ? fromX - toX : 0;
+}
+
+// Walk in a straight line until the character's center is at targetCenterX,
+// then hand over to the behavior waiting for it or to UseFurniture
+void CharacterEngine::SetMoveTarget(int targetCenterX) {
+    hasMoveTarget = true;
+    walkEndsMs = 0;
+    moveTargetX = targetCenterX;
+    moveRight = targetCenterX > x + width / 2;
+    for (size_t i = 0; i < flipped.size(); i++) {
+        if (character.BaseState(character.Animations()[i].state) == STATE_MOVE) {
+            flipped[i] = !moveRight;
+        }
+    }
+}
+
+void CharacterEngine::Place(int newX, int newY) {
+    x = newX;
+    y = newY;
+    NoteState();
+    host.SceneMoved();
+}
+
+void CharacterEngine::NoteState() {
+    trace = HashValue(trace, nowMs - startMs);
+    trace = HashValue(trace, (static_cast<uint64_t>(appState) << 32) | static_cast<uint32_t>(characterState));
+    trace = HashValue(trace, (static_cast<uint64_t>(static_cast<uint32_t>(animation)) << 1) | (shownFlipped ? 1 : 0));
+    trace = HashValue(trace, (static_cast<uint64_t>(static_cast<uint32_t>(x)) << 32) | static_cast<uint32_t>(y));
+}
+
+// Pick the character up by it or by its furniture. The viewer's window
+// only gets clicks on the scene; a replay can have others, which miss.
+void CharacterEngine::MouseDown(int pointerX, int pointerY) {
+    if (held) {
+        return;
+    }
+    bool hit = pointerX >= x && pointerX < x + width && pointerY >= y && pointerY < y + height;
+    for (size_t i = 0; !hit && i < furniture.size(); i++) {
+        const Furniture& piece = furniture[i];
+        hit = piece.visible && pointerX >= piece.x && pointerX < piece.x + piece.width &&
+              pointerY >= piece.y && pointerY < piece.y + piece.height;
+    }
+    if (!hit) {
+        return;
+    }
+
+    // Whatever the character was up to, it's over, and picking it up
+    // clears away any furniture
+    StopBehavior();
+    if (usingFurniture) {
+        appState = STATE_WAIT;
+    }
+    RemoveFurniture();
+
+    // Catching a thrown character keeps the state it had before the throw
+    if (thrown) {
+        StopThrow();
+    } else {
+        prevState = appState;
+    }
+    held = true;
+    appState = STATE_PICK;
+    StopStateTicks();
+
+    pointer.Clear();
+    pointer.Push(static_cast<double>(nowMs), static_cast<float>(pointerX), static_cast<float>(pointerY));
+    PlayState(STATE_PICK);
+}
+
+// Hold the character centered on where the pointer is (or is about to be)
+void CharacterEngine::Drag(int pointerX, int pointerY) {
+    pointer.Push(static_cast<double>(nowMs), static_cast<float>(pointerX), static_cast<float>(pointerY));
+
+    float aimX = pointer.Recent(0).x;
+    float aimY = pointer.Recent(0).y;
+    if (prediction) {
+        pointer.Predict(DRAG_PREDICTION, DRAG_VELOCITY_WINDOW, &aimX, &aimY);
+    }
+
+    ScreenArea bounds = host.ScreenBounds();
+    int newX = static_cast<int>(std::floor(aimX + 0.5f)) - width / 2;
+    int newY = static_cast<int>(std::floor(aimY + 0.5f)) - height / 2;
+    newX = std::max(bounds.left, std::min(newX, bounds.right - width));
+    newY = std::max(bounds.top, std::min(newY, bounds.bottom - height));
+    Place(newX, newY);
+}
+
+// Let go: the character keeps the drag velocity and falls until it lands,
+// then goes back to what it was doing (FinishPick)
+void CharacterEngine::MouseUp(int pointerX, int pointerY) {
+    if (!held) {
+        return;
+    }
+    held = false;
+    Drag(pointerX, pointerY);
+
+    float vx = 0.0f;
+    float vy = 0.0f;
+    pointer.EstimateVelocity(THROW_SAMPLE_WINDOW, &vx, &vy);
+    StartThrow(vx, vy);
+}
+
+void CharacterEngine::Key(uint32_t key) {
+    switch (key) {
+        case KEY_A:
+            mode = mode == AUTOMATIC ? MANUAL : AUTOMATIC;
+            if (mode == AUTOMATIC) {
+                StartStateTimer();
+            } else {
+                StopBehavior();
+                StopStateTicks();
+            }
+            break;
+
+        case KEY_SPACE:
+            // Space gets the character off the furniture first
+            if (mode == MANUAL) {
+                if (usingFurniture) {
+                    FinishUsingFurniture();
+                } else {
+                    NextState();
+                }
+            }
+            break;
+
+        case KEY_P:
+            prediction = !prediction;
+            break;
+
+        case KEY_F:
+            // Place a piece of furniture and walk over to it
+            if (!held && host.Extras().furniture && HasFurniture() && CreateFurniture()) {
+                StopBehavior();
+                StartWalkToFurniture();
+            }
+            break;
+
+        default:
+            break;
+    }
+}
+
+// Nobody can see the character: stop walking. Long state timers are left
+// alone; if one fires while hidden, OnStateTimer suspends it then.
+void CharacterEngine::Suspend() {
+    hidden = true;
+    if (appState == STATE_MOVE && !held && !thrown) {
+        StopStateTicks();
+        stateTimerSuspended = true;
+    }
+}
+
+void CharacterEngine::Resume() {
+    hidden = false;
+    if (stateTimerSuspended && !held && !thrown) {
+        stateTimerSuspended = false;
+        if (appState == STATE_MOVE) {
+            StartStateTicks(MOVE_INTERVAL);
+        } else {
+            StartStateTicks(rules.DurationMs(character, appState));
+        }
+    }
+    if (loopEndSuspended) {
+        loopEndSuspended = false;
+        ResumeBehaviorSoon();
+    }
+}
+
+// Change the drawn size, keeping the feet of the character and each piece
+// of furniture where they are
+void CharacterEngine::Rescale(int newScaleFactor, int newDpiPercent) {
+    if (newScaleFactor < 1 || newDpiPercent < 1 || (newScaleFactor == scaleFactor && newDpiPercent == dpiPercent)) {
+        return;
+    }
+
+    for (size_t i = 0; i < furniture.size(); i++) {
+        Furniture& piece = furniture[i];
+        int newWidth = piece.width * newDpiPercent / dpiPercent;
+        int newHeight = piece.height * newDpiPercent / dpiPercent;
+        piece.x += (piece.width - newWidth) / 2;
+        piece.y += piece.height - newHeight;
+        piece.width = newWidth;
+        piece.height = newHeight;
+    }
+
+    int centerX = x + width / 2;
+    int bottom = y + height;
+    scaleFactor = newScaleFactor;
+    dpiPercent = newDpiPercent;
+    if (animation >= 0) {
+        width = Drawn(animations[animation].width);
+        height = Drawn(animations[animation].height);
+        x = centerX - width / 2;
+        y = bottom - height;
+    }
+    Place(x, y);
+}
+
+void CharacterEngine::StartThrow(float vx, float vy) {
+    bodies.Clear();
+    throwBody = bodies.Add(static_cast<float>(x), static_cast<float>(y), static_cast<float>(width),
+                           static_cast<float>(height), vx, vy);
+    thrown = true;
+    stepper.Reset();
+
+    physicsTask = scheduler.ScheduleAt(nowMs + PHYSICS_INTERVAL, [this]() {
+        physicsTask = INVALID_TASK;
+        StepThrow();
+    });
+}
+
+// The fixed steps one physics interval is worth, then one move
+void CharacterEngine::StepThrow() {
+    int steps = stepper.Advance(PHYSICS_INTERVAL / 1000.0);
+    ScreenArea area = host.ScreenBounds();
+    PhysicsBounds bounds;
+    bounds.left = static_cast<float>(area.left);
+    bounds.top = static_cast<float>(area.top);
+    bounds.right = static_cast<float>(area.right);
+    bounds.bottom = static_cast<float>(area.bottom);
+    for (int i = 0; i < steps; i++) {
+        bodies.Step(static_cast<float>(PHYSICS_STEP), physics, *surfaces, bounds);
+    }
+
+    Place(static_cast<int>(std::floor(bodies.x[throwBody] + 0.5f)),
+          static_cast<int>(std::floor(bodies.y[throwBody] + 0.5f)));
+    if (bodies.IsResting(throwBody)) {
+        StopThrow();
+        FinishPick();
+        return;
+    }
+    physicsTask = scheduler.ScheduleAt(nowMs + PHYSICS_INTERVAL, [this]() {
+        physicsTask = INVALID_TASK;
+        StepThrow();
+    });
+}
+
+void CharacterEngine::StopThrow() {
+    scheduler.Cancel(physicsTask);
+    physicsTask = INVALID_TASK;
+    bodies.Clear();
+    thrown = false;
+}
+
+// Back on its feet: restore the state from before the pick
+void CharacterEngine::FinishPick() {
+    appState = prevState;
+    PlayState(prevState);
+    if (mode == AUTOMATIC) {
+        StartStateTimer();
+    }
+}
+
+bool CharacterEngine::HasFurniture() {
+    int furnitureWidth, furnitureHeight;
+    for (size_t i = 0; i < FURNITURE_TYPE_COUNT; i++) {
+        if (host.FurnitureSize(i, &furnitureWidth, &furnitureHeight)) return true;
+    }
+    return false;
+}
+
+// Place a random available furniture type on the character's floor line
+bool CharacterEngine::CreateFurniture() {
+    std::vector<size_t> available;
+    int furnitureWidth, furnitureHeight;
+    for (size_t i = 0; i < FURNITURE_TYPE_COUNT; i++) {
+        if (host.FurnitureSize(i, &furnitureWidth, &furnitureHeight)) available.push_back(i);
+    }
+    if (available.empty()) return false;
+
+    size_t typeIndex = available[RandomRange(random[RANDOM_FURNITURE], 0, static_cast<int>(available.size()) - 1)];
+    host.FurnitureSize(typeIndex, &furnitureWidth, &furnitureHeight);
+    ScreenArea area = host.WalkArea(x + width / 2, y + height - 1);
+    furniture.clear();
+    furniture.push_back(PlaceFurniture(typeIndex, furnitureWidth * dpiPercent / 100,
+                                       furnitureHeight * dpiPercent / 100,
+                                       area.left, area.top, area.right, area.bottom,
+                                       y + height, random[RANDOM_FURNITURE]));
+    host.SceneMoved();
+    return true;
+}
+
+void CharacterEngine::RemoveFurniture() {
+    scheduler.Cancel(furnitureTask);
+    furnitureTask = INVALID_TASK;
+
+    usingFurniture = false;
+    hasMoveTarget = false;
+    if (!furniture.empty()) {
+        furniture.clear();
+        host.SceneMoved();
+    }
+}
+
+void CharacterEngine::StartWalkToFurniture() {
+    if (furniture.empty()) return;
+
+    StopStateTicks();
+    appState = STATE_MOVE;
+    SetMoveTarget(GetFurnitureCenterX(furniture[0]));
+    PlayState(STATE_MOVE);
+    StartStateTicks(MOVE_INTERVAL);
+}
+
+// The walk reached the furniture
+void CharacterEngine::UseFurniture() {
+    if (furniture.empty()) return;
+
+    StopStateTicks();
+    const Furniture& piece = furniture[0];
+    AppState useState = FURNITURE_TYPES[piece.typeIndex].useType == FURNITURE_SIT ? STATE_SIT : STATE_MISC;
+    appState = useState;
+    PlayState(useState);
+
+    // Bottom-center of the character goes on the use point
+    int useX, useY;
+    GetFurnitureUsePosition(piece, &useX, &useY);
+    usingFurniture = true;
+    Place(useX - width / 2, useY - height);
+
+    // In automatic mode the stay ends on its own; in manual mode Space ends it
+    if (mode == AUTOMATIC) {
+        furnitureTask = scheduler.ScheduleAt(nowMs + rules.StayMs(), [this]() { FinishUsingFurniture(); });
+    }
+}
+
+void CharacterEngine::FinishUsingFurniture() {
+    furnitureTask = INVALID_TASK;
+    RemoveFurniture();
+
+    appState = STATE_WAIT;
+    PlayState(STATE_WAIT);
+    if (mode == AUTOMATIC) {
+        StartStateTimer();
+    }
+}
+
+void CharacterEngine::StartBehavior(Behavior next) {
+    StopBehavior();
+    behavior = std::move(next);
+    behavior.Start();
+}
+
+// Drop the running behavior wherever it is; the caller decides what the
+// character does instead
+void CharacterEngine::StopBehavior() {
+    behavior.Cancel();
+    scheduler.Cancel(behaviorTask);
+    scheduler.Cancel(loopTask);
+    behaviorTask = loopTask = INVALID_TASK;
+    behaviorResume = nullptr;
+    loopEndSuspended = false;
+    hasMoveTarget = false;
+}
+
+// The walk or loop the behavior waits on is done; carry on with it from
+// a task rather than from deep inside the caller
+void CharacterEngine::ResumeBehaviorSoon() {
+    std::coroutine_handle<> resume = behaviorResume;
+    behaviorResume = nullptr;
+    scheduler.Cancel(loopTask);
+    loopTask = INVALID_TASK;
+    behaviorTask = scheduler.ScheduleAt(nowMs, [this, resume]() {
+        behaviorTask = INVALID_TASK;
+        resume.resume();
+    }, false);
+}
+
+void CharacterEngine::FinishBehavior() {
+    behaviorTask = INVALID_TASK;
+    behavior = Behavior();
+
+    appState = STATE_WAIT;
+    PlayState(STATE_WAIT);
+    StartStateTimer();
+}
+
+// Center x at the far end of the surface under the character, if it is
+// long enough to be worth the walk
+bool CharacterEngine::FindStrollEdge(int* edgeX) {
+    int footX = x + width / 2;
+    int footY = y + height;
+    ScreenArea area = host.WalkArea(footX, footY - 1);
+    int left = area.left + width / 2;
+    int right = area.right - width / 2;
+    Surface surface;
+    if (surfaces->FindSupport(footX, footY, SURFACE_SNAP_DISTANCE, &surface)) {
+        left = surface.left + width / 2;
+        right = surface.right - width / 2;
+    }
+
+    *edgeX = footX - left > right - footX ? left : right;
+    return std::abs(*edgeX - footX) >= STROLL_MIN_DISTANCE;
+}
+
+void CharacterEngine::PlayUntilLoopEnd(AppState state, std::coroutine_handle<> resume) {
+    StopStateTicks();
+    appState = state;
+    behaviorResume = resume;
+
+    // No animation for the state: there's no loop to wait for. The loop
+    // ends as the animation comes back round to its first frame, which
+    // doesn't happen while nobody can see it.
+    if (!PlayState(state)) {
+        ResumeBehaviorSoon();
+        return;
+    }
+    loopTask = scheduler.ScheduleAt(nowMs + LoopMs(animation), [this]() {
+        loopTask = INVALID_TASK;
+        if (hidden) {
+            loopEndSuspended = true;
+        } else {
+            ResumeBehaviorSoon();
+        }
+    });
+}
+
+void CharacterEngine::MoveTo(int targetX, std::coroutine_handle<> resume) {
+    StopStateTicks();
+    appState = STATE_MOVE;
+    behaviorResume = resume;
+    SetMoveTarget(targetX);
+    PlayState(STATE_MOVE);
+    StartStateTicks(MOVE_INTERVAL);
+}
+
+void CharacterEngine::CancelResume(std::coroutine_handle<>) {
+    scheduler.Cancel(behaviorTask);
+    scheduler.Cancel(loopTask);
+    behaviorTask = loopTask = INVALID_TASK;
+    behaviorResume = nullptr;
+    loopEndSuspended = false;
+}
+
+void CharacterEngine::BehaviorFinished() {
+    // Still inside the behavior; destroy it once it has returned
+    behaviorTask = scheduler.ScheduleAt(nowMs, [this]() { FinishBehavior(); }, false);
+}
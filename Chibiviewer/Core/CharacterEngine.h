@@ -0,0 +1,270 @@
+#pragma once
+
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "Behavior.h"
+#include "CharacterManifest.h"
+#include "CharacterState.h"
+#include "Furniture.h"
+#include "Physics.h"
+#include "PointerHistory.h"
+#include "RandomStreams.h"
+#include "Scheduler.h"
+#include "Session.h"
+#include "StateRules.h"
+#include "SurfaceIndex.h"
+
+// The character's timings (the viewer's frame queue uses MIN_FRAME_DELAY too)
+const uint32_t MIN_FRAME_DELAY = 16;           // Minimum frame delay (60 FPS)
+const uint64_t MOVE_INTERVAL = 16;             // Between walking steps
+const int MOVE_DISTANCE = 2;                   // Pixels per walking step
+const uint64_t PHYSICS_INTERVAL = 16;          // Between physics updates of a throw
+const double PHYSICS_STEP = 1.0 / 120.0;       // Fixed simulation step in seconds
+const int PHYSICS_MAX_STEPS = 12;              // Catch-up limit after a stall
+const double THROW_SAMPLE_WINDOW = 80.0;       // Pointer history used for the release velocity (ms)
+const double DRAG_PREDICTION = 8.0;            // How far ahead of the pointer to place the character (ms)
+const double DRAG_VELOCITY_WINDOW = 40.0;      // Pointer history used for the prediction (ms)
+const int STROLL_MIN_DISTANCE = 300;           // Surfaces shorter than this aren't worth strolling along
+const uint64_t STROLL_REST_MS = 10000;         // How long the character sits at the far end
+const int SURFACE_SNAP_DISTANCE = 8;           // A surface this close still carries the character
+
+// What the engine needs from an animation: never the pixels. One that
+// failed to load has no delays and is never picked.
+struct CharacterAnimation {
+    std::vector<uint32_t> delaysMs;  // Raw frame delays, before the manifest speed
+    int width;                       // Image size, before scaling
+    int height;
+};
+
+// A rectangle in screen coordinates, right and bottom exclusive
+struct ScreenArea {
+    int left;
+    int top;
+    int right;
+    int bottom;
+};
+
+// What the engine asks of whoever shows the character. The viewer answers
+// with its window and the desktop; CharacterSimulation with a recorded
+// screen and a virtual clock.
+class CharacterHost {
+public:
+    virtual ~CharacterHost() {}
+
+    // Another animation starts from its first frame, mirrored or not. The
+    // character may have moved and changed size with it.
+    virtual void AnimationStarted(int animation, bool flipped) = 0;
+
+    // The animation playing turned the other way and carries on from the
+    // frame it was at
+    virtual void AnimationTurned(bool flipped) = 0;
+
+    // The character or its furniture moved or changed size
+    virtual void SceneMoved() = 0;
+
+    // Where walking stops when no surface carries the character: the work
+    // area of the monitor at (x, y)
+    virtual ScreenArea WalkArea(int x, int y) = 0;
+
+    // The walls of drags and throws
+    virtual ScreenArea ScreenBounds() = 0;
+
+    // Image size of a kind of furniture, false if the character has none
+    virtual bool FurnitureSize(size_t type, int* width, int* height) = 0;
+
+    // Whether furniture and strolls may come up on their own
+    virtual StateOptions Extras() = 0;
+};
+
+// The character's state machine and movement: state timers, walking along
+// surfaces, dragging and throwing, furniture and strolls. The viewer and
+// CharacterSimulation both run it, so a session recorded in one replays in
+// the other through the same code.
+//
+// Time is logical. Every task runs at its own deadline, however late the
+// host calls RunDue(), and input applies at its own time, or at the last
+// task run if that is later. Input() returns that time; recorded with the
+// event, it makes a replay on a virtual clock take exactly the same steps
+// as a run on real timers.
+class CharacterEngine : private BehaviorHost {
+public:
+    // Everything must outlive the engine. Animations line up with
+    // character.Animations().
+    CharacterEngine(const CharacterTable& character, const std::vector<CharacterAnimation>& animations,
+                    const SurfaceIndex& surfaces, CharacterHost& host);
+    ~CharacterEngine();
+
+    // Reseed the random streams and start a new choice trace
+    void Seed(uint64_t seed);
+    uint64_t SessionSeed() const { return random.SessionSeed(); }
+
+    // Put the character on screen waiting, feet at (footX, footY), and
+    // start its state timer in automatic mode. It counts as shown until a
+    // SESSION_HIDDEN says otherwise. Stop() takes it away.
+    void Start(uint64_t nowMs, int footX, int footY, AppMode mode);
+    void Stop();
+
+    // Run every task due by nowMs, each at its own deadline
+    void RunDue(uint64_t nowMs);
+    bool HasPending() const { return scheduler.HasPending(); }
+    uint64_t NextDeadline() const { return scheduler.NextDeadline(); }
+
+    // Apply an event at its time (screen coordinates). Returns the time it
+    // was applied at, which is what a recording should keep.
+    uint64_t Input(const SessionEvent& event);
+
+    // Walk on other surfaces from now on (a recording walks on its floor only)
+    void SetSurfaces(const SurfaceIndex& surfaces) { this->surfaces = &surfaces; }
+
+    // Drawn size: the character is scaleFactor * dpiPercent percent of its
+    // images, furniture dpiPercent. Takes effect at once; a recording
+    // passes changes in as SESSION_SCALE instead.
+    void SetScale(int scaleFactor, int dpiPercent);
+
+    uint64_t Now() const { return nowMs; }
+    AppMode Mode() const { return mode; }
+    AppState State() const { return appState; }
+    int CharacterState() const { return characterState; }
+    int Animation() const { return animation; }  // -1 before Start()
+    bool Flipped() const { return shownFlipped; }
+    int X() const { return x; }                  // Top-left on screen
+    int Y() const { return y; }
+    int Width() const { return width; }          // As drawn
+    int Height() const { return height; }
+    bool Held() const { return held; }
+    bool Thrown() const { return thrown; }
+    bool UsingFurniture() const { return usingFurniture; }
+    const std::vector<Furniture>& PlacedFurniture() const { return furniture; }
+
+    // StateRules::Trace() since the last Seed()
+    uint64_t ChoiceTrace() const { return rules.Trace(); }
+
+    // FNV-1a over the state and position at every change since Start(),
+    // with times relative to it; equal traces mean the character did the same
+    uint64_t StateTrace() const { return trace; }
+
+private:
+    // State machine
+    void UpdateAppState();
+    void NextState();
+    void StartStateTimer();
+    void StartStateTicks(uint64_t intervalMs);
+    void StopStateTicks();
+    void OnStateTimer();
+    int PickAnimation(int characterState);
+    bool PlayState(AppState state);
+    void PlayAnimation(int next);
+    uint64_t LoopMs(int animation) const;
+    bool Anchor(int animation, bool flipped, int* anchorX, int* anchorY) const;
+    int Drawn(int imageSize) const { return imageSize * scaleFactor * dpiPercent / 100; }
+
+    // Movement
+    void MoveStep(int distance);
+    int TurnAround(bool right);
+    void SetMoveTarget(int targetCenterX);
+    void Place(int newX, int newY);
+    void NoteState();
+
+    // Input
+    void MouseDown(int pointerX, int pointerY);
+    void Drag(int pointerX, int pointerY);
+    void MouseUp(int pointerX, int pointerY);
+    void Key(uint32_t key);
+    void Suspend();
+    void Resume();
+    void Rescale(int newScaleFactor, int newDpiPercent);
+
+    // Throwing
+    void StartThrow(float vx, float vy);
+    void StepThrow();
+    void StopThrow();
+    void FinishPick();
+
+    // Furniture
+    bool HasFurniture();
+    bool CreateFurniture();
+    void RemoveFurniture();
+    void StartWalkToFurniture();
+    void UseFurniture();
+    void FinishUsingFurniture();
+
+    // Strolls
+    void StartBehavior(Behavior next);
+    void StopBehavior();
+    void ResumeBehaviorSoon();
+    void FinishBehavior();
+    bool FindStrollEdge(int* edgeX);
+
+    // BehaviorHost
+    Scheduler& BehaviorScheduler() override { return scheduler; }
+    uint64_t BehaviorNowMs() override { return nowMs; }
+    void PlayUntilLoopEnd(AppState state, std::coroutine_handle<> resume) override;
+    void MoveTo(int x, std::coroutine_handle<> resume) override;
+    void CancelResume(std::coroutine_handle<> resume) override;
+    void BehaviorFinished() override;
+
+    CharacterEngine(const CharacterEngine&);
+    CharacterEngine& operator=(const CharacterEngine&);
+
+    const CharacterTable& character;
+    const std::vector<CharacterAnimation>& animations;
+    const SurfaceIndex* surfaces;
+    CharacterHost& host;
+
+    Scheduler scheduler;
+    CharacterRandom random;
+    StateRules rules;
+    uint64_t nowMs;
+    uint64_t startMs;
+    uint64_t trace;
+
+    AppMode mode;
+    AppState appState;
+    AppState prevState;           // Where a pick goes back to
+    int characterState;           // Where the manifest's transitions continue from
+    int animation;
+    bool shownFlipped;
+    std::vector<uint8_t> flipped; // Per animation, mirrored when it next plays
+    int x;
+    int y;
+    int width;
+    int height;
+    int scaleFactor;
+    int dpiPercent;
+
+    bool moveRight;
+    bool hasMoveTarget;
+    int moveTargetX;              // Character center x
+    uint64_t walkEndsMs;          // When a free walk hands over to the next state, 0 for never
+    TaskId stateTask;             // State timer, or walking ticks while in STATE_MOVE
+
+    bool hidden;
+    bool stateTimerSuspended;     // Restart the state timer when shown again
+    bool loopEndSuspended;        // A stroll's loop ended while hidden
+
+    bool held;
+    bool thrown;
+    bool prediction;
+    PointerHistory pointer;
+    BodySystem bodies;
+    PhysicsParams physics;
+    FixedStepper stepper;
+    size_t throwBody;
+    TaskId physicsTask;
+
+    std::vector<Furniture> furniture;
+    bool usingFurniture;
+    TaskId furnitureTask;
+
+    // Multi-step routine in progress (automatic mode only). While it waits
+    // on a walk or a loop of the animation, behaviorResume holds where to
+    // pick it up; resuming goes through a task so it never runs from inside
+    // MoveStep.
+    Behavior behavior;
+    std::coroutine_handle<> behaviorResume;
+    TaskId behaviorTask;          // Resume or clean-up queued
+    TaskId loopTask;              // End of the loop a behavior waits for
+};
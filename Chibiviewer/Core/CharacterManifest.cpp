@@ -0,0 +1,320 @@
+#include "CharacterManifest.h"
+
+#include <algorithm>
+#include <cstdlib>
+
+#include "RandomStreams.h"
+
+namespace {
+
+// The states every character has, in AppState order
+const char* const BUILT_IN_STATES[] = { "move", "wait", "sit", "pick", "misc" };
+const int BUILT_IN_STATE_COUNT = 5;
+
+bool Fail(std::string* error, size_t line, const std::string& reason) {
+    if (error) *error = "line " + std::to_string(line) + ": " + reason;
+    return false;
+}
+
+// Manifests are UTF-8; file names are wide like everywhere else in the viewer
+std::wstring Widen(const std::string& text) {
+    std::wstring wide;
+    for (size_t i = 0; i < text.size();) {
+        unsigned char lead = static_cast<unsigned char>(text[i]);
+        uint32_t codePoint = lead;
+        size_t extra = lead >= 0xF0 ? 3 : lead >= 0xE0 ? 2 : lead >= 0xC0 ? 1 : 0;
+        if (extra) {
+            codePoint = lead & (0x3F >> extra);
+        }
+        i++;
+        for (size_t k = 0; k < extra && i < text.size(); k++, i++) {
+            codePoint = (codePoint << 6) | (static_cast<unsigned char>(text[i]) & 0x3F);
+        }
+        if (sizeof(wchar_t) == 2 && codePoint > 0xFFFF) {
+            codePoint -= 0x10000;
+            wide += static_cast<wchar_t>(0xD800 + (codePoint >> 10));
+            wide += static_cast<wchar_t>(0xDC00 + (codePoint & 0x3FF));
+        } else {
+            wide += static_cast<wchar_t>(codePoint);
+        }
+    }
+    return wide;
+}
+
+// Split a line into words; "double quotes" keep spaces inside a word
+std::vector<std::string> SplitWords(const std::string& line) {
+    std::vector<std::string> words;
+    size_t i = 0;
+    while (i < line.size()) {
+        if (line[i] == ' ' || line[i] == '\t') {
+            i++;
+            continue;
+        }
+        if (line[i] == '#') break;
+
+        std::string word;
+        if (line[i] == '"') {
+            size_t end = line.find('"', i + 1);
+            if (end == std::string::npos) end = line.size();
+            word = line.substr(i + 1, end - i - 1);
+            i = end + 1;
+        } else {
+            while (i < line.size() && line[i] != ' ' && line[i] != '\t' && line[i] != '#') {
+                word += line[i++];
+            }
+        }
+        words.push_back(word);
+    }
+    return words;
+}
+
+// "key=value" into its halves; false if there is no '='
+bool SplitOption(const std::string& word, std::string* key, std::string* value) {
+    size_t equals = word.find('=');
+    if (equals == std::string::npos || equals == 0) return false;
+    *key = word.substr(0, equals);
+    *value = word.substr(equals + 1);
+    return true;
+}
+
+bool ParseUnsigned(const std::string& text, uint32_t* value) {
+    if (text.empty()) return false;
+    char* end = nullptr;
+    unsigned long parsed = std::strtoul(text.c_str(), &end, 10);
+    if (*end != '\0' || parsed > 0xFFFFFFu) return false;
+    *value = static_cast<uint32_t>(parsed);
+    return true;
+}
+
+struct Transition {
+    int from;  // -1 for '*'
+    int to;
+    uint32_t weight;
+};
+
+}  // namespace
+
+CharacterTable::CharacterTable() : hasTransitions(false) {
+    for (int i = 0; i < BUILT_IN_STATE_COUNT; i++) {
+        AddState(BUILT_IN_STATES[i], static_cast<AppState>(i));
+    }
+    Compile(std::vector<std::vector<uint32_t>>());
+}
+
+int CharacterTable::FindState(const std::string& name) const {
+    for (size_t i = 0; i < states.size(); i++) {
+        if (states[i].name == name) return static_cast<int>(i);
+    }
+    return -1;
+}
+
+int CharacterTable::AddState(const std::string& name, AppState base) {
+    StateInfo state = { name, base };
+    states.push_back(state);
+    return static_cast<int>(states.size()) - 1;
+}
+
+int CharacterTable::PickNextState(int state, std::mt19937& random) const {
+    size_t count = states.size();
+    const uint32_t* row = transitions.data() + static_cast<size_t>(state) * count;
+    uint32_t total = row[count - 1];
+    if (total == 0) return -1;
+
+    uint32_t roll = static_cast<uint32_t>(RandomRange(random, 0, static_cast<int>(total - 1)));
+    return static_cast<int>(std::upper_bound(row, row + count, roll) - row);
+}
+
+int CharacterTable::PickAnimation(int state, std::mt19937& random) const {
+    uint32_t first = stateFirst[state];
+    uint32_t last = stateFirst[state + 1];
+    if (first == last) return -1;
+
+    // Zero total: every animation of the state is weight 0, so take the first
+    uint32_t total = byStateWeight[last - 1];
+    if (total == 0) return static_cast<int>(byState[first]);
+
+    uint32_t roll = static_cast<uint32_t>(RandomRange(random, 0, static_cast<int>(total - 1)));
+    const uint32_t* weights = byStateWeight.data();
+    size_t found = std::upper_bound(weights + first, weights + last, roll) - weights;
+    return static_cast<int>(byState[found]);
+}
+
+void CharacterTable::AddAnimationsFromFilenames(const std::vector<std::wstring>& filenames) {
+    for (size_t i = 0; i < filenames.size(); i++) {
+        GifType type = GetGifTypeFromFilename(filenames[i]);
+        int state = STATE_MISC;
+        for (int s = 0; s < BUILT_IN_STATE_COUNT; s++) {
+            if (GifTypeForState(static_cast<AppState>(s)) == type) {
+                state = s;
+                break;
+            }
+        }
+
+        ManifestAnimation animation = { filenames[i], state, 1, false, 0, 0, LOOP_REPEAT, 1.0f };
+        animations.push_back(animation);
+    }
+    Compile(std::vector<std::vector<uint32_t>>());
+}
+
+void CharacterTable::Compile(const std::vector<std::vector<uint32_t>>& weights) {
+    size_t count = states.size();
+
+    transitions.assign(count * count, 0);
+    hasTransitions = false;
+    for (size_t from = 0; from < count && from < weights.size(); from++) {
+        uint32_t total = 0;
+        for (size_t to = 0; to < count; to++) {
+            total += to < weights[from].size() ? weights[from][to] : 0;
+            transitions[from * count + to] = total;
+        }
+        hasTransitions = hasTransitions || total > 0;
+    }
+
+    // Counting sort of the animations by state, keeping file order within one
+    stateFirst.assign(count + 1, 0);
+    for (size_t i = 0; i < animations.size(); i++) {
+        stateFirst[animations[i].state + 1]++;
+    }
+    for (size_t s = 0; s < count; s++) {
+        stateFirst[s + 1] += stateFirst[s];
+    }
+    byState.assign(animations.size(), 0);
+    byStateWeight.assign(animations.size(), 0);
+    std::vector<uint32_t> next(stateFirst.begin(), stateFirst.end() - 1);
+    for (size_t i = 0; i < animations.size(); i++) {
+        byState[next[animations[i].state]++] = static_cast<uint32_t>(i);
+    }
+    for (size_t s = 0; s < count; s++) {
+        uint32_t total = 0;
+        for (uint32_t k = stateFirst[s]; k < stateFirst[s + 1]; k++) {
+            total += animations[byState[k]].weight;
+            byStateWeight[k] = total;
+        }
+    }
+}
+
+bool ParseCharacterManifest(const char* text, size_t length, CharacterTable* table, std::string* error) {
+    *table = CharacterTable();
+    std::vector<Transition> transitions;
+
+    // States are created on first mention; `state` lines only change what
+    // an extra state is based on
+    auto stateId = [table](const std::string& name) {
+        int id = table->FindState(name);
+        return id >= 0 ? id : table->AddState(name, STATE_MISC);
+    };
+
+    size_t lineNumber = 0;
+    size_t start = 0;
+    // Skip a UTF-8 byte order mark
+    if (length >= 3 && static_cast<unsigned char>(text[0]) == 0xEF &&
+        static_cast<unsigned char>(text[1]) == 0xBB && static_cast<unsigned char>(text[2]) == 0xBF) {
+        start = 3;
+    }
+    while (start < length) {
+        size_t end = start;
+        while (end < length && text[end] != '\n') end++;
+        std::string line(text + start, end - start);
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        start = end + 1;
+        lineNumber++;
+
+        std::vector<std::string> words = SplitWords(line);
+        if (words.empty()) continue;
+        std::string key, value;
+
+        if (words[0] == "state") {
+            if (words.size() < 2) return Fail(error, lineNumber, "state needs a name");
+            int state = table->FindState(words[1]);
+            if (state >= 0 && state < BUILT_IN_STATE_COUNT) {
+                return Fail(error, lineNumber, "'" + words[1] + "' is a built-in state");
+            }
+            AppState base = STATE_MISC;
+            for (size_t w = 2; w < words.size(); w++) {
+                if (!SplitOption(words[w], &key, &value) || key != "as") {
+                    return Fail(error, lineNumber, "unknown state option '" + words[w] + "'");
+                }
+                int baseId = table->FindState(value);
+                if (baseId < 0 || baseId >= BUILT_IN_STATE_COUNT) {
+                    return Fail(error, lineNumber, "as= must name a built-in state, not '" + value + "'");
+                }
+                base = static_cast<AppState>(baseId);
+            }
+            table->states[stateId(words[1])].base = base;
+        } else if (words[0] == "animation") {
+            if (words.size() < 3) return Fail(error, lineNumber, "animation needs a file and a state");
+            ManifestAnimation animation = { Widen(words[1]), stateId(words[2]), 1, false, 0, 0, LOOP_REPEAT, 1.0f };
+            for (size_t w = 3; w < words.size(); w++) {
+                if (!SplitOption(words[w], &key, &value)) {
+                    return Fail(error, lineNumber, "expected key=value, got '" + words[w] + "'");
+                }
+                if (key == "weight") {
+                    if (!ParseUnsigned(value, &animation.weight)) {
+                        return Fail(error, lineNumber, "bad weight '" + value + "'");
+                    }
+                } else if (key == "anchor") {
+                    char* comma = nullptr;
+                    animation.anchorX = static_cast<int>(std::strtol(value.c_str(), &comma, 10));
+                    if (*comma != ',') return Fail(error, lineNumber, "anchor is x,y, not '" + value + "'");
+                    char* endY = nullptr;
+                    animation.anchorY = static_cast<int>(std::strtol(comma + 1, &endY, 10));
+                    if (*endY != '\0' || endY == comma + 1) {
+                        return Fail(error, lineNumber, "anchor is x,y, not '" + value + "'");
+                    }
+                    animation.hasAnchor = true;
+                } else if (key == "loop") {
+                    if (value == "repeat") {
+                        animation.loop = LOOP_REPEAT;
+                    } else if (value == "once") {
+                        animation.loop = LOOP_ONCE;
+                    } else {
+                        return Fail(error, lineNumber, "loop is repeat or once, not '" + value + "'");
+                    }
+                } else if (key == "speed") {
+                    char* endSpeed = nullptr;
+                    double speed = std::strtod(value.c_str(), &endSpeed);
+                    if (*endSpeed != '\0' || !(speed > 0.0)) {
+                        return Fail(error, lineNumber, "bad speed '" + value + "'");
+                    }
+                    animation.speed = static_cast<float>(speed);
+                } else {
+                    return Fail(error, lineNumber, "unknown animation option '" + key + "'");
+                }
+            }
+            table->animations.push_back(animation);
+        } else if (words[0] == "transition") {
+            if (words.size() < 3) return Fail(error, lineNumber, "transition needs a state and targets");
+            int from = words[1] == "*" ? -1 : stateId(words[1]);
+            for (size_t w = 2; w < words.size(); w++) {
+                Transition transition = { from, 0, 0 };
+                if (!SplitOption(words[w], &key, &value) || !ParseUnsigned(value, &transition.weight)) {
+                    return Fail(error, lineNumber, "expected state=weight, got '" + words[w] + "'");
+                }
+                transition.to = stateId(key);
+                transitions.push_back(transition);
+            }
+        } else {
+            return Fail(error, lineNumber, "unknown keyword '" + words[0] + "'");
+        }
+    }
+
+    // Rows for every state; states without a line of their own get '*'
+    size_t count = static_cast<size_t>(table->StateCount());
+    std::vector<std::vector<uint32_t>> weights(count, std::vector<uint32_t>(count, 0));
+    std::vector<uint32_t> anyState(count, 0);
+    std::vector<char> hasRow(count, 0);
+    for (const Transition& transition : transitions) {
+        if (transition.from < 0) {
+            anyState[transition.to] += transition.weight;
+        } else {
+            weights[transition.from][transition.to] += transition.weight;
+            hasRow[transition.from] = 1;
+        }
+    }
+    for (size_t s = 0; s < count; s++) {
+        if (!hasRow[s]) weights[s] = anyState;
+    }
+
+    table->Compile(weights);
+    return true;
+}
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "CharacterState.h"
+
+// What a character folder contains and how it behaves, compiled into flat
+// tables so choosing the next state or animation is a lookup, not a parse.
+//
+// A folder can describe itself in a `character.manifest` text file:
+//
+//   # Lines are a keyword and its arguments; '#' starts a comment
+//   state laying as=sit
+//   animation walk.gif   move
+//   animation idle.gif   wait   weight=3
+//   animation idle2.gif  wait   weight=1 speed=1.5
+//   animation work1.gif  work1  loop=once anchor=64,120
+//   animation lay.gif    laying
+//   transition wait   move=3 work1=1 laying=1
+//   transition *      wait=1
+//
+// The states move, wait, sit, pick and misc always exist and have the ids
+// of the matching AppState. Any other name adds a state that the engine
+// treats like its `as=` state (misc if not declared): work1 above stands in
+// place like misc, laying can be used like sit. Transition weights are
+// relative within a line; `*` is the row for states without one of their
+// own. Without transitions the viewer keeps its built-in wandering.
+//
+// Folders without a manifest get one from their file names (see
+// AddAnimationsFromFilenames).
+
+enum LoopMode {
+    LOOP_REPEAT,  // Play until the state ends
+    LOOP_ONCE     // The state ends after one pass through the animation
+};
+
+struct ManifestAnimation {
+    std::wstring file;  // File name inside the folder
+    int state;
+    uint32_t weight;    // Relative chance among the state's animations
+    bool hasAnchor;     // The anchor pixel stays put when switching to it
+    int anchorX;
+    int anchorY;
+    LoopMode loop;
+    float speed;        // Playback speed; frame delays are divided by it
+};
+
+class CharacterTable {
+public:
+    CharacterTable();
+
+    int StateCount() const { return static_cast<int>(states.size()); }
+    const std::string& StateName(int state) const { return states[state].name; }
+
+    // Id of a state by name, or -1
+    int FindState(const std::string& name) const;
+
+    // What the engine does while in a state
+    AppState BaseState(int state) const { return states[state].base; }
+
+    const std::vector<ManifestAnimation>& Animations() const { return animations; }
+
+    // A random next state by the transition weights, or -1 if the manifest
+    // gave none for it
+    int PickNextState(int state, std::mt19937& random) const;
+
+    // A random animation of the state by weight (index into Animations()),
+    // or -1 if it has none
+    int PickAnimation(int state, std::mt19937& random) const;
+
+    bool HasTransitions() const { return hasTransitions; }
+
+    // One animation per file, classified by name with the built-in keywords
+    // (GetGifTypeFromFilename). Every file counts, not only the first of
+    // each kind.
+    void AddAnimationsFromFilenames(const std::vector<std::wstring>& filenames);
+
+private:
+    friend bool ParseCharacterManifest(const char* text, size_t length, CharacterTable* table,
+                                       std::string* error);
+
+    struct StateInfo {
+        std::string name;
+        AppState base;
+    };
+
+    int AddState(const std::string& name, AppState base);
+
+    // Turn what was parsed into the lookup tables below
+    void Compile(const std::vector<std::vector<uint32_t>>& weights);
+
+    std::vector<StateInfo> states;
+    std::vector<ManifestAnimation> animations;
+
+    // StateCount() x StateCount() running totals, row = from state; a row's
+    // last entry is its total weight, 0 if it has no way out
+    std::vector<uint32_t> transitions;
+    bool hasTransitions;
+
+    // Animation indices grouped by state with running weight totals:
+    // state s owns [stateFirst[s], stateFirst[s + 1])
+    std::vector<uint32_t> stateFirst;
+    std::vector<uint32_t> byState;
+    std::vector<uint32_t> byStateWeight;
+};
+
+// Parse manifest text and compile it into table. False with a message
+// naming the line on anything it doesn't understand.
+bool ParseCharacterManifest(const char* text, size_t length, CharacterTable* table, std::string* error);
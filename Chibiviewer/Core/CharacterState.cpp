@@ -0,0 +1,37 @@
+#include "CharacterState.h"
+
+#include "KeywordMatcher.h"
+
+GifType GifTypeForState(AppState state) {
+    switch (state) {
+        case STATE_MOVE: return MOVE;
+        case STATE_WAIT: return WAIT;
+        case STATE_SIT: return SIT;
+        case STATE_PICK: return PICK;
+        default: return MISC;
+    }
+}
+
+AppState NextManualState(AppState state) {
+    switch (state) {
+        case STATE_MOVE: return STATE_WAIT;
+        case STATE_WAIT: return STATE_SIT;
+        case STATE_SIT: return STATE_MISC;
+        case STATE_MISC: return STATE_MOVE;
+        default: return STATE_WAIT;
+    }
+}
+
+GifType GetGifTypeFromFilename(const std::wstring& filename) {
+    // Earlier keywords win when a name contains several
+    static const KeywordMatcher matcher = []() {
+        KeywordMatcher keywords;
+        keywords.Add(L"move", MOVE);
+        keywords.Add(L"wait", WAIT);
+        keywords.Add(L"sit", SIT);
+        keywords.Add(L"pick", PICK);
+        keywords.Build();
+        return keywords;
+    }();
+    return static_cast<GifType>(matcher.Match(filename, MISC));
+}
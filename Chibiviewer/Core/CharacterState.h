@@ -0,0 +1,47 @@
+#pragma once
+
+#include <string>
+
+// GIF categories
+enum GifType {
+    MOVE,
+    WAIT,
+    SIT,
+    PICK,
+    MISC
+};
+
+// Application modes
+enum AppMode {
+    AUTOMATIC,
+    MANUAL
+};
+
+// Application states
+enum AppState {
+    STATE_MOVE,
+    STATE_WAIT,
+    STATE_SIT,
+    STATE_PICK,
+    STATE_MISC
+};
+
+// Which kind of GIF plays while in a state
+GifType GifTypeForState(AppState state);
+
+// The state after `state` when cycling manually (Space in manual mode)
+AppState NextManualState(AppState state);
+
+// Determine GIF type from filename
+GifType GetGifTypeFromFilename(const std::wstring& filename);
+
+// Index of the first entry whose `type` matches, or gifs.size() if none
+template <typename Container>
+size_t FindGifOfType(const Container& gifs, GifType type) {
+    for (size_t i = 0; i < gifs.size(); i++) {
+        if (gifs[i].type == type) {
+            return i;
+        }
+    }
+    return gifs.size();
+}
@@ -0,0 +1,67 @@
+#include "Compositor.h"
+
+#include <algorithm>
+#include <cstddef>
+
+void ClearPixels(const PixelBuffer& target, uint32_t value) {
+    for (int y = 0; y < target.height; y++) {
+        uint32_t* row = target.pixels + static_cast<size_t>(y) * target.stride;
+        std::fill(row, row + target.width, value);
+    }
+}
+
+namespace {
+
+// dst = src + dst * (255 - a) / 255 for one premultiplied pixel
+inline void BlendPixel(uint32_t pixel, uint32_t* destination) {
+    uint32_t alpha = pixel >> 24;
+    if (alpha == 255) {
+        *destination = pixel;
+    } else if (alpha != 0) {
+        // Two channels at a time
+        uint32_t inverse = 255 - alpha;
+        uint32_t under = *destination;
+        uint32_t redBlue = (under & 0x00FF00FFu) * inverse + 0x00800080u;
+        redBlue = ((redBlue + ((redBlue >> 8) & 0x00FF00FFu)) >> 8) & 0x00FF00FFu;
+        uint32_t alphaGreen = ((under >> 8) & 0x00FF00FFu) * inverse + 0x00800080u;
+        alphaGreen = (alphaGreen + ((alphaGreen >> 8) & 0x00FF00FFu)) & 0xFF00FF00u;
+        *destination = pixel + (redBlue | alphaGreen);
+    }
+}
+
+}  // namespace
+
+void BlendSprite(const PixelBuffer& target, const uint32_t* sprite, int width, int height, int x, int y) {
+    const int left = std::max(0, x);
+    const int top = std::max(0, y);
+    const int right = std::min(target.width, x + width);
+    const int bottom = std::min(target.height, y + height);
+    if (right <= left || bottom <= top) return;
+
+    for (int row = top; row < bottom; row++) {
+        const uint32_t* source = sprite + static_cast<size_t>(row - y) * width + (left - x);
+        uint32_t* destination = target.pixels + static_cast<size_t>(row) * target.stride + left;
+
+        for (int i = 0; i < right - left; i++) {
+            BlendPixel(source[i], &destination[i]);
+        }
+    }
+}
+
+void BlendSpriteMirrored(const PixelBuffer& target, const uint32_t* sprite, int width, int height, int x, int y) {
+    const int left = std::max(0, x);
+    const int top = std::max(0, y);
+    const int right = std::min(target.width, x + width);
+    const int bottom = std::min(target.height, y + height);
+    if (right <= left || bottom <= top) return;
+
+    for (int row = top; row < bottom; row++) {
+        // The sprite's row read from its right end backwards
+        const uint32_t* source = sprite + static_cast<size_t>(row - y) * width + (width - 1 - (left - x));
+        uint32_t* destination = target.pixels + static_cast<size_t>(row) * target.stride + left;
+
+        for (int i = 0; i < right - left; i++) {
+            BlendPixel(*(source - i), &destination[i]);
+        }
+    }
+}
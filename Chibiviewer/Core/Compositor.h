@@ -0,0 +1,23 @@
+#pragma once
+
+#include <cstdint>
+
+// A view onto 32bpp premultiplied ARGB pixels. stride is in pixels.
+struct PixelBuffer {
+    uint32_t* pixels;
+    int width;
+    int height;
+    int stride;
+};
+
+// Fill the whole buffer with one value
+void ClearPixels(const PixelBuffer& target, uint32_t value);
+
+// Draw a premultiplied width x height sprite at (x, y) using source-over,
+// clipped to the target. Fully opaque and fully transparent pixels (the
+// common case for GIF frames) skip the blend.
+void BlendSprite(const PixelBuffer& target, const uint32_t* sprite, int width, int height, int x, int y);
+
+// The same with the sprite flipped left to right, for walking the other
+// way without keeping mirrored copies of the frames
+void BlendSpriteMirrored(const PixelBuffer& target, const uint32_t* sprite, int width, int height, int x, int y);
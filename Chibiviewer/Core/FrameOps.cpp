@@ -0,0 +1,112 @@
+#include "FrameOps.h"
+
+#include <algorithm>
+#include <cstring>
+
+void MirrorFrame(const uint32_t* src, uint32_t* dst, int width, int height) {
+    for (int y = 0; y < height; y++) {
+        const uint32_t* sourceRow = src + static_cast<size_t>(y) * width;
+        uint32_t* destinationRow = dst + static_cast<size_t>(y) * width;
+        std::reverse_copy(sourceRow, sourceRow + width, destinationRow);
+    }
+}
+
+void MirrorFrameInPlace(uint32_t* pixels, int width, int height) {
+    for (int y = 0; y < height; y++) {
+        uint32_t* row = pixels + static_cast<size_t>(y) * width;
+        std::reverse(row, row + width);
+    }
+}
+
+FrameRect FindOpaqueBounds(const uint32_t* pixels, int width, int height) {
+    FrameRect bounds = { width, height, 0, 0 };
+
+    for (int y = 0; y < height; y++) {
+        const uint32_t* row = pixels + static_cast<size_t>(y) * width;
+
+        // Find the first opaque pixel, then only the part right of the
+        // current bounds has to be scanned for the last one
+        int x = 0;
+        while (x < width && (row[x] >> 24) == 0) x++;
+        if (x == width) continue;
+
+        bounds.left = std::min(bounds.left, x);
+        int last = width - 1;
+        while (last >= bounds.right && (row[last] >> 24) == 0) last--;
+        bounds.right = std::max(bounds.right, last + 1);
+
+        if (bounds.top > y) bounds.top = y;
+        bounds.bottom = y + 1;
+    }
+
+    if (bounds.right <= bounds.left) {
+        FrameRect empty = { 0, 0, 0, 0 };
+        return empty;
+    }
+    return bounds;
+}
+
+FrameRect DiffBounds(const uint32_t* a, const uint32_t* b, int width, int height) {
+    FrameRect bounds = { width, height, 0, 0 };
+    const size_t rowBytes = static_cast<size_t>(width) * sizeof(uint32_t);
+
+    for (int y = 0; y < height; y++) {
+        const uint32_t* rowA = a + static_cast<size_t>(y) * width;
+        const uint32_t* rowB = b + static_cast<size_t>(y) * width;
+        if (std::memcmp(rowA, rowB, rowBytes) == 0) continue;
+
+        // Same trick as FindOpaqueBounds: after the first changed row only
+        // the columns outside the current bounds need a look
+        int x = 0;
+        while (x < bounds.left && rowA[x] == rowB[x]) x++;
+        bounds.left = std::min(bounds.left, x);
+        int last = width - 1;
+        while (last >= bounds.right && rowA[last] == rowB[last]) last--;
+        bounds.right = std::max(bounds.right, last + 1);
+
+        if (bounds.top > y) bounds.top = y;
+        bounds.bottom = y + 1;
+    }
+
+    if (bounds.right <= bounds.left) {
+        FrameRect empty = { 0, 0, 0, 0 };
+        return empty;
+    }
+    return bounds;
+}
+
+FrameRect UnionRects(const FrameRect& a, const FrameRect& b) {
+    if (a.IsEmpty()) return b;
+    if (b.IsEmpty()) return a;
+    FrameRect result = { std::min(a.left, b.left), std::min(a.top, b.top),
+                         std::max(a.right, b.right), std::max(a.bottom, b.bottom) };
+    return result;
+}
+
+void CropFrame(const uint32_t* src, int srcWidth, const FrameRect& rect, uint32_t* dst) {
+    const int width = rect.Width();
+    for (int y = rect.top; y < rect.bottom; y++) {
+        const uint32_t* sourceRow = src + static_cast<size_t>(y) * srcWidth + rect.left;
+        std::copy(sourceRow, sourceRow + width, dst);
+        dst += width;
+    }
+}
+
+void PremultiplyAlpha(uint32_t* pixels, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        uint32_t pixel = pixels[i];
+        uint32_t alpha = pixel >> 24;
+        if (alpha == 255) continue;
+        if (alpha == 0) {
+            pixels[i] = 0;
+            continue;
+        }
+
+        // x * a / 255 with rounding, for two channels at a time
+        uint32_t redBlue = (pixel & 0x00FF00FFu) * alpha + 0x00800080u;
+        redBlue = ((redBlue + ((redBlue >> 8) & 0x00FF00FFu)) >> 8) & 0x00FF00FFu;
+        uint32_t green = ((pixel >> 8) & 0xFFu) * alpha + 0x80u;
+        green = ((green + (green >> 8)) >> 8) & 0xFFu;
+        pixels[i] = (alpha << 24) | redBlue | (green << 8);
+    }
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Per-frame preparation steps applied to decoded 0xAARRGGBB frames before
+// they are handed to the compositor.
+
+// Pixel rectangle, right/bottom exclusive
+struct FrameRect {
+    int left;
+    int top;
+    int right;
+    int bottom;
+
+    int Width() const { return right - left; }
+    int Height() const { return bottom - top; }
+    bool IsEmpty() const { return right <= left || bottom <= top; }
+};
+
+// Mirror a frame horizontally. src and dst must not overlap.
+void MirrorFrame(const uint32_t* src, uint32_t* dst, int width, int height);
+
+// Mirror a frame horizontally in place
+void MirrorFrameInPlace(uint32_t* pixels, int width, int height);
+
+// Smallest rectangle containing every pixel with non-zero alpha.
+// Fully transparent frames give an empty rect.
+FrameRect FindOpaqueBounds(const uint32_t* pixels, int width, int height);
+
+// Smallest rectangle containing every pixel that differs between two
+// frames of the same size. Identical frames give an empty rect.
+FrameRect DiffBounds(const uint32_t* a, const uint32_t* b, int width, int height);
+
+// Smallest rectangle containing both; an empty rect adds nothing
+FrameRect UnionRects(const FrameRect& a, const FrameRect& b);
+
+// Copy `rect` out of a frame into a tightly packed rect.Width() x rect.Height() buffer
+void CropFrame(const uint32_t* src, int srcWidth, const FrameRect& rect, uint32_t* dst);
+
+// Convert straight alpha to premultiplied alpha (PixelFormat32bppPARGB)
+void PremultiplyAlpha(uint32_t* pixels, size_t count);
@@ -0,0 +1,44 @@
+#include "Furniture.h"
+
+#include <algorithm>
+
+#include "RandomStreams.h"
+
+const FurnitureType FURNITURE_TYPES[] = {
+    { L"couch.png", 100, 200, FURNITURE_SIT, 0, -70 },
+};
+
+const size_t FURNITURE_TYPE_COUNT = sizeof(FURNITURE_TYPES) / sizeof(FURNITURE_TYPES[0]);
+
+// Keep furniture this far away from the screen edges
+const int FURNITURE_SCREEN_MARGIN = 20;
+
+Furniture PlaceFurniture(size_t typeIndex, int width, int height,
+                         int screenLeft, int screenTop, int screenRight, int screenBottom,
+                         int floorY, std::mt19937& rng) {
+    const FurnitureType& type = FURNITURE_TYPES[typeIndex];
+
+    int minX = screenLeft + FURNITURE_SCREEN_MARGIN;
+    int maxX = std::max(minX, screenRight - width - FURNITURE_SCREEN_MARGIN);
+    int minY = screenTop + FURNITURE_SCREEN_MARGIN;
+    int maxY = std::max(minY, screenBottom - height - FURNITURE_SCREEN_MARGIN);
+
+    Furniture furniture;
+    furniture.typeIndex = typeIndex;
+    furniture.width = width;
+    furniture.height = height;
+    furniture.x = std::max(minX, std::min(RandomRange(rng, minX, maxX) + type.xOffset, maxX));
+    furniture.y = std::max(minY, std::min(floorY - height + type.yOffset, maxY));
+    furniture.visible = true;
+    return furniture;
+}
+
+int GetFurnitureCenterX(const Furniture& furniture) {
+    return furniture.x + furniture.width / 2;
+}
+
+void GetFurnitureUsePosition(const Furniture& furniture, int* x, int* y) {
+    const FurnitureType& type = FURNITURE_TYPES[furniture.typeIndex];
+    *x = furniture.x + type.usePointX;
+    *y = furniture.y + type.usePointY;
+}
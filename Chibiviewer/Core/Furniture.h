@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstddef>
+#include <random>
+
+// How the character uses a piece of furniture once it arrives
+enum FurnitureUse {
+    FURNITURE_SIT,
+    FURNITURE_LAYING
+};
+
+// Static description of a furniture kind, ported from the Kalinaviewer
+// prototype's furniture_types table. The use point is relative to the
+// top-left of the furniture image and marks where the character's feet go.
+struct FurnitureType {
+    const wchar_t* fileName;
+    int usePointX;
+    int usePointY;
+    FurnitureUse useType;
+    int xOffset;
+    int yOffset;
+};
+
+extern const FurnitureType FURNITURE_TYPES[];
+extern const size_t FURNITURE_TYPE_COUNT;
+
+// A placed piece of furniture in screen coordinates
+struct Furniture {
+    size_t typeIndex;
+    int x;
+    int y;
+    int width;
+    int height;
+    bool visible;
+
+    Furniture() : typeIndex(0), x(0), y(0), width(0), height(0), visible(false) {}
+};
+
+// Drop furniture somewhere along the character's floor line. The bottom edge
+// lines up with floorY (plus the type's y offset) and the whole thing stays
+// inside the screen rectangle with a small margin.
+Furniture PlaceFurniture(size_t typeIndex, int width, int height,
+                         int screenLeft, int screenTop, int screenRight, int screenBottom,
+                         int floorY, std::mt19937& rng);
+
+int GetFurnitureCenterX(const Furniture& furniture);
+
+// Where the character's bottom-center should sit while using the furniture
+void GetFurnitureUsePosition(const Furniture& furniture, int* x, int* y);
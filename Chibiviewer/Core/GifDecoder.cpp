@@ -0,0 +1,354 @@
+#include "GifDecoder.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+namespace {
+
+const int MAX_LZW_BITS = 12;
+const int MAX_LZW_CODES = 1 << MAX_LZW_BITS;
+
+enum Disposal {
+    DISPOSE_NONE = 0,
+    DISPOSE_KEEP = 1,
+    DISPOSE_BACKGROUND = 2,
+    DISPOSE_PREVIOUS = 3
+};
+
+struct Reader {
+    const uint8_t* data;
+    size_t size;
+    size_t pos;
+
+    bool Has(size_t count) const { return pos + count <= size; }
+    uint8_t Byte() { return data[pos++]; }
+    uint16_t Word() {
+        uint16_t value = static_cast<uint16_t>(data[pos] | (data[pos + 1] << 8));
+        pos += 2;
+        return value;
+    }
+};
+
+bool Fail(std::string* error, const char* reason) {
+    if (error) *error = reason;
+    return false;
+}
+
+// Concatenate data sub-blocks into `out`. Stops after the terminator.
+bool ReadSubBlocks(Reader& reader, std::vector<uint8_t>* out) {
+    while (reader.Has(1)) {
+        uint8_t length = reader.Byte();
+        if (length == 0) return true;
+        if (!reader.Has(length)) return false;
+        if (out) out->insert(out->end(), reader.data + reader.pos, reader.data + reader.pos + length);
+        reader.pos += length;
+    }
+    return false;
+}
+
+void ReadPalette(Reader& reader, int entries, uint32_t* palette) {
+    for (int i = 0; i < entries; i++) {
+        uint32_t r = reader.Byte();
+        uint32_t g = reader.Byte();
+        uint32_t b = reader.Byte();
+        palette[i] = 0xFF000000u | (r << 16) | (g << 8) | b;
+    }
+}
+
+// Variable-width LZW as used by GIF. Writes at most pixelCount indices and
+// returns how many were produced; truncated streams just stop early.
+size_t DecodeLzw(const uint8_t* data, size_t size, int minCodeSize, uint8_t* out, size_t pixelCount) {
+    if (minCodeSize < 1 || minCodeSize > 11) return 0;
+
+    uint16_t prefix[MAX_LZW_CODES];
+    uint8_t suffix[MAX_LZW_CODES];
+    uint8_t stack[MAX_LZW_CODES + 1];
+
+    const int clearCode = 1 << minCodeSize;
+    const int endCode = clearCode + 1;
+    for (int i = 0; i < clearCode; i++) {
+        prefix[i] = 0;
+        suffix[i] = static_cast<uint8_t>(i);
+    }
+
+    int codeSize = minCodeSize + 1;
+    int nextCode = endCode + 1;
+    int previous = -1;
+    uint8_t first = 0;
+
+    uint32_t bitBuffer = 0;
+    int bitCount = 0;
+    size_t pos = 0;
+    size_t written = 0;
+
+    while (written < pixelCount) {
+        while (bitCount < codeSize && pos < size) {
+            bitBuffer |= static_cast<uint32_t>(data[pos++]) << bitCount;
+            bitCount += 8;
+        }
+        if (bitCount < codeSize) break;
+
+        int code = static_cast<int>(bitBuffer & ((1u << codeSize) - 1));
+        bitBuffer >>= codeSize;
+        bitCount -= codeSize;
+
+        if (code == clearCode) {
+            codeSize = minCodeSize + 1;
+            nextCode = endCode + 1;
+            previous = -1;
+            continue;
+        }
+        if (code == endCode) break;
+
+        if (previous < 0) {
+            if (code >= clearCode) break;
+            first = static_cast<uint8_t>(code);
+            out[written++] = first;
+            previous = code;
+            continue;
+        }
+
+        int incoming = code;
+        int top = 0;
+        if (code >= nextCode) {
+            // KwKwK: the code being defined right now
+            if (code > nextCode) break;
+            stack[top++] = first;
+            code = previous;
+        }
+        while (code >= clearCode) {
+            stack[top++] = suffix[code];
+            code = prefix[code];
+        }
+        first = suffix[code];
+        stack[top++] = first;
+
+        while (top > 0 && written < pixelCount) {
+            out[written++] = stack[--top];
+        }
+
+        if (nextCode < MAX_LZW_CODES) {
+            prefix[nextCode] = static_cast<uint16_t>(previous);
+            suffix[nextCode] = first;
+            nextCode++;
+            if (nextCode == (1 << codeSize) && codeSize < MAX_LZW_BITS) {
+                codeSize++;
+            }
+        }
+        previous = incoming;
+    }
+    return written;
+}
+
+}  // namespace
+
+bool DecodeGif(const uint8_t* data, size_t size, DecodedGif* out, std::string* error) {
+    Reader reader = { data, size, 0 };
+    if (!reader.Has(13) || (std::memcmp(data, "GIF87a", 6) != 0 && std::memcmp(data, "GIF89a", 6) != 0)) {
+        return Fail(error, "not a GIF");
+    }
+    reader.pos = 6;
+
+    const int width = reader.Word();
+    const int height = reader.Word();
+    const uint8_t screenFlags = reader.Byte();
+    reader.Byte();  // Background color; browsers and GDI+ treat it as transparent
+    reader.Byte();  // Pixel aspect ratio
+
+    if (width == 0 || height == 0) {
+        return Fail(error, "empty logical screen");
+    }
+
+    uint32_t globalPalette[256];
+    std::memset(globalPalette, 0, sizeof(globalPalette));
+    if (screenFlags & 0x80) {
+        int entries = 2 << (screenFlags & 7);
+        if (!reader.Has(entries * 3)) return Fail(error, "truncated global palette");
+        ReadPalette(reader, entries, globalPalette);
+    }
+
+    out->width = width;
+    out->height = height;
+    out->pixels.clear();
+    out->delaysMs.clear();
+    out->loopCount = 0;
+
+    const size_t canvasSize = static_cast<size_t>(width) * height;
+    std::vector<uint32_t> canvas(canvasSize, 0);
+    std::vector<uint32_t> saved;
+    std::vector<uint8_t> compressed;
+    std::vector<uint8_t> indices;
+
+    // Graphic control state for the next image
+    int disposal = DISPOSE_NONE;
+    int transparentIndex = -1;
+    uint32_t delay = 0;
+
+    // What to undo before drawing the next frame
+    int pendingDisposal = DISPOSE_NONE;
+    int pendingLeft = 0, pendingTop = 0, pendingRight = 0, pendingBottom = 0;
+
+    while (reader.Has(1)) {
+        uint8_t block = reader.Byte();
+
+        if (block == 0x3B) {
+            break;
+        }
+
+        if (block == 0x21) {
+            if (!reader.Has(1)) break;
+            uint8_t label = reader.Byte();
+
+            if (label == 0xF9 && reader.Has(6) && reader.data[reader.pos] >= 4) {
+                size_t blockEnd = reader.pos + 1 + reader.data[reader.pos];
+                reader.Byte();  // Block size
+                uint8_t flags = reader.Byte();
+                delay = reader.Word() * 10u;
+                uint8_t transparent = reader.Byte();
+                disposal = (flags >> 2) & 7;
+                transparentIndex = (flags & 1) ? transparent : -1;
+                reader.pos = blockEnd;
+                if (!ReadSubBlocks(reader, nullptr)) break;
+            } else if (label == 0xFF && reader.Has(12) && reader.data[reader.pos] == 11 &&
+                       std::memcmp(reader.data + reader.pos + 1, "NETSCAPE2.0", 11) == 0) {
+                reader.pos += 12;
+                std::vector<uint8_t> app;
+                if (!ReadSubBlocks(reader, &app)) break;
+                if (app.size() >= 3 && app[0] == 1) {
+                    out->loopCount = app[1] | (app[2] << 8);
+                }
+            } else {
+                if (!ReadSubBlocks(reader, nullptr)) break;
+            }
+            continue;
+        }
+
+        if (block != 0x2C) {
+            // Unknown block; GDI+ gives up here too, keep what we have
+            break;
+        }
+
+        if (!reader.Has(9)) break;
+        const int left = reader.Word();
+        const int top = reader.Word();
+        const int frameWidth = reader.Word();
+        const int frameHeight = reader.Word();
+        const uint8_t imageFlags = reader.Byte();
+
+        uint32_t localPalette[256];
+        const uint32_t* palette = globalPalette;
+        if (imageFlags & 0x80) {
+            int entries = 2 << (imageFlags & 7);
+            if (!reader.Has(entries * 3)) break;
+            std::memset(localPalette, 0, sizeof(localPalette));
+            ReadPalette(reader, entries, localPalette);
+            palette = localPalette;
+        }
+
+        if (!reader.Has(1)) break;
+        int minCodeSize = reader.Byte();
+        compressed.clear();
+        if (!ReadSubBlocks(reader, &compressed)) break;
+
+        // Undo the previous frame's disposal
+        if (pendingDisposal == DISPOSE_BACKGROUND) {
+            for (int y = pendingTop; y < pendingBottom; y++) {
+                std::fill(&canvas[y * width + pendingLeft], &canvas[y * width + pendingRight], 0u);
+            }
+        } else if (pendingDisposal == DISPOSE_PREVIOUS && saved.size() == canvasSize) {
+            canvas = saved;
+        }
+        if (disposal == DISPOSE_PREVIOUS) {
+            saved = canvas;
+        }
+
+        size_t framePixels = static_cast<size_t>(frameWidth) * frameHeight;
+        indices.assign(framePixels, 0);
+        size_t decoded = DecodeLzw(compressed.empty() ? nullptr : &compressed[0], compressed.size(),
+                                   minCodeSize, indices.empty() ? nullptr : &indices[0], framePixels);
+
+        // Interlaced images store rows in four passes
+        const bool interlaced = (imageFlags & 0x40) != 0;
+        static const int passStart[4] = { 0, 4, 2, 1 };
+        static const int passStep[4] = { 8, 8, 4, 2 };
+        int pass = 0;
+        int row = 0;
+
+        // Frames may sit partly or wholly off the canvas; one that misses it
+        // still counts as a frame but draws nothing
+        const int clipLeft = std::max(0, left);
+        const int clipRight = std::min(width, left + frameWidth);
+        const int clipTop = std::max(0, top);
+        const int clipBottom = std::min(height, top + frameHeight);
+        const bool visible = clipLeft < clipRight && clipTop < clipBottom;
+        for (int sourceRow = 0; visible && sourceRow < frameHeight; sourceRow++) {
+            int y;
+            if (interlaced) {
+                while (pass < 4 && row >= frameHeight) {
+                    pass++;
+                    if (pass < 4) row = passStart[pass];
+                }
+                if (pass >= 4) break;
+                y = row;
+                row += passStep[pass];
+            } else {
+                y = sourceRow;
+            }
+
+            int canvasY = top + y;
+            if (canvasY < 0 || canvasY >= height) continue;
+
+            // Pixels past the end of a truncated stream stay untouched
+            size_t rowStart = static_cast<size_t>(sourceRow) * frameWidth;
+            if (rowStart >= decoded) continue;
+            int rowRight = std::min<int>(clipRight, left + static_cast<int>(
+                std::min<size_t>(frameWidth, decoded - rowStart)));
+
+            const uint8_t* source = &indices[rowStart];
+            uint32_t* destination = &canvas[static_cast<size_t>(canvasY) * width];
+            for (int x = clipLeft; x < rowRight; x++) {
+                int index = source[x - left];
+                if (index != transparentIndex) {
+                    destination[x] = palette[index];
+                }
+            }
+        }
+
+        out->pixels.insert(out->pixels.end(), canvas.begin(), canvas.end());
+        out->delaysMs.push_back(delay);
+
+        pendingDisposal = visible ? disposal : DISPOSE_NONE;
+        pendingLeft = clipLeft;
+        pendingRight = clipRight;
+        pendingTop = clipTop;
+        pendingBottom = clipBottom;
+
+        disposal = DISPOSE_NONE;
+        transparentIndex = -1;
+        delay = 0;
+    }
+
+    if (out->delaysMs.empty()) {
+        return Fail(error, "no frames");
+    }
+    return true;
+}
+
+bool ReadFileBytes(const char* path, std::vector<uint8_t>* bytes) {
+    FILE* file = std::fopen(path, "rb");
+    if (!file) return false;
+
+    std::fseek(file, 0, SEEK_END);
+    long length = std::ftell(file);
+    std::fseek(file, 0, SEEK_SET);
+    if (length < 0) {
+        std::fclose(file);
+        return false;
+    }
+
+    bytes->resize(static_cast<size_t>(length));
+    size_t read = length > 0 ? std::fread(&(*bytes)[0], 1, bytes->size(), file) : 0;
+    std::fclose(file);
+    return read == bytes->size();
+}
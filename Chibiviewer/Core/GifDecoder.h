@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Fully composited GIF animation. Every frame is a complete width x height
+// canvas in 0xAARRGGBB (the same layout as PixelFormat32bppARGB), with
+// transparent pixels stored as 0. Frames are stored back to back in
+// `pixels`.
+struct DecodedGif {
+    int width;
+    int height;
+    std::vector<uint32_t> pixels;
+    std::vector<uint32_t> delaysMs;  // Raw GIF delay * 10, like PropertyTagFrameDelay
+    int loopCount;                   // NETSCAPE loop count, 0 = forever
+
+    DecodedGif() : width(0), height(0), loopCount(0) {}
+
+    size_t FrameCount() const { return delaysMs.size(); }
+    size_t FramePixels() const { return static_cast<size_t>(width) * height; }
+    const uint32_t* Frame(size_t index) const { return &pixels[index * FramePixels()]; }
+    uint32_t* Frame(size_t index) { return &pixels[index * FramePixels()]; }
+};
+
+// Decode a GIF87a/89a file held in memory. Handles local palettes,
+// transparency, interlacing and all disposal methods. On failure returns
+// false and, if given, fills in a short reason.
+bool DecodeGif(const uint8_t* data, size_t size, DecodedGif* out, std::string* error = nullptr);
+
+// Read a whole file into memory (helper for decoding from disk)
+bool ReadFileBytes(const char* path, std::vector<uint8_t>* bytes);
@@ -0,0 +1,90 @@
+#include "Histogram.h"
+
+#include <cstring>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace {
+
+const uint64_t LINEAR_LIMIT = 1ull << Histogram::SUB_BUCKET_BITS;
+const size_t HALF_BUCKETS = 1u << (Histogram::SUB_BUCKET_BITS - 1);
+
+int HighestBit(uint64_t value) {
+#if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanReverse64(&index, value);
+    return static_cast<int>(index);
+#else
+    return 63 - __builtin_clzll(value);
+#endif
+}
+
+}  // namespace
+
+Histogram::Histogram() {
+    Reset();
+}
+
+void Histogram::Reset() {
+    std::memset(counts, 0, sizeof(counts));
+    total = 0;
+    sum = 0;
+    minValue = UINT64_MAX;
+    maxValue = 0;
+}
+
+size_t Histogram::IndexOf(uint64_t value) {
+    if (value < LINEAR_LIMIT) {
+        return static_cast<size_t>(value);
+    }
+
+    // shift >= 1; (value >> shift) lands in [HALF_BUCKETS, 2 * HALF_BUCKETS)
+    int shift = HighestBit(value) - (SUB_BUCKET_BITS - 1);
+    size_t sub = static_cast<size_t>(value >> shift) - HALF_BUCKETS;
+    return LINEAR_LIMIT + (shift - 1) * HALF_BUCKETS + sub;
+}
+
+uint64_t Histogram::BucketLow(size_t index) {
+    if (index < LINEAR_LIMIT) {
+        return index;
+    }
+
+    size_t offset = index - LINEAR_LIMIT;
+    int shift = static_cast<int>(offset / HALF_BUCKETS) + 1;
+    uint64_t sub = (offset % HALF_BUCKETS) + HALF_BUCKETS;
+    return sub << shift;
+}
+
+uint64_t Histogram::BucketHigh(size_t index) {
+    if (index < LINEAR_LIMIT) {
+        return index;
+    }
+
+    int shift = static_cast<int>((index - LINEAR_LIMIT) / HALF_BUCKETS) + 1;
+    return BucketLow(index) + ((1ull << shift) - 1);
+}
+
+void Histogram::Record(uint64_t value) {
+    counts[IndexOf(value)]++;
+    total++;
+    sum += value;
+    if (value < minValue) minValue = value;
+    if (value > maxValue) maxValue = value;
+}
+
+uint64_t Histogram::Percentile(double percentile) const {
+    if (total == 0) return 0;
+
+    double wanted = percentile / 100.0 * total;
+    uint64_t seen = 0;
+    for (size_t i = 0; i < BUCKET_COUNT; i++) {
+        seen += counts[i];
+        if (seen > 0 && seen >= wanted) {
+            uint64_t high = BucketHigh(i);
+            return high < maxValue ? high : maxValue;
+        }
+    }
+    return maxValue;
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Log-linear histogram in the spirit of HdrHistogram. Values below 32 get
+// their own bucket; above that every power of two is split into 16 linear
+// steps, so any recorded value is off by at most ~6% and the whole thing
+// is a fixed array with no allocation on Record().
+class Histogram {
+public:
+    static const int SUB_BUCKET_BITS = 5;
+    static const size_t BUCKET_COUNT = (1 << SUB_BUCKET_BITS) +
+                                       (64 - SUB_BUCKET_BITS) * (1 << (SUB_BUCKET_BITS - 1));
+
+    Histogram();
+
+    void Record(uint64_t value);
+    void Reset();
+
+    uint64_t Count() const { return total; }
+    uint64_t Min() const { return total ? minValue : 0; }
+    uint64_t Max() const { return maxValue; }
+    double Mean() const { return total ? static_cast<double>(sum) / total : 0.0; }
+
+    // Smallest bucket upper bound covering at least `percentile` percent
+    // of the recorded values (0..100)
+    uint64_t Percentile(double percentile) const;
+
+    // Raw buckets, for dumping
+    uint64_t BucketCountAt(size_t index) const { return counts[index]; }
+    static uint64_t BucketLow(size_t index);
+    static uint64_t BucketHigh(size_t index);
+
+private:
+    static size_t IndexOf(uint64_t value);
+
+    uint64_t counts[BUCKET_COUNT];
+    uint64_t total;
+    uint64_t sum;
+    uint64_t minValue;
+    uint64_t maxValue;
+};
@@ -0,0 +1,140 @@
+#include "KeywordMatcher.h"
+
+#include <algorithm>
+#include <cwctype>
+#include <map>
+
+namespace {
+
+wchar_t Lower(wchar_t c) {
+    if (c < 128) {
+        return c >= L'A' && c <= L'Z' ? static_cast<wchar_t>(c + (L'a' - L'A')) : c;
+    }
+    return static_cast<wchar_t>(std::towlower(c));
+}
+
+}  // namespace
+
+KeywordMatcher::KeywordMatcher() : keywordCount(0) {
+    Build();
+}
+
+void KeywordMatcher::Add(const std::wstring& keyword, int value) {
+    if (keyword.empty()) return;
+    std::wstring lower = keyword;
+    std::transform(lower.begin(), lower.end(), lower.begin(), Lower);
+    keywords.push_back(lower);
+    values.push_back(value);
+    keywordCount = keywords.size();
+}
+
+void KeywordMatcher::Build() {
+    // Grow the trie with maps first; it is flattened below
+    std::vector<std::map<wchar_t, int32_t>> children(1);
+    std::vector<int32_t> ends(1, -1);
+    for (size_t k = 0; k < keywords.size(); k++) {
+        int32_t node = 0;
+        for (wchar_t c : keywords[k]) {
+            std::map<wchar_t, int32_t>::iterator found = children[node].find(c);
+            if (found == children[node].end()) {
+                int32_t child = static_cast<int32_t>(children.size());
+                children[node][c] = child;
+                children.emplace_back();
+                ends.push_back(-1);
+                node = child;
+            } else {
+                node = found->second;
+            }
+        }
+        if (ends[node] < 0) {
+            ends[node] = static_cast<int32_t>(k);
+        }
+    }
+
+    nodes.assign(children.size(), Node());
+    edges.clear();
+    for (size_t n = 0; n < children.size(); n++) {
+        nodes[n].firstEdge = static_cast<uint32_t>(edges.size());
+        nodes[n].edgeCount = static_cast<uint32_t>(children[n].size());
+        nodes[n].fail = 0;
+        nodes[n].best = ends[n];
+        for (const auto& child : children[n]) {
+            Edge edge = { child.first, child.second };
+            edges.push_back(edge);
+        }
+    }
+
+    // Failure links breadth first, so a node's suffix is always done
+    // before the node itself; the winning keyword is folded in on the way
+    std::vector<int32_t> queue;
+    for (uint32_t e = 0; e < nodes[0].edgeCount; e++) {
+        queue.push_back(edges[nodes[0].firstEdge + e].next);
+    }
+    for (size_t q = 0; q < queue.size(); q++) {
+        int32_t node = queue[q];
+        for (uint32_t e = 0; e < nodes[node].edgeCount; e++) {
+            const Edge& edge = edges[nodes[node].firstEdge + e];
+            int32_t fail = nodes[node].fail;
+            while (fail != 0 && Child(fail, edge.c) < 0) {
+                fail = nodes[fail].fail;
+            }
+            int32_t target = Child(fail, edge.c);
+            nodes[edge.next].fail = target >= 0 && target != edge.next ? target : 0;
+
+            int32_t inherited = nodes[nodes[edge.next].fail].best;
+            int32_t& best = nodes[edge.next].best;
+            if (inherited >= 0 && (best < 0 || inherited < best)) {
+                best = inherited;
+            }
+            queue.push_back(edge.next);
+        }
+    }
+
+    // Same order again, so a node's failure row is filled before its own
+    asciiNext.assign(nodes.size() * ASCII_SIZE, 0);
+    for (size_t q = 0; q <= queue.size(); q++) {
+        int32_t node = q == 0 ? 0 : queue[q - 1];
+        int32_t* row = &asciiNext[static_cast<size_t>(node) * ASCII_SIZE];
+        const int32_t* failRow = &asciiNext[static_cast<size_t>(nodes[node].fail) * ASCII_SIZE];
+        for (int c = 0; c < ASCII_SIZE; c++) {
+            int32_t child = Child(node, static_cast<wchar_t>(Lower(static_cast<wchar_t>(c))));
+            row[c] = child >= 0 ? child : node == 0 ? 0 : failRow[c];
+        }
+    }
+}
+
+int KeywordMatcher::Match(const std::wstring& text, int noMatch) const {
+    int32_t node = 0;
+    int32_t best = -1;
+    for (wchar_t c : text) {
+        if (static_cast<uint32_t>(c) < ASCII_SIZE) {
+            node = asciiNext[static_cast<size_t>(node) * ASCII_SIZE + c];
+        } else {
+            node = Step(node, Lower(c));
+        }
+        int32_t found = nodes[node].best;
+        if (found >= 0 && (best < 0 || found < best)) {
+            best = found;
+            // Nothing can beat the first keyword
+            if (best == 0) break;
+        }
+    }
+    return best >= 0 ? values[best] : noMatch;
+}
+
+int32_t KeywordMatcher::Step(int32_t node, wchar_t c) const {
+    for (;;) {
+        int32_t next = Child(node, c);
+        if (next >= 0) return next;
+        if (node == 0) return 0;
+        node = nodes[node].fail;
+    }
+}
+
+int32_t KeywordMatcher::Child(int32_t node, wchar_t c) const {
+    const Edge* first = edges.data() + nodes[node].firstEdge;
+    const Edge* last = first + nodes[node].edgeCount;
+    const Edge* found = std::lower_bound(first, last, c,
+                                         [](const Edge& edge, wchar_t value) { return edge.c < value; });
+    return found != last && found->c == c ? found->next : -1;
+}
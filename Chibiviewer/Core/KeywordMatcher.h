@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Finds which of a set of keywords occur in a string in one pass over it,
+// however many keywords there are (Aho-Corasick). Matching ignores case.
+// Each keyword carries a value; when several match, the one added first
+// wins, so the order of Add() calls is the order of precedence.
+class KeywordMatcher {
+public:
+    KeywordMatcher();
+
+    // Add every keyword, then Build() once before matching
+    void Add(const std::wstring& keyword, int value);
+    void Build();
+
+    // Value of the winning keyword found anywhere in text, or noMatch
+    int Match(const std::wstring& text, int noMatch) const;
+
+    size_t KeywordCount() const { return keywordCount; }
+
+private:
+    struct Edge {
+        wchar_t c;
+        int32_t next;
+    };
+
+    struct Node {
+        uint32_t firstEdge;  // Edges are sorted by c within a node
+        uint32_t edgeCount;
+        int32_t fail;        // Longest proper suffix that is also in the trie
+        int32_t best;        // Earliest keyword ending here or at any suffix, -1 if none
+    };
+
+    int32_t Step(int32_t node, wchar_t c) const;
+    int32_t Child(int32_t node, wchar_t c) const;
+
+    // Kept as added until Build() flattens them into nodes and edges
+    std::vector<std::wstring> keywords;
+    std::vector<int> values;
+    size_t keywordCount;
+
+    std::vector<Node> nodes;
+    std::vector<Edge> edges;
+
+    // Full transition table for ASCII, failure links already followed:
+    // file names are nearly always ASCII, so matching is one load per char
+    static const int ASCII_SIZE = 128;
+    std::vector<int32_t> asciiNext;  // nodes.size() x ASCII_SIZE
+};
@@ -0,0 +1,138 @@
+#include "MemoryLedger.h"
+
+namespace {
+
+void WriteJsonString(FILE* file, const std::string& text) {
+    std::fputc('"', file);
+    for (unsigned char c : text) {
+        if (c == '"' || c == '\\') {
+            std::fprintf(file, "\\%c", c);
+        } else if (c < 0x20) {
+            std::fprintf(file, "\\u%04x", c);
+        } else {
+            std::fputc(c, file);
+        }
+    }
+    std::fputc('"', file);
+}
+
+void WriteCategories(FILE* file, const uint64_t* bytes) {
+    for (int c = 0; c < MEMORY_CATEGORY_COUNT; c++) {
+        std::fprintf(file, "%s\"%s\": %llu", c == 0 ? "" : ", ", MemoryCategoryName(static_cast<MemoryCategory>(c)),
+                     static_cast<unsigned long long>(bytes[c]));
+    }
+}
+
+}  // namespace
+
+const char* MemoryCategoryName(MemoryCategory category) {
+    switch (category) {
+        case MEMORY_COMPRESSED: return "compressed";
+        case MEMORY_DECODED: return "decoded";
+        case MEMORY_SCALED: return "scaled";
+        case MEMORY_MIRRORED: return "mirrored";
+        case MEMORY_MASKS: return "masks";
+        case MEMORY_BUFFERS: return "buffers";
+        case MEMORY_PLAYBACK: return "playback";
+        default: return "other";
+    }
+}
+
+uint64_t MemoryAssetUsage::Total() const {
+    uint64_t total = 0;
+    for (int c = 0; c < MEMORY_CATEGORY_COUNT; c++) {
+        total += bytes[c];
+    }
+    return total;
+}
+
+MemoryLedger::MemoryLedger() : nextAsset(1) {}
+
+MemoryAsset MemoryLedger::AddAsset(const std::string& name) {
+    std::lock_guard<std::mutex> guard(lock);
+    MemoryAsset asset = nextAsset++;
+    MemoryAssetUsage& usage = assets[asset];
+    usage.asset = asset;
+    usage.name = name;
+    for (int c = 0; c < MEMORY_CATEGORY_COUNT; c++) {
+        usage.bytes[c] = 0;
+    }
+    return asset;
+}
+
+void MemoryLedger::RemoveAsset(MemoryAsset asset) {
+    std::lock_guard<std::mutex> guard(lock);
+    assets.erase(asset);
+}
+
+OwnedMemoryAsset& OwnedMemoryAsset::operator=(OwnedMemoryAsset&& other) noexcept {
+    if (this != &other) {
+        Reset();
+        ledger = other.ledger;
+        asset = other.asset;
+        other.asset = NO_MEMORY_ASSET;
+    }
+    return *this;
+}
+
+void OwnedMemoryAsset::Reset() {
+    if (ledger && asset != NO_MEMORY_ASSET) {
+        ledger->RemoveAsset(asset);
+    }
+    asset = NO_MEMORY_ASSET;
+}
+
+void MemoryLedger::Charge(MemoryAsset asset, MemoryCategory category, int64_t bytes) {
+    std::lock_guard<std::mutex> guard(lock);
+    std::map<MemoryAsset, MemoryAssetUsage>::iterator found = assets.find(asset);
+    if (found == assets.end()) return;
+    uint64_t& count = found->second.bytes[category];
+    count = bytes < 0 && static_cast<uint64_t>(-bytes) > count ? 0 : count + bytes;
+}
+
+void MemoryLedger::Set(MemoryAsset asset, MemoryCategory category, uint64_t bytes) {
+    std::lock_guard<std::mutex> guard(lock);
+    std::map<MemoryAsset, MemoryAssetUsage>::iterator found = assets.find(asset);
+    if (found != assets.end()) {
+        found->second.bytes[category] = bytes;
+    }
+}
+
+uint64_t MemoryLedger::Bytes(MemoryAsset asset, MemoryCategory category) const {
+    std::lock_guard<std::mutex> guard(lock);
+    std::map<MemoryAsset, MemoryAssetUsage>::const_iterator found = assets.find(asset);
+    return found == assets.end() ? 0 : found->second.bytes[category];
+}
+
+std::vector<MemoryAssetUsage> MemoryLedger::Snapshot() const {
+    std::lock_guard<std::mutex> guard(lock);
+    std::vector<MemoryAssetUsage> usage;
+    usage.reserve(assets.size());
+    for (const auto& entry : assets) {
+        usage.push_back(entry.second);
+    }
+    return usage;
+}
+
+void WriteMemoryJson(FILE* file, const std::vector<MemoryAssetUsage>& usage) {
+    uint64_t totals[MEMORY_CATEGORY_COUNT] = {};
+    uint64_t total = 0;
+    for (const MemoryAssetUsage& asset : usage) {
+        for (int c = 0; c < MEMORY_CATEGORY_COUNT; c++) {
+            totals[c] += asset.bytes[c];
+        }
+        total += asset.Total();
+    }
+
+    std::fprintf(file, "{\n  \"total\": %llu,\n  \"categories\": {", static_cast<unsigned long long>(total));
+    WriteCategories(file, totals);
+    std::fprintf(file, "},\n  \"assets\": [");
+    for (size_t i = 0; i < usage.size(); i++) {
+        std::fprintf(file, "%s\n    {\"name\": ", i == 0 ? "" : ",");
+        WriteJsonString(file, usage[i].name);
+        std::fprintf(file, ", \"total\": %llu, ", static_cast<unsigned long long>(usage[i].Total()));
+        WriteCategories(file, usage[i].bytes);
+        std::fprintf(file, "}");
+    }
+    std::fprintf(file, "%s]\n}\n", usage.empty() ? "" : "\n  ");
+}
@@ -0,0 +1,138 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// What a byte is for
+enum MemoryCategory {
+    MEMORY_COMPRESSED,  // The GIF file as loaded
+    MEMORY_DECODED,     // Frames as pixels at their own size
+    MEMORY_SCALED,      // Upscaled and resampled frames
+    MEMORY_MIRRORED,    // Flipped copies for walking left
+    MEMORY_MASKS,       // Per-frame masks and changed areas
+    MEMORY_BUFFERS,     // Layers drawn into
+    MEMORY_PLAYBACK,    // Frame queues and delay tables
+    MEMORY_CATEGORY_COUNT
+};
+
+const char* MemoryCategoryName(MemoryCategory category);
+
+typedef uint32_t MemoryAsset;
+const MemoryAsset NO_MEMORY_ASSET = 0;
+
+struct MemoryAssetUsage {
+    MemoryAsset asset;
+    std::string name;  // UTF-8
+    uint64_t bytes[MEMORY_CATEGORY_COUNT];
+
+    uint64_t Total() const;
+};
+
+// Bytes in use by each asset (a GIF, the scene) in each category. Whatever
+// holds memory for an asset charges it here when it takes it and refunds it
+// when it lets go. Thread safe, since loaders charge while the render
+// thread draws; charging takes a lock, so keep it off per-frame paths.
+class MemoryLedger {
+public:
+    MemoryLedger();
+
+    MemoryAsset AddAsset(const std::string& name);
+
+    // Forgets the asset along with anything still charged to it
+    void RemoveAsset(MemoryAsset asset);
+
+    // Add (or with a negative count, refund) bytes. Unknown assets and
+    // NO_MEMORY_ASSET are ignored, so late refunds after RemoveAsset are fine.
+    void Charge(MemoryAsset asset, MemoryCategory category, int64_t bytes);
+
+    // Replace the count outright, for memory that is measured rather than
+    // allocated by us (GDI+ images and bitmaps)
+    void Set(MemoryAsset asset, MemoryCategory category, uint64_t bytes);
+
+    uint64_t Bytes(MemoryAsset asset, MemoryCategory category) const;
+
+    // Every live asset in the order they were added
+    std::vector<MemoryAssetUsage> Snapshot() const;
+
+private:
+    MemoryLedger(const MemoryLedger&);
+    MemoryLedger& operator=(const MemoryLedger&);
+
+    mutable std::mutex lock;
+    std::map<MemoryAsset, MemoryAssetUsage> assets;
+    MemoryAsset nextAsset;
+};
+
+// An asset's line in a ledger for as long as this lives: moving it hands
+// the line over, and destroying it removes the line, so whatever holds one
+// of these needs no destructor of its own for the ledger's sake
+class OwnedMemoryAsset {
+public:
+    OwnedMemoryAsset() : ledger(nullptr), asset(NO_MEMORY_ASSET) {}
+    OwnedMemoryAsset(MemoryLedger* ledger, MemoryAsset asset) : ledger(ledger), asset(asset) {}
+    OwnedMemoryAsset(OwnedMemoryAsset&& other) noexcept : ledger(other.ledger), asset(other.asset) {
+        other.asset = NO_MEMORY_ASSET;
+    }
+    OwnedMemoryAsset& operator=(OwnedMemoryAsset&& other) noexcept;
+    ~OwnedMemoryAsset() { Reset(); }
+
+    // Remove the line now
+    void Reset();
+
+    MemoryAsset Get() const { return asset; }
+
+private:
+    OwnedMemoryAsset(const OwnedMemoryAsset&);
+    OwnedMemoryAsset& operator=(const OwnedMemoryAsset&);
+
+    MemoryLedger* ledger;
+    MemoryAsset asset;
+};
+
+// Standard allocator that charges what its container holds to one asset
+// and category, so a vector's real capacity is what gets counted
+template <typename T>
+class TrackedAllocator {
+public:
+    typedef T value_type;
+
+    TrackedAllocator(MemoryLedger* ledger, MemoryAsset asset, MemoryCategory category)
+        : ledger(ledger), asset(asset), category(category) {}
+
+    template <typename U>
+    TrackedAllocator(const TrackedAllocator<U>& other)
+        : ledger(other.ledger), asset(other.asset), category(other.category) {}
+
+    T* allocate(size_t count) {
+        T* memory = static_cast<T*>(::operator new(count * sizeof(T)));
+        ledger->Charge(asset, category, static_cast<int64_t>(count * sizeof(T)));
+        return memory;
+    }
+
+    void deallocate(T* memory, size_t count) {
+        ledger->Charge(asset, category, -static_cast<int64_t>(count * sizeof(T)));
+        ::operator delete(memory);
+    }
+
+    template <typename U>
+    bool operator==(const TrackedAllocator<U>& other) const {
+        return ledger == other.ledger && asset == other.asset && category == other.category;
+    }
+
+    template <typename U>
+    bool operator!=(const TrackedAllocator<U>& other) const {
+        return !(*this == other);
+    }
+
+    MemoryLedger* ledger;
+    MemoryAsset asset;
+    MemoryCategory category;
+};
+
+// {"total": ..., "categories": {...}, "assets": [{"name": ..., ...}]}, all in bytes
+void WriteMemoryJson(FILE* file, const std::vector<MemoryAssetUsage>& usage);
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+
+#include "CacheLine.h"
+
+// Bounded multi-producer, single-consumer ring. Any number of threads push,
+// one thread pops. Nothing blocks, takes a lock or allocates after
+// construction; a producer that finds the ring full gets false back and
+// decides itself whether to drop, retry or wait.
+//
+// Each slot carries a sequence number saying whose turn it is (Vyukov's
+// bounded queue): producers claim a slot by advancing tail with a CAS,
+// write it and then publish it by bumping its sequence, so the consumer
+// never sees a half-written item even when producers finish out of order.
+template <typename T>
+class MpscQueue {
+public:
+    // Capacity is rounded up to a power of two
+    explicit MpscQueue(size_t capacity) : head(0), tail(0) {
+        size_t size = 2;
+        while (size < capacity) size *= 2;
+        slots.reset(new Slot[size]);
+        mask = size - 1;
+        for (size_t i = 0; i < size; i++) {
+            slots[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    // Any thread. False when the queue is full.
+    bool TryPush(const T& item) {
+        size_t back = tail.load(std::memory_order_relaxed);
+        for (;;) {
+            Slot& slot = slots[back & mask];
+            size_t sequence = slot.sequence.load(std::memory_order_acquire);
+            ptrdiff_t lap = static_cast<ptrdiff_t>(sequence - back);
+            if (lap == 0) {
+                // Free for this lap; claim it
+                if (tail.compare_exchange_weak(back, back + 1, std::memory_order_relaxed)) {
+                    slot.item = item;
+                    slot.sequence.store(back + 1, std::memory_order_release);
+                    return true;
+                }
+                // Lost to another producer; back now holds the new tail
+            } else if (lap < 0) {
+                // Still holds last lap's item: full
+                return false;
+            } else {
+                back = tail.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // Consumer side only. False when the queue is empty (or the next item
+    // is claimed but not yet written; it shows up on a later call).
+    bool TryPop(T* item) {
+        size_t front = head.load(std::memory_order_relaxed);
+        Slot& slot = slots[front & mask];
+        if (slot.sequence.load(std::memory_order_acquire) != front + 1) {
+            return false;
+        }
+        *item = slot.item;
+        slot.sequence.store(front + mask + 1, std::memory_order_release);
+        head.store(front + 1, std::memory_order_relaxed);
+        return true;
+    }
+
+    size_t Capacity() const { return mask + 1; }
+
+private:
+    MpscQueue(const MpscQueue&);
+    MpscQueue& operator=(const MpscQueue&);
+
+    struct Slot {
+        std::atomic<size_t> sequence;  // == index: free, == index + 1: holds an item
+        T item;
+    };
+
+    std::unique_ptr<Slot[]> slots;
+    size_t mask;
+
+    // Consumer's line; only the consumer touches it
+    alignas(CACHE_LINE_SIZE) std::atomic<size_t> head;
+
+    // Producers' line, contended between them but never with the consumer
+    alignas(CACHE_LINE_SIZE) std::atomic<size_t> tail;
+};
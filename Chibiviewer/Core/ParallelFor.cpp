@@ -0,0 +1,35 @@
+#include "ParallelFor.h"
+
+#include <atomic>
+
+#include "TaskPool.h"
+
+void ParallelFor(size_t count, unsigned threads, const std::function<void(size_t)>& fn) {
+    TaskPool& pool = TaskPool::Shared();
+    if (threads == 0) {
+        threads = pool.WorkerCount() + 1;
+    }
+    if (threads > count) {
+        threads = static_cast<unsigned>(count);
+    }
+    if (threads <= 1) {
+        for (size_t i = 0; i < count; i++) fn(i);
+        return;
+    }
+
+    // Workers pull the next index until there are none left, so uneven
+    // items still finish together
+    std::atomic<size_t> next(0);
+    auto work = [&]() {
+        for (size_t i = next.fetch_add(1); i < count; i = next.fetch_add(1)) {
+            fn(i);
+        }
+    };
+
+    TaskGroup group;
+    for (unsigned t = 1; t < threads; t++) {
+        pool.Submit(&group, TASK_NORMAL, work);
+    }
+    work();
+    pool.Wait(&group);
+}
@@ -0,0 +1,10 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+
+// Run fn(i) for every i in [0, count), spread over up to `threads` threads
+// (0 means one per core) from TaskPool::Shared(). The calling thread takes
+// part and the call returns once every index is done. fn must be safe to
+// run concurrently.
+void ParallelFor(size_t count, unsigned threads, const std::function<void(size_t)>& fn);
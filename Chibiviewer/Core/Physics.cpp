@@ -0,0 +1,117 @@
+#include "Physics.h"
+#include "SurfaceIndex.h"
+
+#include <algorithm>
+#include <cmath>
+
+FixedStepper::FixedStepper(double stepSeconds, int maxSteps)
+    : step(stepSeconds), accumulator(0.0), maxSteps(maxSteps) {}
+
+int FixedStepper::Advance(double elapsedSeconds) {
+    if (elapsedSeconds > 0.0) {
+        accumulator += elapsedSeconds;
+    }
+
+    int steps = static_cast<int>(accumulator / step);
+    accumulator -= steps * step;
+    return std::min(steps, maxSteps);
+}
+
+size_t BodySystem::Add(float bodyX, float bodyY, float bodyWidth, float bodyHeight,
+                       float bodyVx, float bodyVy) {
+    x.push_back(bodyX);
+    y.push_back(bodyY);
+    vx.push_back(bodyVx);
+    vy.push_back(bodyVy);
+    width.push_back(bodyWidth);
+    height.push_back(bodyHeight);
+    resting.push_back(0);
+    return x.size() - 1;
+}
+
+void BodySystem::Remove(size_t index) {
+    size_t last = x.size() - 1;
+    x[index] = x[last];
+    y[index] = y[last];
+    vx[index] = vx[last];
+    vy[index] = vy[last];
+    width[index] = width[last];
+    height[index] = height[last];
+    resting[index] = resting[last];
+
+    x.pop_back();
+    y.pop_back();
+    vx.pop_back();
+    vy.pop_back();
+    width.pop_back();
+    height.pop_back();
+    resting.pop_back();
+}
+
+void BodySystem::Clear() {
+    x.clear();
+    y.clear();
+    vx.clear();
+    vy.clear();
+    width.clear();
+    height.clear();
+    resting.clear();
+}
+
+void BodySystem::Step(float dt, const PhysicsParams& params, const SurfaceIndex& surfaces,
+                      const PhysicsBounds& bounds) {
+    const size_t count = x.size();
+    for (size_t i = 0; i < count; i++) {
+        if (resting[i]) continue;
+
+        float newVx = std::max(-params.maxSpeed, std::min(vx[i], params.maxSpeed));
+        float newVy = std::max(-params.maxSpeed, std::min(vy[i] + params.gravity * dt, params.maxSpeed));
+        float newX = x[i] + newVx * dt;
+        float newY = y[i] + newVy * dt;
+
+        // Screen walls and ceiling
+        if (newX < bounds.left) {
+            newX = bounds.left;
+            newVx = -newVx * params.restitution;
+        } else if (newX + width[i] > bounds.right) {
+            newX = bounds.right - width[i];
+            newVx = -newVx * params.restitution;
+        }
+        if (newY < bounds.top) {
+            newY = bounds.top;
+            newVy = -newVy * params.restitution;
+        }
+
+        // Floors: the first surface the feet cross on the way down,
+        // or the bottom of the screen
+        if (newVy > 0.0f) {
+            float oldFoot = y[i] + height[i];
+            float newFoot = newY + height[i];
+            int footX = static_cast<int>(std::floor(newX + width[i] * 0.5f));
+
+            float floorY = bounds.bottom;
+            Surface surface;
+            if (surfaces.FindBelow(footX, static_cast<int>(std::ceil(oldFoot)), &surface) &&
+                surface.y < floorY) {
+                floorY = static_cast<float>(surface.y);
+            }
+
+            if (newFoot >= floorY) {
+                newY = floorY - height[i];
+                newVy = -newVy * params.restitution;
+                newVx *= params.friction;
+
+                if (-newVy < params.restSpeed) {
+                    newVx = 0.0f;
+                    newVy = 0.0f;
+                    resting[i] = 1;
+                }
+            }
+        }
+
+        x[i] = newX;
+        y[i] = newY;
+        vx[i] = newVx;
+        vy[i] = newVy;
+    }
+}
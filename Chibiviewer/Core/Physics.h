@@ -0,0 +1,73 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class SurfaceIndex;
+
+struct PhysicsParams {
+    float gravity;      // px/s^2
+    float restitution;  // Fraction of speed kept after a bounce
+    float friction;     // Horizontal speed kept per floor bounce
+    float restSpeed;    // Below this vertical speed a landing sticks (px/s)
+    float maxSpeed;     // Clamp for throw speeds (px/s)
+
+    PhysicsParams()
+        : gravity(2500.0f), restitution(0.45f), friction(0.7f),
+          restSpeed(120.0f), maxSpeed(4000.0f) {}
+};
+
+// Walls of the world, usually the virtual screen
+struct PhysicsBounds {
+    float left;
+    float top;
+    float right;
+    float bottom;
+};
+
+// Accumulates real elapsed time and hands out fixed-size steps, so the
+// simulation does not depend on when the timer happens to fire.
+class FixedStepper {
+public:
+    FixedStepper(double stepSeconds, int maxSteps);
+
+    void Reset() { accumulator = 0.0; }
+
+    // Number of whole steps to run for this much elapsed time. Anything
+    // beyond maxSteps is dropped instead of spiralling after a stall.
+    int Advance(double elapsedSeconds);
+
+    double Step() const { return step; }
+
+private:
+    double step;
+    double accumulator;
+    int maxSteps;
+};
+
+// All thrown/falling bodies, stored as parallel arrays so a step is one
+// tight loop over every entity. Positions are top-left corners in screen
+// pixels; bodies land on the top of surfaces from the SurfaceIndex.
+class BodySystem {
+public:
+    size_t Add(float x, float y, float width, float height, float vx, float vy);
+
+    // Swap-removes, so the last body takes over this index
+    void Remove(size_t index);
+    void Clear();
+    size_t Size() const { return x.size(); }
+
+    void Step(float dt, const PhysicsParams& params, const SurfaceIndex& surfaces,
+              const PhysicsBounds& bounds);
+
+    bool IsResting(size_t index) const { return resting[index] != 0; }
+
+    std::vector<float> x;
+    std::vector<float> y;
+    std::vector<float> vx;
+    std::vector<float> vy;
+    std::vector<float> width;
+    std::vector<float> height;
+    std::vector<uint8_t> resting;
+};
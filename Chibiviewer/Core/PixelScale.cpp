@@ -0,0 +1,145 @@
+#include "PixelScale.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define CHIBI_SCALE_SSE2 1
+#endif
+
+namespace {
+
+// Expand one row horizontally; the caller repeats it vertically
+void ReplicateRow(const uint32_t* src, int width, int factor, uint32_t* dst) {
+    int x = 0;
+#ifdef CHIBI_SCALE_SSE2
+    if (factor == 2) {
+        for (; x + 4 <= width; x += 4) {
+            __m128i pixels = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + x));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + x * 2), _mm_unpacklo_epi32(pixels, pixels));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + x * 2 + 4), _mm_unpackhi_epi32(pixels, pixels));
+        }
+    } else if (factor == 4) {
+        for (; x + 4 <= width; x += 4) {
+            __m128i pixels = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + x));
+            __m128i* out = reinterpret_cast<__m128i*>(dst + x * 4);
+            _mm_storeu_si128(out + 0, _mm_shuffle_epi32(pixels, 0x00));
+            _mm_storeu_si128(out + 1, _mm_shuffle_epi32(pixels, 0x55));
+            _mm_storeu_si128(out + 2, _mm_shuffle_epi32(pixels, 0xAA));
+            _mm_storeu_si128(out + 3, _mm_shuffle_epi32(pixels, 0xFF));
+        }
+    }
+#endif
+    for (; x < width; x++) {
+        std::fill(dst + x * factor, dst + (x + 1) * factor, src[x]);
+    }
+}
+
+void ScaleNearest(const uint32_t* src, int width, int height, int factor, uint32_t* dst) {
+    const size_t outWidth = static_cast<size_t>(width) * factor;
+    for (int y = 0; y < height; y++) {
+        uint32_t* first = dst + static_cast<size_t>(y) * factor * outWidth;
+        ReplicateRow(src + static_cast<size_t>(y) * width, width, factor, first);
+        for (int copy = 1; copy < factor; copy++) {
+            std::copy(first, first + outWidth, first + copy * outWidth);
+        }
+    }
+}
+
+// Neighbours of (x, y), clamped at the edges:
+//   A B C
+//   D E F
+//   G H I
+struct Neighbourhood {
+    uint32_t A, B, C, D, E, F, G, H, I;
+};
+
+inline Neighbourhood Around(const uint32_t* src, int width, int height, int x, int y) {
+    const uint32_t* above = src + static_cast<size_t>(y > 0 ? y - 1 : y) * width;
+    const uint32_t* row = src + static_cast<size_t>(y) * width;
+    const uint32_t* below = src + static_cast<size_t>(y + 1 < height ? y + 1 : y) * width;
+    const int left = x > 0 ? x - 1 : x;
+    const int right = x + 1 < width ? x + 1 : x;
+
+    Neighbourhood n = { above[left], above[x], above[right],
+                        row[left],   row[x],   row[right],
+                        below[left], below[x], below[right] };
+    return n;
+}
+
+void Scale2x(const uint32_t* src, int width, int height, uint32_t* dst) {
+    const size_t outWidth = static_cast<size_t>(width) * 2;
+    for (int y = 0; y < height; y++) {
+        uint32_t* top = dst + static_cast<size_t>(y) * 2 * outWidth;
+        uint32_t* bottom = top + outWidth;
+        for (int x = 0; x < width; x++) {
+            Neighbourhood n = Around(src, width, height, x, y);
+            uint32_t e0 = n.E, e1 = n.E, e2 = n.E, e3 = n.E;
+            if (n.B != n.H && n.D != n.F) {
+                if (n.D == n.B) e0 = n.D;
+                if (n.B == n.F) e1 = n.F;
+                if (n.D == n.H) e2 = n.D;
+                if (n.H == n.F) e3 = n.F;
+            }
+            top[x * 2] = e0;
+            top[x * 2 + 1] = e1;
+            bottom[x * 2] = e2;
+            bottom[x * 2 + 1] = e3;
+        }
+    }
+}
+
+void Scale3x(const uint32_t* src, int width, int height, uint32_t* dst) {
+    const size_t outWidth = static_cast<size_t>(width) * 3;
+    for (int y = 0; y < height; y++) {
+        uint32_t* row0 = dst + static_cast<size_t>(y) * 3 * outWidth;
+        uint32_t* row1 = row0 + outWidth;
+        uint32_t* row2 = row1 + outWidth;
+        for (int x = 0; x < width; x++) {
+            Neighbourhood n = Around(src, width, height, x, y);
+            uint32_t out[9] = { n.E, n.E, n.E, n.E, n.E, n.E, n.E, n.E, n.E };
+            if (n.B != n.H && n.D != n.F) {
+                if (n.D == n.B) out[0] = n.D;
+                if ((n.D == n.B && n.E != n.C) || (n.B == n.F && n.E != n.A)) out[1] = n.B;
+                if (n.B == n.F) out[2] = n.F;
+                if ((n.D == n.B && n.E != n.G) || (n.D == n.H && n.E != n.A)) out[3] = n.D;
+                if ((n.B == n.F && n.E != n.I) || (n.H == n.F && n.E != n.C)) out[5] = n.F;
+                if (n.D == n.H) out[6] = n.D;
+                if ((n.D == n.H && n.E != n.I) || (n.H == n.F && n.E != n.G)) out[7] = n.H;
+                if (n.H == n.F) out[8] = n.F;
+            }
+            std::copy(out, out + 3, row0 + x * 3);
+            std::copy(out + 3, out + 6, row1 + x * 3);
+            std::copy(out + 6, out + 9, row2 + x * 3);
+        }
+    }
+}
+
+}  // namespace
+
+bool ScaleFrame(const uint32_t* src, int width, int height, int factor, ScaleFilter filter, uint32_t* dst) {
+    if (factor < 1 || factor > MAX_SCALE_FACTOR || width <= 0 || height <= 0) {
+        return false;
+    }
+
+    if (factor == 1) {
+        std::copy(src, src + static_cast<size_t>(width) * height, dst);
+    } else if (filter == SCALE_NEAREST) {
+        ScaleNearest(src, width, height, factor, dst);
+    } else if (factor == 2) {
+        Scale2x(src, width, height, dst);
+    } else if (factor == 3) {
+        Scale3x(src, width, height, dst);
+    } else {
+        std::vector<uint32_t> half(static_cast<size_t>(width) * height * 4);
+        Scale2x(src, width, height, half.data());
+        Scale2x(half.data(), width * 2, height * 2, dst);
+    }
+    return true;
+}
+
+const wchar_t* ScaleFilterName(ScaleFilter filter) {
+    return filter == SCALE_NEAREST ? L"Nearest" : L"Smooth edges";
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <cstdint>
+
+// Integer upscaling for pixel art. Works on 0xAARRGGBB frames; pixels are
+// only ever copied, never blended, so premultiplied input stays valid.
+
+const int MAX_SCALE_FACTOR = 4;
+
+enum ScaleFilter {
+    SCALE_NEAREST,  // Plain pixel replication
+    SCALE_EDGES     // Scale2x / Scale3x (Scale4x is Scale2x twice): rounds off stair-stepped diagonals
+};
+
+// Scale a width x height frame by factor (1 to MAX_SCALE_FACTOR) into dst,
+// which must hold (width * factor) x (height * factor) pixels. src and dst
+// must not overlap. Returns false for an unsupported factor.
+bool ScaleFrame(const uint32_t* src, int width, int height, int factor, ScaleFilter filter, uint32_t* dst);
+
+const wchar_t* ScaleFilterName(ScaleFilter filter);
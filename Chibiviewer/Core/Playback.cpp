@@ -0,0 +1,58 @@
+#include "Playback.h"
+
+PlaybackCursor::PlaybackCursor()
+    : delays(nullptr), frameCount(0), minDelay(0), loopDuration(0),
+      frame(0), elapsedInFrame(0), loops(0) {
+}
+
+void PlaybackCursor::Reset(const uint32_t* delaysMs, size_t count, uint32_t minDelayMs) {
+    delays = delaysMs;
+    frameCount = count;
+    minDelay = minDelayMs > 0 ? minDelayMs : 1;
+    frame = 0;
+    elapsedInFrame = 0;
+    loops = 0;
+
+    loopDuration = 0;
+    for (size_t i = 0; i < frameCount; i++) {
+        loopDuration += DelayOf(i);
+    }
+}
+
+uint32_t PlaybackCursor::DelayOf(size_t index) const {
+    return delays[index] < minDelay ? minDelay : delays[index];
+}
+
+uint64_t PlaybackCursor::Advance(uint64_t elapsedMs) {
+    if (frameCount == 0) return 0;
+
+    uint64_t changes = 0;
+    uint64_t remaining = elapsedInFrame + elapsedMs;
+
+    // Skip whole loops without walking every frame. A full loop from any
+    // frame lands back on the same frame and wraps exactly once.
+    if (remaining >= loopDuration) {
+        uint64_t wholeLoops = remaining / loopDuration;
+        remaining -= wholeLoops * loopDuration;
+        loops += wholeLoops;
+        changes += wholeLoops * frameCount;
+    }
+
+    while (remaining >= DelayOf(frame)) {
+        remaining -= DelayOf(frame);
+        frame++;
+        changes++;
+        if (frame == frameCount) {
+            frame = 0;
+            loops++;
+        }
+    }
+
+    elapsedInFrame = static_cast<uint32_t>(remaining);
+    return changes;
+}
+
+uint32_t PlaybackCursor::RemainingMs() const {
+    if (frameCount == 0) return 0;
+    return DelayOf(frame) - elapsedInFrame;
+}
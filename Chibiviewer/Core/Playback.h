@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Tracks which frame of a looping animation is showing as time passes.
+// Frame delays are borrowed, not copied, and must outlive the cursor.
+class PlaybackCursor {
+public:
+    PlaybackCursor();
+
+    // Start at frame 0. Delays shorter than minDelayMs are stretched to it,
+    // matching how the viewer clamps very fast GIFs.
+    void Reset(const uint32_t* delaysMs, size_t frameCount, uint32_t minDelayMs);
+
+    // Move forward by elapsedMs. Returns how many frame changes happened,
+    // so 0 means the same frame is still showing. Whole loops are skipped
+    // in constant time.
+    uint64_t Advance(uint64_t elapsedMs);
+
+    size_t Frame() const { return frame; }
+    uint64_t Loops() const { return loops; }
+
+    // Milliseconds until the next frame change
+    uint32_t RemainingMs() const;
+
+    // Length of one loop of the animation in milliseconds
+    uint64_t LoopDurationMs() const { return loopDuration; }
+
+private:
+    uint32_t DelayOf(size_t index) const;
+
+    const uint32_t* delays;
+    size_t frameCount;
+    uint32_t minDelay;
+    uint64_t loopDuration;
+    size_t frame;
+    uint32_t elapsedInFrame;
+    uint64_t loops;
+};
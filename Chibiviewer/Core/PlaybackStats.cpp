@@ -0,0 +1,74 @@
+#include "PlaybackStats.h"
+
+#include <cwchar>
+
+namespace {
+
+void WriteHistogramRows(FILE* file, const char* name, const char* metric, const Histogram& histogram) {
+    for (size_t i = 0; i < Histogram::BUCKET_COUNT; i++) {
+        uint64_t count = histogram.BucketCountAt(i);
+        if (count == 0) continue;
+        std::fprintf(file, "%s,%s,%llu,%llu,%llu\n", name, metric,
+                     static_cast<unsigned long long>(Histogram::BucketLow(i)),
+                     static_cast<unsigned long long>(Histogram::BucketHigh(i)),
+                     static_cast<unsigned long long>(count));
+    }
+}
+
+}  // namespace
+
+PlaybackStats::PlaybackStats() : lateFrames(0), droppedFrames(0) {
+}
+
+void PlaybackStats::RecordFrame(double scheduledMs, double actualMs) {
+    if (scheduledMs <= 0.0 || actualMs < 0.0) return;
+
+    uint64_t scheduledUs = static_cast<uint64_t>(scheduledMs * 1000.0);
+    uint64_t actualUs = static_cast<uint64_t>(actualMs * 1000.0);
+    uint64_t lateUs = actualUs > scheduledUs ? actualUs - scheduledUs : 0;
+
+    scheduled.Record(scheduledUs);
+    actual.Record(actualUs);
+    lateness.Record(lateUs);
+
+    if (lateUs > static_cast<uint64_t>(LATE_TOLERANCE_US)) {
+        lateFrames++;
+    }
+    droppedFrames += lateUs / scheduledUs;
+}
+
+void PlaybackStats::Reset() {
+    scheduled.Reset();
+    actual.Reset();
+    lateness.Reset();
+    lateFrames = 0;
+    droppedFrames = 0;
+}
+
+int PlaybackStats::FormatSummary(wchar_t* buffer, size_t size, const wchar_t* name) const {
+    if (Frames() == 0) {
+        return std::swprintf(buffer, size, L"%ls: not played yet", name);
+    }
+    return std::swprintf(buffer, size,
+        L"%ls: %llu frames, asked %.1f ms, got p50 %.1f / p99 %.1f / max %.1f ms, %llu late, %llu dropped",
+        name, static_cast<unsigned long long>(Frames()),
+        scheduled.Percentile(50.0) / 1000.0,
+        actual.Percentile(50.0) / 1000.0,
+        actual.Percentile(99.0) / 1000.0,
+        actual.Max() / 1000.0,
+        static_cast<unsigned long long>(lateFrames),
+        static_cast<unsigned long long>(droppedFrames));
+}
+
+void PlaybackStats::WriteCsvHeader(FILE* file) {
+    std::fprintf(file, "animation,metric,bucket_low_us,bucket_high_us,count\n");
+}
+
+void PlaybackStats::WriteCsv(FILE* file, const char* name) const {
+    WriteHistogramRows(file, name, "scheduled", scheduled);
+    WriteHistogramRows(file, name, "actual", actual);
+    WriteHistogramRows(file, name, "lateness", lateness);
+    std::fprintf(file, "%s,frames,,,%llu\n", name, static_cast<unsigned long long>(Frames()));
+    std::fprintf(file, "%s,late_frames,,,%llu\n", name, static_cast<unsigned long long>(lateFrames));
+    std::fprintf(file, "%s,dropped_frames,,,%llu\n", name, static_cast<unsigned long long>(droppedFrames));
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+
+#include "Histogram.h"
+
+// How closely one animation's frames follow the delays in its GIF. Times
+// are recorded in microseconds.
+class PlaybackStats {
+public:
+    // A frame is late once it stays up this much longer than asked for
+    static const int LATE_TOLERANCE_US = 4000;
+
+    PlaybackStats();
+
+    // A frame the GIF wanted on screen for scheduledMs was replaced after
+    // actualMs. Every whole extra delay that passed counts as a dropped frame.
+    void RecordFrame(double scheduledMs, double actualMs);
+    void Reset();
+
+    uint64_t Frames() const { return actual.Count(); }
+    uint64_t LateFrames() const { return lateFrames; }
+    uint64_t DroppedFrames() const { return droppedFrames; }
+
+    const Histogram& Scheduled() const { return scheduled; }
+    const Histogram& Actual() const { return actual; }
+    const Histogram& Lateness() const { return lateness; }
+
+    // One line for people, e.g. in a message box
+    int FormatSummary(wchar_t* buffer, size_t size, const wchar_t* name) const;
+
+    // Rows of name,metric,bucket_low_us,bucket_high_us,count for every
+    // non-empty bucket, plus the frame counters
+    static void WriteCsvHeader(FILE* file);
+    void WriteCsv(FILE* file, const char* name) const;
+
+private:
+    Histogram scheduled;
+    Histogram actual;
+    Histogram lateness;
+    uint64_t lateFrames;
+    uint64_t droppedFrames;
+};
@@ -0,0 +1,64 @@
+#include "PointerHistory.h"
+
+PointerHistory::PointerHistory() : head(0), count(0) {}
+
+void PointerHistory::Push(double timeMs, float x, float y) {
+    samples[head].timeMs = timeMs;
+    samples[head].x = x;
+    samples[head].y = y;
+    head = (head + 1) % CAPACITY;
+    if (count < CAPACITY) count++;
+}
+
+const PointerSample& PointerHistory::Recent(size_t i) const {
+    return samples[(head + CAPACITY - 1 - i) % CAPACITY];
+}
+
+bool PointerHistory::EstimateVelocity(double windowMs, float* vx, float* vy) const {
+    *vx = 0.0f;
+    *vy = 0.0f;
+    if (count < 2) return false;
+
+    // Fit x(t) and y(t) with a line, t relative to the newest sample
+    double newest = Recent(0).timeMs;
+    double sumT = 0, sumX = 0, sumY = 0, sumTT = 0, sumTX = 0, sumTY = 0;
+    size_t used = 0;
+    for (size_t i = 0; i < count; i++) {
+        const PointerSample& sample = Recent(i);
+        double t = sample.timeMs - newest;
+        if (-t > windowMs) break;
+
+        sumT += t;
+        sumX += sample.x;
+        sumY += sample.y;
+        sumTT += t * t;
+        sumTX += t * sample.x;
+        sumTY += t * sample.y;
+        used++;
+    }
+    if (used < 2) return false;
+
+    double denominator = used * sumTT - sumT * sumT;
+    if (denominator <= 1e-9) return false;
+
+    // Slopes are px/ms
+    *vx = static_cast<float>((used * sumTX - sumT * sumX) / denominator * 1000.0);
+    *vy = static_cast<float>((used * sumTY - sumT * sumY) / denominator * 1000.0);
+    return true;
+}
+
+void PointerHistory::Predict(double horizonMs, double velocityWindowMs, float* x, float* y) const {
+    *x = 0.0f;
+    *y = 0.0f;
+    if (count == 0) return;
+
+    const PointerSample& newest = Recent(0);
+    *x = newest.x;
+    *y = newest.y;
+
+    float vx, vy;
+    if (EstimateVelocity(velocityWindowMs, &vx, &vy)) {
+        *x += static_cast<float>(vx * horizonMs / 1000.0);
+        *y += static_cast<float>(vy * horizonMs / 1000.0);
+    }
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstddef>
+
+struct PointerSample {
+    double timeMs;
+    float x;
+    float y;
+};
+
+// Small ring buffer of recent pointer positions. Used to turn a drag into
+// a release velocity without keeping any per-message state elsewhere.
+class PointerHistory {
+public:
+    static const size_t CAPACITY = 64;
+
+    PointerHistory();
+
+    void Clear() { count = 0; head = 0; }
+    void Push(double timeMs, float x, float y);
+
+    size_t Count() const { return count; }
+
+    // i = 0 is the newest sample
+    const PointerSample& Recent(size_t i) const;
+
+    // Least-squares velocity in px/s over the samples no older than windowMs
+    // relative to the newest one. Returns false with fewer than two samples.
+    bool EstimateVelocity(double windowMs, float* vx, float* vy) const;
+
+    // Extrapolate the newest sample horizonMs ahead using the velocity over
+    // velocityWindowMs. Without enough history this is the newest sample.
+    void Predict(double horizonMs, double velocityWindowMs, float* x, float* y) const;
+
+private:
+    PointerSample samples[CAPACITY];
+    size_t head;   // Next slot to write
+    size_t count;
+};
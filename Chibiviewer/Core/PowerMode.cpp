@@ -0,0 +1,83 @@
+#include "PowerMode.h"
+
+#include "Playback.h"
+#include "Scheduler.h"
+
+namespace {
+
+// Must match the frontend's MOVE_INTERVAL and MIN_FRAME_DELAY
+const uint32_t SIM_MOVE_INTERVAL = 16;
+const uint32_t SIM_MIN_FRAME_DELAY = 16;
+
+}  // namespace
+
+bool IsPowerSaverActive(PowerSetting setting, bool onBattery) {
+    switch (setting) {
+        case POWER_SAVER_ON: return true;
+        case POWER_SAVER_OFF: return false;
+        default: return onBattery;
+    }
+}
+
+PowerSetting NextPowerSetting(PowerSetting setting) {
+    switch (setting) {
+        case POWER_AUTO: return POWER_SAVER_ON;
+        case POWER_SAVER_ON: return POWER_SAVER_OFF;
+        default: return POWER_AUTO;
+    }
+}
+
+const wchar_t* PowerSettingName(PowerSetting setting) {
+    switch (setting) {
+        case POWER_SAVER_ON: return L"power saver on";
+        case POWER_SAVER_OFF: return L"power saver off";
+        default: return L"power saver on battery";
+    }
+}
+
+WakeupStats SimulateWakeups(const uint32_t* delaysMs, size_t frameCount, bool moving,
+                            bool powerSaver, uint64_t durationMs) {
+    WakeupStats stats = { 0, 0, 0 };
+    if (frameCount == 0) return stats;
+
+    Scheduler scheduler;
+    scheduler.SetGrid(powerSaver ? POWER_SAVER_GRID_MS : 0);
+
+    PlaybackCursor cursor;
+    cursor.Reset(delaysMs, frameCount, SIM_MIN_FRAME_DELAY);
+    uint64_t lastFrame = 0;
+
+    // The animation: one task per frame, rescheduling itself. In power saver
+    // mode it also moves the character by however long it has been.
+    std::function<void()> frameTask;
+    uint64_t now = 0;
+    frameTask = [&]() {
+        if (powerSaver) {
+            cursor.Advance(now - lastFrame);
+            if (moving) stats.moveUpdates++;
+        } else {
+            cursor.Advance(cursor.RemainingMs());
+        }
+        lastFrame = now;
+        stats.frames++;
+        scheduler.ScheduleAt(now + cursor.RemainingMs(), frameTask);
+    };
+    scheduler.ScheduleAt(cursor.RemainingMs(), frameTask);
+
+    std::function<void()> moveTask;
+    moveTask = [&]() {
+        stats.moveUpdates++;
+        scheduler.ScheduleAt(now + SIM_MOVE_INTERVAL, moveTask);
+    };
+    if (moving && !powerSaver) {
+        scheduler.ScheduleAt(SIM_MOVE_INTERVAL, moveTask);
+    }
+
+    while (scheduler.HasPending()) {
+        now = scheduler.NextDeadline();
+        if (now > durationMs) break;
+        scheduler.RunDue(now);
+        stats.wakeups++;
+    }
+    return stats;
+}
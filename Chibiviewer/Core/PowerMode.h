@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Power saver: frame deadlines are rounded up to a coarse grid so the
+// animation, movement and any other scheduled work share one wakeup, and
+// frames whose time passed in between are skipped to keep the speed.
+const uint32_t POWER_SAVER_GRID_MS = 50;
+
+enum PowerSetting {
+    POWER_AUTO,       // Power saver on battery only
+    POWER_SAVER_ON,
+    POWER_SAVER_OFF
+};
+
+bool IsPowerSaverActive(PowerSetting setting, bool onBattery);
+PowerSetting NextPowerSetting(PowerSetting setting);
+const wchar_t* PowerSettingName(PowerSetting setting);
+
+struct WakeupStats {
+    uint64_t wakeups;      // Times the process had to wake up
+    uint64_t frames;       // Animation frames shown
+    uint64_t moveUpdates;  // Position updates while walking
+};
+
+// Headless model of the viewer's timers over durationMs of simulated time,
+// playing one GIF (and walking, if `moving`). Normal mode runs the 16 ms
+// movement tick and a timer per frame delay; power saver drives both from
+// the frame cadence on POWER_SAVER_GRID_MS.
+WakeupStats SimulateWakeups(const uint32_t* delaysMs, size_t frameCount, bool moving,
+                            bool powerSaver, uint64_t durationMs);
@@ -0,0 +1,165 @@
+#include "Profiler.h"
+
+#include <chrono>
+#include <mutex>
+#include <vector>
+
+std::atomic<bool> g_traceEnabled(false);
+
+namespace {
+
+const size_t TRACE_BUFFER_CAPACITY = 1 << 16;  // Events kept per thread
+
+struct TraceEvent {
+    const char* name;
+    uint64_t startNs;
+    uint64_t durationNs;
+};
+
+// A ring slot. sequence is the event's index + 1 once it is complete and
+// TRACE_SLOT_WRITING while the owner rewrites it, so a reader can tell a
+// torn copy from a good one. The fields are release/acquire atomics so a
+// reader that sees any part of a rewrite also sees the slot marked as
+// being written; on x86 these are all plain moves.
+const uint64_t TRACE_SLOT_WRITING = ~0ull;
+
+struct TraceSlot {
+    std::atomic<uint64_t> sequence;
+    std::atomic<const char*> name;
+    std::atomic<uint64_t> startNs;
+    std::atomic<uint64_t> durationNs;
+
+    TraceSlot() : sequence(0), name(nullptr), startNs(0), durationNs(0) {}
+};
+
+// One per thread. Only the owning thread writes; the dump copies the
+// published window and keeps a slot only if its sequence was the same
+// index before and after the copy, so no lock is ever taken on the hot path.
+struct TraceBuffer {
+    std::atomic<uint64_t> writeIndex;
+    uint32_t threadId;
+    char threadName[32];
+    TraceSlot slots[TRACE_BUFFER_CAPACITY];
+
+    TraceBuffer() : writeIndex(0), threadId(0) { threadName[0] = '\0'; }
+};
+
+std::mutex g_registryMutex;
+std::vector<TraceBuffer*> g_registry;  // Buffers outlive their threads
+
+TraceBuffer* CurrentBuffer() {
+    thread_local TraceBuffer* buffer = nullptr;
+    if (!buffer) {
+        buffer = new TraceBuffer();
+        std::lock_guard<std::mutex> lock(g_registryMutex);
+        buffer->threadId = static_cast<uint32_t>(g_registry.size() + 1);
+        g_registry.push_back(buffer);
+    }
+    return buffer;
+}
+
+const std::chrono::steady_clock::time_point g_traceEpoch = std::chrono::steady_clock::now();
+
+void WriteJsonString(FILE* file, const char* text) {
+    fputc('"', file);
+    for (const char* c = text; *c; c++) {
+        if (*c == '"' || *c == '\\') {
+            fputc('\\', file);
+            fputc(*c, file);
+        } else if (static_cast<unsigned char>(*c) < 0x20) {
+            fprintf(file, "\\u%04x", static_cast<unsigned>(static_cast<unsigned char>(*c)));
+        } else {
+            fputc(*c, file);
+        }
+    }
+    fputc('"', file);
+}
+
+}  // namespace
+
+void SetTracingEnabled(bool enabled) {
+    g_traceEnabled.store(enabled, std::memory_order_relaxed);
+}
+
+uint64_t TraceNowNs() {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - g_traceEpoch).count()) + 1;
+}
+
+void RecordTraceEvent(const char* name, uint64_t startNs, uint64_t endNs) {
+    TraceBuffer* buffer = CurrentBuffer();
+    uint64_t index = buffer->writeIndex.load(std::memory_order_relaxed);
+
+    TraceSlot& slot = buffer->slots[index % TRACE_BUFFER_CAPACITY];
+    slot.sequence.store(TRACE_SLOT_WRITING, std::memory_order_relaxed);
+    slot.name.store(name, std::memory_order_release);
+    slot.startNs.store(startNs, std::memory_order_release);
+    slot.durationNs.store(endNs - startNs, std::memory_order_release);
+    slot.sequence.store(index + 1, std::memory_order_release);
+
+    buffer->writeIndex.store(index + 1, std::memory_order_release);
+}
+
+void SetTraceThreadName(const char* name) {
+    TraceBuffer* buffer = CurrentBuffer();
+    snprintf(buffer->threadName, sizeof(buffer->threadName), "%s", name);
+}
+
+void ClearTrace() {
+    std::lock_guard<std::mutex> lock(g_registryMutex);
+    for (size_t i = 0; i < g_registry.size(); i++) {
+        // Not atomic with respect to a writer mid-event; only call when idle
+        g_registry[i]->writeIndex.store(0, std::memory_order_release);
+    }
+}
+
+long WriteChromeTrace(FILE* file) {
+    std::vector<TraceBuffer*> buffers;
+    {
+        std::lock_guard<std::mutex> lock(g_registryMutex);
+        buffers = g_registry;
+    }
+
+    std::vector<TraceEvent> events;
+    long written = 0;
+    bool first = true;
+
+    fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    for (size_t b = 0; b < buffers.size(); b++) {
+        TraceBuffer* buffer = buffers[b];
+
+        // Copy the live window, dropping any slot the writer lapped or was
+        // in the middle of while it was being copied
+        uint64_t end = buffer->writeIndex.load(std::memory_order_acquire);
+        uint64_t begin = end > TRACE_BUFFER_CAPACITY ? end - TRACE_BUFFER_CAPACITY : 0;
+        events.clear();
+        for (uint64_t i = begin; i < end; i++) {
+            const TraceSlot& slot = buffer->slots[i % TRACE_BUFFER_CAPACITY];
+            uint64_t before = slot.sequence.load(std::memory_order_acquire);
+            TraceEvent event;
+            event.name = slot.name.load(std::memory_order_acquire);
+            event.startNs = slot.startNs.load(std::memory_order_acquire);
+            event.durationNs = slot.durationNs.load(std::memory_order_acquire);
+            if (before == i + 1 && slot.sequence.load(std::memory_order_relaxed) == before) {
+                events.push_back(event);
+            }
+        }
+
+        fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":",
+                first ? "" : ",\n", buffer->threadId);
+        WriteJsonString(file, buffer->threadName[0] ? buffer->threadName : "thread");
+        fprintf(file, "}}");
+        first = false;
+
+        for (size_t i = 0; i < events.size(); i++) {
+            fprintf(file, ",\n{\"name\":");
+            WriteJsonString(file, events[i].name);
+            fprintf(file, ",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+                    buffer->threadId, events[i].startNs / 1000.0, events[i].durationNs / 1000.0);
+            written++;
+        }
+    }
+    fprintf(file, "\n]}\n");
+
+    return ferror(file) ? -1 : written;
+}
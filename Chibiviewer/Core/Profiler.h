@@ -0,0 +1,62 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+
+// Build with CHIBI_TRACING=0 to compile every trace zone out completely.
+// With it on (the default) a zone costs one relaxed atomic load while
+// tracing is switched off.
+#ifndef CHIBI_TRACING
+#define CHIBI_TRACING 1
+#endif
+
+extern std::atomic<bool> g_traceEnabled;
+
+void SetTracingEnabled(bool enabled);
+inline bool IsTracingEnabled() { return g_traceEnabled.load(std::memory_order_relaxed); }
+
+// Nanoseconds on a monotonic clock, never 0
+uint64_t TraceNowNs();
+
+// Append a finished zone to the calling thread's ring buffer. `name` must
+// outlive the trace (string literals).
+void RecordTraceEvent(const char* name, uint64_t startNs, uint64_t endNs);
+
+// Label the calling thread in the exported trace
+void SetTraceThreadName(const char* name);
+
+// Drop everything recorded so far
+void ClearTrace();
+
+// Write every buffered zone as Chrome Trace Event JSON (chrome://tracing,
+// Perfetto). Returns the number of events written, or -1 on write error.
+long WriteChromeTrace(FILE* file);
+
+class TraceZone {
+public:
+    explicit TraceZone(const char* name)
+        : name(name), startNs(IsTracingEnabled() ? TraceNowNs() : 0) {}
+
+    ~TraceZone() {
+        if (startNs != 0) {
+            RecordTraceEvent(name, startNs, TraceNowNs());
+        }
+    }
+
+private:
+    TraceZone(const TraceZone&);
+    TraceZone& operator=(const TraceZone&);
+
+    const char* name;
+    uint64_t startNs;
+};
+
+#define TRACE_CONCAT_INNER(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_INNER(a, b)
+
+#if CHIBI_TRACING
+#define TRACE_ZONE(name) TraceZone TRACE_CONCAT(traceZone, __LINE__)(name)
+#else
+#define TRACE_ZONE(name) ((void)0)
+#endif
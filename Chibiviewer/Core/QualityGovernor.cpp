@@ -0,0 +1,82 @@
+#include "QualityGovernor.h"
+
+QualityGovernor::QualityGovernor(const GovernorParams& params)
+    : params(params), tier(QUALITY_FULL), windowFrames(0), windowMisses(0),
+      cleanWindows(0), backoff(0), justUpgraded(false),
+      lastMissRatio(0.0), lastCpu(0.0), downgrades(0), upgrades(0) {
+    for (int i = 0; i < QUALITY_TIER_COUNT; i++) {
+        entries[i] = 0;
+    }
+    entries[QUALITY_FULL] = 1;
+}
+
+void QualityGovernor::RecordFrame(double scheduledMs, double actualMs) {
+    windowFrames++;
+    if (actualMs - scheduledMs >= scheduledMs * params.missFraction) {
+        windowMisses++;
+    }
+}
+
+bool QualityGovernor::Evaluate(double cpuFraction) {
+    lastMissRatio = windowFrames ? static_cast<double>(windowMisses) / windowFrames : 0.0;
+    lastCpu = cpuFraction;
+    windowFrames = 0;
+    windowMisses = 0;
+
+    if (lastMissRatio > params.degradeMissRatio || lastCpu > params.degradeCpu) {
+        cleanWindows = 0;
+        if (tier + 1 >= QUALITY_TIER_COUNT) return false;
+
+        // Giving back an upgrade straight away means we are near the edge;
+        // wait longer before trying again
+        if (justUpgraded && backoff < params.maxBackoff) {
+            backoff++;
+        }
+        justUpgraded = false;
+        tier = static_cast<QualityTier>(tier + 1);
+        entries[tier]++;
+        downgrades++;
+        return true;
+    }
+
+    justUpgraded = false;
+    if (lastMissRatio > params.recoverMissRatio || lastCpu > params.recoverCpu) {
+        // Between the thresholds: hold, and start counting clean windows over
+        cleanWindows = 0;
+        return false;
+    }
+
+    cleanWindows++;
+    if (cleanWindows < (params.recoverWindows << backoff)) return false;
+    cleanWindows = 0;
+
+    if (tier == QUALITY_FULL) {
+        // Stable at the top; let the backoff decay again
+        if (backoff > 0) backoff--;
+        return false;
+    }
+
+    justUpgraded = true;
+    tier = static_cast<QualityTier>(tier - 1);
+    entries[tier]++;
+    upgrades++;
+    return true;
+}
+
+QualitySettings QualityGovernor::SettingsFor(QualityTier tier) {
+    QualitySettings settings = { true, 16, false };
+    if (tier >= QUALITY_FAST_FILTER) settings.smoothInterpolation = false;
+    if (tier >= QUALITY_CAPPED) settings.minFrameDelayMs = 33;
+    if (tier >= QUALITY_SKIP_FRAMES) settings.skipFrames = true;
+    return settings;
+}
+
+const wchar_t* QualityGovernor::TierName(QualityTier tier) {
+    switch (tier) {
+        case QUALITY_FULL: return L"full";
+        case QUALITY_FAST_FILTER: return L"fast filter";
+        case QUALITY_CAPPED: return L"30 fps cap";
+        case QUALITY_SKIP_FRAMES: return L"frame skipping";
+        default: return L"unknown";
+    }
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <cstdint>
+
+// Rendering quality steps, best first. Each tier keeps the savings of the
+// ones above it.
+enum QualityTier {
+    QUALITY_FULL,          // High quality filtering and smoothing
+    QUALITY_FAST_FILTER,   // Nearest neighbor interpolation
+    QUALITY_CAPPED,        // Animation limited to ~30 fps
+    QUALITY_SKIP_FRAMES,   // Late ticks skip frames to keep the GIF's speed
+    QUALITY_TIER_COUNT
+};
+
+struct QualitySettings {
+    bool smoothInterpolation;
+    uint32_t minFrameDelayMs;
+    bool skipFrames;
+};
+
+struct GovernorParams {
+    uint32_t windowFrames;     // Frames per evaluation
+    double missFraction;       // A frame misses its deadline once it is this fraction of its delay late
+    double degradeMissRatio;   // Step down when more frames than this miss...
+    double degradeCpu;         // ...or we use more than this fraction of a core
+    double recoverMissRatio;   // A window this clean counts towards stepping up
+    double recoverCpu;
+    uint32_t recoverWindows;   // Clean windows needed before stepping up
+    uint32_t maxBackoff;       // Cap on doubling recoverWindows after flapping
+
+    GovernorParams()
+        : windowFrames(60), missFraction(1.0),
+          degradeMissRatio(0.10), degradeCpu(0.15),
+          recoverMissRatio(0.02), recoverCpu(0.05),
+          recoverWindows(3), maxBackoff(4) {}
+};
+
+// Watches frame deadlines and CPU use and moves between quality tiers.
+// Stepping down is immediate; stepping up needs several clean windows in
+// a row, and twice as many each time an upgrade had to be taken back.
+class QualityGovernor {
+public:
+    explicit QualityGovernor(const GovernorParams& params = GovernorParams());
+
+    // One frame was shown actualMs after the previous one, where
+    // scheduledMs was asked for
+    void RecordFrame(double scheduledMs, double actualMs);
+
+    // Enough frames for Evaluate()
+    bool WindowComplete() const { return windowFrames >= params.windowFrames; }
+
+    // Close the current window. cpuFraction is the process CPU time over
+    // the window divided by its wall time. Returns true if the tier changed.
+    bool Evaluate(double cpuFraction);
+
+    QualityTier Tier() const { return tier; }
+    QualitySettings Settings() const { return SettingsFor(tier); }
+
+    uint64_t Downgrades() const { return downgrades; }
+    uint64_t Upgrades() const { return upgrades; }
+    uint64_t TierEntries(QualityTier which) const { return entries[which]; }
+
+    // Why the last change happened, for logging
+    double LastMissRatio() const { return lastMissRatio; }
+    double LastCpuFraction() const { return lastCpu; }
+
+    static QualitySettings SettingsFor(QualityTier tier);
+    static const wchar_t* TierName(QualityTier tier);
+
+private:
+    GovernorParams params;
+    QualityTier tier;
+    uint32_t windowFrames;
+    uint32_t windowMisses;
+    uint32_t cleanWindows;
+    uint32_t backoff;
+    bool justUpgraded;
+    double lastMissRatio;
+    double lastCpu;
+    uint64_t downgrades;
+    uint64_t upgrades;
+    uint64_t entries[QUALITY_TIER_COUNT];
+};
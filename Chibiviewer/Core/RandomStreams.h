@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstdint>
+#include <random>
+
+// What a random number is for. Each purpose draws from its own stream, so
+// adding a roll in one place doesn't shift every other decision after it.
+enum RandomStream {
+    RANDOM_STATE,      // Next state and how long it lasts
+    RANDOM_MOVEMENT,   // Walking direction
+    RANDOM_ANIMATION,  // Which of a state's GIFs plays
+    RANDOM_FURNITURE,  // What to place and where
+    RANDOM_STREAM_COUNT
+};
+
+// SplitMix64 step: spreads a seed and a salt into an unrelated 64-bit value
+inline uint64_t MixSeed(uint64_t seed, uint64_t salt) {
+    uint64_t z = seed + 0x9E3779B97F4A7C15ull * (salt + 1);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+// Uniform integer in [low, high]. std::uniform_int_distribution is free to
+// differ between standard libraries; this gives the same answer everywhere
+// (multiply-shift, with a bias of at most range / 2^32).
+inline int RandomRange(std::mt19937& random, int low, int high) {
+    uint64_t range = static_cast<uint64_t>(static_cast<int64_t>(high) - low) + 1;
+    return low + static_cast<int>((static_cast<uint64_t>(random()) * range) >> 32);
+}
+
+// One character's random numbers, all derived from a session seed. The same
+// seed and character number give the same sequence in every stream on
+// every run and platform, which is what makes sessions replayable.
+class CharacterRandom {
+public:
+    explicit CharacterRandom(uint64_t sessionSeed = 0, uint32_t character = 0) {
+        Seed(sessionSeed, character);
+    }
+
+    void Seed(uint64_t sessionSeed, uint32_t character) {
+        seed = sessionSeed;
+        for (int i = 0; i < RANDOM_STREAM_COUNT; i++) {
+            uint64_t mixed = MixSeed(MixSeed(sessionSeed, character), static_cast<uint64_t>(i));
+            std::seed_seq sequence = { static_cast<uint32_t>(mixed), static_cast<uint32_t>(mixed >> 32) };
+            streams[i].seed(sequence);
+        }
+    }
+
+    std::mt19937& operator[](RandomStream stream) { return streams[stream]; }
+    uint64_t SessionSeed() const { return seed; }
+
+private:
+    std::mt19937 streams[RANDOM_STREAM_COUNT];
+    uint64_t seed;
+};
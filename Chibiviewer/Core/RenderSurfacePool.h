@@ -0,0 +1,143 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+
+// Pixel layouts a render surface can have
+enum RenderSurfaceFormat {
+    RENDER_ARGB32,  // Top-down 0xAARRGGBB, what the window is drawn from
+    RENDER_SURFACE_FORMAT_COUNT
+};
+
+inline size_t RenderSurfaceBytes(int width, int height, RenderSurfaceFormat format) {
+    (void)format;  // Every format so far is 32 bits a pixel
+    return static_cast<size_t>(width) * height * 4;
+}
+
+// Render targets shared by everything that draws. A surface is checked out
+// for one frame and handed back, and the next Acquire() of the same size
+// and format gets it again, so a steady frame makes nothing. A free surface
+// nobody has asked for in maxIdle acquires is destroyed by a later
+// Acquire(), which is how surfaces of a size the window has left go away:
+// resizing itself doesn't have to touch the pool or anything else.
+//
+// Surface is whatever the platform draws into. The pool makes and destroys
+// them with the functions it is given and never looks inside. Not thread
+// safe; one thread draws.
+template <typename Surface>
+class RenderSurfacePool {
+public:
+    typedef std::function<bool(Surface*, int, int, RenderSurfaceFormat)> CreateFunction;
+    typedef std::function<void(Surface*)> DestroyFunction;
+
+    static const uint64_t DEFAULT_MAX_IDLE = 120;
+
+    RenderSurfacePool(CreateFunction create, DestroyFunction destroy, uint64_t maxIdle = DEFAULT_MAX_IDLE)
+        : create(create), destroy(destroy), maxIdle(maxIdle), clock(0), bytes(0), created(0), reused(0) {}
+
+    ~RenderSurfacePool() {
+        for (Entry& entry : entries) {
+            destroy(entry.surface.get());
+        }
+    }
+
+    // A surface of exactly this size and format, holding whatever its last
+    // user left in it. Null if a new one was needed and couldn't be made.
+    Surface* Acquire(int width, int height, RenderSurfaceFormat format) {
+        clock++;
+        Surface* found = nullptr;
+        for (size_t i = 0; i < entries.size();) {
+            Entry& entry = entries[i];
+            if (entry.inUse) {
+                i++;
+            } else if (!found && entry.width == width && entry.height == height && entry.format == format) {
+                entry.inUse = true;
+                found = entry.surface.get();
+                reused++;
+                i++;
+            } else if (clock - entry.lastUsed > maxIdle) {
+                Destroy(i);
+            } else {
+                i++;
+            }
+        }
+        if (found) {
+            return found;
+        }
+
+        std::unique_ptr<Surface> surface(new Surface());
+        if (!create(surface.get(), width, height, format)) {
+            return nullptr;
+        }
+        Entry entry;
+        entry.surface = std::move(surface);
+        entry.width = width;
+        entry.height = height;
+        entry.format = format;
+        entry.inUse = true;
+        entry.lastUsed = clock;
+        entries.push_back(std::move(entry));
+        bytes += RenderSurfaceBytes(width, height, format);
+        created++;
+        return entries.back().surface.get();
+    }
+
+    // Hand a surface from Acquire() back for the next frame
+    void Release(Surface* surface) {
+        for (Entry& entry : entries) {
+            if (entry.surface.get() == surface) {
+                entry.inUse = false;
+                entry.lastUsed = clock;
+                return;
+            }
+        }
+    }
+
+    // Destroy every surface that isn't checked out
+    void Clear() {
+        for (size_t i = 0; i < entries.size();) {
+            if (entries[i].inUse) {
+                i++;
+            } else {
+                Destroy(i);
+            }
+        }
+    }
+
+    size_t Surfaces() const { return entries.size(); }
+    size_t Bytes() const { return bytes; }
+    uint64_t Created() const { return created; }
+    uint64_t Reused() const { return reused; }
+
+private:
+    struct Entry {
+        std::unique_ptr<Surface> surface;
+        int width;
+        int height;
+        RenderSurfaceFormat format;
+        bool inUse;
+        uint64_t lastUsed;  // Pool clock when it was last handed back
+    };
+
+    void Destroy(size_t index) {
+        Entry& entry = entries[index];
+        destroy(entry.surface.get());
+        bytes -= RenderSurfaceBytes(entry.width, entry.height, entry.format);
+        entries.erase(entries.begin() + index);
+    }
+
+    RenderSurfacePool(const RenderSurfacePool&);
+    RenderSurfacePool& operator=(const RenderSurfacePool&);
+
+    CreateFunction create;
+    DestroyFunction destroy;
+    std::vector<Entry> entries;
+    uint64_t maxIdle;
+    uint64_t clock;  // Counts acquires
+    size_t bytes;
+    uint64_t created;
+    uint64_t reused;
+};
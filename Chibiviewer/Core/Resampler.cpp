@@ -0,0 +1,290 @@
+#include "Resampler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "ParallelFor.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define CHIBI_RESAMPLE_SSE2 1
+#endif
+
+namespace {
+
+const double PI = 3.14159265358979323846;
+
+// One pixel as linear-light premultiplied floats, in memory order b, g, r, a
+#ifdef CHIBI_RESAMPLE_SSE2
+typedef __m128 Vec4;
+inline Vec4 Zero() { return _mm_setzero_ps(); }
+inline Vec4 Load(const float* p) { return _mm_loadu_ps(p); }
+inline void Store(float* p, Vec4 v) { _mm_storeu_ps(p, v); }
+inline Vec4 MulAdd(Vec4 sum, Vec4 v, float weight) { return _mm_add_ps(sum, _mm_mul_ps(v, _mm_set1_ps(weight))); }
+#else
+struct Vec4 {
+    float c[4];
+};
+inline Vec4 Zero() { Vec4 v = { { 0, 0, 0, 0 } }; return v; }
+inline Vec4 Load(const float* p) { Vec4 v = { { p[0], p[1], p[2], p[3] } }; return v; }
+inline void Store(float* p, Vec4 v) { std::copy(v.c, v.c + 4, p); }
+inline Vec4 MulAdd(Vec4 sum, Vec4 v, float weight) {
+    for (int i = 0; i < 4; i++) sum.c[i] += v.c[i] * weight;
+    return sum;
+}
+#endif
+
+double SrgbToLinear(double value) {
+    return value <= 0.04045 ? value / 12.92 : std::pow((value + 0.055) / 1.055, 2.4);
+}
+
+double LinearToSrgb(double value) {
+    return value <= 0.0031308 ? value * 12.92 : 1.055 * std::pow(value, 1.0 / 2.4) - 0.055;
+}
+
+const int ENCODE_STEPS = 4096;
+
+struct GammaTables {
+    float toLinear[256];
+    uint8_t toSrgb[ENCODE_STEPS + 1];  // Indexed by linear value * ENCODE_STEPS
+
+    GammaTables() {
+        for (int i = 0; i < 256; i++) {
+            toLinear[i] = static_cast<float>(SrgbToLinear(i / 255.0));
+        }
+        for (int i = 0; i <= ENCODE_STEPS; i++) {
+            toSrgb[i] = static_cast<uint8_t>(LinearToSrgb(static_cast<double>(i) / ENCODE_STEPS) * 255.0 + 0.5);
+        }
+    }
+};
+
+const GammaTables& Gamma() {
+    static const GammaTables tables;
+    return tables;
+}
+
+double Kernel(ResampleFilter filter, double x) {
+    x = std::fabs(x);
+    if (filter == RESAMPLE_BILINEAR) {
+        return x < 1.0 ? 1.0 - x : 0.0;
+    }
+    if (x < 1e-8) return 1.0;
+    if (x >= 3.0) return 0.0;
+    double px = PI * x;
+    return 3.0 * std::sin(px) * std::sin(px / 3.0) / (px * px);
+}
+
+double KernelRadius(ResampleFilter filter) {
+    return filter == RESAMPLE_BILINEAR ? 1.0 : 3.0;
+}
+
+// Which source samples feed one output sample, and how much. Samples past
+// the edge are folded onto the edge pixel, so the range stays inside the
+// image and the weights still add up to one.
+struct Contribution {
+    int start;
+    int count;
+    size_t weightOffset;
+};
+
+struct AxisWeights {
+    std::vector<Contribution> contributions;
+    std::vector<double> weights;
+};
+
+AxisWeights ComputeWeights(int sourceSize, int destinationSize, ResampleFilter filter) {
+    AxisWeights axis;
+    axis.contributions.resize(destinationSize);
+
+    // Shrinking widens the kernel so every source pixel is covered
+    const double ratio = static_cast<double>(sourceSize) / destinationSize;
+    const double filterScale = std::max(1.0, ratio);
+    const double support = KernelRadius(filter) * filterScale;
+
+    for (int i = 0; i < destinationSize; i++) {
+        double center = (i + 0.5) * ratio - 0.5;
+        int left = static_cast<int>(std::ceil(center - support));
+        int right = static_cast<int>(std::floor(center + support));
+        int start = std::max(0, std::min(left, sourceSize - 1));
+        int end = std::max(0, std::min(right, sourceSize - 1));
+
+        Contribution& contribution = axis.contributions[i];
+        contribution.start = start;
+        contribution.count = end - start + 1;
+        contribution.weightOffset = axis.weights.size();
+        axis.weights.resize(axis.weights.size() + contribution.count, 0.0);
+
+        double total = 0.0;
+        for (int j = left; j <= right; j++) {
+            double weight = Kernel(filter, (j - center) / filterScale);
+            int index = std::max(0, std::min(j, sourceSize - 1));
+            axis.weights[contribution.weightOffset + (index - start)] += weight;
+            total += weight;
+        }
+        if (total != 0.0) {
+            for (int k = 0; k < contribution.count; k++) {
+                axis.weights[contribution.weightOffset + k] /= total;
+            }
+        }
+    }
+    return axis;
+}
+
+// Straight (unpremultiplied) 8-bit channel of a premultiplied pixel
+inline int Unpremultiply(uint32_t channel, uint32_t alpha) {
+    return static_cast<int>(std::min<uint32_t>(255, (channel * 255 + alpha / 2) / alpha));
+}
+
+// Back from linear premultiplied floats to a premultiplied sRGB pixel.
+// Filters with negative lobes can overshoot, so everything is clamped.
+uint32_t EncodePixel(const float* value) {
+    const GammaTables& gamma = Gamma();
+    float alpha = std::min(1.0f, value[3]);
+    if (!(alpha > 0.0f)) return 0;
+
+    uint32_t a = static_cast<uint32_t>(alpha * 255.0f + 0.5f);
+    if (a == 0) return 0;
+    float scale = ENCODE_STEPS / alpha;
+    uint32_t pixel = a << 24;
+    for (int c = 0; c < 3; c++) {
+        float step = std::max(0.0f, std::min(static_cast<float>(ENCODE_STEPS), value[c] * scale));
+        uint32_t srgb = gamma.toSrgb[static_cast<int>(step + 0.5f)];
+        pixel |= (a == 255 ? srgb : (srgb * a + 127) / 255) << (c * 8);
+    }
+    return pixel;
+}
+
+}  // namespace
+
+void ResampleFrame(const uint32_t* src, int width, int height,
+                   uint32_t* dst, int dstWidth, int dstHeight, ResampleFilter filter) {
+    if (width <= 0 || height <= 0 || dstWidth <= 0 || dstHeight <= 0) return;
+
+    const GammaTables& gamma = Gamma();
+    AxisWeights horizontal = ComputeWeights(width, dstWidth, filter);
+    AxisWeights vertical = ComputeWeights(height, dstHeight, filter);
+    std::vector<float> horizontalWeights(horizontal.weights.begin(), horizontal.weights.end());
+    std::vector<float> verticalWeights(vertical.weights.begin(), vertical.weights.end());
+
+    // Decode to linear premultiplied floats
+    std::vector<float> linear(static_cast<size_t>(width) * height * 4);
+    for (size_t i = 0; i < static_cast<size_t>(width) * height; i++) {
+        uint32_t pixel = src[i];
+        uint32_t alpha = pixel >> 24;
+        float* out = &linear[i * 4];
+        if (alpha == 0) {
+            out[0] = out[1] = out[2] = out[3] = 0.0f;
+            continue;
+        }
+        if (alpha == 255) {
+            out[0] = gamma.toLinear[pixel & 0xFF];
+            out[1] = gamma.toLinear[(pixel >> 8) & 0xFF];
+            out[2] = gamma.toLinear[(pixel >> 16) & 0xFF];
+            out[3] = 1.0f;
+            continue;
+        }
+        float a = alpha / 255.0f;
+        for (int c = 0; c < 3; c++) {
+            out[c] = gamma.toLinear[Unpremultiply((pixel >> (c * 8)) & 0xFF, alpha)] * a;
+        }
+        out[3] = a;
+    }
+
+    // Horizontal pass: width x height -> dstWidth x height
+    std::vector<float> wide(static_cast<size_t>(dstWidth) * height * 4);
+    for (int y = 0; y < height; y++) {
+        const float* row = &linear[static_cast<size_t>(y) * width * 4];
+        float* out = &wide[static_cast<size_t>(y) * dstWidth * 4];
+        for (int x = 0; x < dstWidth; x++) {
+            const Contribution& contribution = horizontal.contributions[x];
+            const float* weights = &horizontalWeights[contribution.weightOffset];
+            const float* source = row + static_cast<size_t>(contribution.start) * 4;
+            Vec4 sum = Zero();
+            for (int k = 0; k < contribution.count; k++) {
+                sum = MulAdd(sum, Load(source + k * 4), weights[k]);
+            }
+            Store(out + static_cast<size_t>(x) * 4, sum);
+        }
+    }
+
+    // Vertical pass: dstWidth x height -> dstWidth x dstHeight, then encode
+    std::vector<float> column(static_cast<size_t>(dstWidth) * 4);
+    const size_t rowFloats = static_cast<size_t>(dstWidth) * 4;
+    for (int y = 0; y < dstHeight; y++) {
+        const Contribution& contribution = vertical.contributions[y];
+        const float* weights = &verticalWeights[contribution.weightOffset];
+        for (int x = 0; x < dstWidth; x++) {
+            const float* source = &wide[static_cast<size_t>(contribution.start) * rowFloats + static_cast<size_t>(x) * 4];
+            Vec4 sum = Zero();
+            for (int k = 0; k < contribution.count; k++) {
+                sum = MulAdd(sum, Load(source + k * rowFloats), weights[k]);
+            }
+            Store(&column[static_cast<size_t>(x) * 4], sum);
+        }
+
+        uint32_t* out = dst + static_cast<size_t>(y) * dstWidth;
+        for (int x = 0; x < dstWidth; x++) {
+            out[x] = EncodePixel(&column[static_cast<size_t>(x) * 4]);
+        }
+    }
+}
+
+void ResampleFrameReference(const uint32_t* src, int width, int height,
+                            uint32_t* dst, int dstWidth, int dstHeight, ResampleFilter filter) {
+    if (width <= 0 || height <= 0 || dstWidth <= 0 || dstHeight <= 0) return;
+
+    AxisWeights horizontal = ComputeWeights(width, dstWidth, filter);
+    AxisWeights vertical = ComputeWeights(height, dstHeight, filter);
+
+    for (int y = 0; y < dstHeight; y++) {
+        const Contribution& rows = vertical.contributions[y];
+        for (int x = 0; x < dstWidth; x++) {
+            const Contribution& columns = horizontal.contributions[x];
+            double sum[4] = { 0, 0, 0, 0 };
+
+            for (int j = 0; j < rows.count; j++) {
+                for (int i = 0; i < columns.count; i++) {
+                    double weight = vertical.weights[rows.weightOffset + j] *
+                                    horizontal.weights[columns.weightOffset + i];
+                    uint32_t pixel = src[static_cast<size_t>(rows.start + j) * width + columns.start + i];
+                    uint32_t alphaByte = pixel >> 24;
+                    if (alphaByte == 0) continue;
+                    double alpha = alphaByte / 255.0;
+                    for (int c = 0; c < 3; c++) {
+                        double straight = Unpremultiply((pixel >> (c * 8)) & 0xFF, alphaByte) / 255.0;
+                        sum[c] += weight * SrgbToLinear(straight) * alpha;
+                    }
+                    sum[3] += weight * alpha;
+                }
+            }
+
+            double alpha = std::min(1.0, sum[3]);
+            uint32_t pixel = 0;
+            if (alpha > 0.0) {
+                double a = std::floor(alpha * 255.0 + 0.5);
+                pixel = static_cast<uint32_t>(a) << 24;
+                for (int c = 0; c < 3; c++) {
+                    double linear = std::max(0.0, std::min(1.0, sum[c] / alpha));
+                    double srgb = std::floor(LinearToSrgb(linear) * 255.0 + 0.5);
+                    pixel |= static_cast<uint32_t>(std::floor(srgb * a / 255.0 + 0.5)) << (c * 8);
+                }
+            }
+            dst[static_cast<size_t>(y) * dstWidth + x] = pixel;
+        }
+    }
+}
+
+void ResampleFrames(const uint32_t* src, size_t count, int width, int height,
+                    uint32_t* dst, int dstWidth, int dstHeight, ResampleFilter filter, unsigned threads) {
+    const size_t sourcePixels = static_cast<size_t>(width) * height;
+    const size_t destinationPixels = static_cast<size_t>(dstWidth) * dstHeight;
+    ParallelFor(count, threads, [&](size_t frame) {
+        ResampleFrame(src + frame * sourcePixels, width, height,
+                      dst + frame * destinationPixels, dstWidth, dstHeight, filter);
+    });
+}
+
+const wchar_t* ResampleFilterName(ResampleFilter filter) {
+    return filter == RESAMPLE_BILINEAR ? L"Bilinear" : L"Lanczos3";
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Resizing by arbitrary factors (1.5x, 0.75x...). Works on premultiplied
+// 0xAARRGGBB pixels but filters in linear light, so edges don't darken the
+// way plain sRGB averaging does. Two separable passes, SSE2 when available.
+
+enum ResampleFilter {
+    RESAMPLE_BILINEAR,  // Soft, no ringing; good for enlarging pixel art
+    RESAMPLE_LANCZOS3   // Sharper; best for shrinking
+};
+
+// Resize width x height pixels to dstWidth x dstHeight. src and dst must
+// not overlap.
+void ResampleFrame(const uint32_t* src, int width, int height,
+                   uint32_t* dst, int dstWidth, int dstHeight, ResampleFilter filter);
+
+// The same resize done the slow, obvious way: one 2D kernel per output
+// pixel, double precision, exact sRGB curves and no lookup tables. For
+// checking ResampleFrame, not for use at runtime.
+void ResampleFrameReference(const uint32_t* src, int width, int height,
+                            uint32_t* dst, int dstWidth, int dstHeight, ResampleFilter filter);
+
+// Resize `count` frames stored back to back, one frame per task, spread
+// over up to `threads` threads (0 = one per core)
+void ResampleFrames(const uint32_t* src, size_t count, int width, int height,
+                    uint32_t* dst, int dstWidth, int dstHeight, ResampleFilter filter, unsigned threads = 0);
+
+const wchar_t* ResampleFilterName(ResampleFilter filter);
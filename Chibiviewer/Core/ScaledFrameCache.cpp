@@ -0,0 +1,180 @@
+#include "ScaledFrameCache.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+#include "FrameOps.h"
+#include "ParallelFor.h"
+#include "Resampler.h"
+
+ScaledFrameCache::ScaledFrameCache(size_t budgetBytes) : budget(budgetBytes), bytes(0), ledger(nullptr) {
+    std::memset(stats, 0, sizeof(stats));
+}
+
+uint64_t ScaledFrameCache::MakeKey(uint32_t sourceId, uint32_t frame, int factor, ScaleFilter filter, int percent) {
+    return (static_cast<uint64_t>(sourceId) << 32) | (static_cast<uint64_t>(frame & 0xFFFF) << 16) |
+           (static_cast<uint64_t>((percent / 25) & 0xFF) << 8) |
+           (static_cast<uint64_t>(factor) << 4) | static_cast<uint64_t>(filter);
+}
+
+const ScaledFrame* ScaledFrameCache::Find(uint32_t sourceId, uint32_t frame, int factor, ScaleFilter filter,
+                                          int percent) {
+    auto found = index.find(MakeKey(sourceId, frame, factor, filter, percent));
+    if (found == index.end()) {
+        return nullptr;
+    }
+    entries.splice(entries.begin(), entries, found->second);
+    return &found->second->frame;
+}
+
+namespace {
+
+uint64_t ElapsedNs(std::chrono::steady_clock::time_point start) {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - start).count());
+}
+
+}  // namespace
+
+void ScaledFrameCache::MakeFrame(int factor, ScaleFilter filter, int percent, const uint32_t* pixels, int width,
+                                 int height, ScaledFrame* out) {
+    // Only scale what shows, plus the pixels filters can spread into
+    const int margin = percent == 100 ? 1 : 3;
+    FrameRect bounds = FindOpaqueBounds(pixels, width, height);
+    if (!bounds.IsEmpty()) {
+        bounds.left = std::max(0, bounds.left - margin);
+        bounds.top = std::max(0, bounds.top - margin);
+        bounds.right = std::min(width, bounds.right + margin);
+        bounds.bottom = std::min(height, bounds.bottom + margin);
+    }
+
+    // Whole-number factor first, then the display scale on top
+    out->x = bounds.left * factor * percent / 100;
+    out->y = bounds.top * factor * percent / 100;
+    out->width = bounds.Width() * factor * percent / 100;
+    out->height = bounds.Height() * factor * percent / 100;
+    if (bounds.IsEmpty() || out->width <= 0 || out->height <= 0) {
+        out->width = 0;
+        out->height = 0;
+        out->pixels.clear();
+        return;
+    }
+
+    std::vector<uint32_t> cropped(static_cast<size_t>(bounds.Width()) * bounds.Height());
+    CropFrame(pixels, width, bounds, cropped.data());
+
+    std::vector<uint32_t> scaled(cropped.size() * factor * factor);
+    ScaleFrame(cropped.data(), bounds.Width(), bounds.Height(), factor, filter, scaled.data());
+    if (percent == 100) {
+        out->pixels.swap(scaled);
+        return;
+    }
+
+    // Lanczos keeps detail when shrinking; enlarging pixel art with it
+    // rings around hard edges, so that uses bilinear
+    out->pixels.resize(static_cast<size_t>(out->width) * out->height);
+    ResampleFrame(scaled.data(), bounds.Width() * factor, bounds.Height() * factor, out->pixels.data(),
+                  out->width, out->height, percent < 100 ? RESAMPLE_LANCZOS3 : RESAMPLE_BILINEAR);
+}
+
+const ScaledFrame* ScaledFrameCache::Insert(uint64_t key, int factor, ScaledFrame&& frame, uint64_t generateNs) {
+    Entry entry;
+    entry.key = key;
+    entry.factor = factor;
+    entry.frame = std::move(frame);
+
+    size_t entryBytes = entry.frame.pixels.size() * sizeof(uint32_t);
+    ScaleStats& factorStats = stats[factor];
+    factorStats.framesGenerated++;
+    factorStats.generateNs += generateNs;
+    factorStats.frames++;
+    factorStats.bytes += entryBytes;
+    bytes += entryBytes;
+    if (ledger) {
+        ledger->Charge(static_cast<MemoryAsset>(key >> 32), MEMORY_SCALED, static_cast<int64_t>(entryBytes));
+    }
+
+    entries.push_front(std::move(entry));
+    index[entries.front().key] = entries.begin();
+
+    while (bytes > budget && entries.size() > 1) {
+        EvictOldest();
+    }
+    return &entries.front().frame;
+}
+
+const ScaledFrame* ScaledFrameCache::Add(uint32_t sourceId, uint32_t frame, int factor, ScaleFilter filter,
+                                         int percent, const uint32_t* pixels, int width, int height) {
+    if (factor < 1 || factor > MAX_SCALE_FACTOR || percent < 25) {
+        return nullptr;
+    }
+    if (const ScaledFrame* existing = Find(sourceId, frame, factor, filter, percent)) {
+        return existing;
+    }
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    ScaledFrame scaled;
+    MakeFrame(factor, filter, percent, pixels, width, height, &scaled);
+    return Insert(MakeKey(sourceId, frame, factor, filter, percent), factor, std::move(scaled), ElapsedNs(start));
+}
+
+void ScaledFrameCache::AddAll(uint32_t sourceId, uint32_t count, int factor, ScaleFilter filter, int percent,
+                              const uint32_t* frames, int width, int height) {
+    if (factor < 1 || factor > MAX_SCALE_FACTOR || percent < 25) {
+        return;
+    }
+
+    std::vector<uint32_t> missing;
+    for (uint32_t frame = 0; frame < count; frame++) {
+        if (index.find(MakeKey(sourceId, frame, factor, filter, percent)) == index.end()) {
+            missing.push_back(frame);
+        }
+    }
+
+    // Workers only touch their own slot; the cache itself is updated
+    // afterwards on this thread
+    const size_t framePixels = static_cast<size_t>(width) * height;
+    std::vector<ScaledFrame> made(missing.size());
+    std::vector<uint64_t> madeNs(missing.size());
+    ParallelFor(missing.size(), 0, [&](size_t i) {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        MakeFrame(factor, filter, percent, frames + missing[i] * framePixels, width, height, &made[i]);
+        madeNs[i] = ElapsedNs(start);
+    });
+
+    for (size_t i = 0; i < missing.size(); i++) {
+        Insert(MakeKey(sourceId, missing[i], factor, filter, percent), factor, std::move(made[i]), madeNs[i]);
+    }
+}
+
+void ScaledFrameCache::EvictOldest() {
+    Entry& oldest = entries.back();
+    size_t entryBytes = oldest.frame.pixels.size() * sizeof(uint32_t);
+    ScaleStats& factorStats = stats[oldest.factor];
+    factorStats.frames--;
+    factorStats.bytes -= entryBytes;
+    factorStats.evictions++;
+    bytes -= entryBytes;
+    if (ledger) {
+        ledger->Charge(static_cast<MemoryAsset>(oldest.key >> 32), MEMORY_SCALED, -static_cast<int64_t>(entryBytes));
+    }
+
+    index.erase(oldest.key);
+    entries.pop_back();
+}
+
+void ScaledFrameCache::Trim(size_t maxBytes) {
+    while (bytes > maxBytes && !entries.empty()) {
+        EvictOldest();
+    }
+}
+
+void ScaledFrameCache::Clear() {
+    Trim(0);
+}
+
+void ScaledFrameCache::SetBudget(size_t budgetBytes) {
+    budget = budgetBytes;
+    Trim(budget);
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <unordered_map>
+#include <vector>
+
+#include "MemoryLedger.h"
+#include "PixelScale.h"
+
+// One upscaled frame, cropped to the part that isn't transparent
+struct ScaledFrame {
+    int x;       // Offset of `pixels` inside the full scaled frame
+    int y;
+    int width;
+    int height;
+    std::vector<uint32_t> pixels;  // Tightly packed, premultiplied
+};
+
+// What each scale factor has cost so far
+struct ScaleStats {
+    uint64_t framesGenerated;
+    uint64_t generateNs;  // Total time spent scaling, summed over threads
+    uint64_t evictions;
+    size_t frames;        // Resident right now
+    size_t bytes;
+};
+
+// Upscaled frames, made once on first use and kept until the byte budget
+// runs out, least recently used first. Lookups don't allocate, so they are
+// safe in the paint path; Add() is where the work and the memory go.
+class ScaledFrameCache {
+public:
+    static const size_t DEFAULT_BUDGET = 192 * 1024 * 1024;
+
+    explicit ScaledFrameCache(size_t budgetBytes = DEFAULT_BUDGET);
+
+    // The cached frame, or nullptr. A hit becomes the most recently used.
+    // percent is the display scale on top of the integer factor (100 for
+    // none), in steps of 25; each step is cached separately.
+    const ScaledFrame* Find(uint32_t sourceId, uint32_t frame, int factor, ScaleFilter filter, int percent);
+
+    // Scale a width x height source frame and keep the result. Evicts old
+    // frames to stay within budget, but never the one just added.
+    const ScaledFrame* Add(uint32_t sourceId, uint32_t frame, int factor, ScaleFilter filter, int percent,
+                           const uint32_t* pixels, int width, int height);
+
+    // Scale every frame of a source in one go, one frame per task across
+    // all cores. frames holds `count` width x height frames back to back;
+    // ones already cached are skipped. Used when a display scale needs
+    // resampling, which is too slow to do a frame at a time while playing.
+    void AddAll(uint32_t sourceId, uint32_t count, int factor, ScaleFilter filter, int percent,
+                const uint32_t* frames, int width, int height);
+
+    // Evict least recently used frames until at most maxBytes are left
+    void Trim(size_t maxBytes);
+    void Clear();
+
+    void SetBudget(size_t budgetBytes);
+
+    // Charge frames as MEMORY_SCALED to a ledger, taking each sourceId
+    // as the MemoryAsset it belongs to. Null (the default) turns it off.
+    void SetLedger(MemoryLedger* ledger) { this->ledger = ledger; }
+    size_t Budget() const { return budget; }
+    size_t Bytes() const { return bytes; }
+    size_t Frames() const { return entries.size(); }
+
+    // Factor 1 to MAX_SCALE_FACTOR
+    const ScaleStats& Stats(int factor) const { return stats[factor]; }
+
+private:
+    struct Entry {
+        uint64_t key;
+        int factor;
+        ScaledFrame frame;
+    };
+
+    static uint64_t MakeKey(uint32_t sourceId, uint32_t frame, int factor, ScaleFilter filter, int percent);
+    static void MakeFrame(int factor, ScaleFilter filter, int percent, const uint32_t* pixels, int width,
+                          int height, ScaledFrame* out);
+    const ScaledFrame* Insert(uint64_t key, int factor, ScaledFrame&& frame, uint64_t generateNs);
+    void EvictOldest();
+
+    std::list<Entry> entries;  // Most recently used first
+    std::unordered_map<uint64_t, std::list<Entry>::iterator> index;
+    size_t budget;
+    size_t bytes;
+    MemoryLedger* ledger;
+    ScaleStats stats[MAX_SCALE_FACTOR + 1];
+};
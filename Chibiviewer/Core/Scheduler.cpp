@@ -0,0 +1,71 @@
+#include "Scheduler.h"
+
+#include <algorithm>
+
+namespace {
+
+// Heap comparator: later deadlines sink, ties keep submission order
+struct TaskLater {
+    template <typename T>
+    bool operator()(const T& a, const T& b) const {
+        if (a.dueMs != b.dueMs) return a.dueMs > b.dueMs;
+        return a.id > b.id;
+    }
+};
+
+}  // namespace
+
+Scheduler::Scheduler() : nextId(1), gridMs(0) {}
+
+TaskId Scheduler::ScheduleAt(uint64_t dueMs, std::function<void()> callback, bool onGrid) {
+    if (onGrid && gridMs > 1) {
+        dueMs = (dueMs + gridMs - 1) / gridMs * gridMs;
+    }
+
+    Task task;
+    task.dueMs = dueMs;
+    task.id = nextId++;
+    task.callback = std::move(callback);
+
+    TaskId id = task.id;
+    tasks.push_back(std::move(task));
+    std::push_heap(tasks.begin(), tasks.end(), TaskLater());
+    return id;
+}
+
+bool Scheduler::Cancel(TaskId id) {
+    if (id == INVALID_TASK) return false;
+
+    for (size_t i = 0; i < tasks.size(); i++) {
+        if (tasks[i].id == id) {
+            tasks[i] = std::move(tasks.back());
+            tasks.pop_back();
+            std::make_heap(tasks.begin(), tasks.end(), TaskLater());
+            return true;
+        }
+    }
+    return false;
+}
+
+size_t Scheduler::RunDue(uint64_t nowMs) {
+    // Pop one task at a time so a callback can cancel or add tasks freely.
+    // Anything added during this call has an id >= firstNewId and waits.
+    TaskId firstNewId = nextId;
+    size_t ran = 0;
+
+    while (!tasks.empty() && tasks.front().dueMs <= nowMs && tasks.front().id < firstNewId) {
+        std::pop_heap(tasks.begin(), tasks.end(), TaskLater());
+        Task task = std::move(tasks.back());
+        tasks.pop_back();
+
+        if (task.callback) {
+            task.callback();
+        }
+        ran++;
+    }
+    return ran;
+}
+
+uint64_t Scheduler::NextDeadline() const {
+    return tasks.empty() ? UINT64_MAX : tasks.front().dueMs;
+}
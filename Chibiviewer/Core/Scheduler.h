@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+// Shared deadline scheduler. Every timed callback in the engine goes through
+// one of these; the frontend only has to keep a single OS timer armed for
+// NextDeadline() and call RunDue() when it fires.
+typedef uint64_t TaskId;
+const TaskId INVALID_TASK = 0;
+
+class Scheduler {
+public:
+    Scheduler();
+
+    // Queue a callback to run once the clock reaches dueMs. Interactive
+    // work passes onGrid = false so the power saver grid never delays it.
+    TaskId ScheduleAt(uint64_t dueMs, std::function<void()> callback, bool onGrid = true);
+
+    // Remove a pending task. Returns false if it already ran or was cancelled
+    bool Cancel(TaskId id);
+
+    // Run every task whose deadline is <= nowMs, earliest first.
+    // Tasks scheduled from inside a callback run on a later call.
+    size_t RunDue(uint64_t nowMs);
+
+    // Round every new deadline up to a multiple of gridMs, so tasks that
+    // are due at nearly the same time share one wakeup. 0 turns it off.
+    void SetGrid(uint64_t gridMs) { this->gridMs = gridMs; }
+    uint64_t Grid() const { return gridMs; }
+
+    bool HasPending() const { return !tasks.empty(); }
+    uint64_t NextDeadline() const;
+    void Clear() { tasks.clear(); }
+
+private:
+    struct Task {
+        uint64_t dueMs;
+        TaskId id;
+        std::function<void()> callback;
+    };
+
+    std::vector<Task> tasks;  // Min-heap on (dueMs, id)
+    TaskId nextId;
+    uint64_t gridMs;
+};
@@ -0,0 +1,153 @@
+#include "Session.h"
+
+namespace {
+
+const uint8_t SESSION_MAGIC[4] = { 'C', 'H', 'S', 'N' };
+const uint32_t SESSION_VERSION = 3;             // 2 added the choice trace, 3 the start and state trace
+const size_t SESSION_HEADER_BYTES = 4 + 4 + 8 + 8 + 4 + 4 + 8 + 8 + 10 * 4 + 8 + 4;
+const size_t SESSION_V2_HEADER_BYTES = 4 + 4 + 8 + 8 + 4 + 4 + 8 + 8 + 4;
+const size_t SESSION_V1_HEADER_BYTES = SESSION_V2_HEADER_BYTES - 8;
+const size_t SESSION_EVENT_BYTES = 8 + 1 + 4 + 4 + 4;
+const size_t RECORDER_RESERVE = 4096;
+
+void Put(std::vector<uint8_t>* bytes, uint64_t value, int size) {
+    for (int i = 0; i < size; i++) {
+        bytes->push_back(static_cast<uint8_t>(value >> (8 * i)));
+    }
+}
+
+uint64_t Get(const uint8_t* data, int size) {
+    uint64_t value = 0;
+    for (int i = 0; i < size; i++) {
+        value |= static_cast<uint64_t>(data[i]) << (8 * i);
+    }
+    return value;
+}
+
+bool Fail(std::string* error, const char* reason) {
+    if (error) *error = reason;
+    return false;
+}
+
+}  // namespace
+
+void SessionRecorder::Start(const Session& setup, uint64_t nowMs) {
+    session = setup;
+    session.durationMs = 0;
+    session.events.clear();
+    session.events.reserve(RECORDER_RESERVE);
+    startMs = nowMs;
+    recording = true;
+}
+
+void SessionRecorder::Record(SessionEventType type, uint64_t nowMs, int x, int y, uint32_t key) {
+    if (!recording) return;
+
+    // Input stamped just before Start() or out of order across threads
+    // still has to come out in time order
+    uint64_t timeMs = nowMs > startMs ? nowMs - startMs : 0;
+    if (!session.events.empty() && timeMs < session.events.back().timeMs) {
+        timeMs = session.events.back().timeMs;
+    }
+    SessionEvent event = { timeMs, type, x, y, key };
+    session.events.push_back(event);
+}
+
+void SessionRecorder::Stop(uint64_t nowMs) {
+    if (!recording) return;
+    session.durationMs = nowMs - startMs;
+    recording = false;
+}
+
+void WriteSession(const Session& session, std::vector<uint8_t>* bytes) {
+    bytes->clear();
+    bytes->reserve(SESSION_HEADER_BYTES + session.events.size() * SESSION_EVENT_BYTES);
+    bytes->insert(bytes->end(), SESSION_MAGIC, SESSION_MAGIC + 4);
+    Put(bytes, SESSION_VERSION, 4);
+    Put(bytes, session.seed, 8);
+    Put(bytes, session.durationMs, 8);
+    Put(bytes, static_cast<uint32_t>(session.screenWidth), 4);
+    Put(bytes, static_cast<uint32_t>(session.screenHeight), 4);
+    Put(bytes, session.traceHash, 8);
+    Put(bytes, session.choiceTrace, 8);
+    const int32_t start[10] = { session.screenLeft, session.screenTop, session.startX, session.startY,
+                                session.areaLeft, session.areaTop, session.areaRight, session.areaBottom,
+                                session.scaleFactor, session.dpiPercent };
+    for (int i = 0; i < 10; i++) {
+        Put(bytes, static_cast<uint32_t>(start[i]), 4);
+    }
+    Put(bytes, session.stateTrace, 8);
+    Put(bytes, static_cast<uint32_t>(session.events.size()), 4);
+    for (const SessionEvent& event : session.events) {
+        Put(bytes, event.timeMs, 8);
+        Put(bytes, static_cast<uint8_t>(event.type), 1);
+        Put(bytes, static_cast<uint32_t>(event.x), 4);
+        Put(bytes, static_cast<uint32_t>(event.y), 4);
+        Put(bytes, event.key, 4);
+    }
+}
+
+bool ReadSession(const uint8_t* data, size_t size, Session* session, std::string* error) {
+    if (size < SESSION_V1_HEADER_BYTES || data[0] != SESSION_MAGIC[0] || data[1] != SESSION_MAGIC[1] ||
+        data[2] != SESSION_MAGIC[2] || data[3] != SESSION_MAGIC[3]) {
+        return Fail(error, "not a session");
+    }
+    uint64_t version = Get(data + 4, 4);
+    if (version < 1 || version > SESSION_VERSION) {
+        return Fail(error, "unknown session version");
+    }
+    size_t headerBytes = version == 1 ? SESSION_V1_HEADER_BYTES :
+                         version == 2 ? SESSION_V2_HEADER_BYTES : SESSION_HEADER_BYTES;
+    if (size < headerBytes) {
+        return Fail(error, "truncated session");
+    }
+
+    *session = Session();
+    session->seed = Get(data + 8, 8);
+    session->durationMs = Get(data + 16, 8);
+    session->screenWidth = static_cast<int32_t>(Get(data + 24, 4));
+    session->screenHeight = static_cast<int32_t>(Get(data + 28, 4));
+    session->traceHash = Get(data + 32, 8);
+    session->choiceTrace = version == 1 ? 0 : Get(data + 40, 8);
+    if (version >= 3) {
+        int32_t* start[10] = { &session->screenLeft, &session->screenTop, &session->startX, &session->startY,
+                               &session->areaLeft, &session->areaTop, &session->areaRight, &session->areaBottom,
+                               &session->scaleFactor, &session->dpiPercent };
+        for (int i = 0; i < 10; i++) {
+            *start[i] = static_cast<int32_t>(Get(data + 48 + 4 * i, 4));
+        }
+        session->stateTrace = Get(data + 88, 8);
+        if (session->scaleFactor < 1 || session->dpiPercent < 1) {
+            return Fail(error, "corrupt session header");
+        }
+    } else {
+        // Older sessions started a quarter of the way along the bottom of
+        // a bare screen
+        session->startX = session->screenWidth / 4;
+        session->startY = session->screenHeight;
+        session->areaRight = session->screenWidth;
+        session->areaBottom = session->screenHeight;
+    }
+    size_t count = static_cast<size_t>(Get(data + headerBytes - 4, 4));
+    if ((size - headerBytes) / SESSION_EVENT_BYTES < count) {
+        return Fail(error, "truncated session");
+    }
+
+    session->events.resize(count);
+    const uint8_t* at = data + headerBytes;
+    uint64_t lastMs = 0;
+    for (size_t i = 0; i < count; i++, at += SESSION_EVENT_BYTES) {
+        SessionEvent& event = session->events[i];
+        event.timeMs = Get(at, 8);
+        uint64_t type = Get(at + 8, 1);
+        event.x = static_cast<int32_t>(Get(at + 9, 4));
+        event.y = static_cast<int32_t>(Get(at + 13, 4));
+        event.key = static_cast<uint32_t>(Get(at + 17, 4));
+        if (type >= SESSION_EVENT_TYPE_COUNT || event.timeMs < lastMs) {
+            return Fail(error, "corrupt session event");
+        }
+        event.type = static_cast<SessionEventType>(type);
+        lastMs = event.timeMs;
+    }
+    return true;
+}
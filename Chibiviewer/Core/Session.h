@@ -0,0 +1,100 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// A recorded stretch of viewer input: the seed the character's random
+// streams started from, where it started, and every input event with the
+// time CharacterEngine applied it at. Together with the GIFs that's
+// everything a run depends on, so a session replays the same way every
+// time (see CharacterSimulation).
+
+enum SessionEventType {
+    SESSION_MOUSE_DOWN,
+    SESSION_MOUSE_MOVE,
+    SESSION_MOUSE_UP,
+    SESSION_KEY,
+    SESSION_HIDDEN,      // Nobody can see the character any more
+    SESSION_SHOWN,
+    SESSION_NEXT_STATE,  // The menu opened, which steps to the next state
+    SESSION_SCALE,       // x: scale factor, y: DPI percent
+    SESSION_EVENT_TYPE_COUNT
+};
+
+struct SessionEvent {
+    uint64_t timeMs;  // Since the session started
+    SessionEventType type;
+    int32_t x;        // Position relative to the screen's top-left for mouse events
+    int32_t y;
+    uint32_t key;     // Virtual key code for SESSION_KEY
+};
+
+struct Session {
+    uint64_t seed;
+    uint64_t durationMs;
+    int32_t screenWidth;
+    int32_t screenHeight;
+    std::vector<SessionEvent> events;  // In time order
+
+    // Where the character was when the session started, in screen
+    // coordinates: the screen's top-left, the feet, and the work area it
+    // walked in. Walking is on the bottom of that area only while the
+    // viewer records, so a replay's positions are the viewer's.
+    int32_t screenLeft;
+    int32_t screenTop;
+    int32_t startX;
+    int32_t startY;
+    int32_t areaLeft;
+    int32_t areaTop;
+    int32_t areaRight;
+    int32_t areaBottom;
+    int32_t scaleFactor;
+    int32_t dpiPercent;
+
+    // CharacterSimulation's trace hash for this session when it was saved,
+    // 0 if nobody ran it. Lets a replay check it still comes out the same.
+    uint64_t traceHash;
+
+    // StateRules::Trace() of the run that made or saved the session, 0 if
+    // unknown. The viewer can't know the frame trace, but it makes its
+    // choices through the same rules, so this is what a replay of a
+    // recording is checked against.
+    uint64_t choiceTrace;
+
+    // CharacterEngine::StateTrace() of the run that made or saved the
+    // session, 0 if unknown: the state and position at every change, which
+    // a replay of a recording has to reproduce too
+    uint64_t stateTrace;
+
+    Session()
+        : seed(0), durationMs(0), screenWidth(0), screenHeight(0), screenLeft(0), screenTop(0), startX(0),
+          startY(0), areaLeft(0), areaTop(0), areaRight(0), areaBottom(0), scaleFactor(1), dpiPercent(100),
+          traceHash(0), choiceTrace(0), stateTrace(0) {}
+};
+
+// Collects events against a clock that starts at Start(). Recording
+// reserves room up front so a drag doesn't grow the vector every move.
+class SessionRecorder {
+public:
+    SessionRecorder() : recording(false), startMs(0) {}
+
+    // setup has everything but the events and the duration
+    void Start(const Session& setup, uint64_t nowMs);
+    void Record(SessionEventType type, uint64_t nowMs, int x, int y, uint32_t key);
+    void Stop(uint64_t nowMs);
+
+    bool Recording() const { return recording; }
+    const Session& Recorded() const { return session; }
+
+private:
+    bool recording;
+    uint64_t startMs;
+    Session session;
+};
+
+// Little-endian binary form: "CHSN", version, header fields, then the
+// events. Stable across platforms so sessions can be passed around.
+void WriteSession(const Session& session, std::vector<uint8_t>* bytes);
+bool ReadSession(const uint8_t* data, size_t size, Session* session, std::string* error);
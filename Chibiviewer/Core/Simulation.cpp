@@ -0,0 +1,195 @@
+#include "Simulation.h"
+
+#include <algorithm>
+
+namespace {
+
+const SurfaceKey FLOOR_SURFACE_KEY = 1;
+
+const uint64_t FNV_OFFSET = 0xCBF29CE484222325ull;
+const uint64_t FNV_PRIME = 0x100000001B3ull;
+
+uint64_t HashValue(uint64_t hash, uint64_t value) {
+    for (int i = 0; i < 8; i++) {
+        hash ^= (value >> (8 * i)) & 0xFF;
+        hash *= FNV_PRIME;
+    }
+    return hash;
+}
+
+}  // namespace
+
+CharacterSimulation::CharacterSimulation(const CharacterTable& character,
+                                         const std::vector<CharacterAnimation>& animations)
+    : engine(character, animations, surfaces, *this),
+      onFrame(nullptr), screen(), area(), screenLeft(0), screenTop(0), nowMs(0), frames(0), hash(FNV_OFFSET),
+      flipped(false), frameTask(INVALID_TASK) {
+    scaledDelays.resize(animations.size());
+    for (size_t i = 0; i < animations.size(); i++) {
+        float speed = i < character.Animations().size() ? character.Animations()[i].speed : 1.0f;
+        for (uint32_t delay : animations[i].delaysMs) {
+            scaledDelays[i].push_back(static_cast<uint32_t>(delay / speed));
+        }
+    }
+}
+
+uint64_t CharacterSimulation::Run(const Session& session, const std::function<void(const SimFrame&)>& onFrame) {
+    StartSession(session, onFrame);
+    for (const SessionEvent& event : session.events) {
+        Input(event);
+    }
+    RunUntil(session.durationMs);
+    return frames;
+}
+
+void CharacterSimulation::Start(uint64_t seed, int screenWidth, int screenHeight,
+                                const std::function<void(const SimFrame&)>& onFrame) {
+    // What an old recording had: one screen, the character a quarter of
+    // the way along its bottom
+    Session setup;
+    setup.seed = seed;
+    setup.screenWidth = screenWidth;
+    setup.screenHeight = screenHeight;
+    setup.startX = screenWidth / 4;
+    setup.startY = screenHeight;
+    setup.areaRight = screenWidth;
+    setup.areaBottom = screenHeight;
+    StartSession(setup, onFrame);
+}
+
+void CharacterSimulation::StartSession(const Session& setup, const std::function<void(const SimFrame&)>& onFrame) {
+    engine.Stop();
+    frameScheduler.Clear();
+    frameTask = INVALID_TASK;
+    this->onFrame = &onFrame;
+    nowMs = 0;
+    frames = 0;
+    hash = FNV_OFFSET;
+    flipped = false;
+
+    screenLeft = setup.screenLeft;
+    screenTop = setup.screenTop;
+    screen.left = setup.screenLeft;
+    screen.top = setup.screenTop;
+    screen.right = setup.screenLeft + setup.screenWidth;
+    screen.bottom = setup.screenTop + setup.screenHeight;
+    area.left = setup.areaLeft;
+    area.top = setup.areaTop;
+    area.right = setup.areaRight;
+    area.bottom = setup.areaBottom;
+    surfaces.Clear();
+    surfaces.Set(FLOOR_SURFACE_KEY, area.left, area.right, area.bottom);
+
+    engine.SetScale(setup.scaleFactor, setup.dpiPercent);
+    engine.Seed(setup.seed);
+    engine.Start(0, setup.startX, setup.startY, AUTOMATIC);
+}
+
+void CharacterSimulation::Input(const SessionEvent& event) {
+    RunUntil(event.timeMs);
+
+    // The engine works in screen coordinates
+    SessionEvent input = event;
+    if (event.type == SESSION_MOUSE_DOWN || event.type == SESSION_MOUSE_MOVE || event.type == SESSION_MOUSE_UP) {
+        input.x += screenLeft;
+        input.y += screenTop;
+    }
+    nowMs = std::max(nowMs, engine.Input(input));
+}
+
+// Frames and the engine's tasks in deadline order; the engine goes first
+// on a tie, so a frame shows what changed at its time
+void CharacterSimulation::RunUntil(uint64_t timeMs) {
+    while (engine.HasPending() || frameScheduler.HasPending()) {
+        uint64_t next = engine.HasPending() ? engine.NextDeadline() : UINT64_MAX;
+        uint64_t frame = frameScheduler.HasPending() ? frameScheduler.NextDeadline() : UINT64_MAX;
+        if (std::min(next, frame) > timeMs) break;
+
+        if (next <= frame) {
+            engine.RunDue(next);
+            nowMs = std::max(nowMs, engine.Now());
+        } else {
+            nowMs = std::max(nowMs, frame);
+            frameScheduler.RunDue(nowMs);
+        }
+    }
+    nowMs = std::max(nowMs, timeMs);
+}
+
+bool CharacterSimulation::CharacterRect(int* left, int* top, int* width, int* height) const {
+    if (engine.Animation() < 0) return false;
+    *left = engine.X();
+    *top = engine.Y();
+    *width = engine.Width();
+    *height = engine.Height();
+    return true;
+}
+
+void CharacterSimulation::ScheduleFrame() {
+    int animation = engine.Animation();
+    if (scaledDelays[animation].empty()) {
+        frameTask = INVALID_TASK;
+        return;
+    }
+    uint32_t remaining = cursor.RemainingMs();
+    frameTask = frameScheduler.ScheduleAt(std::max(nowMs, engine.Now()) + remaining, [this, remaining]() {
+        cursor.Advance(remaining);
+        Present();
+        ScheduleFrame();
+    });
+}
+
+void CharacterSimulation::Present() {
+    SimFrame frame;
+    frame.timeMs = std::max(nowMs, engine.Now());
+    frame.animation = engine.Animation();
+    frame.frame = static_cast<uint32_t>(cursor.Frame());
+    frame.x = engine.X();
+    frame.y = engine.Y();
+    frame.flipped = flipped;
+
+    hash = HashValue(hash, frame.timeMs);
+    hash = HashValue(hash, static_cast<uint64_t>(frame.animation));
+    hash = HashValue(hash, frame.frame);
+    hash = HashValue(hash, static_cast<uint32_t>(frame.x));
+    hash = HashValue(hash, static_cast<uint32_t>(frame.y));
+    hash = HashValue(hash, frame.flipped ? 1 : 0);
+    frames++;
+    if (onFrame && *onFrame) {
+        (*onFrame)(frame);
+    }
+}
+
+void CharacterSimulation::AnimationStarted(int animation, bool flipped) {
+    this->flipped = flipped;
+    frameScheduler.Cancel(frameTask);
+    cursor.Reset(scaledDelays[animation].data(), scaledDelays[animation].size(), MIN_FRAME_DELAY);
+    Present();
+    ScheduleFrame();
+}
+
+void CharacterSimulation::AnimationTurned(bool flipped) {
+    this->flipped = flipped;
+}
+
+void CharacterSimulation::SceneMoved() {
+    if (engine.Animation() >= 0) {
+        Present();
+    }
+}
+
+ScreenArea CharacterSimulation::WalkArea(int, int) {
+    return area;
+}
+
+ScreenArea CharacterSimulation::ScreenBounds() {
+    return screen;
+}
+
+bool CharacterSimulation::FurnitureSize(size_t, int*, int*) {
+    return false;
+}
+
+StateOptions CharacterSimulation::Extras() {
+    return StateOptions();
+}
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include "CharacterEngine.h"
+#include "CharacterManifest.h"
+#include "Playback.h"
+#include "Scheduler.h"
+#include "Session.h"
+#include "SurfaceIndex.h"
+
+// One presented frame: which animation frame shows where
+struct SimFrame {
+    uint64_t timeMs;
+    int animation;   // Index into the simulation's animations
+    uint32_t frame;
+    int x;           // Top-left on screen
+    int y;
+    bool flipped;
+};
+
+// Headless host for the viewer's character: the same CharacterEngine the
+// viewer runs, driven by a Session instead of window messages. Time is
+// virtual; Run() jumps from one deadline to the next, so a long session
+// replays in a fraction of its real length and comes out the same on every
+// run. The screen is the one the session was recorded on, with the bottom
+// of the recorded work area as the only surface, which is all the viewer
+// walks on while it records. Furniture and strolls are left out; the
+// viewer doesn't offer them while it records.
+class CharacterSimulation : private CharacterHost {
+public:
+    // Both must outlive the simulation. Animations line up with
+    // character.Animations() so manifest weights, speeds and loop modes apply.
+    CharacterSimulation(const CharacterTable& character, const std::vector<CharacterAnimation>& animations);
+
+    // Replay a session from the start. onFrame sees every frame the viewer
+    // would present. Returns the number of frames.
+    uint64_t Run(const Session& session, const std::function<void(const SimFrame&)>& onFrame);
+
+    // The same in pieces, for input that depends on what happened so far:
+    // Start() puts the character on screen at time 0, Input() applies an
+    // event at its timeMs (not before Now()) and RunUntil() advances the
+    // clock. onFrame must stay alive until the next Start().
+    void Start(uint64_t seed, int screenWidth, int screenHeight, const std::function<void(const SimFrame&)>& onFrame);
+    void Input(const SessionEvent& event);
+    void RunUntil(uint64_t timeMs);
+
+    uint64_t Now() const { return nowMs; }
+    uint64_t Frames() const { return frames; }
+
+    // Where the character is on screen, false before Start()
+    bool CharacterRect(int* left, int* top, int* width, int* height) const;
+
+    // FNV-1a over every frame of the last run; equal hashes mean equal runs
+    uint64_t TraceHash() const { return hash; }
+
+    // StateRules::Trace() and CharacterEngine::StateTrace() of the last
+    // run, comparable with a viewer recording
+    uint64_t ChoiceTrace() const { return engine.ChoiceTrace(); }
+    uint64_t StateTrace() const { return engine.StateTrace(); }
+
+private:
+    void StartSession(const Session& setup, const std::function<void(const SimFrame&)>& onFrame);
+    void ScheduleFrame();
+    void Present();
+
+    // CharacterHost
+    void AnimationStarted(int animation, bool flipped) override;
+    void AnimationTurned(bool flipped) override;
+    void SceneMoved() override;
+    ScreenArea WalkArea(int x, int y) override;
+    ScreenArea ScreenBounds() override;
+    bool FurnitureSize(size_t type, int* width, int* height) override;
+    StateOptions Extras() override;
+
+    CharacterSimulation(const CharacterSimulation&);
+    CharacterSimulation& operator=(const CharacterSimulation&);
+
+    std::vector<std::vector<uint32_t>> scaledDelays;  // Delays after the manifest speed
+    SurfaceIndex surfaces;
+    CharacterEngine engine;
+
+    Scheduler frameScheduler;  // Animation frames, interleaved with the engine's tasks
+    PlaybackCursor cursor;
+    const std::function<void(const SimFrame&)>* onFrame;
+    ScreenArea screen;
+    ScreenArea area;
+    int screenLeft;            // Events are relative to the screen's top-left
+    int screenTop;
+
+    uint64_t nowMs;
+    uint64_t frames;
+    uint64_t hash;
+    bool flipped;
+    TaskId frameTask;
+};
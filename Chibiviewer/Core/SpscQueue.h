@@ -0,0 +1,77 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+#include "CacheLine.h"
+
+// Bounded single-producer, single-consumer ring. One thread pushes and one
+// other thread pops; neither ever blocks, takes a lock or allocates after
+// construction. T should be cheap to copy (commands, not payloads).
+//
+// The two indices sit on their own cache lines, and each side keeps a
+// private copy of the other side's index that it only refreshes when the
+// ring looks full (or empty), so in steady state a push or pop touches no
+// line the other thread is writing.
+template <typename T>
+class SpscQueue {
+public:
+    // Capacity is rounded up to a power of two
+    explicit SpscQueue(size_t capacity) : head(0), cachedTail(0), tail(0), cachedHead(0) {
+        size_t size = 2;
+        while (size < capacity) size *= 2;
+        slots.resize(size);
+        mask = size - 1;
+    }
+
+    // Producer side. False when the queue is full.
+    bool TryPush(const T& item) {
+        size_t back = tail.load(std::memory_order_relaxed);
+        if (back - cachedHead > mask) {
+            cachedHead = head.load(std::memory_order_acquire);
+            if (back - cachedHead > mask) {
+                return false;
+            }
+        }
+        slots[back & mask] = item;
+        tail.store(back + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer side. False when the queue is empty.
+    bool TryPop(T* item) {
+        size_t front = head.load(std::memory_order_relaxed);
+        if (front == cachedTail) {
+            cachedTail = tail.load(std::memory_order_acquire);
+            if (front == cachedTail) {
+                return false;
+            }
+        }
+        *item = slots[front & mask];
+        head.store(front + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Only a snapshot when called from the other side
+    bool Empty() const {
+        return head.load(std::memory_order_acquire) == tail.load(std::memory_order_acquire);
+    }
+    size_t Capacity() const { return mask + 1; }
+
+private:
+    SpscQueue(const SpscQueue&);
+    SpscQueue& operator=(const SpscQueue&);
+
+    // Read by both sides, written by neither after construction
+    std::vector<T> slots;
+    size_t mask;
+
+    // Consumer's line
+    alignas(CACHE_LINE_SIZE) std::atomic<size_t> head;  // Next slot to pop
+    size_t cachedTail;                                  // Last tail the consumer saw
+
+    // Producer's line
+    alignas(CACHE_LINE_SIZE) std::atomic<size_t> tail;  // Next slot to push
+    size_t cachedHead;                                  // Last head the producer saw
+};
@@ -0,0 +1,77 @@
+#include "StateRules.h"
+
+namespace {
+
+const uint64_t FNV_OFFSET = 0xCBF29CE484222325ull;
+const uint64_t FNV_PRIME = 0x100000001B3ull;
+
+// What a traced value was, so two different choices never hash alike
+enum TracedChoice {
+    TRACED_STATE,
+    TRACED_DIRECTION,
+    TRACED_DURATION
+};
+
+}  // namespace
+
+StateRules::StateRules(CharacterRandom& random) : random(random), trace(FNV_OFFSET) {}
+
+void StateRules::ResetTrace() {
+    trace = FNV_OFFSET;
+}
+
+StateChoice StateRules::NextState(const CharacterTable& character, int fromState, const StateOptions& options) {
+    StateChoice choice;
+    choice.kind = CHOICE_WALK;
+    choice.state = STATE_MOVE;
+
+    if (character.HasTransitions()) {
+        int next = character.PickNextState(fromState, random[RANDOM_STATE]);
+        if (next >= 0) {
+            choice.state = next;
+            if (character.BaseState(next) != STATE_MOVE) {
+                choice.kind = CHOICE_STATE;
+            }
+            Note(TRACED_STATE, (static_cast<uint64_t>(choice.kind) << 32) | static_cast<uint32_t>(choice.state));
+            return choice;
+        }
+    }
+
+    // Furniture has a stream of its own, so placing it doesn't move the
+    // state rolls; the stroll roll only happens when a stroll could follow
+    if (options.furniture && RandomRange(random[RANDOM_FURNITURE], 0, FURNITURE_CHANCE - 1) == 0) {
+        choice.kind = CHOICE_FURNITURE;
+    } else if (options.strolls && RandomRange(random[RANDOM_STATE], 0, STROLL_CHANCE - 1) == 0) {
+        choice.kind = CHOICE_STROLL;
+    }
+    Note(TRACED_STATE, (static_cast<uint64_t>(choice.kind) << 32) | static_cast<uint32_t>(choice.state));
+    return choice;
+}
+
+bool StateRules::WalkRight() {
+    bool right = RandomRange(random[RANDOM_MOVEMENT], 0, 1) == 1;
+    Note(TRACED_DIRECTION, right ? 1 : 0);
+    return right;
+}
+
+uint32_t StateRules::DurationMs(const CharacterTable& character, int state) {
+    if (character.BaseState(state) == STATE_MOVE && !character.HasTransitions()) {
+        return 0;
+    }
+    return StayMs();
+}
+
+uint32_t StateRules::StayMs() {
+    uint32_t duration = static_cast<uint32_t>(RandomRange(random[RANDOM_STATE], MIN_STATE_DURATION, MAX_STATE_DURATION));
+    Note(TRACED_DURATION, duration);
+    return duration;
+}
+
+void StateRules::Note(uint32_t what, uint64_t value) {
+    trace ^= what;
+    trace *= FNV_PRIME;
+    for (int i = 0; i < 8; i++) {
+        trace ^= (value >> (8 * i)) & 0xFF;
+        trace *= FNV_PRIME;
+    }
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <cstdint>
+
+#include "CharacterManifest.h"
+#include "CharacterState.h"
+#include "RandomStreams.h"
+
+// How long a state lasts before the character moves on (ms)
+const int MIN_STATE_DURATION = 5000;
+const int MAX_STATE_DURATION = 20000;
+
+const int FURNITURE_CHANCE = 3;  // One in this many walks heads for furniture instead
+const int STROLL_CHANCE = 4;     // One in this many walks is a stroll instead
+
+// What the character does once its current state has run out
+enum StateChoiceKind {
+    CHOICE_WALK,       // Walk on (a manifest state based on move counts too)
+    CHOICE_FURNITURE,  // Place a piece of furniture and walk over to it
+    CHOICE_STROLL,     // Stroll to the end of the surface and back
+    CHOICE_STATE       // Stand in place in a manifest state that isn't walking
+};
+
+struct StateChoice {
+    StateChoiceKind kind;
+    int state;  // CharacterTable id to enter
+};
+
+// What the host can do besides walking right now
+struct StateOptions {
+    bool furniture;
+    bool strolls;
+
+    StateOptions() : furniture(false), strolls(false) {}
+};
+
+// When and where the character goes next, and every random choice that
+// takes. The viewer and CharacterSimulation both decide through these, so
+// a session recorded in one makes the same choices when it replays in the
+// other: each choice draws from its own stream with RandomRange, in a
+// fixed order, and is folded into Trace(), which a saved session carries
+// so a replay can tell when it has gone its own way.
+class StateRules {
+public:
+    explicit StateRules(CharacterRandom& random);
+
+    // Start a new trace, as when the streams are reseeded
+    void ResetTrace();
+
+    // The state after fromState. A manifest with transitions decides for
+    // itself; otherwise the character walks on, now and then heading for
+    // furniture or a stroll if options allow. A stroll the host then finds
+    // no room for is a walk.
+    StateChoice NextState(const CharacterTable& character, int fromState, const StateOptions& options);
+
+    // Direction of a walk that starts now
+    bool WalkRight();
+
+    // How long state lasts, or 0 for a walk that goes on until something
+    // else happens (a character without manifest transitions)
+    uint32_t DurationMs(const CharacterTable& character, int state);
+
+    // How long to stay on a piece of furniture
+    uint32_t StayMs();
+
+    uint64_t Trace() const { return trace; }
+
+private:
+    void Note(uint32_t what, uint64_t value);
+
+    StateRules(const StateRules&);
+    StateRules& operator=(const StateRules&);
+
+    CharacterRandom& random;
+    uint64_t trace;  // FNV-1a over every choice
+};
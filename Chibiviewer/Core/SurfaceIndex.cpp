@@ -0,0 +1,155 @@
+#include "SurfaceIndex.h"
+
+#include <algorithm>
+#include <cstdlib>
+
+SurfaceIndex::SurfaceIndex(int cellWidth) : cellWidth(cellWidth > 0 ? cellWidth : 256), firstColumn(0) {}
+
+int SurfaceIndex::ColumnOf(int x) const {
+    // Floor division so negative coordinates (monitors left of the primary) work
+    int column = x / cellWidth;
+    if (x % cellWidth != 0 && x < 0) column--;
+    return column;
+}
+
+void SurfaceIndex::Set(SurfaceKey key, int left, int right, int y) {
+    if (right <= left) {
+        Remove(key);
+        return;
+    }
+
+    std::unordered_map<SurfaceKey, uint32_t>::iterator it = keys.find(key);
+    uint32_t slot;
+    if (it != keys.end()) {
+        slot = it->second;
+        Surface& old = slots[slot].surface;
+        if (old.left == left && old.right == right && old.y == y) {
+            return;
+        }
+
+        // Only the y changed: the column lists stay valid
+        if (old.left == left && old.right == right) {
+            old.y = y;
+            return;
+        }
+        RemoveFromColumns(slot);
+    } else {
+        if (!freeSlots.empty()) {
+            slot = freeSlots.back();
+            freeSlots.pop_back();
+        } else {
+            slot = static_cast<uint32_t>(slots.size());
+            slots.push_back(Slot());
+        }
+        keys[key] = slot;
+    }
+
+    slots[slot].key = key;
+    slots[slot].surface.left = left;
+    slots[slot].surface.right = right;
+    slots[slot].surface.y = y;
+    InsertIntoColumns(slot);
+}
+
+bool SurfaceIndex::Remove(SurfaceKey key) {
+    std::unordered_map<SurfaceKey, uint32_t>::iterator it = keys.find(key);
+    if (it == keys.end()) {
+        return false;
+    }
+
+    RemoveFromColumns(it->second);
+    freeSlots.push_back(it->second);
+    keys.erase(it);
+    return true;
+}
+
+void SurfaceIndex::Clear() {
+    columns.clear();
+    slots.clear();
+    freeSlots.clear();
+    keys.clear();
+    firstColumn = 0;
+}
+
+void SurfaceIndex::InsertIntoColumns(uint32_t slot) {
+    const Surface& surface = slots[slot].surface;
+    int first = ColumnOf(surface.left);
+    int last = ColumnOf(surface.right - 1);
+
+    // Grow the column table to cover the new span
+    if (columns.empty()) {
+        firstColumn = first;
+    }
+    if (first < firstColumn) {
+        columns.insert(columns.begin(), firstColumn - first, std::vector<uint32_t>());
+        firstColumn = first;
+    }
+    int needed = last - firstColumn + 1;
+    if (needed > static_cast<int>(columns.size())) {
+        columns.resize(needed);
+    }
+
+    for (int column = first; column <= last; column++) {
+        columns[column - firstColumn].push_back(slot);
+    }
+}
+
+void SurfaceIndex::RemoveFromColumns(uint32_t slot) {
+    const Surface& surface = slots[slot].surface;
+    int first = ColumnOf(surface.left);
+    int last = ColumnOf(surface.right - 1);
+
+    for (int column = first; column <= last; column++) {
+        std::vector<uint32_t>& bucket = columns[column - firstColumn];
+        for (size_t i = 0; i < bucket.size(); i++) {
+            if (bucket[i] == slot) {
+                bucket[i] = bucket.back();
+                bucket.pop_back();
+                break;
+            }
+        }
+    }
+}
+
+const std::vector<uint32_t>* SurfaceIndex::ColumnAt(int x) const {
+    int column = ColumnOf(x) - firstColumn;
+    if (column < 0 || column >= static_cast<int>(columns.size())) {
+        return nullptr;
+    }
+    return &columns[column];
+}
+
+bool SurfaceIndex::FindSupport(int x, int footY, int tolerance, Surface* out) const {
+    const std::vector<uint32_t>* bucket = ColumnAt(x);
+    if (!bucket) return false;
+
+    int bestDistance = tolerance + 1;
+    for (size_t i = 0; i < bucket->size(); i++) {
+        const Surface& surface = slots[(*bucket)[i]].surface;
+        if (x < surface.left || x >= surface.right) continue;
+
+        int distance = std::abs(surface.y - footY);
+        if (distance < bestDistance) {
+            bestDistance = distance;
+            *out = surface;
+        }
+    }
+    return bestDistance <= tolerance;
+}
+
+bool SurfaceIndex::FindBelow(int x, int footY, Surface* out) const {
+    const std::vector<uint32_t>* bucket = ColumnAt(x);
+    if (!bucket) return false;
+
+    bool found = false;
+    for (size_t i = 0; i < bucket->size(); i++) {
+        const Surface& surface = slots[(*bucket)[i]].surface;
+        if (x < surface.left || x >= surface.right || surface.y < footY) continue;
+
+        if (!found || surface.y < out->y) {
+            *out = surface;
+            found = true;
+        }
+    }
+    return found;
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+// A horizontal edge the character can walk on: the top of a window (title
+// bars, the taskbar) or the bottom of a monitor's work area. Spans are
+// half-open, [left, right).
+struct Surface {
+    int left;
+    int right;
+    int y;
+};
+
+typedef uint64_t SurfaceKey;
+
+// Incremental spatial index of walkable surfaces. Space is cut into
+// fixed-width columns and each surface is listed in every column it
+// crosses, so a query only looks at the handful of surfaces over one x.
+// Updates are keyed (by HWND, monitor, ...) so window events can move or
+// drop a single surface without rebuilding anything.
+class SurfaceIndex {
+public:
+    explicit SurfaceIndex(int cellWidth = 256);
+
+    // Insert a surface, or move it if the key is already known
+    void Set(SurfaceKey key, int left, int right, int y);
+    bool Remove(SurfaceKey key);
+    void Clear();
+    size_t Size() const { return keys.size(); }
+
+    // Surface under x whose y is within tolerance of footY, closest first
+    bool FindSupport(int x, int footY, int tolerance, Surface* out) const;
+
+    // Nearest surface under x at or below footY
+    bool FindBelow(int x, int footY, Surface* out) const;
+
+private:
+    struct Slot {
+        Surface surface;
+        SurfaceKey key;
+    };
+
+    int ColumnOf(int x) const;
+    void InsertIntoColumns(uint32_t slot);
+    void RemoveFromColumns(uint32_t slot);
+    const std::vector<uint32_t>* ColumnAt(int x) const;
+
+    int cellWidth;
+    int firstColumn;                            // Column number of columns[0]
+    std::vector<std::vector<uint32_t>> columns; // Slot ids per column
+    std::vector<Slot> slots;
+    std::vector<uint32_t> freeSlots;
+    std::unordered_map<SurfaceKey, uint32_t> keys;
+};
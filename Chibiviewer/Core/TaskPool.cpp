@@ -0,0 +1,159 @@
+#include "TaskPool.h"
+
+namespace {
+
+// Which pool (if any) the current thread works for, and its slot in it
+thread_local const TaskPool* t_pool = nullptr;
+thread_local unsigned t_worker = 0;
+
+}  // namespace
+
+TaskPool::TaskPool(unsigned workerCount) : queued(0), nextWorker(0), steals(0), stopping(false) {
+    if (workerCount == 0) {
+        unsigned cores = std::thread::hardware_concurrency();
+        workerCount = cores > 1 ? cores - 1 : 1;
+    }
+
+    // All deques exist before any worker starts looking at them
+    for (unsigned i = 0; i < workerCount; i++) {
+        workers.emplace_back(new Worker());
+    }
+    for (unsigned i = 0; i < workerCount; i++) {
+        workers[i]->thread = std::thread(&TaskPool::WorkerMain, this, i);
+    }
+}
+
+TaskPool::~TaskPool() {
+    {
+        std::lock_guard<std::mutex> lock(sleepLock);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (size_t i = 0; i < workers.size(); i++) {
+        workers[i]->thread.join();
+    }
+}
+
+void TaskPool::Submit(TaskGroup* group, TaskPriority priority, std::function<void()> task) {
+    group->pending.fetch_add(1, std::memory_order_relaxed);
+
+    unsigned target = t_pool == this ? t_worker
+                                     : nextWorker.fetch_add(1, std::memory_order_relaxed) % WorkerCount();
+    {
+        Worker& worker = *workers[target];
+        std::lock_guard<std::mutex> lock(worker.lock);
+        Task entry = { std::move(task), group };
+        worker.tasks[priority].push_back(std::move(entry));
+    }
+    queued.fetch_add(1, std::memory_order_release);
+
+    // Taking the lock orders this against a worker checking `queued` on its
+    // way to sleep, so the wakeup can't fall in between
+    {
+        std::lock_guard<std::mutex> lock(sleepLock);
+    }
+    wake.notify_one();
+}
+
+void TaskPool::Wait(TaskGroup* group) {
+    bool worker = t_pool == this;
+    unsigned self = worker ? t_worker : WorkerCount();
+    const TaskGroup* only = worker ? nullptr : group;
+    while (!group->Done()) {
+        if (RunOne(self, only)) {
+            continue;
+        }
+
+        // Everything we may run is already running somewhere
+        std::unique_lock<std::mutex> lock(group->lock);
+        group->finished.wait(lock, [group]() { return group->Done(); });
+    }
+
+    // The last task signals while holding the lock; let it finish before
+    // the caller is free to destroy the group
+    std::lock_guard<std::mutex> lock(group->lock);
+}
+
+TaskPool& TaskPool::Shared() {
+    static TaskPool pool;
+    return pool;
+}
+
+void TaskPool::WorkerMain(unsigned index) {
+    t_pool = this;
+    t_worker = index;
+
+    for (;;) {
+        if (RunOne(index, nullptr)) {
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(sleepLock);
+        if (stopping && queued.load(std::memory_order_acquire) == 0) {
+            return;
+        }
+        wake.wait(lock, [this]() {
+            return stopping || queued.load(std::memory_order_acquire) != 0;
+        });
+    }
+}
+
+bool TaskPool::RunOne(unsigned self, const TaskGroup* only) {
+    Task task;
+    if (!TakeTask(self, only, &task)) {
+        return false;
+    }
+    if (!task.group->IsCancelled()) {
+        task.run();
+    }
+
+    TaskGroup* group = task.group;
+    std::lock_guard<std::mutex> lock(group->lock);
+    if (group->pending.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        group->finished.notify_all();
+    }
+    return true;
+}
+
+bool TaskPool::TakeTask(unsigned self, const TaskGroup* only, Task* task) {
+    if (queued.load(std::memory_order_acquire) == 0) {
+        return false;
+    }
+
+    unsigned count = WorkerCount();
+    for (int priority = 0; priority < TASK_PRIORITY_COUNT; priority++) {
+        // Newest first from our own deque
+        if (self < count) {
+            Worker& own = *workers[self];
+            std::lock_guard<std::mutex> lock(own.lock);
+            std::deque<Task>& tasks = own.tasks[priority];
+            if (!tasks.empty() && (!only || tasks.back().group == only)) {
+                *task = std::move(tasks.back());
+                tasks.pop_back();
+                queued.fetch_sub(1, std::memory_order_relaxed);
+                return true;
+            }
+        }
+
+        // Oldest first from everyone else's, starting after ourselves so
+        // thieves spread out
+        for (unsigned offset = 1; offset <= count; offset++) {
+            unsigned victim = (self + offset) % count;
+            if (victim == self) continue;
+            Worker& other = *workers[victim];
+            std::lock_guard<std::mutex> lock(other.lock);
+            std::deque<Task>& tasks = other.tasks[priority];
+            std::deque<Task>::iterator found = tasks.begin();
+            while (only && found != tasks.end() && found->group != only) {
+                ++found;
+            }
+            if (found != tasks.end()) {
+                *task = std::move(*found);
+                tasks.erase(found);
+                queued.fetch_sub(1, std::memory_order_relaxed);
+                steals.fetch_add(1, std::memory_order_relaxed);
+                return true;
+            }
+        }
+    }
+    return false;
+}
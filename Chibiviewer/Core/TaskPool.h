@@ -0,0 +1,106 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Which tasks a worker picks up first. Every high priority task anywhere in
+// the pool runs before any normal one.
+enum TaskPriority {
+    TASK_HIGH,    // Needed on screen next, like the GIF the first state plays
+    TASK_NORMAL,
+    TASK_PRIORITY_COUNT
+};
+
+// Tasks submitted together, to be waited on and cancelled as one. Tasks
+// that haven't started when the group is cancelled are skipped; long tasks
+// can check IsCancelled() to stop early. Must outlive its tasks; TaskPool::
+// Wait() returning is what says it no longer has any.
+class TaskGroup {
+public:
+    TaskGroup() : pending(0), cancelled(false) {}
+
+    void Cancel() { cancelled.store(true, std::memory_order_release); }
+    bool IsCancelled() const { return cancelled.load(std::memory_order_acquire); }
+
+    // No tasks left to run or skip
+    bool Done() const { return pending.load(std::memory_order_acquire) == 0; }
+
+private:
+    TaskGroup(const TaskGroup&);
+    TaskGroup& operator=(const TaskGroup&);
+
+    friend class TaskPool;
+    std::atomic<size_t> pending;
+    std::atomic<bool> cancelled;
+    std::mutex lock;                    // Held while the last task signals
+    std::condition_variable finished;   // Wait() sleeps here
+};
+
+// Small work-stealing thread pool for load-time jobs (decoding, scaling,
+// resampling). Each worker has its own deque per priority: it pushes and
+// pops its own work at the back, so related tasks stay on a warm cache,
+// and when it runs dry it steals from the front of the others'. Each deque
+// has its own lock, which only sees contention while stealing.
+class TaskPool {
+public:
+    // 0 workers means one per core, less one for the thread that waits
+    explicit TaskPool(unsigned workers = 0);
+    ~TaskPool();  // Runs whatever is still queued, then joins the workers
+
+    // Queue a task. From a worker it goes on that worker's own deque,
+    // from anywhere else on the workers' in turn.
+    void Submit(TaskGroup* group, TaskPriority priority, std::function<void()> task);
+
+    // Block until the group is done, helping out in the meantime. A worker
+    // runs any group's tasks, so waiting from inside a task can't starve
+    // the pool; any other thread only runs this group's, so the render
+    // thread never ends up decoding someone else's import. Once nothing it
+    // may run is queued the caller sleeps rather than spins.
+    void Wait(TaskGroup* group);
+
+    unsigned WorkerCount() const { return static_cast<unsigned>(workers.size()); }
+    uint64_t Steals() const { return steals.load(std::memory_order_relaxed); }
+
+    // The pool everything shares, created on first use
+    static TaskPool& Shared();
+
+private:
+    TaskPool(const TaskPool&);
+    TaskPool& operator=(const TaskPool&);
+
+    struct Task {
+        std::function<void()> run;
+        TaskGroup* group;
+    };
+
+    struct Worker {
+        std::mutex lock;
+        std::deque<Task> tasks[TASK_PRIORITY_COUNT];
+        std::thread thread;
+    };
+
+    void WorkerMain(unsigned index);
+
+    // Pop or steal the most urgent task and run it. self is the caller's
+    // worker index, or WorkerCount() for a thread outside the pool; a
+    // non-null only limits it to that group's tasks.
+    bool RunOne(unsigned self, const TaskGroup* only);
+    bool TakeTask(unsigned self, const TaskGroup* only, Task* task);
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::atomic<size_t> queued;       // Tasks sitting in any deque
+    std::atomic<unsigned> nextWorker; // Round robin for outside submissions
+    std::atomic<uint64_t> steals;
+
+    std::mutex sleepLock;
+    std::condition_variable wake;
+    bool stopping;
+};
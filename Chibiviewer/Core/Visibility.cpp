@@ -0,0 +1,65 @@
+#include "Visibility.h"
+
+VisibilityMonitor::VisibilityMonitor()
+    : reasons(0), lastChangeMs(-1.0), visibleMs(0.0), hiddenMs(0.0),
+      wakeups(), windowEvents(), suspensions(0) {
+}
+
+VisibilityChange VisibilityMonitor::SetReason(HiddenReason reason, bool active, double nowMs) {
+    bool wasHidden = IsHidden();
+    if (lastChangeMs >= 0.0) {
+        (wasHidden ? hiddenMs : visibleMs) += nowMs - lastChangeMs;
+    }
+    lastChangeMs = nowMs;
+
+    if (active) {
+        reasons |= reason;
+    } else {
+        reasons &= ~static_cast<unsigned>(reason);
+    }
+
+    if (!wasHidden && IsHidden()) {
+        suspensions++;
+        return VISIBILITY_HIDDEN;
+    }
+    if (wasHidden && !IsHidden()) {
+        return VISIBILITY_SHOWN;
+    }
+    return VISIBILITY_UNCHANGED;
+}
+
+void VisibilityMonitor::RecordWakeup(WakeupSource source) {
+    wakeups[IsHidden()][source]++;
+}
+
+void VisibilityMonitor::RecordWindowEvent() {
+    windowEvents[IsHidden()]++;
+}
+
+double VisibilityMonitor::SpanMs(bool hidden, double nowMs) const {
+    double spanMs = hidden ? hiddenMs : visibleMs;
+    if (lastChangeMs >= 0.0 && IsHidden() == hidden) {
+        spanMs += nowMs - lastChangeMs;
+    }
+    return spanMs;
+}
+
+double VisibilityMonitor::WakeupsPerMinute(bool hidden, double nowMs) const {
+    double total = 0.0;
+    for (int source = 0; source < WAKE_SOURCE_COUNT; source++) {
+        total += WakeupsPerMinute(hidden, static_cast<WakeupSource>(source), nowMs);
+    }
+    return total;
+}
+
+double VisibilityMonitor::WakeupsPerMinute(bool hidden, WakeupSource source, double nowMs) const {
+    double spanMs = SpanMs(hidden, nowMs);
+    if (spanMs <= 0.0) return 0.0;
+    return wakeups[hidden][source] * 60000.0 / spanMs;
+}
+
+double VisibilityMonitor::WindowEventsPerMinute(bool hidden, double nowMs) const {
+    double spanMs = SpanMs(hidden, nowMs);
+    if (spanMs <= 0.0) return 0.0;
+    return windowEvents[hidden] * 60000.0 / spanMs;
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cstdint>
+
+// Why the character can't be seen right now. Several can hold at once.
+enum HiddenReason {
+    HIDDEN_FULLSCREEN = 1 << 0,   // A fullscreen app is in front on our monitor
+    HIDDEN_LOCKED = 1 << 1,       // The session is locked
+    HIDDEN_DISPLAY_OFF = 1 << 2,  // The console display is off
+    HIDDEN_OCCLUDED = 1 << 3      // Other windows cover the whole scene
+};
+
+enum VisibilityChange {
+    VISIBILITY_UNCHANGED,
+    VISIBILITY_HIDDEN,   // Went from seen to unseen
+    VISIBILITY_SHOWN     // Went from unseen to seen
+};
+
+// What got the render thread out of its wait
+enum WakeupSource {
+    WAKE_TIMER,     // The frame timer (animation, walking, scheduled checks)
+    WAKE_COMMAND,   // Input or a loaded folder handed over by another thread
+    WAKE_MESSAGE,   // Window event hooks and other posted messages
+    WAKE_SOURCE_COUNT
+};
+
+// Combines the hidden reasons into one seen/unseen state and keeps wakeup
+// counts for both, by source, so suspension can be checked in numbers.
+// Window event callbacks are counted apart: one wakeup can deliver many.
+class VisibilityMonitor {
+public:
+    VisibilityMonitor();
+
+    // Begin time accounting (visible until told otherwise)
+    void Start(double nowMs) { lastChangeMs = nowMs; }
+
+    // Turn one reason on or off. Only reports a change when the character
+    // as a whole becomes hidden or visible.
+    VisibilityChange SetReason(HiddenReason reason, bool active, double nowMs);
+
+    bool IsHidden() const { return reasons != 0; }
+    bool Has(HiddenReason reason) const { return (reasons & reason) != 0; }
+    unsigned Reasons() const { return reasons; }
+    uint64_t Suspensions() const { return suspensions; }
+
+    // Count a wakeup against the current state
+    void RecordWakeup(WakeupSource source);
+
+    // Count one window event hook callback against the current state
+    void RecordWindowEvent();
+
+    // Average rates while hidden or while visible, up to nowMs
+    double WakeupsPerMinute(bool hidden, double nowMs) const;
+    double WakeupsPerMinute(bool hidden, WakeupSource source, double nowMs) const;
+    double WindowEventsPerMinute(bool hidden, double nowMs) const;
+
+private:
+    unsigned reasons;
+    double lastChangeMs;
+    double visibleMs;
+    double hiddenMs;
+    double SpanMs(bool hidden, double nowMs) const;
+
+    uint64_t wakeups[2][WAKE_SOURCE_COUNT];   // [hidden][source]
+    uint64_t windowEvents[2];
+    uint64_t suspensions;
+};